@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -14,6 +15,15 @@
 #include "lwip/netdb.h"
 #include "lwip/sockets.h"
 
+#include "esp_http_server.h"
+#include "metrics.h"
+#include "trace.h"
+#include "static_alloc.h"
+#include "tlog.h"
+#include "gas_channels.h"
+#include "gas_link.h"
+#include "esp_timer.h"
+
 #define PORT 3333
 #define SERVER_IP "192.168.4.1" // IP address of ESP32 #1 (server)
 #define WIFI_SSID "ESP32-Access-Point"
@@ -24,6 +34,37 @@ static const char *TAG = "TCP_SOCKET_CLIENT";
 static EventGroupHandle_t wifi_event_group;
 #define WIFI_CONNECTED_BIT BIT0
 
+#define METRICS_PORT 80
+
+// Retransmit requests still unanswered after this are sent again
+#define LINK_RETX_TIMEOUT_MS 2000
+#define LINK_RECV_TIMEOUT_MS 1000
+
+// Per-stage counters for the metrics endpoint
+static METRIC_DEFINE_COUNTER(frames_received, "gw_frames_received_total", NULL, "Frames received from the sensor node");
+static METRIC_DEFINE_COUNTER(bytes_received, "gw_bytes_received_total", NULL, "Bytes received from the sensor node");
+static METRIC_DEFINE_COUNTER(parse_failures, "gw_parse_failures_total", NULL, "Frames parse_and_log_data could not parse");
+static METRIC_DEFINE_COUNTER(tcp_connects, "gw_tcp_connects_total", NULL, "Successful connections to the sensor node");
+static METRIC_DEFINE_COUNTER(uart_bytes, "gw_uart_bytes_total", NULL, "Bytes written to the UART");
+static METRIC_DEFINE_GAUGE(free_heap, "gw_free_heap_bytes", NULL, "Current free heap");
+static METRIC_DEFINE_GAUGE(min_free_heap, "gw_min_free_heap_bytes", NULL, "Lowest free heap since boot");
+static METRIC_DEFINE_COUNTER(link_lost, "gw_link_frames_lost_total", NULL, "Frames the node could not re-send");
+static METRIC_DEFINE_COUNTER(link_recovered, "gw_link_frames_recovered_total", NULL, "Missed frames received on retransmission");
+static METRIC_DEFINE_COUNTER(link_duplicates, "gw_link_duplicates_total", NULL, "Frames received more than once");
+static METRIC_DEFINE_COUNTER(link_restarts, "gw_link_node_restarts_total", NULL, "Sequence restarts after a node reboot");
+static METRIC_DEFINE_GAUGE(link_missing, "gw_link_frames_missing", NULL, "Frames in open gaps, asked for and not yet received");
+#if CONFIG_GAS_GW_UDP_SUBSCRIBE
+static METRIC_DEFINE_COUNTER(udp_snapshots, "gw_udp_snapshots_total", NULL, "SNAP: datagrams received from the node");
+#endif
+// Only the task that receives frames in this build is started, so only its stack is reported
+#if CONFIG_GAS_GW_UDP_SUBSCRIBE
+static METRIC_DEFINE_GAUGE(stack_udp_subscriber, "gw_stack_free_bytes", "task=\"udp_subscriber\"", "Stack high-water mark per task");
+static TaskHandle_t udp_subscriber_handle;
+#else
+static METRIC_DEFINE_GAUGE(stack_tcp_client, "gw_stack_free_bytes", "task=\"tcp_client\"", "Stack high-water mark per task");
+static TaskHandle_t tcp_client_handle;
+#endif
+
 //////////////////////////////////////// UART DRIVER ////////////////////////////////////////
 #include "driver/gpio.h" //Controls GPIO pins 
 #include "driver/uart.h"
@@ -33,6 +74,9 @@ static EventGroupHandle_t wifi_event_group;
 #define UART_TX_PIN        GPIO_NUM_17  // TX pin
 #define UART_RX_PIN        GPIO_NUM_16  // RX pin
 
+#define UART_RX_MIN_BUFFER 256   // must be larger than the 128 byte hardware FIFO
+#define UART_TX_BUFFER     1024
+
 void uart_init(void) {
     const uart_config_t uart_config = {
         .baud_rate = UART_BAUD_RATE,
@@ -49,25 +93,44 @@ void uart_init(void) {
 
     //uart_set_pin(UART_NUM_1, GPIO_NUM_17, GPIO_NUM_16, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
     //uart_driver_install(UART_NUM_1, 1024, 0, 0, NULL, 0);
-    // Setup UART buffered IO with an event queue
-    // Install UART driver
+    // Install UART driver. Nothing reads UART events, so there is no event
+    // queue: one left undrained only fills up and drops events.
+#if CONFIG_GAS_STATIC_ALLOCATION
+    // Nothing reads RX data either, keep only the minimum RX ring the driver accepts
+    ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, UART_RX_MIN_BUFFER, UART_TX_BUFFER, 0, NULL, 0));
+#else
     const int uart_buffer_size = (1024 * 2);
-    QueueHandle_t uart_queue;
-    ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, uart_buffer_size, uart_buffer_size, 10, &uart_queue, 0));
+    ESP_ERROR_CHECK(uart_driver_install(UART_PORT_NUM, uart_buffer_size, uart_buffer_size, 0, NULL, 0));
+#endif
 }
 
 void send_data_over_uart(const char *data) {
-    uart_write_bytes(UART_PORT_NUM, data, strlen(data));
+    int written = uart_write_bytes(UART_PORT_NUM, data, strlen(data));
+    if (written > 0) {
+        metric_add(&uart_bytes, written);
+    }
+}
+
+// A received line and its newline, written to the UART from where it was
+// received: the newline goes in place of the NUL that ends the line, which
+// has to be writable, and the NUL is put back. The UART driver's TX ring is
+// the only copy.
+static void send_line_over_uart(char *line) {
+    size_t len = strlen(line);
+    line[len] = '\n';
+    int written = uart_write_bytes(UART_PORT_NUM, line, len + 1);
+    line[len] = '\0';
+    if (written > 0) {
+        metric_add(&uart_bytes, written);
+    }
 }
 //////////////////////////////////////// UART DRIVER ////////////////////////////////////////
 
-// Global variables for sensor data
-float temperature;
-float humidity;
-float ammonia;
-float h2s;
-float co2;
-float methane;
+// Latest sample received from the node
+static gas_sample_t readings;
+
+// Sequence of the node's frames, kept across reconnections
+static gas_link_tracker_t node_link;
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
@@ -83,7 +146,7 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t e
 }
 
 void wifi_init_sta(void) {
-    wifi_event_group = xEventGroupCreate();
+    GAS_EVENT_GROUP_CREATE(wifi_event_group);
     esp_netif_init();
     esp_event_loop_create_default();
     esp_netif_create_default_wifi_sta();
@@ -107,37 +170,97 @@ void wifi_init_sta(void) {
     esp_wifi_start();
 }
 
-// Parsing and logging data for database
-void parse_and_log_data(const char *data) {
-    float parsed_temperature, parsed_humidity, parsed_ammonia, parsed_h2s, parsed_co2, parsed_methane;
+// Parsing and logging data for database. Returns false for frames not to
+// forward: unparsable ones and duplicates.
+bool parse_and_log_data(const char *data) {
+    gas_sample_t parsed;
 
     // Parse the data
-    int result = sscanf(data, "Temp:%f,Humidity:%f,NH3:%f,H2S:%f,CO2:%f,CH4:%f",
-                        &parsed_temperature, &parsed_humidity, &parsed_ammonia, &parsed_h2s, &parsed_co2, &parsed_methane);
-
-    if (result == 6) { // Ensure all values are parsed successfully
+    int result = gas_frame_parse(data, &parsed);
+
+    if (result == GAS_CH_COUNT) { // Ensure all values are parsed successfully
+
+        // Frames from a node without sequence numbers count as new
+        gas_link_verdict_t verdict = GAS_LINK_NEW;
+        uint16_t boot;
+        uint32_t seq;
+        int64_t capture_ms;
+        if (gas_link_parse_suffix(data, &boot, &seq, &capture_ms)) {
+            uint32_t missing = gas_link_missing(&node_link);
+            verdict = gas_link_track(&node_link, boot, seq);
+            if (gas_link_missing(&node_link) > missing) {
+                ESP_LOGW(TAG, "Frames missing before %u", (unsigned)seq);
+            }
+        }
+        if (verdict == GAS_LINK_DUPLICATE) {
+            return false;
+        }
 
-        // Update global variables with parsed values
-        temperature = parsed_temperature;
-        humidity = parsed_humidity;
-        ammonia = parsed_ammonia;
-        h2s = parsed_h2s;
-        co2 = parsed_co2;
-        methane = parsed_methane;
+        // A recovered frame is older than the latest readings
+        if (verdict == GAS_LINK_NEW) {
+            readings = parsed;
+        }
 
         // Log parsed data
-        ESP_LOGI(TAG, "Parsed Data - Temp: %.2f, Humidity: %.2f, NH3: %.2f, H2S: %.2f, CO2: %.2f, CH4: %.2f",
-                 temperature, humidity, ammonia, h2s, co2, methane);
+        TLOG(TLOG_GW_PARSED, parsed.temperature, parsed.humidity, parsed.ammonia,
+             parsed.h2s, parsed.co2, parsed.methane);
+
+        // Channels the node flagged since its previous frame
+        const char *anomaly = strstr(data, ",A:");
+        if (anomaly != NULL) {
+            unsigned long channels = strtoul(anomaly + 3, NULL, 16);
+            for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+                if (channels & (1ul << ch)) {
+                    ESP_LOGW(TAG, "Anomaly on %s, now %.2f", gas_channel_names[ch], parsed.values[ch]);
+                }
+            }
+        }
 
         // TODO: Add code here to forward data to the SQLite database on your computer
+        return true;
     } else {
+        metric_inc(&parse_failures);
         ESP_LOGE(TAG, "Failed to parse data: %s", data);
+        return false;
+    }
+}
+
+// One line from the node: a frame, a clock sync request or a GONE answer.
+// `line` is NUL-terminated in the receive buffer and forwarded from there.
+static void handle_line(int sock, char *line) {
+    uint32_t first, last;
+#if CONFIG_GAS_TRACE_ENABLE
+    int64_t recv_us = trace_now_us();
+    if (trace_sync_reply(sock, line)) {
+        return; // clock sync exchange from the node, not a sample
     }
+#endif
+    if (gas_link_parse_range(line, "GONE", &first, &last)) {
+        ESP_LOGW(TAG, "Frames %u to %u are lost, the node no longer holds them", (unsigned)first, (unsigned)last);
+        gas_link_gone(&node_link, first, last);
+        return;
+    }
+    metric_inc(&frames_received);
+    TLOG(TLOG_GW_FRAME_RECEIVED, (int)strlen(line));
+
+    //Parse and log the data 
+    if (!parse_and_log_data(line)) {
+        return;
+    }
+
+    // Forward the data via UART, one frame per line
+#if CONFIG_GAS_TRACE_ENABLE
+    char uart_line[GAS_LINK_LINE_MAX + 48];
+    trace_format_gateway(line, recv_us, trace_now_us(), uart_line, sizeof(uart_line));
+    send_data_over_uart(uart_line);
+#else
+    send_line_over_uart(line);
+#endif
 }
 
 // TCP Client Task
 void tcp_client(void *pvParameters) {
-    char rx_buffer[128];
+    static gas_link_lines_t rx_lines;
     int addr_family = AF_INET;
     int ip_protocol = IPPROTO_IP;
 
@@ -146,6 +269,8 @@ void tcp_client(void *pvParameters) {
     dest_addr.sin_family = AF_INET;
     dest_addr.sin_port = htons(PORT);
 
+    gas_link_tracker_init(&node_link);
+
     while (1) {
         // Create socket
         int sock = socket(addr_family, SOCK_STREAM, ip_protocol);
@@ -165,31 +290,47 @@ void tcp_client(void *pvParameters) {
             continue;
         }
         ESP_LOGI(TAG, "Successfully connected");
+        metric_inc(&tcp_connects);
 
         // Send a request message to indicate data transfer
-        char *request = "GET_SENSOR_DATA";
+        char *request = "GET_SENSOR_DATA\n";
         send(sock, request, strlen(request), 0);
 
+        // Wake up now and then to repeat unanswered retransmit requests
+        struct timeval timeout = {
+            .tv_sec = LINK_RECV_TIMEOUT_MS / 1000,
+            .tv_usec = (LINK_RECV_TIMEOUT_MS % 1000) * 1000,
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        rx_lines.start = rx_lines.len = 0;
+
         while (1) {
             // Receive data from server
-            int len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
-            if (len < 0) {
+            size_t avail;
+            char *space = gas_link_lines_space(&rx_lines, &avail);
+            int len = recv(sock, space, avail, 0);
+            if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
                 ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
                 break;
             } else if (len == 0) {
                 ESP_LOGI(TAG, "Connection closed by server");
                 break;
-            } else {
-                rx_buffer[len] = '\0'; // Null-terminate the received data
-                ESP_LOGI(TAG, "Received data: %s", rx_buffer);
-
-                //Parse and log the data 
-                parse_and_log_data(rx_buffer);
+            } else if (len > 0) {
+                metric_add(&bytes_received, len);
+                gas_link_lines_commit(&rx_lines, len);
+                for (char *line; (line = gas_link_lines_next(&rx_lines)) != NULL;) {
+                    handle_line(sock, line);
+                }
+            }
 
-                // Forward the data via UART
-                send_data_over_uart(rx_buffer);
+            // Ask for the frames missed so far
+            char requests[GAS_LINK_MAX_GAPS * 32];
+            int requests_len = gas_link_requests(&node_link, (uint32_t)(esp_timer_get_time() / 1000),
+                                                 LINK_RETX_TIMEOUT_MS, requests, sizeof(requests));
+            if (requests_len > 0 && send(sock, requests, requests_len, 0) < 0) {
+                ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+                break;
             }
-            vTaskDelay(5000 / portTICK_PERIOD_MS); // Adjust delay as needed
         }
 
         // Clean up
@@ -203,14 +344,151 @@ void tcp_client(void *pvParameters) {
     }
 }
 
+#if CONFIG_GAS_GW_UDP_SUBSCRIBE
+// A datagram from the node: a frame, or a snapshot of its readings. Nothing
+// is resent over UDP, so a gap counts as lost as soon as it opens; a
+// datagram overtaken by the next one is dropped as a duplicate.
+static void handle_datagram(char *datagram) {
+    size_t len = strlen(datagram);
+    if (len > 0 && datagram[len - 1] == '\n') {
+        datagram[len - 1] = '\0';
+    }
+    if (strncmp(datagram, GAS_LINK_SNAPSHOT, strlen(GAS_LINK_SNAPSHOT)) == 0) {
+        // Only the first readings of a gateway that joined between frames,
+        // the frames that follow are numbered and tracked
+        metric_inc(&udp_snapshots);
+        char *frame = datagram + strlen(GAS_LINK_SNAPSHOT);
+        if (!node_link.synced && gas_frame_parse(frame, &readings) == GAS_CH_COUNT) {
+            send_line_over_uart(frame);
+        }
+        return;
+    }
+    handle_line(-1, datagram);
+    if (gas_link_missing(&node_link) > 0) {
+        gas_link_gone(&node_link, 1, UINT32_MAX);
+    }
+}
+
+// UDP Subscriber Task
+void udp_subscriber(void *pvParameters) {
+    static char datagram[GAS_LINK_LINE_MAX + 1];
+    struct sockaddr_in listen_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_GAS_GW_UDP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    struct ip_mreq group = { .imr_interface.s_addr = htonl(INADDR_ANY) };
+    if (inet_pton(AF_INET, CONFIG_GAS_GW_UDP_ADDR, &group.imr_multiaddr) != 1) {
+        ESP_LOGE(TAG, "Bad UDP address %s", CONFIG_GAS_GW_UDP_ADDR);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    gas_link_tracker_init(&node_link);
+
+    while (1) {
+        int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+        if (sock < 0) {
+            ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+        if (bind(sock, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) != 0) {
+            ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+            close(sock);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+        if (IN_MULTICAST(ntohl(group.imr_multiaddr.s_addr)) &&
+            setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &group, sizeof(group)) != 0) {
+            ESP_LOGE(TAG, "Unable to join %s: errno %d", CONFIG_GAS_GW_UDP_ADDR, errno);
+            close(sock);
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+            continue;
+        }
+        ESP_LOGI(TAG, "Listening for frames on %s:%d", CONFIG_GAS_GW_UDP_ADDR, CONFIG_GAS_GW_UDP_PORT);
+
+        while (1) {
+            int len = recv(sock, datagram, sizeof(datagram) - 1, 0);
+            if (len < 0) {
+                ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+                break;
+            }
+            metric_add(&bytes_received, len);
+            datagram[len] = '\0';
+            handle_datagram(datagram);
+        }
+
+        close(sock);
+        vTaskDelay(1000 / portTICK_PERIOD_MS);
+    }
+}
+#endif
+
+// Refresh gauges right before /metrics is rendered
+static void collect_gateway_metrics(void) {
+    metric_set(&free_heap, esp_get_free_heap_size());
+    metric_set(&min_free_heap, esp_get_minimum_free_heap_size());
+#if CONFIG_GAS_GW_UDP_SUBSCRIBE
+    if (udp_subscriber_handle) metric_set(&stack_udp_subscriber, uxTaskGetStackHighWaterMark(udp_subscriber_handle));
+#else
+    if (tcp_client_handle) metric_set(&stack_tcp_client, uxTaskGetStackHighWaterMark(tcp_client_handle));
+#endif
+    metric_set(&link_lost, node_link.lost);
+    metric_set(&link_recovered, node_link.recovered);
+    metric_set(&link_duplicates, node_link.duplicates);
+    metric_set(&link_restarts, node_link.restarts);
+    metric_set(&link_missing, gas_link_missing(&node_link));
+}
+
+static void register_gateway_metrics(void) {
+    metrics_register(&frames_received);
+    metrics_register(&bytes_received);
+    metrics_register(&parse_failures);
+    metrics_register(&tcp_connects);
+    metrics_register(&uart_bytes);
+    metrics_register(&free_heap);
+    metrics_register(&min_free_heap);
+#if CONFIG_GAS_GW_UDP_SUBSCRIBE
+    metrics_register(&stack_udp_subscriber);
+#else
+    metrics_register(&stack_tcp_client);
+#endif
+    metrics_register(&link_lost);
+    metrics_register(&link_recovered);
+    metrics_register(&link_duplicates);
+    metrics_register(&link_restarts);
+    metrics_register(&link_missing);
+#if CONFIG_GAS_GW_UDP_SUBSCRIBE
+    metrics_register(&udp_snapshots);
+#endif
+    metrics_register_collector(collect_gateway_metrics);
+}
+
+// Small HTTP server that only answers GET /metrics
+static void start_metrics_server(void) {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = METRICS_PORT;
+    config.max_open_sockets = 2;
+    config.lru_purge_enable = true;
+    httpd_handle_t server = NULL;
+
+    if (httpd_start(&server, &config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start metrics server");
+        return;
+    }
+    httpd_uri_t metrics_uri = {
+        .uri       = "/metrics",
+        .method    = HTTP_GET,
+        .handler   = metrics_http_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &metrics_uri);
+}
+
 void app_main(void) {
-    // Initialize global variables
-    temperature = 0.0;
-    humidity = 0.0;
-    ammonia = 0.0;
-    h2s = 0.0;
-    co2 = 0.0;
-    methane = 0.0;
+    register_gateway_metrics();
+    tlog_init();
 
     // Initialize NVS
     esp_err_t ret = nvs_flash_init();
@@ -225,14 +503,22 @@ void app_main(void) {
     //Testing UART
     uart_init();
     char uart_data[256];
-    snprintf(uart_data, sizeof(uart_data),
-            "Temp: %.2f, Humidity: %.2f, NH3: %.2f, H2S: %.2f, CO2: %.2f, CH4: %.2f\n",
-            temperature, humidity, ammonia, h2s, co2, methane);
+    gas_uart_format(&readings, uart_data, sizeof(uart_data));
     send_data_over_uart(uart_data);
 
     // Wait for Wi-Fi to connect
     xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
 
+    start_metrics_server();
+
+#if CONFIG_GAS_GW_UDP_SUBSCRIBE
+    // Frames from the node's UDP publications
+    GAS_TASK_CREATE(udp_subscriber, "udp_subscriber", 4096, NULL, 5, &udp_subscriber_handle);
+#else
     // Start TCP client task
-    xTaskCreate(tcp_client, "tcp_client", 4096, NULL, 5, NULL);
+    GAS_TASK_CREATE(tcp_client, "tcp_client", 4096, NULL, 5, &tcp_client_handle);
+#endif
+
+    static_alloc_report();
+    static_alloc_heap_guard_start();
 }
\ No newline at end of file
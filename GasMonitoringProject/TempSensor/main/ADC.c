@@ -2,13 +2,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "esp_spiffs.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "tlog.h"
+#include "adc_frontend.h"
+#include "gas_calib.h"
+#if CONFIG_GAS_ADC_SOURCE_DMA
+#include "esp_adc/adc_continuous.h"
+#else
+#include "driver/spi_master.h"
+#include "spi_adc.h"
+#endif
 
 // For reading from SPIFFS
 static const char *TAG = "ADC";
 
-static sensor_data_t current_data; // Use the struct defined in ADC.h
 FILE *sensor_data_file = NULL;
 
 void adc_init() {
@@ -35,7 +47,7 @@ void adc_init() {
         ESP_LOGI(TAG, "Partition size: total: %d, used: %d", total, used);
     }
 
-    // Initialize SPI, chip select pin, and open CSV file
+    // Open the CSV file the simulated inputs replay
     sensor_data_file = fopen("/storage/sensor_data.csv", "r");
     if (sensor_data_file == NULL) {
         printf("Failed to open CSV file.\n");
@@ -44,62 +56,376 @@ void adc_init() {
         char header[256];
         fgets(header, sizeof(header), sensor_data_file);
     }
-    printf("ADC set up complete. Reading test data from CSV file.\n");
+    printf("ADC set up complete. Sampling starts with adc_task.\n");
 }
 
-// float adc_read_sensor(sensor_channel_t channel) {
-//     // Simulate selecting different sensor channels based on the channel enum
-//     switch (channel) {
-//         case AIN1_AMMONIA:
-//             return current_data.ammonia;
-//         case AIN2_H2S:
-//             return current_data.h2s;
-//         case AIN3_CO2:
-//             return current_data.co2;
-//         case AIN4_METHANE:
-//             return current_data.methane;
-//         default:
-//             return -1; // Invalid channel
-//     }
-// }
+#define ADC_CHANNELS     4
+#define ADC_CODE_BITS    12
+#define ADC_BURST_FRAMES 64     // most frames one adc_source_read() hands back
+#define ADC_VREF         3.3f
+
+#define ADC_FULL_SCALE   ((1 << ADC_CODE_BITS) << ADC_FE_FRAC_BITS)
+
+// The MQ sensors go through their Rs/R0 curves (gas_calib), the CO2
+// channel has a linear transfer: channel value at the top code
+static const gas_calib_sensor_t adc_calib[ADC_CHANNELS] = {
+    [AIN1_AMMONIA] = GAS_CALIB_NH3,
+    [AIN2_H2S] = GAS_CALIB_H2S,
+    [AIN3_CO2] = GAS_CALIB_NONE,
+    [AIN4_METHANE] = GAS_CALIB_CH4,
+};
+
+static const float adc_full_scale[ADC_CHANNELS] = {
+    [AIN3_CO2] = 6000.0f,       // ppm
+};
+
+// Front end outputs since the last read of each input, and the value the
+// last read returned. adc_task adds, adc_read_sensor() takes the mean, so
+// each reading is decimated all the way down to its job's period.
+static portMUX_TYPE adc_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t adc_sums[ADC_CHANNELS];
+static uint32_t adc_counts[ADC_CHANNELS];
+static int32_t adc_last[ADC_CHANNELS];
+static uint32_t adc_valid;
+
+float adc_read_sensor(sensor_channel_t channel) {
+    if (channel > AIN4_METHANE) {
+        return -1; // Invalid channel
+    }
+    portENTER_CRITICAL(&adc_lock);
+    if (adc_counts[channel] > 0) {
+        adc_last[channel] = (int32_t)(adc_sums[channel] / adc_counts[channel]);
+        adc_sums[channel] = 0;
+        adc_counts[channel] = 0;
+        adc_valid |= 1u << channel;
+    }
+    int32_t value = adc_last[channel];
+    bool valid = adc_valid & (1u << channel);
+    portEXIT_CRITICAL(&adc_lock);
+
+    if (!valid) {
+        return -1; // No output from the front end yet
+    }
+    if (adc_calib[channel] != GAS_CALIB_NONE) {
+        return gas_calib_ppm_from_code(adc_calib[channel], value, ADC_FULL_SCALE) /
+               (float)(1 << GAS_CALIB_PPM_FRAC_BITS);
+    }
+    return adc_fe_to_code(value) / (1 << ADC_CODE_BITS) * adc_full_scale[channel];
+}
+
+// Clean-air calibration of an MQ channel from the value its last read
+// returned, see gas_calib_zero()
+esp_err_t adc_calibrate_clean_air(sensor_channel_t channel, uint32_t *r0_ohms) {
+    if (channel > AIN4_METHANE || adc_calib[channel] == GAS_CALIB_NONE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    portENTER_CRITICAL(&adc_lock);
+    int32_t value = adc_last[channel];
+    bool valid = adc_valid & (1u << channel);
+    portEXIT_CRITICAL(&adc_lock);
+
+    if (!valid) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    uint32_t r0;
+    esp_err_t ret = gas_calib_zero(adc_calib[channel], value, ADC_FULL_SCALE, &r0);
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Channel %d calibrated in clean air, R0 %u ohms", channel, (unsigned)r0);
+        if (r0_ohms != NULL) {
+            *r0_ohms = r0;
+        }
+    }
+    return ret;
+}
+
+static void adc_publish(const int32_t *out, int count) {
+    portENTER_CRITICAL(&adc_lock);
+    for (int i = 0; i < count; i++) {
+        for (int ch = 0; ch < ADC_CHANNELS; ch++) {
+            adc_sums[ch] += out[i * ADC_CHANNELS + ch];
+        }
+    }
+    for (int ch = 0; ch < ADC_CHANNELS; ch++) {
+        adc_counts[ch] += count;
+    }
+    portEXIT_CRITICAL(&adc_lock);
+}
+
+#if CONFIG_GAS_ADC_SOURCE_DMA
+
+#define ADC_DMA_RESULT_BYTES SOC_ADC_DIGI_RESULT_BYTES
+#define ADC_DMA_FRAME_BYTES  (ADC_BURST_FRAMES * ADC_CHANNELS * ADC_DMA_RESULT_BYTES)
+
+static const char *adc_source_name = "ADC1 DMA";
+static adc_continuous_handle_t adc_dma;
+
+// ADC1 channel of each input: GPIO36, GPIO39, GPIO34, GPIO35
+static const adc_channel_t adc_dma_channels[ADC_CHANNELS] = {
+    [AIN1_AMMONIA] = ADC_CHANNEL_0,
+    [AIN2_H2S] = ADC_CHANNEL_3,
+    [AIN3_CO2] = ADC_CHANNEL_6,
+    [AIN4_METHANE] = ADC_CHANNEL_7,
+};
+
+// Conversions of the frame being reassembled, and which inputs it has
+static uint16_t adc_dma_frame[ADC_CHANNELS];
+static uint32_t adc_dma_have;
+
+static esp_err_t adc_source_start(void) {
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = 4 * ADC_DMA_FRAME_BYTES,
+        .conv_frame_size = ADC_DMA_FRAME_BYTES,
+    };
+    esp_err_t ret = adc_continuous_new_handle(&handle_config, &adc_dma);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    adc_digi_pattern_config_t pattern[ADC_CHANNELS];
+    for (int i = 0; i < ADC_CHANNELS; i++) {
+        pattern[i].atten = ADC_ATTEN_DB_12;
+        pattern[i].channel = adc_dma_channels[i];
+        pattern[i].unit = ADC_UNIT_1;
+        pattern[i].bit_width = ADC_CODE_BITS;
+    }
+    adc_continuous_config_t config = {
+        .pattern_num = ADC_CHANNELS,
+        .adc_pattern = pattern,
+        .sample_freq_hz = CONFIG_GAS_ADC_SAMPLE_RATE_HZ * ADC_CHANNELS,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    ret = adc_continuous_config(adc_dma, &config);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return adc_continuous_start(adc_dma);
+}
+
+static int adc_dma_input(int channel) {
+    for (int i = 0; i < ADC_CHANNELS; i++) {
+        if (adc_dma_channels[i] == channel) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Blocks until the DMA pool has conversions, then regroups them into
+// frames. Asking for at most ADC_BURST_FRAMES * ADC_CHANNELS results
+// completes at most ADC_BURST_FRAMES frames, whatever partial frame was
+// left from the previous call.
+static int adc_source_read(const uint16_t **block) {
+    static uint8_t buffer[ADC_DMA_FRAME_BYTES];
+    static uint16_t frames[ADC_BURST_FRAMES * ADC_CHANNELS];
+    uint32_t length = 0;
+    *block = frames;
+    if (adc_continuous_read(adc_dma, buffer, sizeof(buffer), &length, 100) != ESP_OK) {
+        return 0;
+    }
+    int count = 0;
+    for (uint32_t i = 0; i + ADC_DMA_RESULT_BYTES <= length; i += ADC_DMA_RESULT_BYTES) {
+        const adc_digi_output_data_t *result = (const adc_digi_output_data_t *)&buffer[i];
+        int input = adc_dma_input(result->type1.channel);
+        if (input < 0) {
+            continue;
+        }
+        // A repeated input means a conversion was lost; start the frame over
+        if (adc_dma_have & (1u << input)) {
+            adc_dma_have = 0;
+        }
+        adc_dma_frame[input] = result->type1.data;
+        adc_dma_have |= 1u << input;
+        if (adc_dma_have == (1u << ADC_CHANNELS) - 1) {
+            memcpy(&frames[count * ADC_CHANNELS], adc_dma_frame, sizeof(adc_dma_frame));
+            adc_dma_have = 0;
+            count++;
+        }
+    }
+    return count;
+}
+
+#else
+
+// Frames per scan: as many as the driver queues in one go
+#define ADC_SCAN_FRAMES (SPI_ADC_MAX_TRANSACTIONS / ADC_CHANNELS)
+
+// Two blocks: the bus fills one while the front end decimates the other
+static uint16_t adc_scan_blocks[2][ADC_SCAN_FRAMES * ADC_CHANNELS];
+static int adc_scan_block;
+static int adc_scan_pending;    // frames in the scan in flight, 0 if none
+static int64_t adc_scan_start_us;
+static uint64_t adc_scan_frames;
+
+#if CONFIG_GAS_ADC_SOURCE_SIM
+
+#define ADC_SIM_NOISE_LSB 1.0f  // enough dither for the decimation to gain resolution
+
+static const char *adc_source_name = "simulated SPI ADC";
+static adc_sim_t adc_sim;
+static gas_sample_t adc_row;
+static int64_t adc_sim_row_us;
+
+static const gas_channel_t adc_channels[ADC_CHANNELS] = {
+    [AIN1_AMMONIA] = GAS_CH_AMMONIA,
+    [AIN2_H2S] = GAS_CH_H2S,
+    [AIN3_CO2] = GAS_CH_CO2,
+    [AIN4_METHANE] = GAS_CH_METHANE,
+};
+
+// Next CSV row becomes the voltage on each simulated input
+static void adc_sim_load_row(void) {
+    if (sensor_data_file == NULL) {
+        return;
+    }
+    read_sensor_data_csv(&adc_row);
+    for (int i = 0; i < ADC_CHANNELS; i++) {
+        float value = adc_row.values[adc_channels[i]];
+        float share = adc_calib[i] != GAS_CALIB_NONE ? gas_calib_share_for_ppm(adc_calib[i], value)
+                                                     : value / adc_full_scale[i];
+        adc_sim_set_input(&adc_sim, i, (share < 0 ? 0 : share > 1 ? 1 : share) * ADC_VREF);
+    }
+}
+
+#else
+
+static const char *adc_source_name = "SPI ADC";
+
+#endif
+
+static esp_err_t adc_source_start(void) {
+    spi_adc_config_t config = {
+        .host = SPI3_HOST,
+        .clock_hz = CONFIG_GAS_ADC_SPI_CLOCK_HZ,
+        .pin_cs = SPI_CS,
+        .pin_sclk = SPI_CLK,
+        .pin_miso = SPI_MISO,
+        .pin_mosi = SPI_MOSI,
+        .channels = ADC_CHANNELS,
+    };
+#if CONFIG_GAS_ADC_SOURCE_SIM
+    adc_sim_init(&adc_sim, ADC_VREF, ADC_SIM_NOISE_LSB, 1);
+    adc_sim_load_row();
+    adc_sim_row_us = esp_timer_get_time() + CONFIG_GAS_ADC_SIM_ROW_MS * 1000LL;
+    config.sim = &adc_sim;
+#endif
+    adc_scan_start_us = esp_timer_get_time();
+    return spi_adc_init(&config);
+}
+
+// Waits for the scan in flight, queues the frames due since then into the
+// other block and hands back the finished one, so the bus keeps sampling
+// while the front end works. Sleeps a tick when nothing is due.
+static int adc_source_read(const uint16_t **block) {
+    int finished = 0;
+    if (adc_scan_pending > 0) {
+        esp_err_t ret = spi_adc_scan_wait(100);
+        if (ret != ESP_OK) {
+            ESP_LOGW(TAG, "SPI ADC scan: %s", esp_err_to_name(ret));
+            return 0;
+        }
+        finished = adc_scan_pending;
+        *block = adc_scan_blocks[adc_scan_block];
+        adc_scan_pending = 0;
+    }
+
+    int64_t now = esp_timer_get_time();
+#if CONFIG_GAS_ADC_SOURCE_SIM
+    if (now >= adc_sim_row_us) {
+        adc_sim_load_row();
+        adc_sim_row_us += CONFIG_GAS_ADC_SIM_ROW_MS * 1000LL;
+    }
+#endif
+    uint64_t due = (uint64_t)(now - adc_scan_start_us) * CONFIG_GAS_ADC_SAMPLE_RATE_HZ / 1000000 - adc_scan_frames;
+    // After a stall, drop the backlog beyond one second rather than race it
+    if (due > CONFIG_GAS_ADC_SAMPLE_RATE_HZ) {
+        adc_scan_frames += due - CONFIG_GAS_ADC_SAMPLE_RATE_HZ;
+        due = CONFIG_GAS_ADC_SAMPLE_RATE_HZ;
+    }
+    if (due > 0) {
+        int count = due < ADC_SCAN_FRAMES ? (int)due : ADC_SCAN_FRAMES;
+        adc_scan_block ^= 1;
+        if (spi_adc_scan_start(adc_scan_blocks[adc_scan_block], count) == ESP_OK) {
+            adc_scan_pending = count;
+        }
+        adc_scan_frames += count;
+    } else if (finished == 0) {
+        vTaskDelay(1);
+    }
+    return finished;
+}
+
+#endif
+
+// Samples AIN1..AIN4 continuously and decimates them; adc_read_sensor()
+// serves the results
+void adc_task(void *pvParameters) {
+    static adc_fe_t frontend;
+    static int32_t outputs[(ADC_BURST_FRAMES + 1) * ADC_CHANNELS];
+
+    adc_fe_config_t config = {
+        .filter = CONFIG_GAS_ADC_FE_ORDER,
+        .channels = ADC_CHANNELS,
+        .ratio = 1 << CONFIG_GAS_ADC_FE_RATIO_LOG2,
+        .code_bits = ADC_CODE_BITS,
+    };
+    if (!adc_fe_init(&frontend, &config)) {
+        ESP_LOGE(TAG, "Unsupported front end: %s, ratio %d", adc_fe_filter_name(config.filter), config.ratio);
+        vTaskDelete(NULL);
+        return;
+    }
+    esp_err_t ret = adc_source_start();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start %s (%s)", adc_source_name, esp_err_to_name(ret));
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "%s at %d Hz, %s decimating by %d to %d Hz", adc_source_name, CONFIG_GAS_ADC_SAMPLE_RATE_HZ,
+             adc_fe_filter_name(config.filter), config.ratio, CONFIG_GAS_ADC_SAMPLE_RATE_HZ / config.ratio);
+
+    while (1) {
+        const uint16_t *frames = NULL;
+        int count = adc_source_read(&frames);
+        if (count == 0) {
+            continue;
+        }
+        int produced = adc_fe_push(&frontend, frames, count, outputs);
+        if (produced > 0) {
+            adc_publish(outputs, produced);
+        }
+    }
+}
 
 // Function to check chip select and print only the required sensor data
-void chip_select(float mq_ammonia, float mq_methane, float mq_h2s, float mq_co2) {
-    if (mq_ammonia == 1.0) {
-        printf("Ammonia (NH3) Level: %.2f ppm\n", current_data.ammonia);
+void chip_select(const gas_sample_t *sample, const gas_csv_flags_t *select) {
+    if (select->flags[GAS_CH_AMMONIA] == 1.0) {
+        TLOG(TLOG_ADC_AMMONIA, sample->ammonia);
     }
-    if (mq_methane == 1.0) {
-        printf("Methane (CH4) Level: %.2f ppm\n", current_data.methane);
+    if (select->flags[GAS_CH_METHANE] == 1.0) {
+        TLOG(TLOG_ADC_METHANE, sample->methane);
     }
-    if (mq_h2s == 1.0) {
-        printf("Hydrogen Sulfide (H2S) Level: %.2f ppm\n", current_data.h2s);
+    if (select->flags[GAS_CH_H2S] == 1.0) {
+        TLOG(TLOG_ADC_H2S, sample->h2s);
     }
-    if (mq_co2 == 1.0) {
-        printf("Carbon Dioxide (CO2) Level: %.2f ppm\n", current_data.co2);
+    if (select->flags[GAS_CH_CO2] == 1.0) {
+        TLOG(TLOG_ADC_CO2, sample->co2);
     }
 }
 
-void read_sensor_data_csv() {
+void read_sensor_data_csv(gas_sample_t *sample) {
     char line[256];
     if (fgets(line, sizeof(line), sensor_data_file) != NULL) {
-        float mq_ammonia, mq_methane, mq_h2s, mq_co2;
-        
-        // Read sensor data values from the CSV and store them in current_data structure
-        sscanf(line, "%*[^,],%f,%f,%f,%f,%f,%f,%f,%f", 
-               &current_data.ammonia, &current_data.methane, &current_data.co2, &current_data.h2s,
-               &mq_ammonia, &mq_methane, &mq_h2s, &mq_co2);
+        gas_csv_flags_t select;
 
-        printf("New sensor data read from CSV:\n");
+        // Column order comes from the channel registry in gas_channels.h
+        gas_csv_parse(line, sample, &select);
+
+        TLOG(TLOG_ADC_CSV_ROW);
         
         // Use the chip select function to display relevant data based on sensor flags
-        chip_select(mq_ammonia, mq_methane, mq_h2s, mq_co2);
+        chip_select(sample, &select);
     } else {
-        printf("End of CSV file reached.\n");
+        TLOG(TLOG_ADC_CSV_END);
         rewind(sensor_data_file);  // Restart reading from the beginning if at the end
     }
 }
-
-// Adding this function to fetch current data 
-sensor_data_t get_current_data() {
-    return current_data;
-}
\ No newline at end of file
@@ -4,12 +4,15 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "esp_err.h"
+#include "gas_channels.h"
 
-// SPI pin configurations (modify as necessary)
+// SPI pin configurations (modify as necessary). These are the SPI3 (VSPI)
+// IO_MUX pins; GPIO21 is the Si7021's I2C SDA, so MOSI cannot share it.
 #define SPI_CS   5  // Chip Select (CS)
 #define SPI_CLK  18 // Clock
 #define SPI_MISO 19 // Master In Slave Out
-#define SPI_MOSI 21 // Master Out Slave In
+#define SPI_MOSI 23 // Master Out Slave In
 
 // Define sensor channels (e.g., AIN1, AIN2, AIN3, AIN4)
 typedef enum {
@@ -19,18 +22,11 @@ typedef enum {
     AIN4_METHANE
 } sensor_channel_t;
 
-//Define sensor data structure
-typedef struct {
-    float ammonia;
-    float h2s;
-    float co2;
-    float methane;
-} sensor_data_t;
-
 // Function prototypes
 void adc_init();
+void adc_task(void *pvParameters);
 float adc_read_sensor(sensor_channel_t channel);
-void read_sensor_data_csv();
-sensor_data_t get_current_data();
+esp_err_t adc_calibrate_clean_air(sensor_channel_t channel, uint32_t *r0_ohms);
+void read_sensor_data_csv(gas_sample_t *sample);
 
 #endif
\ No newline at end of file
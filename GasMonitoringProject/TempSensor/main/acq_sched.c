@@ -0,0 +1,119 @@
+#include "acq_sched.h"
+
+// Millisecond timestamps wrap after 49 days, compare them by difference
+static bool due_before(const acq_job_t *a, const acq_job_t *b) {
+    return (int32_t)(a->due_ms - b->due_ms) < 0;
+}
+
+static void heap_push(acq_sched_t *sched, acq_job_t *job) {
+    int i = sched->count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!due_before(job, sched->heap[parent])) {
+            break;
+        }
+        sched->heap[i] = sched->heap[parent];
+        i = parent;
+    }
+    sched->heap[i] = job;
+}
+
+static acq_job_t *heap_pop(acq_sched_t *sched) {
+    acq_job_t *top = sched->heap[0];
+    acq_job_t *last = sched->heap[--sched->count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= sched->count) {
+            break;
+        }
+        if (child + 1 < sched->count && due_before(sched->heap[child + 1], sched->heap[child])) {
+            child++;
+        }
+        if (!due_before(sched->heap[child], last)) {
+            break;
+        }
+        sched->heap[i] = sched->heap[child];
+        i = child;
+    }
+    sched->heap[i] = last;
+    return top;
+}
+
+void acq_init(acq_sched_t *sched) {
+    sched->count = 0;
+}
+
+bool acq_add(acq_sched_t *sched, acq_job_t *job, uint32_t now_ms) {
+    if (sched->count == ACQ_MAX_JOBS || job->period_ms == 0) {
+        return false;
+    }
+    job->slot_ms = now_ms + job->phase_ms;
+    job->due_ms = job->slot_ms;
+    job->converting = false;
+    heap_push(sched, job);
+    return true;
+}
+
+// ms until the earliest job is due, 0 if one is already due, -1 if there are none
+int32_t acq_time_until_due(const acq_sched_t *sched, uint32_t now_ms) {
+    if (sched->count == 0) {
+        return -1;
+    }
+    int32_t wait = (int32_t)(sched->heap[0]->due_ms - now_ms);
+    return wait > 0 ? wait : 0;
+}
+
+// Next period boundary after now, keeping the job's phase. A boundary the
+// late job lands on exactly is skipped too, it would run twice in a row.
+static void next_slot(acq_job_t *job, uint32_t now_ms) {
+    job->slot_ms += job->period_ms;
+    int32_t behind = (int32_t)(now_ms - job->slot_ms);
+    if (behind >= 0) {
+        uint32_t skipped = (uint32_t)behind / job->period_ms + 1;
+        job->slot_ms += skipped * job->period_ms;
+        job->overruns += skipped;
+    }
+    job->due_ms = job->slot_ms;
+}
+
+// Runs one step of the earliest due job: either the start of its conversion
+// or the collection of its result. Returns the job when it collected new
+// data, NULL otherwise.
+acq_job_t *acq_run(acq_sched_t *sched, uint32_t now_ms, gas_sample_t *sample) {
+    if (acq_time_until_due(sched, now_ms) != 0) {
+        return NULL;
+    }
+    acq_job_t *job = heap_pop(sched);
+
+    if (!job->converting && job->start != NULL) {
+        int32_t conversion_ms = job->start(job->ctx);
+        if (conversion_ms < 0) {
+            job->start_errors++;
+            next_slot(job, now_ms);
+            heap_push(sched, job);
+            return NULL;
+        }
+        if (conversion_ms & ACQ_STEP_FLAG) {
+            job->due_ms = now_ms + (uint32_t)(conversion_ms & ~ACQ_STEP_FLAG);
+            heap_push(sched, job);
+            return NULL;
+        }
+        if (conversion_ms > 0) {
+            job->converting = true;
+            job->due_ms = now_ms + (uint32_t)conversion_ms;
+            heap_push(sched, job);
+            return NULL;
+        }
+    }
+
+    job->converting = false;
+    bool fresh = job->collect(job->ctx, sample);
+    job->runs++;
+    if (job->adaptive != NULL) {
+        job->period_ms = adaptive_update(job->adaptive, now_ms, sample);
+    }
+    next_slot(job, now_ms);
+    heap_push(sched, job);
+    return fresh ? job : NULL;
+}
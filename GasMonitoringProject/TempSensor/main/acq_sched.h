@@ -0,0 +1,61 @@
+#ifndef ACQ_SCHED_H
+#define ACQ_SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gas_channels.h"
+#include "adaptive_sampling.h"
+
+// Deadline-ordered acquisition for every sensor from one task. Each job has
+// its own period and phase and sits in a min-heap keyed on the time it is
+// next due. A job with a start() kicks off its conversion, goes back into the
+// heap for the conversion time and is collected when it comes due again, so
+// other jobs run on the bus meanwhile instead of waiting behind it.
+// Plain C without FreeRTOS, the task loop lives in hello_world_main.c.
+
+#define ACQ_MAX_JOBS 8
+
+// Kicks off a conversion. Returns the ms until the result can be collected
+// (0 = collect straight away) or a negative value if the start failed.
+// Sensors that need more than one bus exchange before the result return
+// ACQ_STEP(ms) to have start() called again after ms instead.
+typedef int32_t (*acq_start_t)(void *ctx);
+
+#define ACQ_STEP_FLAG   0x40000000
+#define ACQ_STEP(ms)    (ACQ_STEP_FLAG | (int32_t)(ms))
+
+// Reads the result into the job's channels of sample. Returns true when
+// there is new data to publish.
+typedef bool (*acq_collect_t)(void *ctx, gas_sample_t *sample);
+
+typedef struct {
+    const char *name;
+    uint32_t channel_mask;      // ADAPTIVE_CHANNEL() bits of the channels it writes
+    uint32_t period_ms;
+    uint32_t phase_ms;          // offset of the first run, spreads jobs apart
+    acq_start_t start;          // NULL for jobs that only collect
+    acq_collect_t collect;
+    void *ctx;
+    adaptive_sched_t *adaptive; // picks period_ms after each run, NULL = fixed
+
+    // Scheduler state
+    uint32_t slot_ms;           // period boundary of the current run
+    uint32_t due_ms;
+    bool converting;
+    uint32_t runs;
+    uint32_t start_errors;
+    uint32_t overruns;          // period boundaries skipped because the job ran late
+} acq_job_t;
+
+typedef struct {
+    acq_job_t *heap[ACQ_MAX_JOBS];
+    int count;
+} acq_sched_t;
+
+// Function prototypes
+void acq_init(acq_sched_t *sched);
+bool acq_add(acq_sched_t *sched, acq_job_t *job, uint32_t now_ms);
+int32_t acq_time_until_due(const acq_sched_t *sched, uint32_t now_ms);
+acq_job_t *acq_run(acq_sched_t *sched, uint32_t now_ms, gas_sample_t *sample);
+
+#endif
@@ -0,0 +1,113 @@
+#include "adaptive_sampling.h"
+#include <math.h>
+
+// Time constants of the fast and slow means, in seconds. Defined in time
+// rather than in samples so the noise in the slope estimate does not grow
+// when the period shrinks. The slope is the gap between the two means over
+// the gap between the constants, which is exact for a steady ramp.
+#define ADAPTIVE_TAU_S       10.0f
+#define ADAPTIVE_TREND_TAU_S 60.0f
+
+// Channels left out (all zero) never speed sampling up
+static const adaptive_threshold_t thresholds[GAS_CH_COUNT] = {
+    [GAS_CH_TEMPERATURE] = { .fast_rate = 0.02f, .slow_rate = 0.002f, .fast_std = 1.0f },   // F
+    [GAS_CH_HUMIDITY]    = { .fast_rate = 0.05f, .slow_rate = 0.005f, .fast_std = 3.0f },   // %RH
+    [GAS_CH_AMMONIA]     = { .fast_rate = 0.2f,  .slow_rate = 0.02f,  .fast_std = 5.0f },   // ppm
+    [GAS_CH_H2S]         = { .fast_rate = 0.05f, .slow_rate = 0.005f, .fast_std = 2.0f },   // ppm
+    [GAS_CH_CO2]         = { .fast_rate = 5.0f,  .slow_rate = 0.5f,   .fast_std = 150.0f }, // ppm
+    [GAS_CH_METHANE]     = { .fast_rate = 2.0f,  .slow_rate = 0.2f,   .fast_std = 50.0f },  // ppm
+};
+
+void adaptive_init(adaptive_sched_t *sched, const adaptive_config_t *config, uint32_t channel_mask) {
+    *sched = (adaptive_sched_t){
+        .config = *config,
+        .channel_mask = channel_mask,
+        .period_ms = config->start_period_ms,
+        .tokens = (float)config->budget_per_min,
+    };
+}
+
+// Feed one channel, returns 2 for urgent, 1 for changing, 0 for flat
+static int update_signal(adaptive_signal_t *signal, const adaptive_threshold_t *threshold, float value, float dt) {
+    float alpha = 1.0f - expf(-dt / ADAPTIVE_TAU_S);
+    float trend_alpha = 1.0f - expf(-dt / ADAPTIVE_TREND_TAU_S);
+    float deviation = value - signal->mean;
+
+    signal->mean += alpha * deviation;
+    signal->trend += trend_alpha * (value - signal->trend);
+    signal->var = (1.0f - alpha) * (signal->var + alpha * deviation * deviation);
+    signal->slope = (signal->mean - signal->trend) / (ADAPTIVE_TREND_TAU_S - ADAPTIVE_TAU_S);
+
+    if (threshold->fast_rate <= 0) {
+        return 0;
+    }
+    // At long periods alpha is close to 1 and var forgets everything, so a
+    // single value far from the mean counts on its own
+    float limit = threshold->fast_std * threshold->fast_std;
+    float rate = fabsf(signal->slope);
+    if (rate >= threshold->fast_rate || signal->var >= limit || deviation * deviation >= limit) {
+        return 2;
+    }
+    return rate >= threshold->slow_rate ? 1 : 0;
+}
+
+uint32_t adaptive_update(adaptive_sched_t *sched, uint32_t now_ms, const gas_sample_t *sample) {
+    const adaptive_config_t *config = &sched->config;
+    sched->samples++;
+
+    if (!sched->primed) {
+        for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+            sched->signals[ch] = (adaptive_signal_t){ .mean = sample->values[ch], .trend = sample->values[ch] };
+        }
+        sched->primed = true;
+        sched->last_ms = now_ms;
+        if (config->budget_per_min > 0) {
+            sched->tokens -= 1.0f;
+        }
+        return sched->period_ms;
+    }
+
+    uint32_t elapsed_ms = now_ms - sched->last_ms;
+    float dt = (elapsed_ms > 0 ? elapsed_ms : 1) / 1000.0f;
+    sched->last_ms = now_ms;
+
+    int level = 0;
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        if (sched->channel_mask & ADAPTIVE_CHANNEL(ch)) {
+            int channel_level = update_signal(&sched->signals[ch], &thresholds[ch], sample->values[ch], dt);
+            if (channel_level > level) {
+                level = channel_level;
+            }
+        }
+    }
+
+    if (level == 2) {
+        sched->period_ms = config->min_period_ms;
+        sched->flat_count = 0;
+    } else if (level == 1) {
+        sched->period_ms = sched->period_ms / 2 > config->min_period_ms ? sched->period_ms / 2 : config->min_period_ms;
+        sched->flat_count = 0;
+    } else if (++sched->flat_count >= config->flat_samples) {
+        sched->period_ms = sched->period_ms * 2 < config->max_period_ms ? sched->period_ms * 2 : config->max_period_ms;
+        sched->flat_count = 0;
+    }
+
+    if (config->budget_per_min == 0) {
+        return sched->period_ms;
+    }
+
+    // Token bucket: refill at budget_per_min, one token per sample
+    sched->tokens += elapsed_ms * (float)config->budget_per_min / 60000.0f;
+    if (sched->tokens > config->budget_per_min) {
+        sched->tokens = (float)config->budget_per_min;
+    }
+    sched->tokens -= 1.0f;
+    if (sched->tokens < 1.0f) {
+        uint32_t wait_ms = (uint32_t)((1.0f - sched->tokens) * 60000.0f / config->budget_per_min);
+        if (wait_ms > sched->period_ms) {
+            sched->budget_limited++;
+            return wait_ms;
+        }
+    }
+    return sched->period_ms;
+}
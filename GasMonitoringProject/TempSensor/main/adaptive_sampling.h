@@ -0,0 +1,56 @@
+#ifndef ADAPTIVE_SAMPLING_H
+#define ADAPTIVE_SAMPLING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gas_channels.h"
+
+// Per-task sampling period that follows the signal. Every read feeds the new
+// values of the channels the task owns; the returned delay drops straight to
+// the minimum when a channel moves fast or gets noisy, halves while anything
+// still changes, and doubles after a run of flat samples. A token bucket
+// caps the samples per minute whatever the signal does, which bounds CPU and
+// bus time. Plain C without FreeRTOS so tools/adaptive_replay.c can run it.
+
+typedef struct {
+    uint32_t min_period_ms;
+    uint32_t max_period_ms;
+    uint32_t start_period_ms;
+    uint32_t budget_per_min;    // samples per rolling minute, 0 = unlimited
+    uint32_t flat_samples;      // flat samples in a row before backing off
+} adaptive_config_t;
+
+// Per-channel trigger levels, in channel units
+typedef struct {
+    float fast_rate;    // |slope| per second that asks for the minimum period
+    float slow_rate;    // below this the channel counts as flat
+    float fast_std;     // spread or single jump that asks for the minimum period
+} adaptive_threshold_t;
+
+typedef struct {
+    float mean;         // exponentially weighted mean
+    float trend;        // slower mean, the slope is taken against it
+    float var;          // exponentially weighted variance around it
+    float slope;        // rate of change, per second
+} adaptive_signal_t;
+
+typedef struct {
+    adaptive_config_t config;
+    uint32_t channel_mask;      // bit per gas_channel_t driven by this task
+    adaptive_signal_t signals[GAS_CH_COUNT];
+    bool primed;
+    uint32_t last_ms;
+    uint32_t period_ms;
+    uint32_t flat_count;
+    float tokens;
+    uint32_t samples;
+    uint32_t budget_limited;    // periods stretched by the budget
+} adaptive_sched_t;
+
+#define ADAPTIVE_CHANNEL(ch) (1u << (ch))
+
+// Function prototypes
+void adaptive_init(adaptive_sched_t *sched, const adaptive_config_t *config, uint32_t channel_mask);
+uint32_t adaptive_update(adaptive_sched_t *sched, uint32_t now_ms, const gas_sample_t *sample);
+
+#endif
@@ -1,5 +1,9 @@
 #include <stdio.h> //for basic printf commands
+#include <stdarg.h> //for the command answers
+#include <inttypes.h>
 #include <string.h> //for handling strings
+#include <time.h> //for sample timestamps
+#include <sys/time.h> //for capture times in ms
 
 #include "freertos/FreeRTOS.h" //for delay,mutexs,semphrs rtos operations
 #include "freertos/task.h"
@@ -19,7 +23,34 @@
 #include "nvs_flash.h" //non volatile storage
 #include "driver/i2c.h" // I2C communication
 #include "si7021.h" // Custom Si7021 library
+#include "scd41.h" // SCD41 CO2 sensor
 #include "ADC.h" // My ADC simulation
+#include "http_api.h" // HTTP API with JSON snapshot and SSE stream
+#include "history.h" // On-flash sample history
+#include "quantiles.h" // Percentile sketches per window
+#include "node_time.h" // Clock the history and percentiles are keyed by, carries on across reboots
+#include "metrics.h" // Prometheus counters
+#include "trace.h" // End-to-end latency stamps
+#include "static_alloc.h" // Static task/queue creation and RAM budget
+#include "tlog.h" // Deferred tokenized logging for the sample path
+#include "gas_channels.h" // Channel registry, frame encoder
+#include "fastfmt.h" // Fixed-point formatter benchmark
+#include "adaptive_sampling.h" // Signal-driven sampling period
+#include "acq_sched.h" // Deadline-ordered acquisition jobs
+#include "gas_filter.h" // Fixed-point conditioning of the gas channels
+#include "gas_comp.h" // Temperature/humidity compensation of the MQ sensors
+#include "gas_calib.h" // Rs/R0 to ppm curves of the MQ sensors
+#include "gas_anomaly.h" // Streaming anomaly detection per channel
+#include "gas_sketch.h" // Quantile sketch benchmark
+#include "block_kernels.h" // Vector kernels over sample blocks
+#include "gas_link.h" // Frame numbering and retransmission
+#include "gas_fbuf.h" // Encoded frames shared by the senders
+#include "gas_cmd.h" // Commands of the TCP clients
+#include "udp_publish.h" // One datagram per frame for every listener
+#include "mqtt_publish.h" // Batches of frames to an MQTT broker
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_vfs_eventfd.h"
 
 #define PORT 3333
 #define EXAMPLE_ESP_WIFI_SSID "ESP32-Access-Point"
@@ -28,15 +59,317 @@
 #define EXAMPLE_MAX_STA_CONN        4
 #define LED_GPIO GPIO_NUM_2
 
+// Clients tcp_server_task serves at once, one per soft AP station
+#define NODE_MAX_CLIENTS EXAMPLE_MAX_STA_CONN
+
+// The HTTP server's sockets and its 3 internal ones, the listening socket,
+// the clients, one being refused, the UDP publisher and the MQTT session
+// all come out of lwIP's socket table
+#if CONFIG_GAS_UDP_PUBLISH
+#define UDP_PUBLISH_SOCKETS 1
+#else
+#define UDP_PUBLISH_SOCKETS 0
+#endif
+#if CONFIG_GAS_MQTT
+#define MQTT_SOCKETS 1
+#else
+#define MQTT_SOCKETS 0
+#endif
+_Static_assert(HTTP_API_MAX_SOCKETS + 3 + 1 + NODE_MAX_CLIENTS + 1 + UDP_PUBLISH_SOCKETS + MQTT_SOCKETS <=
+               CONFIG_LWIP_MAX_SOCKETS,
+               "CONFIG_LWIP_MAX_SOCKETS too low for the HTTP server and the TCP clients");
+
+// How often tcp_server_task looks for new frames if there is no eventfd
+#define LINK_POLL_MS 200
+
 static const char *TAG = "TCP_SOCKET_SERVER";
 
-// Initialize sensor variables
-float temperature;
-float humidity;
-float ammonia;
-float h2s;
-float co2;
-float methane;
+// Latest sensor readings, written by the acquisition jobs in acq_task
+static gas_sample_t readings;
+
+// Task handles, kept for stack high-water marks
+static TaskHandle_t tcp_server_handle;
+static TaskHandle_t acq_task_handle;
+static TaskHandle_t adc_task_handle;
+
+// Per-stage counters for the metrics endpoint
+static const uint32_t send_us_bounds[] = { 100, 500, 1000, 5000, 20000, 100000 };
+static METRIC_DEFINE_COUNTER(samples_si7021, "node_samples_total", "source=\"si7021\"", "Samples acquired per source");
+static METRIC_DEFINE_COUNTER(samples_scd41, "node_samples_total", "source=\"scd41\"", "Samples acquired per source");
+static METRIC_DEFINE_COUNTER(samples_csv, "node_samples_total", "source=\"csv\"", "Samples acquired per source");
+static METRIC_DEFINE_COUNTER(tcp_frames_sent, "node_tcp_frames_sent_total", NULL, "Frames sent by tcp_server_task");
+static METRIC_DEFINE_COUNTER(tcp_send_errors, "node_tcp_send_errors_total", NULL, "Failed sends in tcp_server_task");
+static METRIC_DEFINE_COUNTER(tcp_bytes_client0, "node_tcp_bytes_sent_total", "client=\"0\"", "Bytes sent per client slot");
+static METRIC_DEFINE_COUNTER(tcp_bytes_client1, "node_tcp_bytes_sent_total", "client=\"1\"", "Bytes sent per client slot");
+static METRIC_DEFINE_COUNTER(tcp_bytes_client2, "node_tcp_bytes_sent_total", "client=\"2\"", "Bytes sent per client slot");
+static METRIC_DEFINE_COUNTER(tcp_bytes_client3, "node_tcp_bytes_sent_total", "client=\"3\"", "Bytes sent per client slot");
+static METRIC_DEFINE_HISTOGRAM(tcp_send_us, "node_tcp_send_us", "Time spent in send() per write, microseconds", send_us_bounds);
+static METRIC_DEFINE_GAUGE(free_heap, "node_free_heap_bytes", NULL, "Current free heap");
+static METRIC_DEFINE_GAUGE(min_free_heap, "node_min_free_heap_bytes", NULL, "Lowest free heap since boot");
+static METRIC_DEFINE_GAUGE(stack_tcp_server, "node_stack_free_bytes", "task=\"tcp_server_task\"", "Stack high-water mark per task");
+static METRIC_DEFINE_GAUGE(stack_acq, "node_stack_free_bytes", "task=\"acq_task\"", "Stack high-water mark per task");
+static METRIC_DEFINE_GAUGE(stack_adc, "node_stack_free_bytes", "task=\"adc_task\"", "Stack high-water mark per task");
+static METRIC_DEFINE_GAUGE(period_si7021, "node_sample_period_ms", "job=\"si7021\"", "Current sampling period per acquisition job");
+static METRIC_DEFINE_GAUGE(period_nh3, "node_sample_period_ms", "job=\"nh3\"", "Current sampling period per acquisition job");
+static METRIC_DEFINE_GAUGE(period_h2s, "node_sample_period_ms", "job=\"h2s\"", "Current sampling period per acquisition job");
+static METRIC_DEFINE_GAUGE(period_co2, "node_sample_period_ms", "job=\"co2\"", "Current sampling period per acquisition job");
+static METRIC_DEFINE_GAUGE(period_ch4, "node_sample_period_ms", "job=\"ch4\"", "Current sampling period per acquisition job");
+static METRIC_DEFINE_COUNTER(acq_overruns, "node_acq_overruns_total", NULL, "Acquisition periods skipped because a job ran late");
+static METRIC_DEFINE_COUNTER(scd41_i2c_transactions, "scd41_i2c_transactions_total", NULL, "I2C transactions issued to the SCD41");
+static METRIC_DEFINE_COUNTER(scd41_i2c_errors, "scd41_i2c_errors_total", NULL, "SCD41 I2C transactions that failed");
+static METRIC_DEFINE_COUNTER(scd41_crc_failures, "scd41_crc_failures_total", NULL, "SCD41 readings with a bad CRC");
+static METRIC_DEFINE_COUNTER(scd41_not_ready, "scd41_polls_not_ready_total", NULL, "SCD41 data-ready polls that found no new measurement");
+static METRIC_DEFINE_COUNTER(anomalies, "node_anomalies_total", NULL, "Samples the anomaly detector flagged");
+static METRIC_DEFINE_COUNTER(link_retransmits, "node_link_retransmits_total", NULL, "Frames sent again on request of the gateway");
+static METRIC_DEFINE_COUNTER(link_gone, "node_link_gone_total", NULL, "Requested frames already overwritten in the retransmit ring");
+static METRIC_DEFINE_COUNTER(link_frame_encodes, "node_link_frame_encodes_total", NULL, "Frames encoded into a shared buffer");
+static METRIC_DEFINE_COUNTER(link_frame_reuses, "node_link_frame_reuses_total", NULL, "Frame sends served from a buffer already encoded");
+static METRIC_DEFINE_GAUGE(tcp_clients, "node_tcp_clients", NULL, "Connected TCP clients");
+static METRIC_DEFINE_GAUGE(link_ring_frames, "node_link_ring_frames", NULL, "Frames held in the retransmit ring");
+static METRIC_DEFINE_GAUGE(link_unsent_client0, "node_link_frames_unsent", "client=\"0\"", "Frames in the ring not yet pushed to the client in this slot");
+static METRIC_DEFINE_GAUGE(link_unsent_client1, "node_link_frames_unsent", "client=\"1\"", "Frames in the ring not yet pushed to the client in this slot");
+static METRIC_DEFINE_GAUGE(link_unsent_client2, "node_link_frames_unsent", "client=\"2\"", "Frames in the ring not yet pushed to the client in this slot");
+static METRIC_DEFINE_GAUGE(link_unsent_client3, "node_link_frames_unsent", "client=\"3\"", "Frames in the ring not yet pushed to the client in this slot");
+static METRIC_DEFINE_COUNTER(node_commands, "node_commands_total", NULL, "Command lines the TCP clients sent");
+static METRIC_DEFINE_HISTOGRAM(node_command_us, "node_command_us", "Time to run and answer one command, microseconds", send_us_bounds);
+
+// One byte counter and one backlog gauge per slot of tcp_server_task,
+// whoever holds the slot
+_Static_assert(NODE_MAX_CLIENTS == 4, "one node_tcp_bytes_sent_total counter per client slot");
+static metric_t *tcp_bytes_per_client[NODE_MAX_CLIENTS] = {
+    &tcp_bytes_client0, &tcp_bytes_client1, &tcp_bytes_client2, &tcp_bytes_client3
+};
+static metric_t *link_unsent_per_client[NODE_MAX_CLIENTS] = {
+    &link_unsent_client0, &link_unsent_client1, &link_unsent_client2, &link_unsent_client3
+};
+
+static void collect_acq_metrics(void);
+static void collect_link_metrics(void);
+
+// Refresh gauges right before /metrics is rendered
+static void collect_node_metrics(void) {
+    metric_set(&free_heap, esp_get_free_heap_size());
+    metric_set(&min_free_heap, esp_get_minimum_free_heap_size());
+    if (tcp_server_handle) metric_set(&stack_tcp_server, uxTaskGetStackHighWaterMark(tcp_server_handle));
+    if (acq_task_handle) metric_set(&stack_acq, uxTaskGetStackHighWaterMark(acq_task_handle));
+    if (adc_task_handle) metric_set(&stack_adc, uxTaskGetStackHighWaterMark(adc_task_handle));
+    collect_acq_metrics();
+    collect_link_metrics();
+}
+
+static void register_node_metrics(void) {
+    metrics_register(&samples_si7021);
+    metrics_register(&samples_scd41);
+    metrics_register(&samples_csv);
+    metrics_register(&tcp_frames_sent);
+    metrics_register(&tcp_send_errors);
+    for (int i = 0; i < NODE_MAX_CLIENTS; i++) {
+        metrics_register(tcp_bytes_per_client[i]);
+    }
+    metrics_register(&tcp_send_us);
+    metrics_register(&free_heap);
+    metrics_register(&min_free_heap);
+    metrics_register(&stack_tcp_server);
+    metrics_register(&stack_acq);
+    metrics_register(&stack_adc);
+    metrics_register(&period_si7021);
+    metrics_register(&period_nh3);
+    metrics_register(&period_h2s);
+    metrics_register(&period_co2);
+    metrics_register(&period_ch4);
+    metrics_register(&acq_overruns);
+    metrics_register(&scd41_i2c_transactions);
+    metrics_register(&scd41_i2c_errors);
+    metrics_register(&scd41_crc_failures);
+    metrics_register(&scd41_not_ready);
+    metrics_register(&anomalies);
+    metrics_register(&link_retransmits);
+    metrics_register(&link_gone);
+    metrics_register(&link_frame_encodes);
+    metrics_register(&link_frame_reuses);
+    metrics_register(&tcp_clients);
+    metrics_register(&link_ring_frames);
+    for (int i = 0; i < NODE_MAX_CLIENTS; i++) {
+        metrics_register(link_unsent_per_client[i]);
+    }
+    metrics_register(&node_commands);
+    metrics_register(&node_command_us);
+    metrics_register_collector(collect_node_metrics);
+}
+
+#if CONFIG_GAS_TRACE_ENABLE
+// Stamps of the sample currently held in the globals
+static trace_stamps_t sample_trace;
+static uint32_t sample_seq;
+static portMUX_TYPE sample_trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void trace_publish(trace_stamps_t *stamps) {
+    portENTER_CRITICAL(&sample_trace_lock);
+    stamps->seq = ++sample_seq;
+    sample_trace = *stamps;
+    portEXIT_CRITICAL(&sample_trace_lock);
+}
+
+// Stamp the send hop and append the trace to an outgoing frame
+static int trace_frame_suffix(char *buf, size_t len) {
+    trace_stamps_t stamps;
+    portENTER_CRITICAL(&sample_trace_lock);
+    stamps = sample_trace;
+    portEXIT_CRITICAL(&sample_trace_lock);
+    TRACE_STAMP(&stamps, TRACE_SEND);
+    return trace_format_node(&stamps, buf, len);
+}
+#endif
+
+static uint32_t uptime_ms(void) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+#if CONFIG_GAS_ANOMALY
+// Floor of each channel's noise estimate and its rate limit per second, in
+// channel units (degF, %RH, ppm)
+typedef struct {
+    float min_spread;
+    float max_rate;
+} anomaly_limits_t;
+
+static const anomaly_limits_t anomaly_limits[GAS_CH_COUNT] = {
+    [GAS_CH_TEMPERATURE] = { 0.2f, 1.0f },
+    [GAS_CH_HUMIDITY] = { 0.5f, 5.0f },
+    [GAS_CH_AMMONIA] = { 0.5f, 20.0f },
+    [GAS_CH_H2S] = { 0.05f, 2.0f },
+    [GAS_CH_CO2] = { 10.0f, 200.0f },
+    [GAS_CH_METHANE] = { 2.0f, 50.0f },
+};
+
+static gas_anomaly_t anomaly_detectors[GAS_CH_COUNT];
+static uint32_t anomaly_pending;    // channels flagged since the last frame
+static portMUX_TYPE anomaly_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void anomaly_init(void) {
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        gas_anomaly_config_t config = {
+            .mode = CONFIG_GAS_ANOMALY_MODE, .shift = CONFIG_GAS_ANOMALY_SHIFT, .warmup = CONFIG_GAS_ANOMALY_WARMUP,
+            .threshold = CONFIG_GAS_ANOMALY_THRESHOLD_X10 / 10.0f, .min_spread = anomaly_limits[ch].min_spread,
+#if CONFIG_GAS_ANOMALY_RATE
+            .max_rate = anomaly_limits[ch].max_rate,
+#endif
+        };
+        gas_anomaly_init(&anomaly_detectors[ch], &config);
+    }
+}
+
+// Run from the collectors with every new reading of a channel
+static void anomaly_check(gas_channel_t channel, float value) {
+    uint8_t flags = gas_anomaly_apply(&anomaly_detectors[channel], value, uptime_ms());
+    if (flags == 0) {
+        return;
+    }
+    portENTER_CRITICAL(&anomaly_lock);
+    anomaly_pending |= 1u << channel;
+    portEXIT_CRITICAL(&anomaly_lock);
+    metric_inc(&anomalies);
+    TLOG(TLOG_ANOMALY, channel, value, flags);
+}
+
+// Channels flagged since the last frame, for its ",A:" suffix
+static uint32_t anomaly_take_pending(void) {
+    portENTER_CRITICAL(&anomaly_lock);
+    uint32_t channels = anomaly_pending;
+    anomaly_pending = 0;
+    portEXIT_CRITICAL(&anomaly_lock);
+    return channels;
+}
+#else
+#define anomaly_check(channel, value) ((void)0)
+#define anomaly_take_pending() 0
+#endif
+
+// Frames for the gateway, numbered whether or not it is connected and held
+// in a ring so it can ask for the ones it missed (see gas_link.h)
+static gas_link_record_t link_records[CONFIG_GAS_LINK_RETX_FRAMES];
+static gas_link_ring_t link_ring;
+static uint16_t link_boot;              // new on every boot, restarts the sequence
+static uint32_t link_last_push_ms;
+static portMUX_TYPE link_lock = portMUX_INITIALIZER_UNLOCKED;
+static int link_wake_fd = -1;           // eventfd link_push() wakes tcp_server_task with
+
+// Frames as sent, encoded once for every client with the same channels and
+// the UDP publisher; tcp_server_task's alone. One buffer per client and one
+// for the publisher keep the newest frame in each client's channel set.
+#define LINK_FBUFS (NODE_MAX_CLIENTS + 1)
+static gas_fbuf_t link_fbuf_storage[LINK_FBUFS];
+static gas_fbuf_pool_t link_fbufs;
+
+static void link_init(void) {
+    gas_link_ring_init(&link_ring, link_records, CONFIG_GAS_LINK_RETX_FRAMES);
+    gas_fbuf_pool_init(&link_fbufs, link_fbuf_storage, LINK_FBUFS);
+    link_boot = (uint16_t)(esp_random() % UINT16_MAX + 1);
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    if (esp_vfs_eventfd_register(&config) == ESP_OK) {
+        link_wake_fd = eventfd(0, 0);
+    }
+    if (link_wake_fd < 0) {
+        ESP_LOGW(TAG, "No eventfd, new frames are polled for every %d ms", LINK_POLL_MS);
+    }
+}
+
+// Node clock in ms, the capture time the frames carry
+static int64_t node_clock_ms(void) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (int64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+// Numbers the readings as the next frame and wakes the TCP task to send it
+static void link_push(const gas_sample_t *sample) {
+    uint32_t channels = anomaly_take_pending();
+    int64_t capture_ms = node_clock_ms();
+    portENTER_CRITICAL(&link_lock);
+    gas_link_ring_push(&link_ring, sample, channels, capture_ms);
+    portEXIT_CRITICAL(&link_lock);
+    link_last_push_ms = uptime_ms();
+    if (link_wake_fd >= 0) {
+        uint64_t pushed = 1;
+        write(link_wake_fd, &pushed, sizeof(pushed));
+    }
+}
+
+// Copy of frame `seq`, false once it left the ring or before it is pushed
+static bool link_get(uint32_t seq, gas_link_record_t *record) {
+    portENTER_CRITICAL(&link_lock);
+    const gas_link_record_t *held = gas_link_ring_get(&link_ring, seq);
+    if (held != NULL) {
+        *record = *held;
+    }
+    portEXIT_CRITICAL(&link_lock);
+    return held != NULL;
+}
+
+// Oldest frame the ring holds and the newest, 0 before the first
+static void link_range(uint32_t *oldest, uint32_t *newest) {
+    portENTER_CRITICAL(&link_lock);
+    *oldest = gas_link_ring_oldest(&link_ring);
+    *newest = link_ring.next_seq - 1;
+    portEXIT_CRITICAL(&link_lock);
+}
+
+static void collect_link_metrics(void) {
+    uint32_t oldest, newest;
+    link_range(&oldest, &newest);
+    metric_set(&link_ring_frames, newest >= oldest ? newest - oldest + 1 : 0);
+}
+
+// Snapshot of the global readings
+static gas_sample_t current_sample(void) {
+    return readings;
+}
+
+// Hand the latest readings to the HTTP API
+static void publish_sample(void) {
+    gas_sample_t sample = current_sample();
+    http_api_publish(&sample);
+}
 
 // Function to blink LED
 void blink_led() {
@@ -92,6 +425,478 @@ void wifi_init_softap(void) {
                         EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS, EXAMPLE_ESP_WIFI_CHANNEL);
 }
 
+// A HIST under way, answered a slice per pass of the server loop
+typedef struct {
+    bool active;
+    history_cursor_t cursor;
+    uint32_t count;             // points sent so far
+} node_hist_t;
+
+// One connection of tcp_server_task
+typedef struct {
+    int sock;                   // -1 for a free slot
+    metric_t *bytes;
+    gas_link_lines_t requests;
+    uint32_t next_seq;          // next frame to push
+    uint32_t rate_ms;           // 0 pushes every frame, GAS_CMD_RATE_OFF none
+    uint32_t last_push_ms;
+    uint32_t channels;          // in the frames sent, GAS_CH_BIT()s
+    node_hist_t hist;           // later commands wait until it is done
+} node_client_t;
+
+static node_client_t node_clients[NODE_MAX_CLIENTS];
+static int node_client_count;
+
+// A send stuck on one client holds up the others at most this long
+#define CLIENT_SEND_TIMEOUT_S 2
+
+static bool client_send(node_client_t *client, const char *buf, int len) {
+    int64_t send_start = esp_timer_get_time();
+    int err = send(client->sock, buf, len, 0);
+    metric_observe(&tcp_send_us, (uint32_t)(esp_timer_get_time() - send_start));
+    if (err < 0) {
+        metric_inc(&tcp_send_errors);
+        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+        return false;
+    }
+    metric_add(client->bytes, err);
+    return true;
+}
+
+// One answer line, newline added
+static bool client_printf(node_client_t *client, const char *fmt, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return false;
+    }
+    if (len > (int)sizeof(line) - 2) {
+        len = sizeof(line) - 2;
+    }
+    line[len++] = '\n';
+    return client_send(client, line, len);
+}
+
+// The encoded frame of `record` with `channels`, referenced until
+// gas_fbuf_release(). NULL only if every buffer is held, which one sender at
+// a time never does.
+static gas_fbuf_t *link_frame(const gas_link_record_t *record, uint32_t channels) {
+    uint32_t encodes = link_fbufs.encodes;
+    gas_fbuf_t *fbuf = gas_fbuf_get(&link_fbufs, record, channels, link_boot);
+    if (fbuf != NULL) {
+        metric_inc(link_fbufs.encodes != encodes ? &link_frame_encodes : &link_frame_reuses);
+    }
+    return fbuf;
+}
+
+// Sends one frame with the client's channels, newline-terminated, from the
+// shared buffer. With tracing, live frames carry the stamps of the current
+// sample and their own send time, so they are encoded per client; a
+// retransmitted one goes out as it was numbered.
+static bool link_send(node_client_t *client, const gas_link_record_t *record, bool live) {
+    bool sent;
+#if CONFIG_GAS_TRACE_ENABLE
+    if (live) {
+        char frame[128 + GAS_LINK_SUFFIX_LEN + GAS_ANOMALY_SUFFIX_LEN + TRACE_SUFFIX_LEN + 1];
+        int len = gas_link_format(record, client->channels, link_boot, frame, sizeof(frame) - 1);
+        len += trace_frame_suffix(frame + len, sizeof(frame) - 1 - len);
+        frame[len++] = '\n';
+        sent = client_send(client, frame, len);
+    } else
+#endif
+    {
+        gas_fbuf_t *fbuf = link_frame(record, client->channels);
+        sent = fbuf != NULL && client_send(client, fbuf->data, fbuf->len);
+        gas_fbuf_release(fbuf);
+    }
+
+    if (!sent) {
+        return false;
+    }
+    if (!live) {
+        metric_inc(&link_retransmits);
+        return true;
+    }
+    metric_inc(&tcp_frames_sent);
+    gas_sample_t sample;
+    gas_sample_unpack(&record->sample, &sample);
+    TLOG(TLOG_NODE_FRAME_SENT, sample.temperature, sample.humidity, sample.ammonia,
+         sample.h2s, sample.co2, sample.methane);
+    return true;
+}
+
+// Re-sends the frames of a RETX request the ring still holds; the older
+// ones are answered with GONE
+static bool link_retransmit(node_client_t *client, uint32_t first, uint32_t last) {
+    uint32_t oldest, newest;
+    link_range(&oldest, &newest);
+    if (last > newest) {
+        last = newest;
+    }
+    if (first < oldest && first <= last) {
+        char gone[32];
+        uint32_t gone_last = last < oldest - 1 ? last : oldest - 1;
+        int len = gas_link_format_range("GONE", first, gone_last, gone, sizeof(gone));
+        if (!client_send(client, gone, len)) {
+            return false;
+        }
+        metric_add(&link_gone, gone_last - first + 1);
+        first = oldest;
+    }
+    gas_link_record_t record;
+    for (uint32_t seq = first; seq <= last; seq++) {
+        if (link_get(seq, &record) && !link_send(client, &record, false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// "OK:NOW:<frame>" with the current readings
+static bool client_now(node_client_t *client) {
+    char line[8 + 128 + 1];
+    gas_sample_t sample = current_sample();
+    int len = snprintf(line, sizeof(line), "OK:NOW:");
+    len += gas_frame_format_channels(&sample, client->channels, line + len, sizeof(line) - 1 - len);
+    line[len++] = '\n';
+    return client_send(client, line, len);
+}
+
+typedef struct {
+    node_client_t *client;
+    char buf[512];
+    int len;
+    uint32_t count;
+    bool failed;
+} hist_writer_t;
+
+static bool hist_write_point(uint32_t timestamp, float value, void *ctx) {
+    hist_writer_t *writer = (hist_writer_t *)ctx;
+    if (writer->len > (int)sizeof(writer->buf) - 32) {
+        if (!client_send(writer->client, writer->buf, writer->len)) {
+            writer->failed = true;
+            return false;
+        }
+        writer->len = 0;
+    }
+    fastfmt_t f;
+    fastfmt_begin(&f, writer->buf + writer->len, sizeof(writer->buf) - writer->len);
+    fastfmt_str(&f, "H:");
+    fastfmt_u32(&f, timestamp);
+    fastfmt_char(&f, ':');
+    fastfmt_fixed2(&f, value);
+    fastfmt_char(&f, '\n');
+    writer->len += fastfmt_end(&f);
+    writer->count++;
+    return true;
+}
+
+// A HIST is answered at most this many seconds of history per pass of the
+// server loop, about one block at the 5 s record cadence, so a long one
+// does not hold up the frames and the other clients' commands
+#define HIST_SLICE_S (HISTORY_RECORDS_PER_BLOCK * 5)
+
+// Sends the next slice of the client's HIST as "H:<ts>:<value>" lines, and
+// "OK:HIST:<count>" after the last
+static bool client_history_step(node_client_t *client) {
+    static hist_writer_t writer; // only tcp_server_task answers commands
+    node_hist_t *hist = &client->hist;
+    writer.client = client;
+    writer.len = 0;
+    writer.count = 0;
+    writer.failed = false;
+    hist->active = history_cursor_next(&hist->cursor, HIST_SLICE_S, hist_write_point, &writer);
+    if (writer.failed || (writer.len > 0 && !client_send(client, writer.buf, writer.len))) {
+        return false;
+    }
+    hist->count += writer.count;
+    return hist->active || client_printf(client, "OK:HIST:%" PRIu32, hist->count);
+}
+
+// Starts a HIST, its first slice goes out now
+static bool client_history(node_client_t *client, const gas_cmd_t *cmd) {
+    node_hist_t *hist = &client->hist;
+    hist->count = 0;
+    hist->active = history_cursor_init(&hist->cursor, cmd->channel, cmd->first, cmd->last, cmd->value);
+    return hist->active ? client_history_step(client) : client_printf(client, "OK:HIST:0");
+}
+
+static bool client_stats(node_client_t *client) {
+    uint32_t oldest, newest;
+    link_range(&oldest, &newest);
+    return client_printf(client,
+                         "STATS:uptime_ms=%" PRIu32 ",time=%" PRIu32 ",boot=%x,seq=%" PRIu32 ",oldest=%" PRIu32
+                         ",clients=%d,frames_sent=%" PRIu32 ",retransmits=%" PRIu32 ",anomalies=%" PRIu32
+                         ",commands=%" PRIu32 ",free_heap=%" PRIu32,
+                         uptime_ms(), node_time_now(), (unsigned)link_boot, newest, oldest, node_client_count,
+                         metric_get(&tcp_frames_sent), metric_get(&link_retransmits), metric_get(&anomalies),
+                         metric_get(&node_commands), esp_get_free_heap_size());
+}
+
+// Runs one request line. False once the connection is gone.
+static bool client_command(node_client_t *client, const char *line) {
+    int64_t start = esp_timer_get_time();
+    gas_cmd_t cmd;
+    bool ok = true;
+    if (!gas_cmd_parse(line, &cmd)) {
+        ok = client_printf(client, "ERR:%s", gas_cmd_name(cmd.id));
+    } else {
+        switch (cmd.id) {
+        case GAS_CMD_NOW:
+            ok = client_now(client);
+            break;
+        case GAS_CMD_RATE:
+            client->rate_ms = cmd.value;
+            client->last_push_ms = 0;
+            ok = cmd.value == GAS_CMD_RATE_OFF ? client_printf(client, "OK:RATE:OFF")
+                                               : client_printf(client, "OK:RATE:%" PRIu32, cmd.value);
+            break;
+        case GAS_CMD_SUB:
+            client->channels |= cmd.channels;
+            ok = client_printf(client, "OK:SUB:%" PRIx32, client->channels);
+            break;
+        case GAS_CMD_UNSUB:
+            client->channels &= ~cmd.channels;
+            ok = client_printf(client, "OK:SUB:%" PRIx32, client->channels);
+            break;
+        case GAS_CMD_HIST:
+            ok = client_history(client, &cmd);
+            break;
+        case GAS_CMD_STATS:
+            ok = client_stats(client);
+            break;
+        case GAS_CMD_RETX:
+            TLOG(TLOG_LINK_RETX, cmd.first, cmd.last);
+            ok = link_retransmit(client, cmd.first, cmd.last);
+            break;
+        default:
+            break; // the gateway's greeting needs no answer
+        }
+    }
+    metric_inc(&node_commands);
+    metric_observe(&node_command_us, (uint32_t)(esp_timer_get_time() - start));
+    return ok;
+}
+
+// Answers the whole lines received so far, up to one that starts a HIST.
+// False once the connection is gone.
+static bool client_answer(node_client_t *client) {
+    for (char *line; !client->hist.active && (line = gas_link_lines_next(&client->requests)) != NULL;) {
+        if (!client_command(client, line)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads whatever the client sent without blocking and answers its
+// commands. Nothing is read while a HIST is under way: its later commands
+// stay in the socket until the answer is complete. False once the
+// connection is gone.
+static bool client_serve(node_client_t *client) {
+    while (!client->hist.active) {
+        size_t avail;
+        char *space = gas_link_lines_space(&client->requests, &avail);
+        int len = recv(client->sock, space, avail, MSG_DONTWAIT);
+        if (len == 0) {
+            ESP_LOGI(TAG, "Connection closed by the client");
+            return false;
+        }
+        if (len < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        gas_link_lines_commit(&client->requests, len);
+        if (!client_answer(client)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// One slice of the client's HIST, then the commands that were waiting
+// behind it
+static bool client_continue(node_client_t *client) {
+    return !client->hist.active || (client_history_step(client) && client_answer(client));
+}
+
+// Sends the client the frames numbered since its last push, or only the
+// newest one once its RATE period is up
+static bool client_push(node_client_t *client, uint32_t now) {
+    uint32_t oldest, newest;
+    link_range(&oldest, &newest);
+    if (client->next_seq < oldest) {
+        client->next_seq = oldest; // the client asks for the rest if it wants them
+    }
+    if (client->next_seq > newest) {
+        return true;
+    }
+    if (client->rate_ms == GAS_CMD_RATE_OFF || client->channels == 0) {
+        client->next_seq = newest + 1;
+        return true;
+    }
+    if (client->rate_ms > 0) {
+        if (client->last_push_ms != 0 && now - client->last_push_ms < client->rate_ms) {
+            return true;
+        }
+        client->next_seq = newest;
+        client->last_push_ms = now;
+    }
+    gas_link_record_t record;
+    while (client->next_seq <= newest && link_get(client->next_seq, &record)) {
+        if (!link_send(client, &record, true)) {
+            return false;
+        }
+        client->next_seq++;
+    }
+    return true;
+}
+
+// Frames each slot has yet to be pushed, refreshed by tcp_server_task, which
+// owns node_clients. A throttled client only gets the newest frame when its
+// period is up, so its backlog counts what it will skip as well.
+static void client_update_unsent(void) {
+    uint32_t oldest, newest;
+    link_range(&oldest, &newest);
+    for (int i = 0; i < NODE_MAX_CLIENTS; i++) {
+        const node_client_t *client = &node_clients[i];
+        uint32_t next = client->next_seq < oldest ? oldest : client->next_seq;
+        metric_set(link_unsent_per_client[i], client->sock >= 0 && next <= newest ? newest - next + 1 : 0);
+    }
+}
+
+// Until the first throttled client with a frame waiting is due, 0 while a
+// HIST is under way, -1 if none is
+static int32_t client_wait_ms(uint32_t now) {
+    portENTER_CRITICAL(&link_lock);
+    uint32_t newest = link_ring.next_seq - 1;
+    portEXIT_CRITICAL(&link_lock);
+    int32_t wait_ms = -1;
+    for (int i = 0; i < NODE_MAX_CLIENTS; i++) {
+        const node_client_t *client = &node_clients[i];
+        if (client->sock >= 0 && client->hist.active) {
+            return 0;
+        }
+        if (client->sock < 0 || client->rate_ms == 0 || client->rate_ms == GAS_CMD_RATE_OFF ||
+            client->next_seq > newest) {
+            continue;
+        }
+        uint32_t elapsed = now - client->last_push_ms;
+        int32_t due = elapsed >= client->rate_ms ? 0 : (int32_t)(client->rate_ms - elapsed);
+        if (wait_ms < 0 || due < wait_ms) {
+            wait_ms = due;
+        }
+    }
+    return wait_ms;
+}
+
+static void client_accept(int listen_sock) {
+    struct sockaddr_storage source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    int sock = accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+        return;
+    }
+    node_client_t *client = NULL;
+    for (int i = 0; i < NODE_MAX_CLIENTS && client == NULL; i++) {
+        if (node_clients[i].sock < 0) {
+            client = &node_clients[i];
+        }
+    }
+    if (client == NULL) {
+        ESP_LOGW(TAG, "All %d client slots taken, connection refused", NODE_MAX_CLIENTS);
+        send(sock, "ERR:BUSY\n", 9, 0);
+        close(sock);
+        return;
+    }
+    struct timeval send_timeout = { .tv_sec = CLIENT_SEND_TIMEOUT_S };
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+#if CONFIG_GAS_TRACE_ENABLE
+    trace_sync_client(sock);
+#endif
+
+    // The newest frame goes first, so a gateway that was away sees the
+    // jump in the sequence and asks for what it missed
+    portENTER_CRITICAL(&link_lock);
+    uint32_t next_seq = link_ring.next_seq > 1 ? link_ring.next_seq - 1 : 1;
+    portEXIT_CRITICAL(&link_lock);
+    client->sock = sock;
+    client->bytes = tcp_bytes_per_client[client - node_clients];
+    client->requests.start = client->requests.len = 0;
+    client->next_seq = next_seq;
+    client->rate_ms = 0;
+    client->last_push_ms = 0;
+    client->channels = GAS_CH_ALL;
+    client->hist.active = false;
+    node_client_count++;
+    metric_set(&tcp_clients, node_client_count);
+    ESP_LOGI(TAG, "Socket accepted, %d of %d clients", node_client_count, NODE_MAX_CLIENTS);
+}
+
+static void client_close(node_client_t *client) {
+    ESP_LOGI(TAG, "Shutting down socket %d", client->sock);
+    shutdown(client->sock, 0);
+    close(client->sock);
+    client->sock = -1;
+    node_client_count--;
+    metric_set(&tcp_clients, node_client_count);
+}
+
+#if CONFIG_GAS_UDP_PUBLISH
+static uint32_t udp_next_seq = 1;       // next frame to publish
+static uint32_t udp_snapshot_ms;        // last SNAP: datagram
+
+// One datagram per frame numbered since the last call, then the current
+// readings as a snapshot if one is due
+static void link_publish(uint32_t now) {
+    portENTER_CRITICAL(&link_lock);
+    uint32_t oldest = gas_link_ring_oldest(&link_ring);
+    portEXIT_CRITICAL(&link_lock);
+    if (udp_next_seq < oldest) {
+        udp_next_seq = oldest;
+    }
+    gas_link_record_t record;
+    while (link_get(udp_next_seq, &record)) {
+        // Encoded here first, the TCP clients with every channel reuse it
+        gas_fbuf_t *fbuf = link_frame(&record, GAS_CH_ALL);
+        if (fbuf != NULL) {
+            udp_publish_send(fbuf->data, fbuf->len);
+            gas_fbuf_release(fbuf);
+        }
+        udp_next_seq++;
+    }
+
+    if (CONFIG_GAS_UDP_SNAPSHOT_S == 0 || udp_next_seq == 1 ||
+        now - udp_snapshot_ms < CONFIG_GAS_UDP_SNAPSHOT_S * 1000) {
+        return;
+    }
+    udp_snapshot_ms = now;
+    char datagram[sizeof(GAS_LINK_SNAPSHOT) + 128 + GAS_LINK_SUFFIX_LEN + GAS_ANOMALY_SUFFIX_LEN + 1];
+    gas_sample_t sample = current_sample();
+    record.seq = udp_next_seq - 1;
+    record.anomalies = 0;
+    record.capture_ms = node_clock_ms();
+    gas_sample_pack(&sample, &record.sample);
+    int len = snprintf(datagram, sizeof(datagram), GAS_LINK_SNAPSHOT);
+    len += gas_link_format(&record, GAS_CH_ALL, link_boot, datagram + len, sizeof(datagram) - 1 - len);
+    datagram[len++] = '\n';
+    udp_publish_send(datagram, len);
+}
+
+// Until the next snapshot is due, -1 without snapshots or before the first
+// frame
+static int32_t link_publish_wait_ms(uint32_t now) {
+    if (CONFIG_GAS_UDP_SNAPSHOT_S == 0 || udp_next_seq == 1) {
+        return -1;
+    }
+    uint32_t elapsed = now - udp_snapshot_ms;
+    return elapsed >= CONFIG_GAS_UDP_SNAPSHOT_S * 1000 ? 0 : (int32_t)(CONFIG_GAS_UDP_SNAPSHOT_S * 1000 - elapsed);
+}
+#endif
+
 static void tcp_server_task(void *pvParameters) {
     char addr_str[128];
     int addr_family = (int)pvParameters;
@@ -119,91 +924,361 @@ static void tcp_server_task(void *pvParameters) {
     }
     ESP_LOGI(TAG, "Socket bound, port %d", PORT);
 
-    err = listen(listen_sock, 1);
+    err = listen(listen_sock, NODE_MAX_CLIENTS);
     if (err != 0) {
         ESP_LOGE(TAG, "Error occurred during listen: errno %d", errno);
         close(listen_sock);
         vTaskDelete(NULL);
         return;
     }
+    for (int i = 0; i < NODE_MAX_CLIENTS; i++) {
+        node_clients[i].sock = -1;
+    }
+    ESP_LOGI(TAG, "Socket listening");
 
+    // One select() over the listening socket, the clients and link_push()'s
+    // eventfd: a new frame, a command or a connection wakes the task, and a
+    // throttled client or a UDP snapshot wakes it when it is due
     while (1) {
-        ESP_LOGI(TAG, "Socket listening");
-
-        struct sockaddr_storage source_addr;
-        socklen_t addr_len = sizeof(source_addr);
-        int sock = accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
-        if (sock < 0) {
-            ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
-            break;
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listen_sock, &readable);
+        int max_fd = listen_sock;
+        if (link_wake_fd >= 0) {
+            FD_SET(link_wake_fd, &readable);
+            max_fd = link_wake_fd > max_fd ? link_wake_fd : max_fd;
         }
-        ESP_LOGI(TAG, "Socket accepted");
-
-        while (1) {
-            char data_to_send[128];
-            snprintf(data_to_send, sizeof(data_to_send),
-                     "Temp:%.2f,Humidity:%.2f,NH3:%.2f,H2S:%.2f,CO2:%.2f,CH4:%.2f",
-                     temperature, humidity, ammonia, h2s, co2, methane);
-
-            int err = send(sock, data_to_send, strlen(data_to_send), 0);
-            if (err < 0) {
-                ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                break;
+        for (int i = 0; i < NODE_MAX_CLIENTS; i++) {
+            if (node_clients[i].sock >= 0) {
+                FD_SET(node_clients[i].sock, &readable);
+                max_fd = node_clients[i].sock > max_fd ? node_clients[i].sock : max_fd;
             }
-            ESP_LOGI(TAG, "Data sent: %s", data_to_send);
-            vTaskDelay(5000 / portTICK_PERIOD_MS);
+        }
+        int32_t wait_ms = client_wait_ms(uptime_ms());
+#if CONFIG_GAS_UDP_PUBLISH
+        int32_t snapshot_ms = link_publish_wait_ms(uptime_ms());
+        if (snapshot_ms >= 0 && (wait_ms < 0 || snapshot_ms < wait_ms)) {
+            wait_ms = snapshot_ms;
+        }
+#endif
+        if (link_wake_fd < 0 && (wait_ms < 0 || wait_ms > LINK_POLL_MS)) {
+            wait_ms = LINK_POLL_MS; // no eventfd, new frames are polled for
+        }
+        struct timeval timeout = { .tv_sec = wait_ms / 1000, .tv_usec = (wait_ms % 1000) * 1000 };
+        if (select(max_fd + 1, &readable, NULL, NULL, wait_ms < 0 ? NULL : &timeout) < 0) {
+            ESP_LOGE(TAG, "select failed: errno %d", errno);
+            vTaskDelay(LINK_POLL_MS / portTICK_PERIOD_MS);
+            continue;
         }
 
-        if (sock != -1) {
-            ESP_LOGE(TAG, "Shutting down socket and restarting...");
-            shutdown(sock, 0);
-            close(sock);
+        if (link_wake_fd >= 0 && FD_ISSET(link_wake_fd, &readable)) {
+            uint64_t pushed;
+            read(link_wake_fd, &pushed, sizeof(pushed));
+        }
+        if (FD_ISSET(listen_sock, &readable)) {
+            client_accept(listen_sock);
         }
+        uint32_t now = uptime_ms();
+#if CONFIG_GAS_UDP_PUBLISH
+        // Once for all the listeners, ahead of the per-client sends
+        link_publish(now);
+#endif
+        for (int i = 0; i < NODE_MAX_CLIENTS; i++) {
+            node_client_t *client = &node_clients[i];
+            if (client->sock < 0) {
+                continue;
+            }
+            bool alive = client_continue(client) && (!FD_ISSET(client->sock, &readable) || client_serve(client));
+            if (!alive || !client_push(client, now)) {
+                client_close(client);
+            }
+        }
+        client_update_unsent();
     }
 
     close(listen_sock);
     vTaskDelete(NULL);
 }
 
-// Need to create a task to read the sensor data
-void sensor_task(void *pvParameters) {
+#if CONFIG_GAS_ADAPTIVE_SAMPLING
+static const adaptive_config_t sampling_config = {
+    .min_period_ms = CONFIG_GAS_SAMPLE_MIN_PERIOD_MS,
+    .max_period_ms = CONFIG_GAS_SAMPLE_MAX_PERIOD_MS,
+    .budget_per_min = CONFIG_GAS_SAMPLE_BUDGET_PER_MIN,
+    .flat_samples = CONFIG_GAS_SAMPLE_FLAT_COUNT,
+};
+#endif
+
+// A single Si7021 RH conversion also measures temperature, so both channels
+// come from one job: start the conversion, read RH and the previous
+// temperature once it is done.
+static int32_t si7021_start(void *ctx) {
+    return si7021_start_measurement(TRIGGER_HUMD_MEASURE_NOHOLD) == SI7021_ERR_OK ? SI7021_RH_CONVERSION_MS : -1;
+}
+
+// T/RH snapshot the MQ readings are compensated for, invalid until the
+// first good Si7021 sample
+static gas_comp_point_t comp_point;
+
+static bool si7021_collect(void *ctx, gas_sample_t *sample) {
+    uint16_t raw_humidity = si7021_fetch_measurement();
+    float temperature_c = si7021_read_previous_temperature();
+    sample->temperature = (temperature_c * 9.0 / 5.0) + 32.0; // Converting from Celsius to Farenheit
+    sample->humidity = raw_humidity != 0 ? si7021_raw_to_humidity(raw_humidity) : -999;
+#if CONFIG_GAS_COMP
+    if (raw_humidity != 0 && temperature_c != -999) {
+        gas_comp_locate(&comp_point, temperature_c, sample->humidity);
+    }
+#endif
+    if (temperature_c != -999) {
+        anomaly_check(GAS_CH_TEMPERATURE, sample->temperature);
+    }
+    if (raw_humidity != 0) {
+        anomaly_check(GAS_CH_HUMIDITY, sample->humidity);
+    }
+    metric_inc(&samples_si7021);
+
+    // Log the temperature and humidity values to the terminal
+    TLOG(TLOG_SI7021_SAMPLE, sample->temperature, sample->humidity);
+    return true;
+}
+
+// The SCD41 measures on its own schedule; every poll is a data-ready check
+// of two short transactions, followed by the read when a measurement is in.
+// Steps in between go back to the scheduler so the other jobs get the bus.
+static int32_t scd41_start(void *ctx) {
+    switch (scd41_step()) {
+    case SCD41_STEP_AGAIN:
+        return ACQ_STEP(SCD41_COMMAND_MS);
+    case SCD41_STEP_FETCH:
+        return SCD41_COMMAND_MS;
+    case SCD41_STEP_NO_DATA:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static bool scd41_collect(void *ctx, gas_sample_t *sample) {
+    scd41_measurement_t measurement;
+    if (scd41_fetch(&measurement) != ESP_OK) {
+        return false; // No new measurement since the last poll
+    }
+    sample->co2 = measurement.co2_ppm;
+    anomaly_check(GAS_CH_CO2, sample->co2);
+    metric_inc(&samples_scd41);
+    TLOG(TLOG_SCD41_SAMPLE, measurement.co2_ppm, measurement.temperature_c, measurement.humidity);
+    return true;
+}
+
+// Each MQ sensor is its own ADC input, corrected for temperature and
+// humidity and conditioned by its own filter before the value is published
+typedef struct {
+    sensor_channel_t input;
+    gas_channel_t channel;
+    gas_comp_sensor_t comp;
+    gas_filter_config_t filter;
+} adc_job_t;
+
+// Kalman noise levels are per channel, in ppm^2
+#define ADC_FILTER(filter_kind, q, r) \
+    { .kind = (filter_kind), .window = CONFIG_GAS_FILTER_WINDOW, .ewma_shift = CONFIG_GAS_FILTER_EWMA_SHIFT, \
+      .kalman_q = (q), .kalman_r = (r) }
+
+static const adc_job_t adc_nh3 = { AIN1_AMMONIA, GAS_CH_AMMONIA, GAS_COMP_NH3, ADC_FILTER(CONFIG_GAS_FILTER_NH3_KIND, 1.0f, 25.0f) };
+static const adc_job_t adc_h2s = { AIN2_H2S, GAS_CH_H2S, GAS_COMP_H2S, ADC_FILTER(CONFIG_GAS_FILTER_H2S_KIND, 0.04f, 1.0f) };
+static const adc_job_t adc_co2 = { AIN3_CO2, GAS_CH_CO2, GAS_COMP_NONE, ADC_FILTER(CONFIG_GAS_FILTER_CO2_KIND, 4.0f, 400.0f) };
+static const adc_job_t adc_ch4 = { AIN4_METHANE, GAS_CH_METHANE, GAS_COMP_CH4, ADC_FILTER(CONFIG_GAS_FILTER_CH4_KIND, 1.0f, 100.0f) };
+
+static gas_filter_t adc_filters[GAS_CH_COUNT];
+
+static bool adc_collect(void *ctx, gas_sample_t *sample) {
+    const adc_job_t *adc = ctx;
+    float raw = adc_read_sensor(adc->input);
+    if (raw < 0) {
+        return false; // Front end has no output yet
+    }
+    if (adc->comp != GAS_COMP_NONE && comp_point.valid) {
+        raw = gas_fixed_to_float(gas_comp_apply(adc->comp, &comp_point, gas_fixed_from_float(raw)));
+    }
+    // Ahead of the filter, which would smooth away the spikes it looks for
+    anomaly_check(adc->channel, raw);
+    sample->values[adc->channel] = gas_filter_apply(&adc_filters[adc->channel], raw);
+    metric_inc(&samples_csv);
+    return true;
+}
+
+// History keeps its 5 s record cadence whatever the channel periods are
+static bool history_collect(void *ctx, gas_sample_t *sample) {
+    uint32_t now = node_time_now();
+    history_append(now, sample);
+#if CONFIG_GAS_QUANTILES
+    // Same cadence as the history, so the percentiles weigh time evenly
+    quantiles_add(now, sample);
+#endif
+    return false;
+}
+
+// Frame cadence of the link, whether or not the gateway is connected. With
+// CONFIG_GAS_ANOMALY_ONLY only the heartbeat comes from here, flagged
+// samples are pushed from acq_task as soon as they are published.
+static bool link_collect(void *ctx, gas_sample_t *sample) {
+#if CONFIG_GAS_ANOMALY_ONLY
+    if (uptime_ms() - link_last_push_ms < CONFIG_GAS_ANOMALY_HEARTBEAT_S * 1000) {
+        return false;
+    }
+#endif
+    link_push(sample);
+    return false;
+}
+
+// Phases spread the jobs over the first half second so their bus traffic
+// does not bunch up on the same tick
+static acq_job_t acq_jobs[] = {
+    { .name = "si7021", .period_ms = CONFIG_GAS_ACQ_SI7021_PERIOD_MS, .phase_ms = 0,
+      .channel_mask = ADAPTIVE_CHANNEL(GAS_CH_TEMPERATURE) | ADAPTIVE_CHANNEL(GAS_CH_HUMIDITY),
+      .start = si7021_start, .collect = si7021_collect },
+    { .name = "nh3", .period_ms = CONFIG_GAS_ACQ_MQ_PERIOD_MS, .phase_ms = 100,
+      .channel_mask = ADAPTIVE_CHANNEL(GAS_CH_AMMONIA), .collect = adc_collect, .ctx = (void *)&adc_nh3 },
+    { .name = "h2s", .period_ms = CONFIG_GAS_ACQ_MQ_PERIOD_MS, .phase_ms = 200,
+      .channel_mask = ADAPTIVE_CHANNEL(GAS_CH_H2S), .collect = adc_collect, .ctx = (void *)&adc_h2s },
+    { .name = "co2", .period_ms = CONFIG_GAS_ACQ_CO2_PERIOD_MS, .phase_ms = 300,
+      .channel_mask = ADAPTIVE_CHANNEL(GAS_CH_CO2), .collect = adc_collect, .ctx = (void *)&adc_co2 },
+    // Fixed poll period: the sensor sets the measurement cadence, not the signal
+    { .name = "scd41", .period_ms = CONFIG_GAS_SCD41_POLL_MS, .phase_ms = 300,
+      .start = scd41_start, .collect = scd41_collect },
+    { .name = "ch4", .period_ms = CONFIG_GAS_ACQ_MQ_PERIOD_MS, .phase_ms = 400,
+      .channel_mask = ADAPTIVE_CHANNEL(GAS_CH_METHANE), .collect = adc_collect, .ctx = (void *)&adc_ch4 },
+    { .name = "history", .period_ms = 5000, .phase_ms = 4500, .collect = history_collect },
+    { .name = "link", .period_ms = 5000, .phase_ms = 4000, .collect = link_collect },
+};
+
+#define ACQ_JOB_COUNT (sizeof(acq_jobs) / sizeof(acq_jobs[0]))
+
+// Period gauge per job, in acq_jobs order
+static metric_t *const acq_period_gauges[ACQ_JOB_COUNT] = {
+    &period_si7021, &period_nh3, &period_h2s, &period_co2, &period_co2, &period_ch4, NULL, NULL
+};
+
+// Jobs acq_task scheduled; the CO2 gauge follows whichever CO2 source runs
+static bool acq_active[ACQ_JOB_COUNT];
+
+#if CONFIG_GAS_ADAPTIVE_SAMPLING
+static adaptive_sched_t acq_adaptive[ACQ_JOB_COUNT];
+#endif
+
+static void collect_acq_metrics(void) {
+    uint32_t overruns = 0;
+    for (int i = 0; i < ACQ_JOB_COUNT; i++) {
+        if (acq_period_gauges[i] != NULL && acq_active[i]) {
+            metric_set(acq_period_gauges[i], acq_jobs[i].period_ms);
+        }
+        overruns += acq_jobs[i].overruns;
+    }
+    metric_set(&acq_overruns, overruns);
+
+    scd41_stats_t scd41_stats;
+    scd41_get_stats(&scd41_stats);
+    metric_set(&scd41_i2c_transactions, scd41_stats.transactions);
+    metric_set(&scd41_i2c_errors, scd41_stats.errors);
+    metric_set(&scd41_crc_failures, scd41_stats.crc_failures);
+    metric_set(&scd41_not_ready, scd41_stats.not_ready);
+}
+
+// One task runs every sensor, sleeping until the next job is due
+void acq_task(void *pvParameters) {
     // Initialize the Si7021 sensor with the I2C port and pins
     esp_err_t ret = si7021_init(I2C_NUM_0, GPIO_NUM_21, GPIO_NUM_22, GPIO_PULLUP_ENABLE, GPIO_PULLUP_ENABLE);
     if (ret != ESP_OK) {
         ESP_LOGE("SI7021", "Failed to initialize Si7021 sensor, error code: %d", ret);
-        vTaskDelete(NULL);
     }
-    // Infinite loop to keep reading and printing sensor data
-    while (1) {
-        // Read temperature and humidity using the library functions
-        float temperature_c = si7021_read_temperature();
-        temperature = (temperature_c * 9.0 / 5.0) + 32.0; // Converting from Celsius to Farenheit
-        float humidity = si7021_read_humidity();
 
-        // Log the temperature and humidity values to the terminal
-        ESP_LOGI("SI7021", "Temperature: %.2f°F, Humidity: %.2f%%", temperature, humidity);
+    // The SCD41 shares the port; without it CO2 comes from AIN3
+    esp_err_t scd41_ret = ESP_ERR_NOT_SUPPORTED;
+#if CONFIG_GAS_SCD41
+    const scd41_config_t scd41_config = {
+        .port = I2C_NUM_0,
+#if CONFIG_GAS_SCD41_LOW_POWER
+        .low_power = true,
+#endif
+        .altitude_m = CONFIG_GAS_SCD41_ALTITUDE_M,
+        .pressure_hpa = CONFIG_GAS_SCD41_PRESSURE_HPA,
+    };
+    uint64_t scd41_serial = 0;
+    scd41_ret = scd41_init(&scd41_config, &scd41_serial);
+    if (scd41_ret == ESP_OK) {
+        ESP_LOGI("SCD41", "SCD41 %012llx measuring, CO2 from the sensor", (unsigned long long)scd41_serial);
+    } else {
+        ESP_LOGW("SCD41", "No SCD41 (%s), CO2 from the analog input", esp_err_to_name(scd41_ret));
+    }
+#endif
 
-        // Wait for 5 seconds before the next reading
-        vTaskDelay(5000 / portTICK_PERIOD_MS);  // Adjust the delay time as needed
+#if CONFIG_GAS_COMP
+    gas_comp_init();
+    int comp_tables = 0;
+    esp_err_t comp_ret = gas_comp_load_nvs(&comp_tables);
+    if (comp_ret != ESP_OK) {
+        ESP_LOGW("GAS_COMP", "Could not read calibration tables from NVS: %s", esp_err_to_name(comp_ret));
     }
-}
+    ESP_LOGI("GAS_COMP", "%d of %d compensation tables calibrated, the rest from the datasheet curves",
+             comp_tables, GAS_COMP_SENSORS);
+#endif
 
-// Task for reading sensor data from csv file
-void csv_task(void *pvParameters) {
-    //Infinite loop to continuously read from the CSV file
-    while(1) {
-        read_sensor_data_csv();
+#if CONFIG_GAS_ANOMALY
+    anomaly_init();
+#endif
 
-        // Get latest sensor data
-        sensor_data_t data = get_current_data();
+    acq_sched_t acq;
+    acq_init(&acq);
+    uint32_t now_ms = uptime_ms();
+    for (int i = 0; i < ACQ_JOB_COUNT; i++) {
+        acq_job_t *job = &acq_jobs[i];
+        if (job->start == si7021_start && ret != ESP_OK) {
+            continue;
+        }
+        if ((job->start == scd41_start && scd41_ret != ESP_OK) || (job->ctx == &adc_co2 && scd41_ret == ESP_OK)) {
+            continue;
+        }
+        if (job->collect == adc_collect) {
+            const adc_job_t *adc = job->ctx;
+            gas_filter_init(&adc_filters[adc->channel], &adc->filter);
+        }
+#if CONFIG_GAS_ADAPTIVE_SAMPLING
+        if (job->channel_mask != 0) {
+            adaptive_config_t config = sampling_config;
+            config.start_period_ms = job->period_ms;
+            adaptive_init(&acq_adaptive[i], &config, job->channel_mask);
+            job->adaptive = &acq_adaptive[i];
+        }
+#endif
+        acq_active[i] = acq_add(&acq, job, now_ms);
+    }
 
-        // Update global variables with latest sensor readings
-        ammonia = data.ammonia;
-        h2s = data.h2s;
-        co2 = data.co2;
-        methane = data.methane;
-        //ESP_LOGI("Analog Sensors", "nh3: %.2f, h2s: %.2f, co2: %.2f, ch4: %.2f", ammonia, h2s, co2, methane);
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
+    while (1) {
+        int32_t wait_ms = acq_time_until_due(&acq, uptime_ms());
+        if (wait_ms != 0) {
+            // Round up so no job runs a tick early
+            vTaskDelay(wait_ms > 0 ? (wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS : portMAX_DELAY);
+            continue;
+        }
+        if (acq_run(&acq, uptime_ms(), &readings) == NULL) {
+            continue;
+        }
+#if CONFIG_GAS_TRACE_ENABLE
+        trace_stamps_t stamps;
+        TRACE_STAMP(&stamps, TRACE_ACQUIRE);
+#endif
+        publish_sample();
+#if CONFIG_GAS_ANOMALY_ONLY
+        // A flagged sample goes out now rather than at the next link run
+        if (anomaly_pending != 0) {
+            link_push(&readings);
+        }
+#endif
+#if CONFIG_GAS_TRACE_ENABLE
+        TRACE_STAMP(&stamps, TRACE_PUBLISH);
+        trace_publish(&stamps);
+#endif
     }
 }
 
@@ -215,22 +1290,75 @@ void app_main() {
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    tlog_init();
+#if CONFIG_GAS_FASTFMT_BENCHMARK
+    fastfmt_benchmark();
+#endif
+#if CONFIG_GAS_FILTER_BENCHMARK
+    gas_filter_benchmark();
+#endif
+#if CONFIG_GAS_BLOCK_KERNELS_BENCHMARK
+    block_kernels_benchmark();
+#endif
+#if CONFIG_GAS_COMP_BENCHMARK
+    gas_comp_benchmark();
+#endif
+#if CONFIG_GAS_ANOMALY_BENCHMARK
+    gas_anomaly_benchmark();
+#endif
+#if CONFIG_GAS_CALIB_BENCHMARK
+    gas_calib_benchmark();
+#endif
+#if CONFIG_GAS_SKETCH_BENCHMARK
+    gas_sketch_benchmark();
+#endif
 
     // Initialize LED GPIO
     esp_rom_gpio_pad_select_gpio(LED_GPIO);
     gpio_set_direction(LED_GPIO, GPIO_MODE_OUTPUT);
 
+    register_node_metrics();
     wifi_init_softap();
 
+    // MQ sensor R0 from the last clean-air calibration, before the first reading
+    gas_calib_init();
+    int calibrated = 0;
+    ret = gas_calib_load_nvs(&calibrated);
+    if (ret != ESP_OK) {
+        ESP_LOGW("GAS_CALIB", "Could not read R0 values from NVS: %s", esp_err_to_name(ret));
+    }
+    ESP_LOGI("GAS_CALIB", "%d of %d MQ sensors calibrated, the rest at their nominal R0", calibrated,
+             GAS_CALIB_SENSORS);
+
     // Initialize sensors
     adc_init();  // Initialize CSV file reading for simulated sensors
+    history_init();  // Needs the SPIFFS partition mounted by adc_init()
+#if CONFIG_GAS_QUANTILES
+    quantiles_init();
+#endif
+    http_api_start();   // Its handlers query the stores, so not before they exist
+
+    // Frames are numbered from the first acquisition on
+    link_init();
+#if CONFIG_GAS_UDP_PUBLISH
+    udp_publish_init();
+#endif
+#if CONFIG_GAS_MQTT
+    mqtt_source_t mqtt_source = { .boot = link_boot, .get = link_get, .range = link_range };
+    mqtt_publish_start(&mqtt_source);
+#endif
 
     // Start TCP server task
-    xTaskCreate(tcp_server_task, "tcp_server_task", 4096, (void *)AF_INET, 5, NULL);
+    GAS_TASK_CREATE(tcp_server_task, "tcp_server_task", 4096, (void *)AF_INET, 5, &tcp_server_handle);
+
+    // Oversampled analog channels, decimated for the acquisition jobs
+    GAS_TASK_CREATE(adc_task, "adc_task", 4096, NULL, 6, &adc_task_handle);
+
+    // One task for every sensor
+    GAS_TASK_CREATE(acq_task, "acq_task", 4096, NULL, 5, &acq_task_handle);
 
-    // Create separate tasks for reading sensors
-    xTaskCreate(sensor_task, "sensor_task", 4096, NULL, 5, NULL);
-    xTaskCreate(csv_task, "csv_task", 4096, NULL, 5, NULL);
+    static_alloc_report();
+    static_alloc_heap_guard_start();
 
     // Blink LED to indicate successful initialization
     for (int i = 0; i < 50; i++) {
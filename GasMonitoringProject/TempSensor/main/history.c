@@ -0,0 +1,76 @@
+#include "history.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "static_alloc.h"
+#include "node_time.h"
+
+static const char *TAG = "HISTORY";
+
+static gas_history_t history;
+static gas_history_hdr_t block_index[HISTORY_BLOCKS];  // sparse time index, one entry per block
+static SemaphoreHandle_t history_lock = NULL;           // index, file and the block being filled
+static SemaphoreHandle_t query_lock = NULL;             // one query at a time, they share a scratch block
+
+static void history_take(void *ctx) {
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+}
+
+static void history_give(void *ctx) {
+    xSemaphoreGive(history_lock);
+}
+
+// Before the HTTP API and the TCP server can query it, and before the first
+// node_time_now(): the node's clock resumes after the newest record here
+esp_err_t history_init(void) {
+    GAS_MUTEX_CREATE(history_lock);
+    GAS_MUTEX_CREATE(query_lock);
+
+    bool opened = gas_history_open(&history, HISTORY_PATH, block_index, HISTORY_BLOCKS);
+    history.lock = history_take;
+    history.unlock = history_give;
+    node_time_resume(gas_history_newest(&history));
+    if (!opened) {
+        ESP_LOGE(TAG, "Failed to open %s, history kept in RAM only", HISTORY_PATH);
+        return ESP_FAIL;
+    }
+
+    uint32_t blocks = history.next_seq - 1;
+    ESP_LOGI(TAG, "History ready, %u blocks on flash, newest record at %u s",
+             (unsigned)(blocks < HISTORY_BLOCKS ? blocks : HISTORY_BLOCKS), (unsigned)gas_history_newest(&history));
+    return ESP_OK;
+}
+
+void history_append(uint32_t timestamp, const gas_sample_t *sample) {
+    if (!gas_history_append(&history, timestamp, sample)) {
+        ESP_LOGE(TAG, "Failed to write history block");
+    }
+}
+
+esp_err_t history_query(gas_channel_t channel, uint32_t from, uint32_t to, int max_points,
+                        history_emit_t emit, void *ctx) {
+    xSemaphoreTake(query_lock, portMAX_DELAY);
+    int touched = gas_history_query(&history, channel, from, to, max_points, emit, ctx);
+    xSemaphoreGive(query_lock);
+
+    if (touched < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGD(TAG, "Query ch %d [%u, %u] read %d blocks", channel, (unsigned)from, (unsigned)to, touched);
+    return ESP_OK;
+}
+
+// history_query() a slice at a time, for callers that must not be held up
+// for the whole of a long one. False from history_cursor_init() when no
+// record falls in the range, from history_cursor_next() once it is done.
+bool history_cursor_init(history_cursor_t *cursor, gas_channel_t channel, uint32_t from, uint32_t to,
+                         int max_points) {
+    return gas_history_cursor_init(&history, cursor, channel, from, to, max_points);
+}
+
+bool history_cursor_next(history_cursor_t *cursor, uint32_t slice_s, history_emit_t emit, void *ctx) {
+    xSemaphoreTake(query_lock, portMAX_DELAY);
+    bool more = gas_history_cursor_next(&history, cursor, slice_s, emit, ctx);
+    xSemaphoreGive(query_lock);
+    return more;
+}
@@ -0,0 +1,31 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "gas_channels.h"
+#include "gas_history.h"
+
+// On-flash sample history, a gas_history store on the storage partition.
+// Samples are appended into fixed-size blocks that are written to a
+// circular file; a small RAM index keeps the time span of each block so a
+// range query only reads the blocks that overlap it. Timestamps are
+// node_time_now() seconds, which carry on across reboots.
+#define HISTORY_PATH              "/storage/history.bin"
+#define HISTORY_BLOCKS            128
+#define HISTORY_RECORDS_PER_BLOCK GAS_HISTORY_RECORDS_PER_BLOCK   // 128 * 64 samples = ~11 hours at 5 s
+
+typedef gas_history_emit_t history_emit_t;
+typedef gas_history_cursor_t history_cursor_t;
+
+// Function prototypes
+esp_err_t history_init(void);
+void history_append(uint32_t timestamp, const gas_sample_t *sample);
+esp_err_t history_query(gas_channel_t channel, uint32_t from, uint32_t to, int max_points,
+                        history_emit_t emit, void *ctx);
+bool history_cursor_init(history_cursor_t *cursor, gas_channel_t channel, uint32_t from, uint32_t to,
+                         int max_points);
+bool history_cursor_next(history_cursor_t *cursor, uint32_t slice_s, history_emit_t emit, void *ctx);
+
+#endif
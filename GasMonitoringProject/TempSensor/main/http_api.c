@@ -0,0 +1,464 @@
+#include "http_api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+#include "lwip/sockets.h"
+#include "history.h"
+#include "quantiles.h"
+#include "metrics.h"
+#include "static_alloc.h"
+#include "fastfmt.h"
+#include "gas_channels.h"
+#include "ADC.h"
+
+static const char *TAG = "HTTP_API";
+
+static const char stream_headers[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+// Collects history points into chunks of the HTTP response
+typedef struct {
+    httpd_req_t *req;
+    char buf[512];
+    int len;
+} history_writer_t;
+
+static httpd_handle_t server = NULL;
+static SemaphoreHandle_t snapshot_lock = NULL;
+
+// Cached responses, rebuilt only when a published sample differs from the last
+// one. All of it, and stream_count, under snapshot_lock.
+static gas_sample_t last_sample;
+static bool have_sample = false;
+static uint32_t snapshot_version = 0;
+static char snapshot_json[HTTP_API_JSON_LEN] = "{}";
+static int snapshot_json_len = 2;
+static char snapshot_etag[16] = "\"0\"";
+static char stream_event[HTTP_API_JSON_LEN + 32];
+static int stream_event_len = 0;
+
+// Sockets subscribed to /stream. Only touched from the httpd task; the count
+// is also read by http_api_publish().
+static int stream_fds[HTTP_API_MAX_STREAMS];
+static int stream_count = 0;
+
+static void stream_remove(int fd) {
+    for (int i = 0; i < HTTP_API_MAX_STREAMS; i++) {
+        if (stream_fds[i] == fd) {
+            stream_fds[i] = -1;
+            xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+            stream_count--;
+            xSemaphoreGive(snapshot_lock);
+        }
+    }
+}
+
+// Subscribers never send anything after their request, so to the LRU purge
+// they would look like the most idle sessions, and the next connection over
+// max_open_sockets would close a live stream. Marking them used whenever
+// another request is served keeps the purge on idle request/response
+// connections: a session that has not sent a request since is older.
+static void stream_keep(void) {
+    for (int i = 0; i < HTTP_API_MAX_STREAMS; i++) {
+        if (stream_fds[i] >= 0) {
+            httpd_sess_update_lru_counter(server, stream_fds[i]);
+        }
+    }
+}
+
+// Runs in the httpd task, sends the current event once per subscriber
+static void stream_push(void *arg) {
+    char event[sizeof(stream_event)];
+    int len;
+
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    len = stream_event_len;
+    memcpy(event, stream_event, len);
+    xSemaphoreGive(snapshot_lock);
+
+    for (int i = 0; i < HTTP_API_MAX_STREAMS; i++) {
+        int fd = stream_fds[i];
+        if (fd < 0) {
+            continue;
+        }
+        if (httpd_socket_send(server, fd, event, len, 0) < 0) {
+            ESP_LOGW(TAG, "Dropping stream subscriber %d", fd);
+            stream_remove(fd);
+            httpd_sess_trigger_close(server, fd);
+        } else {
+            httpd_sess_update_lru_counter(server, fd);
+        }
+    }
+}
+
+static void on_close(httpd_handle_t hd, int sockfd) {
+    stream_remove(sockfd);
+    close(sockfd);
+}
+
+static esp_err_t get_sensor_data_handler(httpd_req_t *req) {
+    char body[HTTP_API_JSON_LEN];
+    char etag[sizeof(snapshot_etag)];
+    char if_none_match[sizeof(snapshot_etag)];
+    int len;
+
+    stream_keep();
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    len = snapshot_json_len;
+    memcpy(body, snapshot_json, len);
+    memcpy(etag, snapshot_etag, sizeof(etag));
+    xSemaphoreGive(snapshot_lock);
+
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "ETag", etag);
+
+    // Client already has this snapshot
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strcmp(if_none_match, etag) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, body, len);
+}
+
+static esp_err_t get_stream_handler(httpd_req_t *req) {
+    int fd = httpd_req_to_sockfd(req);
+    int slot = -1;
+    stream_keep();
+    for (int i = 0; i < HTTP_API_MAX_STREAMS; i++) {
+        if (stream_fds[i] < 0) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Too many streams", HTTPD_RESP_USE_STRLEN);
+    }
+
+    // The response stays open; events are written straight to the socket by stream_push()
+    if (httpd_send(req, stream_headers, sizeof(stream_headers) - 1) < 0) {
+        return ESP_FAIL;
+    }
+    stream_fds[slot] = fd;
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    int count = ++stream_count;
+    bool sample = have_sample;
+    xSemaphoreGive(snapshot_lock);
+    ESP_LOGI(TAG, "Stream subscriber %d added (%d active)", fd, count);
+
+    if (sample) {
+        stream_push(NULL);
+    }
+    return ESP_OK;
+}
+
+static bool history_write_point(uint32_t timestamp, float value, void *ctx) {
+    history_writer_t *writer = (history_writer_t *)ctx;
+    if (writer->len > (int)sizeof(writer->buf) - 32) {
+        if (httpd_resp_send_chunk(writer->req, writer->buf, writer->len) != ESP_OK) {
+            return false; // client went away
+        }
+        writer->len = 0;
+    }
+    fastfmt_t f;
+    fastfmt_begin(&f, writer->buf + writer->len, sizeof(writer->buf) - writer->len);
+    fastfmt_u32(&f, timestamp);
+    fastfmt_char(&f, ',');
+    fastfmt_fixed2(&f, value);
+    fastfmt_char(&f, '\n');
+    writer->len += fastfmt_end(&f);
+    return true;
+}
+
+// GET /history?ch=<name>&from=<t1>&to=<t2>[&points=<n>], answered as chunked CSV
+static esp_err_t get_history_handler(httpd_req_t *req) {
+    char query[96];
+    char value[16];
+    int channel;
+    uint32_t from = 0, to = UINT32_MAX;
+    int points = 0;
+
+    stream_keep();
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "ch", value, sizeof(value)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch is required");
+    }
+    channel = gas_channel_find(value);
+    if (channel < 0) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown channel");
+    }
+    if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK) {
+        from = strtoul(value, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK) {
+        to = strtoul(value, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "points", value, sizeof(value)) == ESP_OK) {
+        points = atoi(value);
+    }
+    if (from > to) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "from is after to");
+    }
+
+    static history_writer_t writer; // served one request at a time from the httpd task
+    writer.req = req;
+    writer.len = 0;
+
+    httpd_resp_set_type(req, "text/csv");
+    history_query((gas_channel_t)channel, from, to, points, history_write_point, &writer);
+    if (writer.len > 0) {
+        httpd_resp_send_chunk(req, writer.buf, writer.len);
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// ch, from and to of a /percentiles or /sketch query into the merged
+// sketch; sends the error response itself and returns false on failure
+static bool sketch_query(httpd_req_t *req, const char *query, gas_sketch_t *sketch, int *windows) {
+    char value[16];
+    uint32_t from = 0, to = UINT32_MAX;
+
+    if (httpd_query_key_value(query, "ch", value, sizeof(value)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch is required");
+        return false;
+    }
+    int channel = gas_channel_find(value);
+    if (channel < 0) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Unknown channel");
+        return false;
+    }
+    if (httpd_query_key_value(query, "from", value, sizeof(value)) == ESP_OK) {
+        from = strtoul(value, NULL, 10);
+    }
+    if (httpd_query_key_value(query, "to", value, sizeof(value)) == ESP_OK) {
+        to = strtoul(value, NULL, 10);
+    }
+    if (from > to) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "from is after to");
+        return false;
+    }
+    esp_err_t ret = quantiles_query((gas_channel_t)channel, from, to, sketch, windows);
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Percentiles are disabled");
+        return false;
+    }
+    if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No percentiles for this channel");
+        return false;
+    }
+    return true;
+}
+
+// GET /percentiles?ch=<name>[&from=<t1>][&to=<t2>][&q=50,95,99], answered as
+// {"samples":n,"windows":w,"relative_accuracy":a,"p50":v,...}. A percentile
+// below the range the sketch kept reads null.
+static esp_err_t get_percentiles_handler(httpd_req_t *req) {
+    char query[128];
+    char q_list[48] = "50,95,99";
+    static gas_sketch_t sketch;     // served one request at a time from the httpd task
+    int windows;
+
+    stream_keep();
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch is required");
+    }
+    if (!sketch_query(req, query, &sketch, &windows)) {
+        return ESP_OK;
+    }
+    httpd_query_key_value(query, "q", q_list, sizeof(q_list));
+
+    char body[384];
+    int len = snprintf(body, sizeof(body), "{\"samples\":%u,\"windows\":%d,\"relative_accuracy\":%.4f",
+                       (unsigned)sketch.count, windows, GAS_SKETCH_ACCURACY);
+    for (char *p = q_list, *end; *p != '\0' && len < (int)sizeof(body) - 40; p = *end == ',' ? end + 1 : end) {
+        float percent = strtof(p, &end);
+        if (end == p || percent < 0 || percent > 100) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "q takes percents, comma-separated");
+        }
+        float q = percent / 100;
+        if (sketch.count > 0 && gas_sketch_reliable(&sketch, q)) {
+            len += snprintf(body + len, sizeof(body) - len, ",\"p%g\":%.3f", percent, gas_sketch_quantile(&sketch, q));
+        } else {
+            len += snprintf(body + len, sizeof(body) - len, ",\"p%g\":null", percent);
+        }
+    }
+    len += snprintf(body + len, sizeof(body) - len, "}");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, body, len);
+}
+
+// GET /sketch?ch=<name>[&from=<t1>][&to=<t2>], the merged sketch in the
+// gas_sketch_serialize() format for merging with other nodes on the host
+static esp_err_t get_sketch_handler(httpd_req_t *req) {
+    char query[96];
+    static gas_sketch_t sketch;
+    static uint8_t body[GAS_SKETCH_SERIALIZED_MAX];
+    int windows;
+
+    stream_keep();
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch is required");
+    }
+    if (!sketch_query(req, query, &sketch, &windows)) {
+        return ESP_OK;
+    }
+    size_t len = gas_sketch_serialize(&sketch, body, sizeof(body));
+    httpd_resp_set_type(req, "application/octet-stream");
+    return httpd_resp_send(req, (const char *)body, len);
+}
+
+// POST /calibrate?ch=<name>, with the sensor in clean air after its warm-up:
+// stores the R0 of that MQ channel, see adc_calibrate_clean_air()
+static esp_err_t post_calibrate_handler(httpd_req_t *req) {
+    char query[32];
+    char value[16];
+    sensor_channel_t input;
+
+    stream_keep();
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+        httpd_query_key_value(query, "ch", value, sizeof(value)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "ch is required");
+    }
+    switch (gas_channel_find(value)) {
+    case GAS_CH_AMMONIA:
+        input = AIN1_AMMONIA;
+        break;
+    case GAS_CH_H2S:
+        input = AIN2_H2S;
+        break;
+    case GAS_CH_METHANE:
+        input = AIN4_METHANE;
+        break;
+    default:
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Not an MQ channel");
+    }
+
+    uint32_t r0_ohms;
+    esp_err_t ret = adc_calibrate_clean_air(input, &r0_ohms);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Calibration of %s failed (%s)", value, esp_err_to_name(ret));
+        return httpd_resp_send_err(req, ret == ESP_ERR_INVALID_ARG || ret == ESP_ERR_INVALID_STATE ?
+                                   HTTPD_400_BAD_REQUEST : HTTPD_500_INTERNAL_SERVER_ERROR,
+                                   "Calibration failed");
+    }
+    char body[48];
+    int len = snprintf(body, sizeof(body), "{\"r0_ohms\":%u}", (unsigned)r0_ohms);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, body, len);
+}
+
+static esp_err_t get_metrics_handler(httpd_req_t *req) {
+    stream_keep();
+    return metrics_http_handler(req);
+}
+
+void http_api_publish(const gas_sample_t *sample) {
+    xSemaphoreTake(snapshot_lock, portMAX_DELAY);
+    if (have_sample && memcmp(&last_sample, sample, sizeof(last_sample)) == 0) {
+        xSemaphoreGive(snapshot_lock);
+        return;
+    }
+    last_sample = *sample;
+    have_sample = true;
+    snapshot_version++;
+
+    snapshot_json_len = gas_json_format(sample, snapshot_json, sizeof(snapshot_json));
+    snprintf(snapshot_etag, sizeof(snapshot_etag), "\"%u\"", (unsigned)snapshot_version);
+    stream_event_len = snprintf(stream_event, sizeof(stream_event), "id: %u\ndata: %s\n\n",
+             (unsigned)snapshot_version, snapshot_json);
+    bool push = stream_count > 0;
+    xSemaphoreGive(snapshot_lock);
+
+    if (server != NULL && push) {
+        httpd_queue_work(server, stream_push, NULL);
+    }
+}
+
+void http_api_start(void) {
+    for (int i = 0; i < HTTP_API_MAX_STREAMS; i++) {
+        stream_fds[i] = -1;
+    }
+    GAS_MUTEX_CREATE(snapshot_lock);
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = HTTP_API_PORT;
+    config.max_open_sockets = HTTP_API_MAX_SOCKETS;
+    config.lru_purge_enable = true;     // drop the oldest idle connection instead of refusing new ones, see stream_keep()
+    config.keep_alive_enable = true;    // TCP keep-alive so dead stream subscribers get reaped
+    config.close_fn = on_close;
+
+    if (httpd_start(&server, &config) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start HTTP server");
+        server = NULL;
+        return;
+    }
+
+    httpd_uri_t sensor_data_uri = {
+        .uri       = "/sensor",
+        .method    = HTTP_GET,
+        .handler   = get_sensor_data_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &sensor_data_uri);
+
+    httpd_uri_t stream_uri = {
+        .uri       = "/stream",
+        .method    = HTTP_GET,
+        .handler   = get_stream_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &stream_uri);
+
+    httpd_uri_t history_uri = {
+        .uri       = "/history",
+        .method    = HTTP_GET,
+        .handler   = get_history_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &history_uri);
+
+    httpd_uri_t metrics_uri = {
+        .uri       = "/metrics",
+        .method    = HTTP_GET,
+        .handler   = get_metrics_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &metrics_uri);
+
+    httpd_uri_t calibrate_uri = {
+        .uri       = "/calibrate",
+        .method    = HTTP_POST,
+        .handler   = post_calibrate_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &calibrate_uri);
+
+    httpd_uri_t percentiles_uri = {
+        .uri       = "/percentiles",
+        .method    = HTTP_GET,
+        .handler   = get_percentiles_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &percentiles_uri);
+
+    httpd_uri_t sketch_uri = {
+        .uri       = "/sketch",
+        .method    = HTTP_GET,
+        .handler   = get_sketch_handler,
+        .user_ctx  = NULL
+    };
+    httpd_register_uri_handler(server, &sketch_uri);
+
+    ESP_LOGI(TAG, "HTTP API listening on port %d", HTTP_API_PORT);
+}
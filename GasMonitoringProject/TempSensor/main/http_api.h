@@ -0,0 +1,15 @@
+#ifndef HTTP_API_H
+#define HTTP_API_H
+
+#include "gas_channels.h"
+
+#define HTTP_API_PORT         80
+#define HTTP_API_MAX_SOCKETS  5   // has to stay <= CONFIG_LWIP_MAX_SOCKETS - 3
+#define HTTP_API_MAX_STREAMS  3   // concurrent /stream subscribers
+#define HTTP_API_JSON_LEN     192
+
+// Function prototypes
+void http_api_start(void);
+void http_api_publish(const gas_sample_t *sample);
+
+#endif
@@ -0,0 +1,200 @@
+#include "mqtt_publish.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "gas_mqtt_session.h"
+#include "metrics.h"
+#include "static_alloc.h"
+
+#if CONFIG_GAS_MQTT
+
+static const char *TAG = "MQTT_PUBLISH";
+
+#define MQTT_SPOOL_PATH     "/storage/mqtt_spool.bin"
+#define MQTT_POLL_MS        100         // longest wait for broker packets between looks at the ring
+#define MQTT_IO_TIMEOUT_S   5           // connect and each send
+
+static METRIC_DEFINE_COUNTER(mqtt_messages, "node_mqtt_messages_total", NULL, "PUBLISH packets sent, spooled batches included");
+static METRIC_DEFINE_COUNTER(mqtt_bytes, "node_mqtt_bytes_total", NULL, "PUBLISH bytes sent, MQTT headers included");
+static METRIC_DEFINE_COUNTER(mqtt_acks, "node_mqtt_acks_total", NULL, "PUBACKs received for messages in flight");
+static METRIC_DEFINE_COUNTER(mqtt_frames, "node_mqtt_frames_total", NULL, "Frames put in a batch");
+static METRIC_DEFINE_COUNTER(mqtt_frames_lost, "node_mqtt_frames_lost_total", NULL, "Frames overwritten in the ring before they were batched");
+static METRIC_DEFINE_COUNTER(mqtt_spooled, "node_mqtt_spooled_total", NULL, "Batches written to the spool file");
+static METRIC_DEFINE_COUNTER(mqtt_spool_dropped, "node_mqtt_spool_dropped_total", NULL, "Spooled batches overwritten or unreadable before they were sent");
+static METRIC_DEFINE_COUNTER(mqtt_connects, "node_mqtt_connects_total", NULL, "Sessions the broker accepted");
+static METRIC_DEFINE_COUNTER(mqtt_disconnects, "node_mqtt_disconnects_total", NULL, "Sessions lost or refused");
+static METRIC_DEFINE_GAUGE(mqtt_connected, "node_mqtt_connected", NULL, "1 while a broker session is up");
+static METRIC_DEFINE_GAUGE(mqtt_inflight, "node_mqtt_inflight", NULL, "Messages waiting for their PUBACK");
+static METRIC_DEFINE_GAUGE(mqtt_spool_depth, "node_mqtt_spool_depth", NULL, "Batches in the spool file");
+
+static mqtt_source_t mqtt_source;
+static TaskHandle_t mqtt_task_handle = NULL;
+static gas_mqtt_session_t mqtt_session;
+static gas_spool_t mqtt_spool;
+static int mqtt_sock = -1;
+
+static uint32_t mqtt_now_ms(void *ctx) {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+static bool mqtt_get(uint32_t seq, gas_link_record_t *record, void *ctx) {
+    return mqtt_source.get(seq, record);
+}
+
+static void mqtt_range(uint32_t *oldest, uint32_t *newest, void *ctx) {
+    mqtt_source.range(oldest, newest);
+}
+
+static bool mqtt_connect(void *ctx) {
+    struct sockaddr_in dest = { .sin_family = AF_INET, .sin_port = htons(CONFIG_GAS_MQTT_BROKER_PORT) };
+    if (inet_pton(AF_INET, CONFIG_GAS_MQTT_BROKER_IP, &dest.sin_addr) != 1) {
+        ESP_LOGE(TAG, "Bad broker address %s", CONFIG_GAS_MQTT_BROKER_IP);
+        return false;
+    }
+    mqtt_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (mqtt_sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return false;
+    }
+    struct timeval timeout = { .tv_sec = MQTT_IO_TIMEOUT_S };
+    setsockopt(mqtt_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(mqtt_sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int nodelay = 1;    // each PUBLISH is one send, the window keeps the pipe full
+    setsockopt(mqtt_sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if (connect(mqtt_sock, (struct sockaddr *)&dest, sizeof(dest)) != 0) {
+        ESP_LOGD(TAG, "Broker %s:%d unreachable: errno %d", CONFIG_GAS_MQTT_BROKER_IP, CONFIG_GAS_MQTT_BROKER_PORT, errno);
+        close(mqtt_sock);
+        mqtt_sock = -1;
+        return false;
+    }
+    return true;
+}
+
+static int mqtt_send(const uint8_t *data, size_t len, void *ctx) {
+    int sent = send(mqtt_sock, data, len, 0);
+    if (sent <= 0) {
+        ESP_LOGW(TAG, "send failed: errno %d", errno);
+    }
+    return sent;
+}
+
+static int mqtt_recv(uint8_t *buf, size_t size, void *ctx) {
+    int len = recv(mqtt_sock, buf, size, MSG_DONTWAIT);
+    if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    return len > 0 ? len : -1;
+}
+
+static void mqtt_close(void *ctx) {
+    shutdown(mqtt_sock, 0);
+    close(mqtt_sock);
+    mqtt_sock = -1;
+}
+
+// The session keeps totals, the metrics follow them
+static void mqtt_update_metrics(void) {
+    metric_set(&mqtt_messages, mqtt_session.messages);
+    metric_set(&mqtt_bytes, mqtt_session.bytes);
+    metric_set(&mqtt_acks, mqtt_session.acks);
+    metric_set(&mqtt_frames, mqtt_session.frames);
+    metric_set(&mqtt_frames_lost, mqtt_session.frames_lost);
+    metric_set(&mqtt_spooled, mqtt_session.spooled);
+    metric_set(&mqtt_spool_dropped, mqtt_session.spool_dropped);
+    metric_set(&mqtt_connects, mqtt_session.connects);
+    metric_set(&mqtt_disconnects, mqtt_session.disconnects);
+    metric_set(&mqtt_connected, mqtt_session.state == GAS_MQTT_UP);
+    metric_set(&mqtt_inflight, mqtt_session.window.count);
+    metric_set(&mqtt_spool_depth, gas_mqtt_session_spooled(&mqtt_session));
+}
+
+static void mqtt_task(void *pvParameters) {
+    while (1) {
+        uint32_t connects = mqtt_session.connects;
+        uint32_t disconnects = mqtt_session.disconnects;
+        gas_mqtt_session_step(&mqtt_session);
+        if (mqtt_session.state != GAS_MQTT_DOWN) {
+            fd_set readfds;
+            FD_ZERO(&readfds);
+            FD_SET(mqtt_sock, &readfds);
+            struct timeval timeout = { .tv_sec = 0, .tv_usec = MQTT_POLL_MS * 1000 };
+            if (select(mqtt_sock + 1, &readfds, NULL, NULL, &timeout) > 0) {
+                gas_mqtt_session_receive(&mqtt_session);
+            }
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(MQTT_POLL_MS));
+        }
+
+        if (mqtt_session.disconnects != disconnects) {
+            ESP_LOGW(TAG, "Broker session lost: %s", mqtt_session.reason);
+        }
+        if (mqtt_session.connects != connects) {
+            ESP_LOGI(TAG, "Connected to %s:%d, %u batches spooled", CONFIG_GAS_MQTT_BROKER_IP,
+                     CONFIG_GAS_MQTT_BROKER_PORT, (unsigned)gas_mqtt_session_spooled(&mqtt_session));
+        }
+        mqtt_update_metrics();
+    }
+}
+
+esp_err_t mqtt_publish_start(const mqtt_source_t *source) {
+    metrics_register(&mqtt_messages);
+    metrics_register(&mqtt_bytes);
+    metrics_register(&mqtt_acks);
+    metrics_register(&mqtt_frames);
+    metrics_register(&mqtt_frames_lost);
+    metrics_register(&mqtt_spooled);
+    metrics_register(&mqtt_spool_dropped);
+    metrics_register(&mqtt_connects);
+    metrics_register(&mqtt_disconnects);
+    metrics_register(&mqtt_connected);
+    metrics_register(&mqtt_inflight);
+    metrics_register(&mqtt_spool_depth);
+
+    mqtt_source = *source;
+    bool spool_ok = gas_spool_open(&mqtt_spool, MQTT_SPOOL_PATH, CONFIG_GAS_MQTT_SPOOL_SLOTS, GAS_MQTT_PAYLOAD_MAX);
+    if (!spool_ok) {
+        ESP_LOGW(TAG, "No spool file, frames wait in the ring while the broker is away");
+    } else if (gas_spool_count(&mqtt_spool) > 0) {
+        ESP_LOGI(TAG, "%u batches spooled before the restart", (unsigned)gas_spool_count(&mqtt_spool));
+    }
+    gas_mqtt_config_t config = {
+        .client_id = CONFIG_GAS_MQTT_CLIENT_ID,
+        .topic = CONFIG_GAS_MQTT_TOPIC,
+        .keepalive_s = CONFIG_GAS_MQTT_KEEPALIVE_S,
+        .boot = source->boot,
+        .batch = CONFIG_GAS_MQTT_BATCH_SAMPLES,
+        .batch_ms = CONFIG_GAS_MQTT_BATCH_MS,
+        .window = CONFIG_GAS_MQTT_WINDOW,
+    };
+    gas_mqtt_hooks_t hooks = {
+        .get = mqtt_get,
+        .range = mqtt_range,
+        .connect = mqtt_connect,
+        .send = mqtt_send,
+        .recv = mqtt_recv,
+        .close = mqtt_close,
+        .now_ms = mqtt_now_ms,
+    };
+    if (!gas_mqtt_session_init(&mqtt_session, &config, &hooks, spool_ok ? &mqtt_spool : NULL)) {
+        ESP_LOGE(TAG, "Topic longer than %d bytes", GAS_MQTT_TOPIC_MAX);
+        if (spool_ok) {
+            gas_spool_close(&mqtt_spool);
+        }
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    GAS_TASK_CREATE(mqtt_task, "mqtt_task", 4096, NULL, 4, &mqtt_task_handle);
+    return mqtt_task_handle != NULL ? ESP_OK : ESP_FAIL;
+}
+
+#else
+
+esp_err_t mqtt_publish_start(const mqtt_source_t *source) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
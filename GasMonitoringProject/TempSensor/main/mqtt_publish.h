@@ -0,0 +1,25 @@
+#ifndef MQTT_PUBLISH_H
+#define MQTT_PUBLISH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "gas_link.h"
+
+// Publishes the link frames in batches to the MQTT broker at
+// CONFIG_GAS_MQTT_BROKER_IP, QoS 1 with a window of PUBACKs outstanding.
+// While the broker cannot be reached the batches go to a spool file on the
+// storage partition, sent first once it is back. Payload format in
+// gas_mqtt.h.
+
+// Where the frames come from: the node's retransmit ring
+typedef struct {
+    uint16_t boot;
+    bool (*get)(uint32_t seq, gas_link_record_t *record);   // false once the ring no longer holds it
+    void (*range)(uint32_t *oldest, uint32_t *newest);      // newest is 0 before the first frame
+} mqtt_source_t;
+
+// Function prototypes
+esp_err_t mqtt_publish_start(const mqtt_source_t *source);
+
+#endif
@@ -0,0 +1,15 @@
+#include "node_time.h"
+#include "esp_timer.h"
+
+static uint32_t node_time_base;     // node time at boot
+
+// Called by every store before the first node_time_now(), 0 for an empty one
+void node_time_resume(uint32_t newest) {
+    if (newest != 0 && newest >= node_time_base) {
+        node_time_base = newest + 1;
+    }
+}
+
+uint32_t node_time_now(void) {
+    return node_time_base + (uint32_t)(esp_timer_get_time() / 1000000);
+}
@@ -0,0 +1,18 @@
+#ifndef NODE_TIME_H
+#define NODE_TIME_H
+
+#include <stdint.h>
+
+// Seconds on a timeline that carries on across reboots, the time the
+// history and percentile stores on flash are keyed by. The node has no wall
+// clock (no SNTP, and TSYNC only measures the offset on the gateway), so
+// time() starts again at 0 with every boot while the stores keep what
+// earlier boots wrote. Each store passes the newest time it holds at init
+// and the clock resumes one second after the latest of them, then counts
+// uptime. On a node that has never written a store it reads as uptime.
+
+// Function prototypes
+void node_time_resume(uint32_t newest);
+uint32_t node_time_now(void);
+
+#endif
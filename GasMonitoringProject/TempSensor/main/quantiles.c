@@ -0,0 +1,189 @@
+#include "quantiles.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "static_alloc.h"
+#include "node_time.h"
+
+#if CONFIG_GAS_QUANTILES
+
+static const char *TAG = "QUANTILES";
+
+#define QUANTILES_MAGIC    0x32534b51   // "QKS2", also changes with the sketch layout or the clock
+#define QUANTILES_WINDOW_S (CONFIG_GAS_QUANTILES_WINDOW_MIN * 60)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // 0 means the slot was never written
+    uint32_t start_ts;      // window start, node_time_now() seconds
+    uint32_t last_ts;       // last sample in the window
+    uint16_t octave_log2;   // GAS_SKETCH_OCTAVE_LOG2 and GAS_SKETCH_BUCKETS the
+    uint16_t buckets;       // sketches were written with
+} quantiles_window_hdr_t;
+
+typedef struct {
+    quantiles_window_hdr_t hdr;
+    gas_sketch_t sketches[QUANTILES_CHANNELS];
+} quantiles_window_t;
+
+static FILE *quantiles_file = NULL;
+static SemaphoreHandle_t quantiles_lock = NULL;
+
+static quantiles_window_hdr_t window_index[CONFIG_GAS_QUANTILES_WINDOWS];
+static int head_slot = 0;                   // slot the open window goes to when it closes
+static uint32_t next_seq = 1;
+static quantiles_window_t open_window;      // window currently being filled
+static gas_sketch_t query_sketch;           // scratch copy used by quantiles_query()
+
+static void open_window_reset(uint32_t start_ts) {
+    open_window.hdr.start_ts = start_ts;
+    open_window.hdr.last_ts = start_ts;
+    for (int i = 0; i < QUANTILES_CHANNELS; i++) {
+        gas_sketch_init(&open_window.sketches[i]);
+    }
+}
+
+static void open_window_close(void) {
+    quantiles_window_hdr_t *hdr = &open_window.hdr;
+    hdr->magic = QUANTILES_MAGIC;
+    hdr->seq = next_seq++;
+    hdr->octave_log2 = GAS_SKETCH_OCTAVE_LOG2;
+    hdr->buckets = GAS_SKETCH_BUCKETS;
+    if (quantiles_file != NULL) {
+        if (fseek(quantiles_file, (long)head_slot * sizeof(quantiles_window_t), SEEK_SET) != 0 ||
+            fwrite(&open_window, sizeof(open_window), 1, quantiles_file) != 1) {
+            ESP_LOGE(TAG, "Failed to write window %d", head_slot);
+        }
+        fflush(quantiles_file);
+    }
+    window_index[head_slot] = *hdr;
+    head_slot = (head_slot + 1) % CONFIG_GAS_QUANTILES_WINDOWS;
+}
+
+esp_err_t quantiles_init(void) {
+    GAS_MUTEX_CREATE(quantiles_lock);
+    memset(window_index, 0, sizeof(window_index));
+    memset(&open_window, 0, sizeof(open_window));
+    open_window_reset(0);
+
+    quantiles_file = fopen(QUANTILES_PATH, "r+b");
+    if (quantiles_file == NULL) {
+        quantiles_file = fopen(QUANTILES_PATH, "w+b");
+    }
+    if (quantiles_file == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s, percentiles kept in RAM only", QUANTILES_PATH);
+        return ESP_FAIL;
+    }
+
+    // Rebuild the index from the window headers and resume after the newest
+    uint32_t newest_seq = 0;
+    uint32_t newest_ts = 0;
+    int newest_slot = -1;
+    int windows = 0;
+    for (int slot = 0; slot < CONFIG_GAS_QUANTILES_WINDOWS; slot++) {
+        quantiles_window_hdr_t hdr;
+        if (fseek(quantiles_file, (long)slot * sizeof(quantiles_window_t), SEEK_SET) != 0 ||
+            fread(&hdr, sizeof(hdr), 1, quantiles_file) != 1) {
+            break;
+        }
+        if (hdr.magic != QUANTILES_MAGIC || hdr.seq == 0 || hdr.octave_log2 != GAS_SKETCH_OCTAVE_LOG2 ||
+            hdr.buckets != GAS_SKETCH_BUCKETS) {
+            continue;
+        }
+        window_index[slot] = hdr;
+        windows++;
+        if (hdr.last_ts > newest_ts) {
+            newest_ts = hdr.last_ts;
+        }
+        if (hdr.seq > newest_seq) {
+            newest_seq = hdr.seq;
+            newest_slot = slot;
+        }
+    }
+    head_slot = (newest_slot + 1) % CONFIG_GAS_QUANTILES_WINDOWS;
+    next_seq = newest_seq + 1;
+    // The node clock must not restart below windows already on flash
+    node_time_resume(newest_ts);
+
+    ESP_LOGI(TAG, "Percentiles ready, %d windows of %d min on flash, %u bytes per window", windows,
+             CONFIG_GAS_QUANTILES_WINDOW_MIN, (unsigned)sizeof(quantiles_window_t));
+    return ESP_OK;
+}
+
+void quantiles_add(uint32_t timestamp, const gas_sample_t *sample) {
+    uint32_t start_ts = timestamp - timestamp % QUANTILES_WINDOW_S;
+    xSemaphoreTake(quantiles_lock, portMAX_DELAY);
+
+    // A new window: the open one is done
+    if (start_ts != open_window.hdr.start_ts) {
+        if (open_window.sketches[0].count > 0) {
+            open_window_close();
+        }
+        open_window_reset(start_ts);
+    }
+    open_window.hdr.last_ts = timestamp;
+    for (int i = 0; i < QUANTILES_CHANNELS; i++) {
+        gas_sketch_add(&open_window.sketches[i], sample->values[QUANTILES_FIRST_CHANNEL + i]);
+    }
+
+    xSemaphoreGive(quantiles_lock);
+}
+
+// Merges into `out` the sketches of `channel` from every window that overlaps
+// [from, to], the open one included; `windows` gets their number. Windows
+// count whole, so the range is rounded out to window boundaries.
+esp_err_t quantiles_query(gas_channel_t channel, uint32_t from, uint32_t to, gas_sketch_t *out, int *windows) {
+    if (channel < QUANTILES_FIRST_CHANNEL || channel >= GAS_CH_COUNT || from > to) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int index = channel - QUANTILES_FIRST_CHANNEL;
+    long offset = offsetof(quantiles_window_t, sketches) + index * sizeof(gas_sketch_t);
+    gas_sketch_init(out);
+    *windows = 0;
+
+    // Slots are few, so every one is checked instead of searching by time
+    xSemaphoreTake(quantiles_lock, portMAX_DELAY);
+    for (int slot = 0; slot < CONFIG_GAS_QUANTILES_WINDOWS; slot++) {
+        const quantiles_window_hdr_t *hdr = &window_index[slot];
+        if (hdr->seq == 0 || hdr->start_ts > to || hdr->last_ts < from || quantiles_file == NULL) {
+            continue;
+        }
+        // One channel's sketch per window, not the whole window
+        if (fseek(quantiles_file, (long)slot * sizeof(quantiles_window_t) + offset, SEEK_SET) != 0 ||
+            fread(&query_sketch, sizeof(query_sketch), 1, quantiles_file) != 1) {
+            ESP_LOGW(TAG, "Failed to read window %d", slot);
+            continue;
+        }
+        gas_sketch_merge(out, &query_sketch);
+        (*windows)++;
+    }
+    const gas_sketch_t *open = &open_window.sketches[index];
+    if (open->count > 0 && open_window.hdr.start_ts <= to && open_window.hdr.last_ts >= from) {
+        gas_sketch_merge(out, open);
+        (*windows)++;
+    }
+    xSemaphoreGive(quantiles_lock);
+
+    ESP_LOGD(TAG, "Query ch %d [%u, %u] merged %d windows, %u samples", channel, (unsigned)from, (unsigned)to,
+             *windows, (unsigned)out->count);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t quantiles_init(void) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void quantiles_add(uint32_t timestamp, const gas_sample_t *sample) {
+}
+
+esp_err_t quantiles_query(gas_channel_t channel, uint32_t from, uint32_t to, gas_sketch_t *out, int *windows) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
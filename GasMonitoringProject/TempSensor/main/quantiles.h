@@ -0,0 +1,24 @@
+#ifndef QUANTILES_H
+#define QUANTILES_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "gas_channels.h"
+#include "gas_sketch.h"
+
+// Percentiles of the gas channels over hours without the raw samples. Every
+// gas channel adds its samples to a quantile sketch of the current window,
+// CONFIG_GAS_QUANTILES_WINDOW_MIN long and aligned to node_time_now(). Closed
+// windows go to a circular file on the storage partition, the last
+// CONFIG_GAS_QUANTILES_WINDOWS of them, with a RAM index of their time spans;
+// a query merges the sketches of the windows that overlap its range.
+#define QUANTILES_PATH          "/storage/quantiles.bin"
+#define QUANTILES_FIRST_CHANNEL GAS_CH_AMMONIA      // gas channels only, T/RH can go negative
+#define QUANTILES_CHANNELS      (GAS_CH_COUNT - QUANTILES_FIRST_CHANNEL)
+
+// Function prototypes
+esp_err_t quantiles_init(void);
+void quantiles_add(uint32_t timestamp, const gas_sample_t *sample);
+esp_err_t quantiles_query(gas_channel_t channel, uint32_t from, uint32_t to, gas_sketch_t *out, int *windows);
+
+#endif
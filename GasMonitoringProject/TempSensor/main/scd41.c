@@ -0,0 +1,203 @@
+#include "scd41.h"
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define SCD41_BUS_TIMEOUT_TICKS (50 / portTICK_PERIOD_MS)
+#endif
+
+// Where the read cycle stands between scd41_step() calls
+typedef enum {
+    SCD41_IDLE,
+    SCD41_STATUS_SENT,
+    SCD41_READ_SENT,
+} scd41_state_t;
+
+static scd41_config_t scd41;
+static scd41_state_t scd41_state;
+static scd41_stats_t scd41_stats;
+
+#ifdef ESP_PLATFORM
+
+static esp_err_t scd41_bus_write(const uint8_t *data, size_t len) {
+    return i2c_master_write_to_device(scd41.port, SCD41_ADDR, data, len, SCD41_BUS_TIMEOUT_TICKS);
+}
+
+static esp_err_t scd41_bus_read(uint8_t *data, size_t len) {
+    return i2c_master_read_from_device(scd41.port, SCD41_ADDR, data, len, SCD41_BUS_TIMEOUT_TICKS);
+}
+
+static void scd41_bus_delay(uint32_t ms) {
+    vTaskDelay((ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+}
+
+#endif
+
+// CRC-8 over one data word: polynomial 0x31, initial value 0xFF
+uint8_t scd41_crc(const uint8_t *data) {
+    uint8_t crc = 0xff;
+    for (int i = 0; i < 2; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static esp_err_t scd41_write(const uint8_t *data, size_t len) {
+    esp_err_t ret = scd41_bus_write(data, len);
+    scd41_stats.transactions++;
+    if (ret != ESP_OK) {
+        scd41_stats.errors++;
+    }
+    return ret;
+}
+
+static esp_err_t scd41_command(uint16_t command) {
+    uint8_t tx[2] = { command >> 8, command & 0xff };
+    return scd41_write(tx, sizeof(tx));
+}
+
+static esp_err_t scd41_command_arg(uint16_t command, uint16_t arg) {
+    uint8_t tx[5] = { command >> 8, command & 0xff, arg >> 8, arg & 0xff };
+    tx[4] = scd41_crc(&tx[2]);
+    return scd41_write(tx, sizeof(tx));
+}
+
+// Reads `count` words, each followed by its CRC byte on the wire
+static esp_err_t scd41_read_words(uint16_t *words, int count) {
+    uint8_t rx[9];
+    esp_err_t ret = scd41_bus_read(rx, count * 3);
+    scd41_stats.transactions++;
+    if (ret != ESP_OK) {
+        scd41_stats.errors++;
+        return ret;
+    }
+    for (int i = 0; i < count; i++) {
+        if (scd41_crc(&rx[i * 3]) != rx[i * 3 + 2]) {
+            scd41_stats.crc_failures++;
+            return ESP_ERR_INVALID_CRC;
+        }
+        words[i] = (uint16_t)(rx[i * 3] << 8 | rx[i * 3 + 1]);
+    }
+    return ESP_OK;
+}
+
+// Stops a measurement left running by the previous boot, checks the sensor
+// answers, applies the compensation and starts periodic measurement. Blocks
+// for about half a second, so call it once from the acquisition task.
+esp_err_t scd41_init(const scd41_config_t *config, uint64_t *serial) {
+    scd41 = *config;
+    scd41_state = SCD41_IDLE;
+    memset(&scd41_stats, 0, sizeof(scd41_stats));
+
+    // Accepted in idle as well; the sensor takes 500 ms to settle either way
+    scd41_command(SCD41_CMD_STOP_PERIODIC);
+    scd41_bus_delay(SCD41_STOP_MS);
+
+    uint16_t words[3];
+    esp_err_t ret = scd41_command(SCD41_CMD_GET_SERIAL);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    scd41_bus_delay(SCD41_COMMAND_MS);
+    ret = scd41_read_words(words, 3);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (serial != NULL) {
+        *serial = (uint64_t)words[0] << 32 | (uint64_t)words[1] << 16 | words[2];
+    }
+
+    // Altitude can only be set while idle; a pressure overrides it
+    if (config->pressure_hpa == 0 && config->altitude_m != 0) {
+        ret = scd41_command_arg(SCD41_CMD_SET_ALTITUDE, config->altitude_m);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        scd41_bus_delay(SCD41_COMMAND_MS);
+    }
+    if (config->pressure_hpa != 0) {
+        ret = scd41_set_ambient_pressure(config->pressure_hpa);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        scd41_bus_delay(SCD41_COMMAND_MS);
+    }
+    return scd41_command(config->low_power ? SCD41_CMD_START_LOW_POWER : SCD41_CMD_START_PERIODIC);
+}
+
+// Allowed while measuring, e.g. to follow a barometer; only between read
+// cycles, since the sensor answers the last command it got
+esp_err_t scd41_set_ambient_pressure(uint16_t pressure_hpa) {
+    if (scd41_state != SCD41_IDLE) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (pressure_hpa < 700 || pressure_hpa > 1200) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return scd41_command_arg(SCD41_CMD_SET_AMBIENT_PRESSURE, pressure_hpa);
+}
+
+// One bus exchange of the read cycle, see scd41.h. Any failure drops back to
+// idle so the next call starts a fresh cycle.
+scd41_step_t scd41_step(void) {
+    switch (scd41_state) {
+    case SCD41_IDLE:
+        if (scd41_command(SCD41_CMD_GET_DATA_READY) != ESP_OK) {
+            return SCD41_STEP_ERROR;
+        }
+        scd41_state = SCD41_STATUS_SENT;
+        return SCD41_STEP_AGAIN;
+
+    case SCD41_STATUS_SENT: {
+        uint16_t status;
+        scd41_state = SCD41_IDLE;
+        if (scd41_read_words(&status, 1) != ESP_OK) {
+            return SCD41_STEP_ERROR;
+        }
+        // Any of the low 11 bits set means a measurement is waiting
+        if ((status & 0x07ff) == 0) {
+            scd41_stats.not_ready++;
+            return SCD41_STEP_NO_DATA;
+        }
+        if (scd41_command(SCD41_CMD_READ_MEASUREMENT) != ESP_OK) {
+            return SCD41_STEP_ERROR;
+        }
+        scd41_state = SCD41_READ_SENT;
+        return SCD41_STEP_FETCH;
+    }
+
+    case SCD41_READ_SENT:
+        // The fetch was skipped; the measurement stays until the next read
+        scd41_state = SCD41_IDLE;
+        return scd41_step();
+    }
+    return SCD41_STEP_ERROR;
+}
+
+// Reads the measurement requested by the last step. ESP_ERR_INVALID_STATE
+// when that step did not request one.
+esp_err_t scd41_fetch(scd41_measurement_t *measurement) {
+    if (scd41_state != SCD41_READ_SENT) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    scd41_state = SCD41_IDLE;
+    uint16_t words[3];
+    esp_err_t ret = scd41_read_words(words, 3);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    measurement->co2_ppm = words[0];
+    measurement->temperature_c = -45.0f + 175.0f * words[1] / 65535.0f;
+    measurement->humidity = 100.0f * words[2] / 65535.0f;
+    scd41_stats.measurements++;
+    return ESP_OK;
+}
+
+void scd41_get_stats(scd41_stats_t *stats) {
+    *stats = scd41_stats;
+}
@@ -0,0 +1,97 @@
+#ifndef SCD41_H
+#define SCD41_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#include "driver/i2c.h"
+#else
+// Host builds against the scripted model in tools/scd41_model.c
+typedef int esp_err_t;
+typedef int i2c_port_t;
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_CRC     0x109
+#endif
+
+// Sensirion SCD41 photoacoustic CO2 sensor on the Si7021's I2C port.
+//
+// The sensor runs in periodic (5 s) or low-power periodic (30 s) mode and
+// raises a data-ready flag when a new measurement is in. Reading it takes a
+// command, at least 1 ms of execution time and then the read, so the driver
+// never blocks on the sensor: scd41_step() issues one bus exchange and says
+// how long to wait before the next, and the acquisition scheduler runs the
+// other jobs meanwhile. A cycle is
+//
+//   get_data_ready_status  -> 1 ms -> read status -> not ready: done
+//                                                  -> ready: read_measurement
+//                                                     -> 1 ms -> scd41_fetch()
+//
+// and the fetch reads CO2, temperature and RH as one 9-byte burst, every
+// word checked against its CRC.
+
+#define SCD41_ADDR                      0x62
+
+#define SCD41_CMD_START_PERIODIC        0x21B1
+#define SCD41_CMD_START_LOW_POWER       0x21AC
+#define SCD41_CMD_READ_MEASUREMENT      0xEC05
+#define SCD41_CMD_STOP_PERIODIC         0x3F86
+#define SCD41_CMD_GET_DATA_READY        0xE4B8
+#define SCD41_CMD_SET_AMBIENT_PRESSURE  0xE000
+#define SCD41_CMD_SET_ALTITUDE          0x2427
+#define SCD41_CMD_GET_SERIAL            0x3682
+
+// Execution times from the datasheet
+#define SCD41_COMMAND_MS                1
+#define SCD41_STOP_MS                   500
+
+typedef struct {
+    i2c_port_t port;            // already installed by si7021_init()
+    bool low_power;             // 30 s instead of 5 s measurement interval
+    uint16_t altitude_m;        // used while no pressure is set
+    uint16_t pressure_hpa;      // ambient pressure, 0 = compensate by altitude
+} scd41_config_t;
+
+typedef struct {
+    uint16_t co2_ppm;
+    float temperature_c;
+    float humidity;
+} scd41_measurement_t;
+
+// What scd41_step() did
+typedef enum {
+    SCD41_STEP_ERROR = -1,
+    SCD41_STEP_AGAIN,           // call scd41_step() again after SCD41_COMMAND_MS
+    SCD41_STEP_NO_DATA,         // cycle over, nothing new since the last fetch
+    SCD41_STEP_FETCH,           // call scd41_fetch() after SCD41_COMMAND_MS
+} scd41_step_t;
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t errors;            // NACKs and bus errors
+    uint32_t crc_failures;
+    uint32_t not_ready;         // status polls that found no new data
+    uint32_t measurements;
+} scd41_stats_t;
+
+// Function prototypes
+esp_err_t scd41_init(const scd41_config_t *config, uint64_t *serial);
+esp_err_t scd41_set_ambient_pressure(uint16_t pressure_hpa);
+scd41_step_t scd41_step(void);
+esp_err_t scd41_fetch(scd41_measurement_t *measurement);
+void scd41_get_stats(scd41_stats_t *stats);
+uint8_t scd41_crc(const uint8_t *data);
+
+#ifndef ESP_PLATFORM
+// Provided by the host model
+esp_err_t scd41_bus_write(const uint8_t *data, size_t len);
+esp_err_t scd41_bus_read(uint8_t *data, size_t len);
+void scd41_bus_delay(uint32_t ms);
+#endif
+
+#endif
@@ -1,14 +1,33 @@
 // Component header file
 #include "si7021.h"
+#include "metrics.h"
 
 // Here I will define the port as a variable, that way it is only defined once
 i2c_port_t _port;
 
+// Bus statistics for the metrics endpoint
+static METRIC_DEFINE_COUNTER(si7021_i2c_transactions, "si7021_i2c_transactions_total", NULL, "I2C transactions issued to the Si7021");
+static METRIC_DEFINE_COUNTER(si7021_i2c_errors, "si7021_i2c_errors_total", NULL, "Si7021 I2C transactions that failed");
+static METRIC_DEFINE_COUNTER(si7021_crc_failures, "si7021_crc_failures_total", NULL, "Si7021 readings with a bad CRC");
+
+// run a queued I2C command on the sensor port and count it
+static esp_err_t si7021_cmd_begin(i2c_cmd_handle_t cmd) {
+
+	esp_err_t ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
+	metric_inc(&si7021_i2c_transactions);
+	if(ret != ESP_OK) metric_inc(&si7021_i2c_errors);
+	return ret;
+}
+
 int si7021_init(i2c_port_t port, int sda_pin, int scl_pin,  gpio_pullup_t sda_internal_pullup,  gpio_pullup_t scl_internal_pullup) {
 
 	esp_err_t ret;
 	_port = port;
 
+	metrics_register(&si7021_i2c_transactions);
+	metrics_register(&si7021_i2c_errors);
+	metrics_register(&si7021_crc_failures);
+
 	// setup i2c controller
 	i2c_config_t conf;
 	conf.mode = I2C_MODE_MASTER;
@@ -29,7 +48,7 @@ int si7021_init(i2c_port_t port, int sda_pin, int scl_pin,  gpio_pullup_t sda_in
 	i2c_master_start(cmd);
 	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, true);
 	i2c_master_stop(cmd);
-	if(i2c_master_cmd_begin(port, cmd, 1000 / portTICK_PERIOD_MS) != ESP_OK) {
+	if(si7021_cmd_begin(cmd) != ESP_OK) {
 		return SI7021_ERR_NOTFOUND;
 	}
 
@@ -43,7 +62,7 @@ float si7021_read_temperature() {
 	if(raw_temperature == 0) return -999;
 
 	// return the real value using the formula in datasheet
-	return (raw_temperature * 175.72 / 65536.0) - 46.85;
+	return si7021_raw_to_temperature(raw_temperature);
 }
 
 float si7021_read_humidity() {
@@ -53,7 +72,7 @@ float si7021_read_humidity() {
 	if(raw_humidity == 0) return -999;
 
 	// return the real value from the formula in datasheet
-	return (raw_humidity * 125.0 / 65536.0) - 6.0;
+	return si7021_raw_to_humidity(raw_humidity);
 }
 
 uint8_t si7021_get_resolution() {
@@ -85,7 +104,7 @@ int si7021_soft_reset() {
 	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, true);
 	i2c_master_write_byte(cmd, SOFT_RESET, true);
 	i2c_master_stop(cmd);
-	ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
+	ret = si7021_cmd_begin(cmd);
 	i2c_cmd_link_delete(cmd);
 
 	switch(ret) {
@@ -115,7 +134,7 @@ uint8_t si7021_read_user_register() {
 	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, true);
 	i2c_master_write_byte(cmd, READ_USER_REG, true);
 	i2c_master_stop(cmd);
-	ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
+	ret = si7021_cmd_begin(cmd);
 	i2c_cmd_link_delete(cmd);
 	if(ret != ESP_OK) return 0;
 
@@ -126,7 +145,7 @@ uint8_t si7021_read_user_register() {
 	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_READ, true);
 	i2c_master_read_byte(cmd, &reg_value, 0x01);
 	i2c_master_stop(cmd);
-	ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
+	ret = si7021_cmd_begin(cmd);
 	i2c_cmd_link_delete(cmd);
 	if(ret != ESP_OK) return 0;
 
@@ -144,7 +163,7 @@ int si7021_write_user_register(uint8_t value) {
 	i2c_master_write_byte(cmd, WRITE_USER_REG, true);
 	i2c_master_write_byte(cmd, value, true);
 	i2c_master_stop(cmd);
-	ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
+	ret = si7021_cmd_begin(cmd);
 	i2c_cmd_link_delete(cmd);
 
 	switch(ret) {
@@ -166,39 +185,96 @@ int si7021_write_user_register(uint8_t value) {
 
 uint16_t read_value(uint8_t command) {
 
+	if(si7021_start_measurement(command) != SI7021_ERR_OK) return 0;
+
+	// wait for the sensor (50ms)
+	vTaskDelay(50 / portTICK_PERIOD_MS);
+
+	return si7021_fetch_measurement();
+}
+
+int si7021_start_measurement(uint8_t command) {
+
 	esp_err_t ret;
 
-	// send the command
+	// send the command, the sensor converts while the bus is free
 	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
 	i2c_master_start(cmd);
 	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, true);
 	i2c_master_write_byte(cmd, command, true);
 	i2c_master_stop(cmd);
-	ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
+	ret = si7021_cmd_begin(cmd);
 	i2c_cmd_link_delete(cmd);
-	if(ret != ESP_OK) return 0;
 
-	// wait for the sensor (50ms)
-	vTaskDelay(50 / portTICK_PERIOD_MS);
+	return ret == ESP_OK ? SI7021_ERR_OK : SI7021_ERR_FAIL;
+}
+
+uint16_t si7021_fetch_measurement() {
+
+	esp_err_t ret;
 
 	// receive the answer
 	uint8_t msb, lsb, crc;
-	cmd = i2c_cmd_link_create();
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
 	i2c_master_start(cmd);
 	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_READ, true);
 	i2c_master_read_byte(cmd, &msb, 0x00);
 	i2c_master_read_byte(cmd, &lsb, 0x00);
 	i2c_master_read_byte(cmd, &crc, 0x01);
 	i2c_master_stop(cmd);
-	ret = i2c_master_cmd_begin(_port, cmd, 1000 / portTICK_PERIOD_MS);
+	ret = si7021_cmd_begin(cmd);
 	i2c_cmd_link_delete(cmd);
 	if(ret != ESP_OK) return 0;
 
 	uint16_t raw_value = ((uint16_t) msb << 8) | (uint16_t) lsb;
-	if(!is_crc_valid(raw_value, crc)) printf("CRC invalid\r\n");
+	if(!is_crc_valid(raw_value, crc)) {
+		metric_inc(&si7021_crc_failures);
+		printf("CRC invalid\r\n");
+	}
 	return raw_value & 0xFFFC;
 }
 
+float si7021_read_previous_temperature() {
+
+	esp_err_t ret;
+
+	// the temperature measured during the last RH conversion, no new conversion
+	i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+	i2c_master_start(cmd);
+	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_WRITE, true);
+	i2c_master_write_byte(cmd, SI7021_READPREVTEMP_CMD, true);
+	i2c_master_stop(cmd);
+	ret = si7021_cmd_begin(cmd);
+	i2c_cmd_link_delete(cmd);
+	if(ret != ESP_OK) return -999;
+
+	// no CRC byte is sent for this command
+	uint8_t msb, lsb;
+	cmd = i2c_cmd_link_create();
+	i2c_master_start(cmd);
+	i2c_master_write_byte(cmd, (SI7021_ADDR << 1) | I2C_MASTER_READ, true);
+	i2c_master_read_byte(cmd, &msb, 0x00);
+	i2c_master_read_byte(cmd, &lsb, 0x01);
+	i2c_master_stop(cmd);
+	ret = si7021_cmd_begin(cmd);
+	i2c_cmd_link_delete(cmd);
+	if(ret != ESP_OK) return -999;
+
+	return si7021_raw_to_temperature((((uint16_t) msb << 8) | (uint16_t) lsb) & 0xFFFC);
+}
+
+float si7021_raw_to_temperature(uint16_t raw_temperature) {
+
+	// formula in datasheet
+	return (raw_temperature * 175.72 / 65536.0) - 46.85;
+}
+
+float si7021_raw_to_humidity(uint16_t raw_humidity) {
+
+	// formula in datasheet
+	return (raw_humidity * 125.0 / 65536.0) - 6.0;
+}
+
 // verify the CRC, algorithm in the datasheet (see comments below)
 bool is_crc_valid(uint16_t value, uint8_t crc) {
 
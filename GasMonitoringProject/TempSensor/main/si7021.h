@@ -40,6 +40,10 @@ extern "C" {
 #define READ_USER_REG  					0xE7
 #define SOFT_RESET  					0xFE
 
+// worst-case RH conversion at 12 bit, including the temperature conversion
+// that comes with it (datasheet: 12 ms + 10.8 ms)
+#define SI7021_RH_CONVERSION_MS		25
+
 // return values
 #define SI7021_ERR_OK				0x00
 #define SI7021_ERR_CONFIG			0x01
@@ -62,6 +66,14 @@ uint8_t si7021_get_resolution();
 int si7021_set_resolution(uint8_t resolution);
 int si7021_soft_reset();
 
+// split measurement: start a no-hold conversion, do other work for the
+// conversion time, then fetch the raw value (0 on failure)
+int si7021_start_measurement(uint8_t command);
+uint16_t si7021_fetch_measurement();
+float si7021_read_previous_temperature();
+float si7021_raw_to_temperature(uint16_t raw_temperature);
+float si7021_raw_to_humidity(uint16_t raw_humidity);
+
 // helper functions
 uint8_t si7021_read_user_register();
 int si7021_write_user_register(uint8_t value);
@@ -0,0 +1,80 @@
+#include "udp_publish.h"
+#include <string.h>
+#include "lwip/sockets.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "metrics.h"
+
+#if CONFIG_GAS_UDP_PUBLISH
+
+static const char *TAG = "UDP_PUBLISH";
+
+static const uint32_t udp_send_us_bounds[] = { 50, 100, 200, 500, 1000, 5000 };
+static METRIC_DEFINE_COUNTER(udp_datagrams, "node_udp_datagrams_total", NULL, "Datagrams published over UDP");
+static METRIC_DEFINE_COUNTER(udp_bytes, "node_udp_bytes_total", NULL, "Payload bytes published over UDP");
+static METRIC_DEFINE_COUNTER(udp_send_errors, "node_udp_send_errors_total", NULL, "Failed sendto() calls");
+static METRIC_DEFINE_HISTOGRAM(udp_send_us, "node_udp_send_us", "Time spent in sendto() per datagram, microseconds", udp_send_us_bounds);
+
+static int udp_sock = -1;
+static struct sockaddr_in udp_dest;
+
+esp_err_t udp_publish_init(void) {
+    metrics_register(&udp_datagrams);
+    metrics_register(&udp_bytes);
+    metrics_register(&udp_send_errors);
+    metrics_register(&udp_send_us);
+
+    memset(&udp_dest, 0, sizeof(udp_dest));
+    udp_dest.sin_family = AF_INET;
+    udp_dest.sin_port = htons(CONFIG_GAS_UDP_PUBLISH_PORT);
+    if (inet_pton(AF_INET, CONFIG_GAS_UDP_PUBLISH_ADDR, &udp_dest.sin_addr) != 1) {
+        ESP_LOGE(TAG, "Bad destination address %s", CONFIG_GAS_UDP_PUBLISH_ADDR);
+        return ESP_ERR_INVALID_ARG;
+    }
+    udp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (udp_sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+    if (IN_MULTICAST(ntohl(udp_dest.sin_addr.s_addr))) {
+        uint8_t ttl = 1; // the soft AP network only
+        setsockopt(udp_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    } else {
+        int broadcast = 1;
+        setsockopt(udp_sock, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+    }
+    ESP_LOGI(TAG, "Publishing frames to %s:%d", CONFIG_GAS_UDP_PUBLISH_ADDR, CONFIG_GAS_UDP_PUBLISH_PORT);
+    return ESP_OK;
+}
+
+// One datagram. A failure is counted and left at that, the listeners see
+// the gap in the frame numbers.
+bool udp_publish_send(const char *datagram, int len) {
+    if (udp_sock < 0) {
+        return false;
+    }
+    int64_t send_start = esp_timer_get_time();
+    int err = sendto(udp_sock, datagram, len, 0, (struct sockaddr *)&udp_dest, sizeof(udp_dest));
+    metric_observe(&udp_send_us, (uint32_t)(esp_timer_get_time() - send_start));
+    if (err < 0) {
+        metric_inc(&udp_send_errors);
+        ESP_LOGD(TAG, "sendto failed: errno %d", errno);
+        return false;
+    }
+    metric_inc(&udp_datagrams);
+    metric_add(&udp_bytes, err);
+    return true;
+}
+
+#else
+
+esp_err_t udp_publish_init(void) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool udp_publish_send(const char *datagram, int len) {
+    return false;
+}
+
+#endif
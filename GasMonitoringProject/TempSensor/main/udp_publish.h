@@ -0,0 +1,15 @@
+#ifndef UDP_PUBLISH_H
+#define UDP_PUBLISH_H
+
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Datagrams to CONFIG_GAS_UDP_PUBLISH_ADDR:CONFIG_GAS_UDP_PUBLISH_PORT,
+// sent once whatever the number of listeners. The frame format and the
+// snapshots are described in gas_link.h.
+
+// Function prototypes
+esp_err_t udp_publish_init(void);
+bool udp_publish_send(const char *datagram, int len);
+
+#endif
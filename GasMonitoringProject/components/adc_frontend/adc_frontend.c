@@ -0,0 +1,115 @@
+#include "adc_frontend.h"
+#include <string.h>
+
+// Sum of `1 << gain_bits` codes to a Q.ADC_FE_FRAC_BITS mean, rounded
+static int32_t scale_output(int64_t total, int gain_bits) {
+    if (gain_bits > ADC_FE_FRAC_BITS) {
+        int shift = gain_bits - ADC_FE_FRAC_BITS;
+        return (int32_t)((total + ((int64_t)1 << (shift - 1))) >> shift);
+    }
+    return (int32_t)(total * (1 << (ADC_FE_FRAC_BITS - gain_bits)));
+}
+
+bool adc_fe_init(adc_fe_t *fe, const adc_fe_config_t *config) {
+    int order = config->filter;
+    if (order < 1 || order > ADC_FE_MAX_ORDER ||
+        config->channels < 1 || config->channels > ADC_FE_MAX_CHANNELS ||
+        config->code_bits < 8 || config->code_bits > 16 ||
+        config->ratio < 1 || config->ratio > ADC_FE_MAX_RATIO || (config->ratio & (config->ratio - 1)) != 0) {
+        return false;
+    }
+    int log2_ratio = 0;
+    while ((1 << log2_ratio) < config->ratio) {
+        log2_ratio++;
+    }
+    // The CIC gain is ratio^order; the centred sum must stay inside int32
+    if (config->code_bits + order * log2_ratio > 32) {
+        return false;
+    }
+
+    memset(fe, 0, sizeof(*fe));
+    fe->config = *config;
+    fe->order = order;
+    fe->log2_ratio = log2_ratio;
+    fe->mid = 1 << (config->code_bits - 1);
+    fe->settle = order - 1;
+    return true;
+}
+
+static void cic_integrate(adc_fe_t *fe, const uint16_t *frame) {
+    for (int ch = 0; ch < fe->config.channels; ch++) {
+        uint32_t *integ = fe->integ[ch];
+        uint32_t x = (uint32_t)((int32_t)frame[ch] - fe->mid);
+        for (int s = 0; s < fe->order; s++) {
+            integ[s] += x;
+            x = integ[s];
+        }
+    }
+}
+
+static void cic_output(adc_fe_t *fe, int32_t *out) {
+    int gain_bits = fe->order * fe->log2_ratio;
+    for (int ch = 0; ch < fe->config.channels; ch++) {
+        uint32_t y = fe->integ[ch][fe->order - 1];
+        for (int s = 0; s < fe->order; s++) {
+            uint32_t delayed = fe->comb[ch][s];
+            fe->comb[ch][s] = y;
+            y -= delayed;
+        }
+        int64_t total = (int32_t)y + ((int64_t)fe->mid << gain_bits);
+        out[ch] = scale_output(total, gain_bits);
+    }
+}
+
+static void average_output(adc_fe_t *fe, int32_t *out) {
+    for (int ch = 0; ch < fe->config.channels; ch++) {
+        int64_t total = block_sum_s16(fe->block[ch], fe->config.ratio) + ((int64_t)fe->mid << fe->log2_ratio);
+        out[ch] = scale_output(total, fe->log2_ratio);
+    }
+}
+
+// Feeds `count` interleaved frames and writes the output frames they
+// complete to `out`, which needs room for count / ratio + 1 frames of
+// `channels` values. Returns the number of output frames written.
+int adc_fe_push(adc_fe_t *fe, const uint16_t *frames, int count, int32_t *out) {
+    int channels = fe->config.channels;
+    int outputs = 0;
+    for (int f = 0; f < count; f++) {
+        const uint16_t *frame = frames + f * channels;
+        if (fe->order == 1) {
+            for (int ch = 0; ch < channels; ch++) {
+                fe->block[ch][fe->fill] = (int16_t)((int32_t)frame[ch] - fe->mid);
+            }
+        } else {
+            cic_integrate(fe, frame);
+        }
+        if (++fe->fill < fe->config.ratio) {
+            continue;
+        }
+        fe->fill = 0;
+
+        int32_t *dst = out + outputs * channels;
+        if (fe->order == 1) {
+            average_output(fe, dst);
+        } else {
+            cic_output(fe, dst);
+            if (fe->settle > 0) {
+                fe->settle--;
+                continue;
+            }
+        }
+        outputs++;
+    }
+    fe->frames += count;
+    fe->outputs += outputs;
+    return outputs;
+}
+
+const char *adc_fe_filter_name(adc_fe_filter_t filter) {
+    switch (filter) {
+        case ADC_FE_AVERAGE: return "average";
+        case ADC_FE_CIC2:    return "cic2";
+        case ADC_FE_CIC3:    return "cic3";
+        default:             return "unknown";
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef ADC_FRONTEND_H
+#define ADC_FRONTEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "block_kernels.h"
+
+// Decimating front end for oversampled ADC channels. Raw converter codes
+// arrive as interleaved frames (one code per channel) at the sampling rate;
+// every `ratio` frames the front end emits one frame of channel means at the
+// reporting rate. Averaging N samples with at least ~0.5 LSB of noise on the
+// input buys log4(N) extra bits, so outputs carry ADC_FE_FRAC_BITS of
+// fraction below the converter LSB.
+//
+// ADC_FE_AVERAGE is a boxcar mean over each run of `ratio` samples, summed
+// with the block kernels. ADC_FE_CIC2/3 are 2- and 3-stage CIC decimators,
+// which reject the aliases around multiples of the output rate much better
+// at the cost of a longer step response (order * ratio samples).
+
+#define ADC_FE_MAX_CHANNELS 4
+#define ADC_FE_MAX_RATIO    256
+#define ADC_FE_MAX_ORDER    3
+#define ADC_FE_FRAC_BITS    8
+
+typedef enum {
+    ADC_FE_AVERAGE = 1,
+    ADC_FE_CIC2 = 2,
+    ADC_FE_CIC3 = 3,
+} adc_fe_filter_t;
+
+typedef struct {
+    adc_fe_filter_t filter;
+    int channels;           // codes per frame, 1..ADC_FE_MAX_CHANNELS
+    int ratio;              // decimation factor, a power of two up to ADC_FE_MAX_RATIO
+    int code_bits;          // converter resolution, 8..16
+} adc_fe_config_t;
+
+typedef struct {
+    adc_fe_config_t config;
+    int order;              // CIC stages, 1 for the boxcar
+    int log2_ratio;
+    int32_t mid;            // half scale, subtracted so samples fit int16
+    int fill;               // frames gathered towards the next output
+    int settle;             // CIC outputs still to drop while the combs fill
+    uint32_t frames;        // frames pushed since init
+    uint32_t outputs;       // output frames emitted since init
+    // CIC state, wrapping arithmetic; exact while the true sum fits 32 bits
+    uint32_t integ[ADC_FE_MAX_CHANNELS][ADC_FE_MAX_ORDER];
+    uint32_t comb[ADC_FE_MAX_CHANNELS][ADC_FE_MAX_ORDER];
+    // Boxcar input, one row per channel so each sum is one aligned block
+    int16_t block[ADC_FE_MAX_CHANNELS][ADC_FE_MAX_RATIO] __attribute__((aligned(BLOCK_ALIGN)));
+} adc_fe_t;
+
+// Function prototypes
+bool adc_fe_init(adc_fe_t *fe, const adc_fe_config_t *config);
+int adc_fe_push(adc_fe_t *fe, const uint16_t *frames, int count, int32_t *out);
+const char *adc_fe_filter_name(adc_fe_filter_t filter);
+
+// Output value (Q.ADC_FE_FRAC_BITS converter codes) as a float code
+static inline float adc_fe_to_code(int32_t value) {
+    return value / (float)(1 << ADC_FE_FRAC_BITS);
+}
+
+#endif
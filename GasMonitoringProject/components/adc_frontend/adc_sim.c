@@ -0,0 +1,56 @@
+#include "adc_sim.h"
+#include <string.h>
+
+#define ADC_SIM_MAX_CODE ((1 << ADC_SIM_BITS) - 1)
+
+static uint32_t sim_random(adc_sim_t *sim) {
+    sim->seed = sim->seed * 1664525u + 1013904223u;
+    return sim->seed;
+}
+
+// Sum of four uniforms: close enough to Gaussian for a noise floor, and
+// cheap enough to run at the full sampling rate on the node. Unit variance.
+static float sim_gaussian(adc_sim_t *sim) {
+    uint32_t sum = (sim_random(sim) >> 20) + (sim_random(sim) >> 20) +
+                   (sim_random(sim) >> 20) + (sim_random(sim) >> 20);
+    return ((float)sum - 2.0f * 4095.0f) * (1.7320508f / 4096.0f);
+}
+
+void adc_sim_init(adc_sim_t *sim, float vref, float noise_lsb, uint32_t seed) {
+    memset(sim, 0, sizeof(*sim));
+    sim->vref = vref;
+    sim->noise_lsb = noise_lsb;
+    sim->seed = seed != 0 ? seed : 1;
+}
+
+void adc_sim_set_input(adc_sim_t *sim, int channel, float volts) {
+    if (channel >= 0 && channel < ADC_SIM_CHANNELS) {
+        sim->level[channel] = volts;
+    }
+}
+
+static uint16_t sim_convert(adc_sim_t *sim, int channel) {
+    // Transitions at half-LSB points, so code k reads k LSB +-0.5
+    float code = sim->level[channel] / sim->vref * (1 << ADC_SIM_BITS) + sim->noise_lsb * sim_gaussian(sim) + 0.5f;
+    sim->conversions++;
+    if (code < 1.0f) {
+        return 0;
+    }
+    return code >= ADC_SIM_MAX_CODE ? ADC_SIM_MAX_CODE : (uint16_t)code;
+}
+
+// One chip-select window: converts the channel named by the first command
+// and clocks its result back. A window without the start bit, or shorter
+// than a command, reads back zeros.
+void adc_sim_transfer(adc_sim_t *sim, const uint8_t *tx, uint8_t *rx, int len) {
+    sim->transfers++;
+    sim->bytes += len;
+    memset(rx, 0, len);
+    if (len < ADC_SIM_FRAME_BYTES || (tx[0] & 0x06) != 0x06) {
+        return;
+    }
+    int channel = ((tx[0] & 1) << 2) | (tx[1] >> 6);
+    uint16_t code = sim_convert(sim, channel);
+    rx[1] = (uint8_t)(code >> 8);
+    rx[2] = (uint8_t)code;
+}
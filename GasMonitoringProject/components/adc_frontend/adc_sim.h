@@ -0,0 +1,48 @@
+#ifndef ADC_SIM_H
+#define ADC_SIM_H
+
+#include <stdint.h>
+
+// Simulated SPI ADC: an 8-channel, 12-bit successive-approximation
+// converter with the MCP3208 wire format. Each conversion is a 3-byte
+// full-duplex exchange inside its own chip-select window; as on the chip,
+// anything clocked after the first result reads back zero. The analog side
+// is a settable voltage per input plus Gaussian noise, so the node can run
+// its acquisition path without the board and the host tools can measure
+// what decimation recovers.
+//
+//   MOSI  0000 01 S D2 | D1 D0 xx xxxx | xxxx xxxx     S = 1 single-ended
+//   MISO  xxxx xxxx    | xxx0 B11..B8  | B7..B0
+
+#define ADC_SIM_CHANNELS   8
+#define ADC_SIM_BITS       12
+#define ADC_SIM_FRAME_BYTES 3
+
+typedef struct {
+    float vref;
+    float noise_lsb;                    // rms input noise in LSB
+    float level[ADC_SIM_CHANNELS];      // volts at each input
+    uint32_t seed;
+    uint32_t conversions;               // bus accounting since init
+    uint32_t bytes;
+    uint32_t transfers;                 // chip-select windows
+} adc_sim_t;
+
+// Function prototypes
+void adc_sim_init(adc_sim_t *sim, float vref, float noise_lsb, uint32_t seed);
+void adc_sim_set_input(adc_sim_t *sim, int channel, float volts);
+void adc_sim_transfer(adc_sim_t *sim, const uint8_t *tx, uint8_t *rx, int len);
+
+// Command bytes for one single-ended conversion of `channel`
+static inline void adc_sim_command(int channel, uint8_t *tx) {
+    tx[0] = 0x06 | ((channel >> 2) & 1);
+    tx[1] = (uint8_t)((channel & 3) << 6);
+    tx[2] = 0;
+}
+
+// Conversion result from the 3 bytes clocked back for one command
+static inline uint16_t adc_sim_result(const uint8_t *rx) {
+    return (uint16_t)(((rx[1] & 0x0f) << 8) | rx[2]);
+}
+
+#endif
@@ -0,0 +1,421 @@
+#include "block_kernels.h"
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#endif
+
+#if defined(CONFIG_IDF_TARGET_ESP32S3) && CONFIG_GAS_BLOCK_KERNELS_PIE
+#define BLOCK_PIE 1
+#else
+#define BLOCK_PIE 0
+#endif
+
+// Lane primitives. Every pointer is 16-byte aligned and blocks >= 1. The
+// kernels below are written once against these, so the PIE and portable
+// builds only differ here.
+
+#if BLOCK_PIE
+
+static const int16_t lane_ones[BLOCK_LANES] __attribute__((aligned(BLOCK_ALIGN))) = { 1, 1, 1, 1, 1, 1, 1, 1 };
+
+// ACCX is 40 bits, read as the low word and the top byte
+static inline int64_t accx_value(uint32_t lo, uint32_t hi) {
+    return (int64_t)(int8_t)(hi & 0xff) * 4294967296LL + lo;
+}
+
+static int64_t lanes_sum(const int16_t *x, int blocks) {
+    const int16_t *ones = lane_ones;
+    uint32_t lo, hi;
+    __asm__ volatile(
+        "ee.zero.accx\n"
+        "ee.vld.128.ip q1, %[ones], 0\n"
+        "1:\n"
+        "ee.vld.128.ip q0, %[x], 16\n"
+        "ee.vmulas.s16.accx q0, q1\n"
+        "addi %[n], %[n], -1\n"
+        "bnez %[n], 1b\n"
+        "rur.accx_0 %[lo]\n"
+        "rur.accx_1 %[hi]\n"
+        : [x] "+r"(x), [n] "+r"(blocks), [ones] "+r"(ones), [lo] "=r"(lo), [hi] "=r"(hi)
+        :
+        : "memory");
+    return accx_value(lo, hi);
+}
+
+static int64_t lanes_dot(const int16_t *a, const int16_t *b, int blocks) {
+    uint32_t lo, hi;
+    __asm__ volatile(
+        "ee.zero.accx\n"
+        "1:\n"
+        "ee.vld.128.ip q0, %[a], 16\n"
+        "ee.vld.128.ip q1, %[b], 16\n"
+        "ee.vmulas.s16.accx q0, q1\n"
+        "addi %[n], %[n], -1\n"
+        "bnez %[n], 1b\n"
+        "rur.accx_0 %[lo]\n"
+        "rur.accx_1 %[hi]\n"
+        : [a] "+r"(a), [b] "+r"(b), [n] "+r"(blocks), [lo] "=r"(lo), [hi] "=r"(hi)
+        :
+        : "memory");
+    return accx_value(lo, hi);
+}
+
+static void lanes_minmax(const int16_t *x, int blocks, int16_t *min, int16_t *max) {
+    __asm__ volatile(
+        "ee.vld.128.ip q0, %[x], 0\n"
+        "ee.vld.128.ip q1, %[x], 16\n"
+        "addi %[n], %[n], -1\n"
+        "beqz %[n], 2f\n"
+        "1:\n"
+        "ee.vld.128.ip q2, %[x], 16\n"
+        "ee.vmin.s16 q0, q0, q2\n"
+        "ee.vmax.s16 q1, q1, q2\n"
+        "addi %[n], %[n], -1\n"
+        "bnez %[n], 1b\n"
+        "2:\n"
+        "ee.vst.128.ip q0, %[min], 0\n"
+        "ee.vst.128.ip q1, %[max], 0\n"
+        : [x] "+r"(x), [n] "+r"(blocks), [min] "+r"(min), [max] "+r"(max)
+        :
+        : "memory");
+}
+
+// vcmp sets a lane to -1 where x > threshold; summing the lanes counts them
+static int lanes_count_above(const int16_t *x, int blocks, int16_t threshold) {
+    const int16_t *ones = lane_ones;
+    const int16_t *limit = &threshold;
+    uint32_t lo, hi;
+    __asm__ volatile(
+        "ee.zero.accx\n"
+        "ee.vldbc.16 q3, %[limit]\n"
+        "ee.vld.128.ip q4, %[ones], 0\n"
+        "1:\n"
+        "ee.vld.128.ip q0, %[x], 16\n"
+        "ee.vcmp.gt.s16 q1, q0, q3\n"
+        "ee.vmulas.s16.accx q1, q4\n"
+        "addi %[n], %[n], -1\n"
+        "bnez %[n], 1b\n"
+        "rur.accx_0 %[lo]\n"
+        "rur.accx_1 %[hi]\n"
+        : [x] "+r"(x), [n] "+r"(blocks), [ones] "+r"(ones), [lo] "=r"(lo), [hi] "=r"(hi)
+        : [limit] "r"(limit)
+        : "memory");
+    return (int)-accx_value(lo, hi);
+}
+
+#else
+
+static int64_t lanes_sum(const int16_t *x, int blocks) {
+    int32_t acc[BLOCK_LANES] = { 0 };
+    for (int b = 0; b < blocks; b++, x += BLOCK_LANES) {
+        for (int l = 0; l < BLOCK_LANES; l++) {
+            acc[l] += x[l];
+        }
+    }
+    int64_t sum = 0;
+    for (int l = 0; l < BLOCK_LANES; l++) {
+        sum += acc[l];
+    }
+    return sum;
+}
+
+static int64_t lanes_dot(const int16_t *a, const int16_t *b, int blocks) {
+    int64_t acc[BLOCK_LANES] = { 0 };
+    for (int k = 0; k < blocks; k++, a += BLOCK_LANES, b += BLOCK_LANES) {
+        for (int l = 0; l < BLOCK_LANES; l++) {
+            acc[l] += (int32_t)a[l] * b[l];
+        }
+    }
+    int64_t sum = 0;
+    for (int l = 0; l < BLOCK_LANES; l++) {
+        sum += acc[l];
+    }
+    return sum;
+}
+
+static void lanes_minmax(const int16_t *x, int blocks, int16_t *min, int16_t *max) {
+    memcpy(min, x, BLOCK_LANES * sizeof(int16_t));
+    memcpy(max, x, BLOCK_LANES * sizeof(int16_t));
+    for (int b = 1; b < blocks; b++) {
+        x += BLOCK_LANES;
+        for (int l = 0; l < BLOCK_LANES; l++) {
+            min[l] = x[l] < min[l] ? x[l] : min[l];
+            max[l] = x[l] > max[l] ? x[l] : max[l];
+        }
+    }
+}
+
+static int lanes_count_above(const int16_t *x, int blocks, int16_t threshold) {
+    uint16_t acc[BLOCK_LANES] = { 0 };
+    for (int b = 0; b < blocks; b++, x += BLOCK_LANES) {
+        for (int l = 0; l < BLOCK_LANES; l++) {
+            acc[l] += x[l] > threshold;
+        }
+    }
+    int count = 0;
+    for (int l = 0; l < BLOCK_LANES; l++) {
+        count += acc[l];
+    }
+    return count;
+}
+
+#endif
+
+// Samples before x reaches a vector boundary. Odd addresses never do, so
+// the whole buffer goes scalar.
+static int head_count(const int16_t *x, int n) {
+    uintptr_t addr = (uintptr_t)x;
+    if (addr & 1) {
+        return n;
+    }
+    int head = (int)(((BLOCK_ALIGN - (addr & (BLOCK_ALIGN - 1))) & (BLOCK_ALIGN - 1)) / sizeof(int16_t));
+    return head < n ? head : n;
+}
+
+int32_t block_sum_s16_scalar(const int16_t *x, int n) {
+    int32_t sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+int32_t block_sum_s16(const int16_t *x, int n) {
+    int head = head_count(x, n);
+    int blocks = (n - head) / BLOCK_LANES;
+    int32_t sum = block_sum_s16_scalar(x, head);
+    if (blocks > 0) {
+        sum += (int32_t)lanes_sum(x + head, blocks);
+    }
+    int done = head + blocks * BLOCK_LANES;
+    return sum + block_sum_s16_scalar(x + done, n - done);
+}
+
+// An empty buffer gives min INT16_MAX and max INT16_MIN
+void block_minmax_s16_scalar(const int16_t *x, int n, int16_t *min, int16_t *max) {
+    int16_t lo = INT16_MAX;
+    int16_t hi = INT16_MIN;
+    for (int i = 0; i < n; i++) {
+        lo = x[i] < lo ? x[i] : lo;
+        hi = x[i] > hi ? x[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+void block_minmax_s16(const int16_t *x, int n, int16_t *min, int16_t *max) {
+    int head = head_count(x, n);
+    int blocks = (n - head) / BLOCK_LANES;
+    int done = head + blocks * BLOCK_LANES;
+    int16_t lo, hi, tail_lo, tail_hi;
+    block_minmax_s16_scalar(x, head, &lo, &hi);
+    block_minmax_s16_scalar(x + done, n - done, &tail_lo, &tail_hi);
+    lo = tail_lo < lo ? tail_lo : lo;
+    hi = tail_hi > hi ? tail_hi : hi;
+    if (blocks > 0) {
+        int16_t lane_min[BLOCK_LANES] __attribute__((aligned(BLOCK_ALIGN)));
+        int16_t lane_max[BLOCK_LANES] __attribute__((aligned(BLOCK_ALIGN)));
+        lanes_minmax(x + head, blocks, lane_min, lane_max);
+        for (int l = 0; l < BLOCK_LANES; l++) {
+            lo = lane_min[l] < lo ? lane_min[l] : lo;
+            hi = lane_max[l] > hi ? lane_max[l] : hi;
+        }
+    }
+    *min = lo;
+    *max = hi;
+}
+
+int block_count_above_s16_scalar(const int16_t *x, int n, int16_t threshold) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        count += x[i] > threshold;
+    }
+    return count;
+}
+
+int block_count_above_s16(const int16_t *x, int n, int16_t threshold) {
+    int head = head_count(x, n);
+    int blocks = (n - head) / BLOCK_LANES;
+    int count = block_count_above_s16_scalar(x, head, threshold);
+    // A lane counter wraps after 65535 blocks, so long buffers go in chunks
+    for (int offset = 0; offset < blocks; offset += 0xffff) {
+        int chunk = blocks - offset < 0xffff ? blocks - offset : 0xffff;
+        count += lanes_count_above(x + head + offset * BLOCK_LANES, chunk, threshold);
+    }
+    int done = head + blocks * BLOCK_LANES;
+    return count + block_count_above_s16_scalar(x + done, n - done, threshold);
+}
+
+bool block_fir_init(block_fir_t *fir, const int16_t *coeffs, int taps, int shift, int step) {
+    if (taps < 1 || taps > BLOCK_FIR_MAX_TAPS || shift < 0 || shift > 31 || step < 1) {
+        return false;
+    }
+    memset(fir, 0, sizeof(*fir));
+    fir->taps = taps;
+    fir->shift = shift;
+    fir->step = step;
+    fir->bank_len = (taps + BLOCK_LANES - 1 + BLOCK_LANES - 1) / BLOCK_LANES * BLOCK_LANES;
+    memcpy(fir->coeffs, coeffs, taps * sizeof(int16_t));
+    for (int s = 0; s < BLOCK_LANES; s++) {
+        memcpy(&fir->bank[s][s], coeffs, taps * sizeof(int16_t));
+    }
+    return true;
+}
+
+// Mean of each run of `factor` samples, one output per run. factor is a
+// power of two up to BLOCK_FIR_MAX_TAPS.
+bool block_decimate_init(block_fir_t *fir, int factor) {
+    if (factor < 1 || factor > BLOCK_FIR_MAX_TAPS || (factor & (factor - 1)) != 0) {
+        return false;
+    }
+    int16_t coeffs[BLOCK_FIR_MAX_TAPS];
+    int shift = 0;
+    for (int i = 0; i < factor; i++) {
+        coeffs[i] = 1;
+    }
+    while ((1 << shift) < factor) {
+        shift++;
+    }
+    return block_fir_init(fir, coeffs, factor, shift, factor);
+}
+
+static int16_t fir_output(int64_t acc, int shift) {
+    if (acc > INT32_MAX) {
+        acc = INT32_MAX;
+    } else if (acc < INT32_MIN) {
+        acc = INT32_MIN;
+    }
+    if (shift > 0) {
+        acc = (acc + ((int64_t)1 << (shift - 1))) >> shift;
+    }
+    return acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : (int16_t)acc;
+}
+
+static int64_t fir_dot_scalar(const block_fir_t *fir, const int16_t *x) {
+    int64_t acc = 0;
+    for (int k = 0; k < fir->taps; k++) {
+        acc += (int32_t)x[k] * fir->coeffs[k];
+    }
+    return acc;
+}
+
+// Outputs for j = 0, step, 2*step, ... while the taps fit in x. Returns
+// the number written to y.
+int block_fir_run_scalar(const block_fir_t *fir, const int16_t *x, int n, int16_t *y) {
+    int count = 0;
+    for (int j = 0; j + fir->taps <= n; j += fir->step) {
+        y[count++] = fir_output(fir_dot_scalar(fir, x + j), fir->shift);
+    }
+    return count;
+}
+
+// Output j reads x from the vector boundary at or below j against the bank
+// row delayed by the remaining lanes. Outputs whose last vector would run
+// past the buffer fall back to scalar, so x is never over-read.
+int block_fir_run(const block_fir_t *fir, const int16_t *x, int n, int16_t *y) {
+    if ((uintptr_t)x & (BLOCK_ALIGN - 1)) {
+        return block_fir_run_scalar(fir, x, n, y);
+    }
+    int count = 0;
+    for (int j = 0; j + fir->taps <= n; j += fir->step) {
+        int base = j & ~(BLOCK_LANES - 1);
+        int delay = j - base;
+        int blocks = (fir->taps + delay + BLOCK_LANES - 1) / BLOCK_LANES;
+        int64_t acc;
+        if (base + blocks * BLOCK_LANES <= n) {
+            acc = lanes_dot(x + base, fir->bank[delay], blocks);
+        } else {
+            acc = fir_dot_scalar(fir, x + j);
+        }
+        y[count++] = fir_output(acc, fir->shift);
+    }
+    return count;
+}
+
+const char *block_kernels_path(void) {
+    return BLOCK_PIE ? "pie" : "portable";
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_BLOCK_KERNELS_BENCHMARK
+
+#define BENCH_SAMPLES 512
+
+static const char *TAG = "BLOCK_KERNELS";
+
+static int16_t bench_in[BENCH_SAMPLES] __attribute__((aligned(BLOCK_ALIGN)));
+static int16_t bench_out[2][BENCH_SAMPLES];
+static block_fir_t bench_fir;
+
+static void bench_report(const char *name, uint32_t scalar_cycles, uint32_t block_cycles, bool identical) {
+    ESP_LOGI(TAG, "%-10s scalar %u.%02u, %s %u.%02u cycles/sample, %s", name,
+             (unsigned)(scalar_cycles / BENCH_SAMPLES), (unsigned)(scalar_cycles % BENCH_SAMPLES * 100 / BENCH_SAMPLES),
+             block_kernels_path(),
+             (unsigned)(block_cycles / BENCH_SAMPLES), (unsigned)(block_cycles % BENCH_SAMPLES * 100 / BENCH_SAMPLES),
+             identical ? "identical" : "DIFFERENT");
+}
+
+void block_kernels_benchmark(void) {
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        bench_in[i] = (int16_t)(seed >> 16);
+    }
+    uint32_t start, scalar_cycles, block_cycles;
+
+    start = esp_cpu_get_cycle_count();
+    int32_t sum_scalar = block_sum_s16_scalar(bench_in, BENCH_SAMPLES);
+    scalar_cycles = esp_cpu_get_cycle_count() - start;
+    start = esp_cpu_get_cycle_count();
+    int32_t sum_block = block_sum_s16(bench_in, BENCH_SAMPLES);
+    block_cycles = esp_cpu_get_cycle_count() - start;
+    bench_report("sum", scalar_cycles, block_cycles, sum_scalar == sum_block);
+
+    int16_t min[2], max[2];
+    start = esp_cpu_get_cycle_count();
+    block_minmax_s16_scalar(bench_in, BENCH_SAMPLES, &min[0], &max[0]);
+    scalar_cycles = esp_cpu_get_cycle_count() - start;
+    start = esp_cpu_get_cycle_count();
+    block_minmax_s16(bench_in, BENCH_SAMPLES, &min[1], &max[1]);
+    block_cycles = esp_cpu_get_cycle_count() - start;
+    bench_report("minmax", scalar_cycles, block_cycles, min[0] == min[1] && max[0] == max[1]);
+
+    start = esp_cpu_get_cycle_count();
+    int above_scalar = block_count_above_s16_scalar(bench_in, BENCH_SAMPLES, 1000);
+    scalar_cycles = esp_cpu_get_cycle_count() - start;
+    start = esp_cpu_get_cycle_count();
+    int above_block = block_count_above_s16(bench_in, BENCH_SAMPLES, 1000);
+    block_cycles = esp_cpu_get_cycle_count() - start;
+    bench_report("threshold", scalar_cycles, block_cycles, above_scalar == above_block);
+
+    // 16-tap low-pass and decimation by 8, as the oversampling front end uses them
+    static const int16_t lowpass[16] = {
+        -120, -250, 0, 1100, 3000, 5200, 6900, 7600, 7600, 6900, 5200, 3000, 1100, 0, -250, -120
+    };
+    block_fir_init(&bench_fir, lowpass, 16, 15, 1);
+    start = esp_cpu_get_cycle_count();
+    int outputs = block_fir_run_scalar(&bench_fir, bench_in, BENCH_SAMPLES, bench_out[0]);
+    scalar_cycles = esp_cpu_get_cycle_count() - start;
+    start = esp_cpu_get_cycle_count();
+    block_fir_run(&bench_fir, bench_in, BENCH_SAMPLES, bench_out[1]);
+    block_cycles = esp_cpu_get_cycle_count() - start;
+    bench_report("fir16", scalar_cycles, block_cycles, memcmp(bench_out[0], bench_out[1], outputs * sizeof(int16_t)) == 0);
+
+    block_decimate_init(&bench_fir, 8);
+    start = esp_cpu_get_cycle_count();
+    outputs = block_fir_run_scalar(&bench_fir, bench_in, BENCH_SAMPLES, bench_out[0]);
+    scalar_cycles = esp_cpu_get_cycle_count() - start;
+    start = esp_cpu_get_cycle_count();
+    block_fir_run(&bench_fir, bench_in, BENCH_SAMPLES, bench_out[1]);
+    block_cycles = esp_cpu_get_cycle_count() - start;
+    bench_report("decimate8", scalar_cycles, block_cycles, memcmp(bench_out[0], bench_out[1], outputs * sizeof(int16_t)) == 0);
+}
+
+#else
+
+void block_kernels_benchmark(void) {
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef BLOCK_KERNELS_H
+#define BLOCK_KERNELS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Block kernels over int16 sample buffers for the conditioning code: sum,
+// min/max, threshold count and FIR with optional decimation. Every kernel
+// has a scalar reference (_scalar) and a block path that works on aligned
+// runs of 8 lanes. On the ESP32-S3 the lane loops use the PIE vector unit
+// (CONFIG_GAS_BLOCK_KERNELS_PIE); elsewhere they are portable C. Both paths
+// give bit-identical results for any length and alignment; buffers that are
+// 16-byte aligned take the vector path for their whole body.
+//
+// Results are exact: sums are int32 (n up to 65535 samples), FIR outputs are
+// the int64 dot product saturated to int32, rounded-shifted by `shift` and
+// saturated to int16.
+
+#define BLOCK_LANES         8
+#define BLOCK_FIR_MAX_TAPS  32
+#define BLOCK_ALIGN         16
+
+// Room for the taps plus one lane of offset, in whole vectors
+#define BLOCK_FIR_BANK_LEN  (BLOCK_FIR_MAX_TAPS + BLOCK_LANES)
+
+typedef struct {
+    int taps;
+    int shift;
+    int step;               // decimation factor, 1 = one output per input
+    int bank_len;           // used length of each bank row, a multiple of BLOCK_LANES
+    int16_t coeffs[BLOCK_FIR_MAX_TAPS];
+    // Row s holds the taps delayed by s lanes, so an output that starts s
+    // samples past an aligned address is one aligned dot product
+    int16_t bank[BLOCK_LANES][BLOCK_FIR_BANK_LEN] __attribute__((aligned(BLOCK_ALIGN)));
+} block_fir_t;
+
+// Function prototypes
+int32_t block_sum_s16(const int16_t *x, int n);
+int32_t block_sum_s16_scalar(const int16_t *x, int n);
+void block_minmax_s16(const int16_t *x, int n, int16_t *min, int16_t *max);
+void block_minmax_s16_scalar(const int16_t *x, int n, int16_t *min, int16_t *max);
+int block_count_above_s16(const int16_t *x, int n, int16_t threshold);
+int block_count_above_s16_scalar(const int16_t *x, int n, int16_t threshold);
+
+bool block_fir_init(block_fir_t *fir, const int16_t *coeffs, int taps, int shift, int step);
+bool block_decimate_init(block_fir_t *fir, int factor);
+int block_fir_run(const block_fir_t *fir, const int16_t *x, int n, int16_t *y);
+int block_fir_run_scalar(const block_fir_t *fir, const int16_t *x, int n, int16_t *y);
+
+const char *block_kernels_path(void);
+void block_kernels_benchmark(void);
+
+#endif
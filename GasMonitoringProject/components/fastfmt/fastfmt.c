@@ -0,0 +1,163 @@
+#include "fastfmt.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#endif
+
+// Two ASCII digits for every value 0..99
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static void put(fastfmt_t *f, const char *data, size_t len) {
+    if (f->len + len >= f->size) {
+        len = f->size > f->len ? f->size - f->len - 1 : 0;
+    }
+    memcpy(f->buf + f->len, data, len);
+    f->len += len;
+}
+
+void fastfmt_str(fastfmt_t *f, const char *str) {
+    put(f, str, strlen(str));
+}
+
+// Digits of value, right-aligned at end. Returns the first digit.
+static char *u32_digits(char *end, uint32_t value) {
+    while (value >= 100) {
+        uint32_t pair = value % 100;
+        value /= 100;
+        end -= 2;
+        memcpy(end, &digit_pairs[pair * 2], 2);
+    }
+    if (value >= 10) {
+        end -= 2;
+        memcpy(end, &digit_pairs[value * 2], 2);
+    } else {
+        *--end = (char)('0' + value);
+    }
+    return end;
+}
+
+void fastfmt_u32(fastfmt_t *f, uint32_t value) {
+    char digits[10];
+    char *end = digits + sizeof(digits);
+    char *start = u32_digits(end, value);
+    put(f, start, end - start);
+}
+
+void fastfmt_fixed2(fastfmt_t *f, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t exponent = (bits >> 23) & 0xFF;
+    uint32_t fraction = bits & 0x7FFFFF;
+
+    // inf, nan and magnitudes of 2^40 and up never occur in sensor data
+    if (exponent == 0xFF || exponent >= 127 + 40) {
+        char text[FASTFMT_FIXED2_MAX + 8];
+        snprintf(text, sizeof(text), "%.2f", value);
+        fastfmt_str(f, text);
+        return;
+    }
+
+    // value = mantissa * 2^shift exactly, so value * 100 is an exact binary
+    // fraction and can be rounded half-to-even like printf does
+    uint64_t mantissa = exponent == 0 ? fraction : (fraction | 0x800000);
+    int shift = exponent == 0 ? -149 : (int)exponent - 150;
+    uint64_t scaled = mantissa * 100;
+    uint64_t hundredths;
+    if (shift >= 0) {
+        hundredths = scaled << shift;
+    } else if (shift <= -40) {
+        hundredths = 0;     // scaled < 2^31, so the value is below 0.005
+    } else {
+        hundredths = scaled >> -shift;
+        uint64_t rest = scaled & ((1ULL << -shift) - 1);
+        uint64_t half = 1ULL << (-shift - 1);
+        if (rest > half || (rest == half && (hundredths & 1))) {
+            hundredths++;
+        }
+    }
+
+    char text[FASTFMT_FIXED2_MAX];
+    char *end = text + sizeof(text);
+    char *start = end - 3;
+    uint32_t cents;
+    if (hundredths <= UINT32_MAX) {
+        uint32_t small = (uint32_t)hundredths;
+        cents = small % 100;
+        start = u32_digits(start, small / 100);
+    } else {
+        uint64_t whole = hundredths / 100;
+        cents = (uint32_t)(hundredths % 100);
+        while (whole > UINT32_MAX) {
+            *--start = (char)('0' + whole % 10);
+            whole /= 10;
+        }
+        start = u32_digits(start, (uint32_t)whole);
+    }
+    end[-3] = '.';
+    memcpy(end - 2, &digit_pairs[cents * 2], 2);
+    if (bits >> 31) {
+        *--start = '-';     // printf keeps the sign of values that round to zero, e.g. "-0.00"
+    }
+    put(f, start, end - start);
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_FASTFMT_BENCHMARK
+
+#define BENCH_ROUNDS 32
+
+static const char *TAG = "FASTFMT";
+
+static int frame_fast(char *buf, size_t size, const float *v) {
+    fastfmt_t f;
+    fastfmt_begin(&f, buf, size);
+    fastfmt_str(&f, "Temp:");
+    fastfmt_fixed2(&f, v[0]);
+    fastfmt_str(&f, ",Humidity:");
+    fastfmt_fixed2(&f, v[1]);
+    fastfmt_str(&f, ",NH3:");
+    fastfmt_fixed2(&f, v[2]);
+    fastfmt_str(&f, ",H2S:");
+    fastfmt_fixed2(&f, v[3]);
+    fastfmt_str(&f, ",CO2:");
+    fastfmt_fixed2(&f, v[4]);
+    fastfmt_str(&f, ",CH4:");
+    fastfmt_fixed2(&f, v[5]);
+    return fastfmt_end(&f);
+}
+
+void fastfmt_benchmark(void) {
+    static const float values[6] = { 71.27f, 43.61f, 12.345f, 0.125f, 415.5f, -0.004f };
+    char fast[128];
+    char slow[128];
+    uint32_t start;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        frame_fast(fast, sizeof(fast), values);
+    }
+    uint32_t fast_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_ROUNDS;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        snprintf(slow, sizeof(slow), "Temp:%.2f,Humidity:%.2f,NH3:%.2f,H2S:%.2f,CO2:%.2f,CH4:%.2f",
+                 values[0], values[1], values[2], values[3], values[4], values[5]);
+    }
+    uint32_t slow_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_ROUNDS;
+
+    ESP_LOGI(TAG, "Frame build cycles: fastfmt %u, snprintf %u, output %s",
+             (unsigned)fast_cycles, (unsigned)slow_cycles, strcmp(fast, slow) == 0 ? "identical" : "DIFFERENT");
+}
+
+#else
+
+void fastfmt_benchmark(void) {
+}
+
+#endif
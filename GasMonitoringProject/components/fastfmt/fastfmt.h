@@ -0,0 +1,55 @@
+#ifndef FASTFMT_H
+#define FASTFMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-point text formatting for the sample frames. Writes straight into the
+// caller's socket or UART buffer without varargs or float arithmetic, and the
+// output is byte-identical to snprintf("%.2f"). Output that does not fit is
+// truncated, and the buffer always stays NUL-terminated, like snprintf.
+//
+//   fastfmt_t f;
+//   fastfmt_begin(&f, buf, sizeof(buf));
+//   fastfmt_str(&f, "Temp:");
+//   fastfmt_fixed2(&f, temperature);
+//   int len = fastfmt_end(&f);
+
+// Longest fastfmt_fixed2() output: sign, 39 integer digits, point, 2 decimals
+#define FASTFMT_FIXED2_MAX 44
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} fastfmt_t;
+
+static inline void fastfmt_begin(fastfmt_t *f, char *buf, size_t size) {
+    f->buf = buf;
+    f->size = size;
+    f->len = 0;
+    if (size > 0) {
+        buf[0] = '\0';
+    }
+}
+
+static inline void fastfmt_char(fastfmt_t *f, char ch) {
+    if (f->len + 1 < f->size) {
+        f->buf[f->len++] = ch;
+    }
+}
+
+static inline int fastfmt_end(fastfmt_t *f) {
+    if (f->size > 0) {
+        f->buf[f->len] = '\0';
+    }
+    return (int)f->len;
+}
+
+// Function prototypes
+void fastfmt_str(fastfmt_t *f, const char *str);
+void fastfmt_u32(fastfmt_t *f, uint32_t value);
+void fastfmt_fixed2(fastfmt_t *f, float value);
+void fastfmt_benchmark(void);
+
+#endif
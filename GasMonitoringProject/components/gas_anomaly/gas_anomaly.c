@@ -0,0 +1,217 @@
+#include "gas_anomaly.h"
+#include <math.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#endif
+
+#define MAD_TO_SIGMA 1.4826f    // sigma / MAD for normal noise
+
+void gas_anomaly_init(gas_anomaly_t *detector, const gas_anomaly_config_t *config) {
+    float threshold = config->threshold < 1 ? 1 : config->threshold > 16 ? 16 : config->threshold;
+    detector->mode = config->mode;
+    detector->shift = config->shift < 1 ? 1 : config->shift > GAS_ANOMALY_MAX_SHIFT ? GAS_ANOMALY_MAX_SHIFT : config->shift;
+    detector->warmup = config->warmup;
+    detector->threshold = (uint16_t)(threshold * 256 + 0.5f);
+    detector->band = config->mode == GAS_ANOMALY_MAD ? (uint32_t)(threshold * MAD_TO_SIGMA * 256 + 0.5f)
+                                                     : (uint32_t)(threshold * threshold * 256 + 0.5f);
+    detector->min_spread = gas_fixed_from_float(config->min_spread);
+    if (detector->min_spread < 1) {
+        detector->min_spread = 1;
+    }
+    detector->max_rate = config->max_rate > 0 ? gas_fixed_from_float(config->max_rate) : 0;
+    gas_anomaly_reset(detector);
+}
+
+void gas_anomaly_reset(gas_anomaly_t *detector) {
+    detector->count = 0;
+    detector->run = 0;
+    detector->center = 0;
+    detector->var = 0;
+}
+
+// The first sample after a (re)start is the baseline
+static void anomaly_restart(gas_anomaly_t *detector, gas_fixed_t value, uint32_t now_ms) {
+    detector->count = 1;
+    detector->run = 0;
+    detector->center = value;
+    detector->previous = value;
+    detector->previous_ms = now_ms;
+    if (detector->mode == GAS_ANOMALY_MAD) {
+        detector->mad = 0;
+    } else {
+        detector->var = 0;
+    }
+}
+
+// Outside threshold * max(sigma, min_spread), sigma from the EWMA variance
+static bool zscore_outlier(const gas_anomaly_t *detector, int32_t d) {
+    uint64_t var = detector->var;
+    uint64_t floor = (uint64_t)detector->min_spread * (uint64_t)detector->min_spread;
+    if (var < floor) {
+        var = floor;
+    }
+    // d^2 > threshold^2 * var with the Q8 threshold split so nothing overflows
+    uint64_t band = (var >> 8) * detector->band + (((var & 0xff) * detector->band) >> 8);
+    return (uint64_t)((int64_t)d * d) > band;
+}
+
+// EWMA with alpha = 1 / min(n, 2^shift), so the first 2^shift samples
+// average evenly instead of starting from zero
+static void zscore_learn(gas_anomaly_t *detector, int32_t d) {
+    int64_t delta = (int64_t)d * d - (int64_t)detector->var;
+    if (detector->count < (1u << detector->shift)) {
+        int32_t n = detector->count + 1;
+        detector->center += d / n;
+        detector->var += delta / n;
+    } else {
+        int shift = detector->shift;
+        detector->center += (d + (1 << (shift - 1))) >> shift;
+        detector->var += delta >> shift;
+    }
+}
+
+static bool mad_outlier(const gas_anomaly_t *detector, int32_t d) {
+    int64_t band = (int64_t)detector->band * detector->mad;
+    int64_t floor = (int64_t)detector->threshold * detector->min_spread;
+    return (int64_t)(d < 0 ? -d : d) * 256 > (band > floor ? band : floor);
+}
+
+// Frugal median and MAD: each moves one step of MAD / 2^shift towards the
+// sample. Warming up they start as the running mean and mean absolute
+// deviation instead, which reach the signal's scale within a few samples;
+// the steps refine them from there.
+static void mad_learn(gas_anomaly_t *detector, int32_t d) {
+    int32_t deviation = (d < 0 ? -d : d) - detector->mad;
+    if (detector->count < detector->warmup) {
+        int32_t n = detector->count + 1;
+        detector->center += d / n;
+        detector->mad += deviation / n;
+        return;
+    }
+    int32_t scale = detector->mad > detector->min_spread ? detector->mad : detector->min_spread;
+    int32_t step = scale >> detector->shift;
+    if (step < 1) {
+        step = 1;
+    }
+    if (d > 0) {
+        detector->center += d < step ? d : step;
+    } else if (d < 0) {
+        detector->center -= -d < step ? -d : step;
+    }
+    if (deviation > 0) {
+        detector->mad += deviation < step ? deviation : step;
+    } else if (deviation < 0) {
+        detector->mad -= -deviation < step ? -deviation : step;
+    }
+}
+
+uint8_t gas_anomaly_step(gas_anomaly_t *detector, gas_fixed_t value, uint32_t now_ms) {
+    uint8_t flags = 0;
+    if (detector->mode == GAS_ANOMALY_OFF) {
+        return 0;
+    }
+
+    if (detector->count == 0) {
+        anomaly_restart(detector, value, now_ms);
+        return 0;
+    }
+
+    // |dx| / dt > max_rate against the last sample that was not flagged, so
+    // a spike trips it on the way up only; dt in ms
+    if (detector->max_rate > 0) {
+        uint32_t dt_ms = now_ms - detector->previous_ms;
+        int64_t dx = (int64_t)value - detector->previous;
+        if ((dx < 0 ? -dx : dx) * 1000 > detector->max_rate * (dt_ms > 0 ? dt_ms : 1)) {
+            flags |= GAS_ANOMALY_RATE;
+        }
+    }
+
+    int32_t d = value - detector->center;
+    bool mad = detector->mode == GAS_ANOMALY_MAD;
+    if (detector->count >= detector->warmup && (mad ? mad_outlier(detector, d) : zscore_outlier(detector, d))) {
+        flags |= GAS_ANOMALY_LEVEL;
+    }
+    if (flags != 0) {
+        // Kept out of the baseline; a level that persists becomes the new one
+        if (++detector->run >= GAS_ANOMALY_RELEARN) {
+            anomaly_restart(detector, value, now_ms);
+        }
+        return flags;
+    }
+    detector->run = 0;
+    detector->previous = value;
+    detector->previous_ms = now_ms;
+    if (mad) {
+        mad_learn(detector, d);
+    } else {
+        zscore_learn(detector, d);
+    }
+    if (detector->count < UINT16_MAX) {
+        detector->count++;
+    }
+    return flags;
+}
+
+// Current noise estimate in channel units: the standard deviation, or
+// 1.4826 MAD
+float gas_anomaly_spread(const gas_anomaly_t *detector) {
+    if (detector->mode == GAS_ANOMALY_MAD) {
+        return gas_fixed_to_float(detector->mad) * MAD_TO_SIGMA;
+    }
+    return sqrtf((float)detector->var) / (1 << GAS_FILTER_FRAC_BITS);
+}
+
+const char *gas_anomaly_mode_name(gas_anomaly_mode_t mode) {
+    switch (mode) {
+        case GAS_ANOMALY_ZSCORE: return "zscore";
+        case GAS_ANOMALY_MAD:    return "mad";
+        default:                 return "off";
+    }
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_ANOMALY_BENCHMARK
+
+#define BENCH_SAMPLES 256
+
+static const char *TAG = "GAS_ANOMALY";
+
+void gas_anomaly_benchmark(void) {
+    static gas_fixed_t input[BENCH_SAMPLES];
+    static gas_anomaly_t detector;
+
+    // Noisy level with a spike every 32 samples
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = (gas_fixed_t)((100 << GAS_FILTER_FRAC_BITS) + (int32_t)(seed >> 20) - 2048);
+        if (i % 32 == 31) {
+            input[i] += 100 << GAS_FILTER_FRAC_BITS;
+        }
+    }
+
+    for (int mode = GAS_ANOMALY_ZSCORE; mode <= GAS_ANOMALY_MAD; mode++) {
+        gas_anomaly_config_t config = {
+            .mode = mode, .shift = CONFIG_GAS_ANOMALY_SHIFT, .warmup = 16,
+            .threshold = CONFIG_GAS_ANOMALY_THRESHOLD_X10 / 10.0f, .min_spread = 0.5f, .max_rate = 50.0f,
+        };
+        gas_anomaly_init(&detector, &config);
+        int flagged = 0;
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            flagged += gas_anomaly_step(&detector, input[i], i * 1000) != 0;
+        }
+        uint32_t cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+        ESP_LOGI(TAG, "%-6s %u cycles/sample, %d of %d samples flagged", gas_anomaly_mode_name(mode),
+                 (unsigned)cycles, flagged, BENCH_SAMPLES);
+    }
+}
+
+#else
+
+void gas_anomaly_benchmark(void) {
+}
+
+#endif
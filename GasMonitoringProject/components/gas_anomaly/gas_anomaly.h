@@ -0,0 +1,84 @@
+#ifndef GAS_ANOMALY_H
+#define GAS_ANOMALY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gas_filter.h"
+
+// Streaming anomaly detection per channel, so the node can flag the samples
+// worth looking at instead of the gateway scanning every frame. Each channel
+// keeps a few words of state in gas_anomaly_t and costs O(1) per sample, in
+// the same Q24.8 fixed point as the filters:
+//
+//   z-score    EWMA mean and variance, alpha = 1 / 2^shift; flags samples
+//              more than `threshold` standard deviations from the mean
+//   MAD        streaming median and median absolute deviation (frugal
+//              estimates, stepping by MAD / 2^shift per sample); flags
+//              samples more than `threshold` sigmas away, sigma = 1.4826 MAD,
+//              and a spike moves either estimate by one step only
+//   rate       |x - previous| over the time between them against max_rate,
+//              on top of either mode, previous being the last sample that
+//              was not flagged
+//
+// Flagged samples are left out of the baseline. When the flags last for
+// GAS_ANOMALY_RELEARN samples in a row the level is taken as the new normal
+// and the detector warms up again from it, so a step is reported once
+// instead of for good.
+
+#define GAS_ANOMALY_MAX_SHIFT 8
+#define GAS_ANOMALY_RELEARN   8
+
+// Room for the ",A:<hex channel mask>" the node appends to a TCP frame
+#define GAS_ANOMALY_SUFFIX_LEN 16
+
+// Flags returned per sample
+#define GAS_ANOMALY_LEVEL 0x01      // outside the z-score or MAD band
+#define GAS_ANOMALY_RATE  0x02      // changed faster than max_rate
+
+typedef enum {
+    GAS_ANOMALY_OFF,
+    GAS_ANOMALY_ZSCORE,
+    GAS_ANOMALY_MAD,
+} gas_anomaly_mode_t;
+
+typedef struct {
+    gas_anomaly_mode_t mode;
+    uint8_t shift;          // 1..GAS_ANOMALY_MAX_SHIFT
+    uint8_t warmup;         // samples before anything is flagged
+    float threshold;        // standard deviations, 1..16
+    float min_spread;       // floor of the standard deviation, channel units
+    float max_rate;         // channel units per second, 0 = no rate check
+} gas_anomaly_config_t;
+
+typedef struct {
+    gas_anomaly_mode_t mode;
+    uint8_t shift;
+    uint8_t warmup;
+    uint8_t run;                // flagged samples in a row
+    uint16_t count;             // samples learned since the (re)start, saturating
+    uint16_t threshold;         // Q8
+    uint32_t band;              // Q8: threshold^2 (z-score) or 1.4826 threshold (MAD)
+    int32_t min_spread;         // LSB
+    int64_t max_rate;           // LSB per second, 0 = off
+    gas_fixed_t previous;       // last sample that was not flagged
+    uint32_t previous_ms;
+    gas_fixed_t center;         // EWMA mean or median
+    union {
+        uint64_t var;           // z-score, LSB^2
+        int32_t mad;            // MAD, LSB
+    };
+} gas_anomaly_t;
+
+// Function prototypes
+void gas_anomaly_init(gas_anomaly_t *detector, const gas_anomaly_config_t *config);
+void gas_anomaly_reset(gas_anomaly_t *detector);
+uint8_t gas_anomaly_step(gas_anomaly_t *detector, gas_fixed_t value, uint32_t now_ms);
+float gas_anomaly_spread(const gas_anomaly_t *detector);
+const char *gas_anomaly_mode_name(gas_anomaly_mode_t mode);
+void gas_anomaly_benchmark(void);
+
+static inline uint8_t gas_anomaly_apply(gas_anomaly_t *detector, float value, uint32_t now_ms) {
+    return detector->mode == GAS_ANOMALY_OFF ? 0 : gas_anomaly_step(detector, gas_fixed_from_float(value), now_ms);
+}
+
+#endif
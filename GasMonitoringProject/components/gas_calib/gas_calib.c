@@ -0,0 +1,264 @@
+#include "gas_calib.h"
+#include <math.h>
+#include <string.h>
+#include "gas_calib_tables.h"
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "nvs.h"
+#endif
+
+_Static_assert(GAS_CALIB_TABLE_SENSORS == GAS_CALIB_SENSORS, "gas_calib_curves.csv and gas_calib_sensor_t differ");
+
+#define GAS_CALIB_GRID_SHIFT (16 - GAS_CALIB_GRID_LOG2)
+#define GAS_CALIB_EXP_SHIFT  (16 - GAS_CALIB_LOG_SEGMENTS_LOG2)
+
+static uint32_t gas_calib_r0_ohms[GAS_CALIB_SENSORS];
+static uint32_t gas_calib_load_per_r0[GAS_CALIB_SENSORS];    // RL / R0, Q16
+
+void gas_calib_init(void) {
+    for (int sensor = 0; sensor < GAS_CALIB_SENSORS; sensor++) {
+        gas_calib_set_r0(sensor, gas_calib_curves[sensor].r0_ohms);
+    }
+}
+
+const gas_calib_curve_t *gas_calib_curve(gas_calib_sensor_t sensor) {
+    return &gas_calib_curves[sensor];
+}
+
+int gas_calib_find(const char *name) {
+    for (int sensor = 0; sensor < GAS_CALIB_SENSORS; sensor++) {
+        if (strcmp(gas_calib_curves[sensor].name, name) == 0) {
+            return sensor;
+        }
+    }
+    return -1;
+}
+
+bool gas_calib_set_r0(gas_calib_sensor_t sensor, uint32_t r0_ohms) {
+    if (sensor < 0 || sensor >= GAS_CALIB_SENSORS || r0_ohms == 0) {
+        return false;
+    }
+    uint64_t load_per_r0 = ((uint64_t)gas_calib_curves[sensor].load_ohms << 16) / r0_ohms;
+    if (load_per_r0 == 0 || load_per_r0 > UINT32_MAX) {
+        return false;
+    }
+    gas_calib_r0_ohms[sensor] = r0_ohms;
+    gas_calib_load_per_r0[sensor] = (uint32_t)load_per_r0;
+    return true;
+}
+
+uint32_t gas_calib_r0(gas_calib_sensor_t sensor) {
+    return gas_calib_r0_ohms[sensor];
+}
+
+// Rs/R0 in Q16 from the divider: Rs = RL (full_scale - code) / code
+uint32_t gas_calib_ratio(gas_calib_sensor_t sensor, int32_t code, int32_t full_scale) {
+    if (code <= 0) {
+        return UINT32_MAX;
+    }
+    if (code >= full_scale) {
+        return 0;
+    }
+    uint64_t ratio = (uint64_t)(full_scale - code) * gas_calib_load_per_r0[sensor] / (uint32_t)code;
+    return ratio > UINT32_MAX ? UINT32_MAX : (uint32_t)ratio;
+}
+
+// log2(x / 2^16) in Q16, x > 0: the exponent from the leading one, the
+// mantissa from the table
+static int32_t gas_calib_log2(uint32_t x) {
+    int lead = __builtin_clz(x);
+    uint32_t frac = (x << lead) & 0x7fffffff;
+    uint32_t i = frac >> (31 - GAS_CALIB_LOG_SEGMENTS_LOG2);
+    int32_t w = (int32_t)((frac >> (15 - GAS_CALIB_LOG_SEGMENTS_LOG2)) & 0xffff);
+    int32_t lo = gas_calib_log2_table[i];
+    int32_t hi = gas_calib_log2_table[i + 1];
+    return (15 - lead) * 65536 + lo + (((hi - lo) * w) >> 16);
+}
+
+// 2^(y / 2^16) as ppm in Q8, saturating at GAS_CALIB_PPM_LIMIT
+static int32_t gas_calib_exp2(int32_t y) {
+    int32_t whole = y >> 16;
+    uint32_t frac = (uint32_t)y & 0xffff;
+    uint32_t i = frac >> GAS_CALIB_EXP_SHIFT;
+    uint32_t w = frac & ((1u << GAS_CALIB_EXP_SHIFT) - 1);
+    uint32_t lo = gas_calib_exp2_table[i];
+    uint32_t value = lo + (((gas_calib_exp2_table[i + 1] - lo) * w) >> GAS_CALIB_EXP_SHIFT);
+    int shift = whole + GAS_CALIB_PPM_FRAC_BITS - GAS_CALIB_EXP_BITS;
+    if (shift >= 0) {
+        return GAS_CALIB_PPM_LIMIT;     // value is at least 2^24 already
+    }
+    if (shift < -31) {
+        return 0;
+    }
+    return (int32_t)((value + (1u << (-shift - 1))) >> -shift);
+}
+
+// ppm in Q8 for Rs/R0 in Q16
+int32_t gas_calib_ppm(gas_calib_sensor_t sensor, uint32_t ratio) {
+    const gas_calib_curve_t *curve = &gas_calib_curves[sensor];
+    int32_t y;
+    int32_t x = ratio == 0 ? 0 : gas_calib_log2(ratio) - curve->grid_first;
+    if (ratio == 0 || x <= 0) {
+        y = curve->grid[0];
+    } else if ((x >> GAS_CALIB_GRID_SHIFT) >= curve->grid_points - 1) {
+        y = curve->grid[curve->grid_points - 1];
+    } else {
+        const int32_t *grid = &curve->grid[x >> GAS_CALIB_GRID_SHIFT];
+        int32_t w = x & ((1 << GAS_CALIB_GRID_SHIFT) - 1);
+        y = grid[0] + (((grid[1] - grid[0]) * w) >> GAS_CALIB_GRID_SHIFT);
+    }
+    return gas_calib_exp2(y);
+}
+
+// The textbook conversion on the datasheet segment the ratio falls in
+float gas_calib_reference_ppm(gas_calib_sensor_t sensor, float ratio) {
+    const gas_calib_curve_t *curve = &gas_calib_curves[sensor];
+    const gas_calib_segment_t *segment = curve->segments;
+    while (segment < curve->segments + curve->segment_count - 1 && ratio > segment->ratio_end) {
+        segment++;
+    }
+    return powf(10.0f, (log10f(ratio) - segment->b) / segment->m);
+}
+
+// Share of the supply the divider puts on the ADC at `ppm`, for the
+// simulated inputs
+float gas_calib_share_for_ppm(gas_calib_sensor_t sensor, float ppm) {
+    const gas_calib_curve_t *curve = &gas_calib_curves[sensor];
+    float ratio = 0;
+    for (int i = 0; i < curve->segment_count; i++) {
+        const gas_calib_segment_t *segment = &curve->segments[i];
+        ratio = powf(10.0f, segment->m * log10f(fmaxf(ppm, 0.01f)) + segment->b);
+        if (ratio <= segment->ratio_end) {
+            break;
+        }
+    }
+    return 1.0f / (1.0f + ratio * gas_calib_r0_ohms[sensor] / curve->load_ohms);
+}
+
+#ifdef ESP_PLATFORM
+
+static const char *TAG = "GAS_CALIB";
+
+// Stored R0 values replace the nominal ones; a missing namespace or key
+// keeps the nominal R0
+esp_err_t gas_calib_load_nvs(int *loaded) {
+    *loaded = 0;
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open("gas_calib", NVS_READONLY, &handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    for (int sensor = 0; sensor < GAS_CALIB_SENSORS; sensor++) {
+        uint32_t r0_ohms;
+        ret = nvs_get_u32(handle, gas_calib_curves[sensor].name, &r0_ohms);
+        if (ret == ESP_ERR_NVS_NOT_FOUND) {
+            continue;
+        }
+        if (ret != ESP_OK || !gas_calib_set_r0(sensor, r0_ohms)) {
+            ESP_LOGW(TAG, "Ignoring stored R0 of %s (%s)", gas_calib_curves[sensor].name, esp_err_to_name(ret));
+            continue;
+        }
+        (*loaded)++;
+    }
+    nvs_close(handle);
+    return ESP_OK;
+}
+
+static esp_err_t gas_calib_store_r0(gas_calib_sensor_t sensor, uint32_t r0_ohms) {
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open("gas_calib", NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ret = nvs_set_u32(handle, gas_calib_curves[sensor].name, r0_ohms);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return ret;
+}
+
+#else
+
+esp_err_t gas_calib_load_nvs(int *loaded) {
+    *loaded = 0;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t gas_calib_store_r0(gas_calib_sensor_t sensor, uint32_t r0_ohms) {
+    return ESP_OK;
+}
+
+#endif
+
+// Field calibration: `code` is a reading taken in clean air after the
+// sensor's warm-up, where Rs/R0 is the clean-air ratio of its datasheet.
+// Sets and stores the R0 that implies. Readings near either rail are
+// refused, they say more about the wiring than the sensor.
+esp_err_t gas_calib_zero(gas_calib_sensor_t sensor, int32_t code, int32_t full_scale, uint32_t *r0_ohms) {
+    if (sensor < 0 || sensor >= GAS_CALIB_SENSORS || code < full_scale / 64 || code > full_scale - full_scale / 64) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const gas_calib_curve_t *curve = &gas_calib_curves[sensor];
+    double rs = (double)curve->load_ohms * (full_scale - code) / code;
+    uint32_t r0 = (uint32_t)(rs / curve->clean_air_ratio + 0.5);
+    if (!gas_calib_set_r0(sensor, r0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (r0_ohms != NULL) {
+        *r0_ohms = r0;
+    }
+    return gas_calib_store_r0(sensor, r0);
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_CALIB_BENCHMARK
+
+#define BENCH_SAMPLES 256
+
+void gas_calib_benchmark(void) {
+    static int32_t codes[BENCH_SAMPLES];
+    const int32_t full_scale = 4096 << 8;
+
+    // Codes spread over the working part of the divider
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        codes[i] = full_scale / 16 + (int32_t)((seed >> 8) % (uint32_t)(full_scale * 7 / 8));
+    }
+
+    for (int sensor = 0; sensor < GAS_CALIB_SENSORS; sensor++) {
+        volatile int32_t sink = 0;
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            sink = gas_calib_ppm_from_code(sensor, codes[i], full_scale);
+        }
+        uint32_t table_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+
+        volatile float reference = 0;
+        const gas_calib_curve_t *curve = &gas_calib_curves[sensor];
+        start = esp_cpu_get_cycle_count();
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            float rs = (float)curve->load_ohms * (full_scale - codes[i]) / codes[i];
+            reference = gas_calib_reference_ppm(sensor, rs / gas_calib_r0_ohms[sensor]);
+        }
+        uint32_t reference_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+
+        ESP_LOGI(TAG, "%s: table %u cycles/sample, pow() reference %u cycles/sample", curve->name,
+                 (unsigned)table_cycles, (unsigned)reference_cycles);
+        (void)sink;
+        (void)reference;
+    }
+}
+
+#else
+
+void gas_calib_benchmark(void) {
+}
+
+#endif
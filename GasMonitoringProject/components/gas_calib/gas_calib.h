@@ -0,0 +1,90 @@
+#ifndef GAS_CALIB_H
+#define GAS_CALIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#else
+// Host builds of the tables and the evaluation
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#endif
+
+// Rs/R0 to ppm for the MQ sensors. An MQ sensor is a resistance Rs in a
+// divider with the load resistor RL, so the ADC code gives Rs, and its
+// datasheet curve gives ppm against Rs/R0 on log-log axes, where R0 is
+// the sensor's resistance in its calibration gas.
+//
+// The curves live in gas_calib_curves.csv. At build time gas_calib_gen.py
+// samples each one on a uniform grid in log2(Rs/R0) and stores log2(ppm)
+// at every point, so at run time a reading is
+//
+//   code -> Rs/R0 in Q16        one multiply and one divide
+//   log2(Rs/R0)                 leading zeros plus a 33-entry table
+//   log2(ppm)                   grid lookup, linear between points
+//   ppm in Q8                   2^x from a 33-entry table
+//
+// all integer math, instead of log10() and pow() on the segment's power law
+// per sample. The grid reaches half an octave past the datasheet points and
+// out to the clean-air ratio; beyond it the reading saturates.
+//
+// R0 differs from unit to unit. gas_calib_zero() takes a reading in clean
+// air, where Rs/R0 is the datasheet's clean-air ratio, and stores the R0
+// it implies in NVS (namespace "gas_calib", a u32 per sensor keyed by its
+// name), where gas_calib_load_nvs() finds it at the next boot.
+
+#define GAS_CALIB_PPM_FRAC_BITS 8
+#define GAS_CALIB_PPM_LIMIT     (1 << 24)   // 65536 ppm in Q8
+
+typedef enum {
+    GAS_CALIB_NONE = -1,
+    GAS_CALIB_NH3,              // MQ-137
+    GAS_CALIB_H2S,              // MQ136
+    GAS_CALIB_CH4,              // MQ-4
+    GAS_CALIB_SENSORS
+} gas_calib_sensor_t;
+
+// One datasheet segment for the reference: up to Rs/R0 = ratio_end,
+// log10(Rs/R0) = m * log10(ppm) + b
+typedef struct {
+    float ratio_end;
+    float m, b;
+} gas_calib_segment_t;
+
+typedef struct {
+    const char *name;           // also the NVS key
+    uint32_t load_ohms;
+    uint32_t r0_ohms;           // nominal, until a field calibration is stored
+    float clean_air_ratio;
+    int32_t grid_first;         // log2(Rs/R0) of the first grid point, Q16
+    uint16_t grid_points;
+    const int32_t *grid;        // log2(ppm) per grid point, Q16
+    const gas_calib_segment_t *segments;
+    uint8_t segment_count;
+} gas_calib_curve_t;
+
+// Function prototypes
+void gas_calib_init(void);
+esp_err_t gas_calib_load_nvs(int *loaded);
+esp_err_t gas_calib_zero(gas_calib_sensor_t sensor, int32_t code, int32_t full_scale, uint32_t *r0_ohms);
+bool gas_calib_set_r0(gas_calib_sensor_t sensor, uint32_t r0_ohms);
+uint32_t gas_calib_r0(gas_calib_sensor_t sensor);
+const gas_calib_curve_t *gas_calib_curve(gas_calib_sensor_t sensor);
+int gas_calib_find(const char *name);
+uint32_t gas_calib_ratio(gas_calib_sensor_t sensor, int32_t code, int32_t full_scale);
+int32_t gas_calib_ppm(gas_calib_sensor_t sensor, uint32_t ratio);
+float gas_calib_reference_ppm(gas_calib_sensor_t sensor, float ratio);
+float gas_calib_share_for_ppm(gas_calib_sensor_t sensor, float ppm);
+void gas_calib_benchmark(void);
+
+// ppm in Q8 for a converter code in any fixed-point format, full_scale in
+// the same format
+static inline int32_t gas_calib_ppm_from_code(gas_calib_sensor_t sensor, int32_t code, int32_t full_scale) {
+    return gas_calib_ppm(sensor, gas_calib_ratio(sensor, code, full_scale));
+}
+
+#endif
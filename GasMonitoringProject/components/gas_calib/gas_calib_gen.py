@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# Generates gas_calib_tables.h from gas_calib_curves.csv.
+#
+# Each sensor's datasheet points become a curve of log2(ppm) against
+# log2(Rs/R0) sampled on a uniform grid of 2^GRID_LOG2 points per octave,
+# interpolating linearly between the points in log space and extending the
+# end segments half an octave past the outer points, or to the clean-air
+# ratio when that lies further out. The runtime takes log2 of the ratio and
+# 2^x of the result with the two small tables emitted here, so evaluating a
+# curve is integer math only. The per-segment power laws are emitted as
+# well for the pow() reference.
+#
+#   python3 gas_calib_gen.py gas_calib_curves.csv gas_calib_tables.h
+
+import math
+import sys
+
+GRID_LOG2 = 4           # 16 grid points per octave of Rs/R0
+MARGIN = 0.5            # octaves the curve extends past the outer points
+LOG_SEGMENTS = 32       # segments of the log2 and 2^x tables
+EXP_BITS = 24           # 2^x table values, Q8.24
+
+
+def q16(value):
+    return int(round(value * 65536))
+
+
+def load(path):
+    sensors = []
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            fields = line.split(',')
+            points = []
+            for field in fields[4:]:
+                ppm, ratio = field.split(':')
+                points.append((float(ratio), float(ppm)))
+            points.sort()
+            if len(points) < 2:
+                sys.exit('%s: needs at least two points' % fields[0])
+            sensors.append({
+                'name': fields[0],
+                'load_ohms': int(fields[1]),
+                'r0_ohms': int(fields[2]),
+                'clean_air_ratio': float(fields[3]),
+                'points': points,
+            })
+    return sensors
+
+
+def curve_at(points, log2_ratio):
+    # Piecewise linear in log space, end segments extended
+    xs = [math.log2(r) for r, _ in points]
+    ys = [math.log2(p) for _, p in points]
+    i = 0
+    while i < len(xs) - 2 and log2_ratio > xs[i + 1]:
+        i += 1
+    t = (log2_ratio - xs[i]) / (xs[i + 1] - xs[i])
+    return ys[i] + t * (ys[i + 1] - ys[i])
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: gas_calib_gen.py curves.csv out.h')
+    sensors = load(sys.argv[1])
+    out = []
+    w = out.append
+    w('// Generated by gas_calib_gen.py from %s, do not edit' % sys.argv[1].split('/')[-1])
+    w('#ifndef GAS_CALIB_TABLES_H')
+    w('#define GAS_CALIB_TABLES_H')
+    w('')
+    w('#define GAS_CALIB_GRID_LOG2 %d' % GRID_LOG2)
+    w('#define GAS_CALIB_LOG_SEGMENTS_LOG2 %d' % int(math.log2(LOG_SEGMENTS)))
+    w('#define GAS_CALIB_EXP_BITS %d' % EXP_BITS)
+    w('#define GAS_CALIB_TABLE_SENSORS %d' % len(sensors))
+    w('')
+    w('// log2(1 + i/%d), Q16' % LOG_SEGMENTS)
+    w('static const int32_t gas_calib_log2_table[%d] = {' % (LOG_SEGMENTS + 1))
+    values = [q16(math.log2(1 + i / LOG_SEGMENTS)) for i in range(LOG_SEGMENTS + 1)]
+    w('    ' + ', '.join(str(v) for v in values) + ',')
+    w('};')
+    w('')
+    w('// 2^(i/%d), Q%d' % (LOG_SEGMENTS, EXP_BITS))
+    w('static const uint32_t gas_calib_exp2_table[%d] = {' % (LOG_SEGMENTS + 1))
+    values = [int(round(2 ** (i / LOG_SEGMENTS) * (1 << EXP_BITS))) for i in range(LOG_SEGMENTS + 1)]
+    w('    ' + ', '.join(str(v) for v in values) + ',')
+    w('};')
+
+    for s in sensors:
+        name = s['name']
+        points = s['points']
+        first = math.floor((math.log2(points[0][0]) - MARGIN) * (1 << GRID_LOG2))
+        top = max(math.log2(points[-1][0]) + MARGIN, math.log2(s['clean_air_ratio']))
+        last = math.ceil(top * (1 << GRID_LOG2))
+        grid = [q16(curve_at(points, k / (1 << GRID_LOG2))) for k in range(first, last + 1)]
+        w('')
+        w('// %s: log2(ppm) in Q16 at log2(Rs/R0) = %d/%d + i/%d' % (name, first, 1 << GRID_LOG2, 1 << GRID_LOG2))
+        w('static const int32_t gas_calib_%s_grid[%d] = {' % (name, len(grid)))
+        for i in range(0, len(grid), 8):
+            w('    ' + ', '.join(str(v) for v in grid[i:i + 8]) + ',')
+        w('};')
+        w('')
+        # Reference: log10(ppm) = (log10(ratio) - b) / m on each segment
+        w('static const gas_calib_segment_t gas_calib_%s_segments[%d] = {' % (name, len(points) - 1))
+        for (r0, p0), (r1, p1) in zip(points, points[1:]):
+            m = (math.log10(r1) - math.log10(r0)) / (math.log10(p1) - math.log10(p0))
+            b = math.log10(r0) - m * math.log10(p0)
+            w('    { %.6ff, %.6ff, %.6ff },' % (r1, m, b))
+        w('};')
+        s['first'] = first
+        s['grid_points'] = len(grid)
+
+    w('')
+    w('static const gas_calib_curve_t gas_calib_curves[GAS_CALIB_TABLE_SENSORS] = {')
+    for s in sensors:
+        name = s['name']
+        w('    [GAS_CALIB_%s] = {' % name.upper())
+        w('        .name = "%s", .load_ohms = %d, .r0_ohms = %d, .clean_air_ratio = %.3ff,'
+          % (name, s['load_ohms'], s['r0_ohms'], s['clean_air_ratio']))
+        w('        .grid_first = %d, .grid_points = %d, .grid = gas_calib_%s_grid,'
+          % (q16(s['first'] / (1 << GRID_LOG2)), s['grid_points'], name))
+        w('        .segments = gas_calib_%s_segments, .segment_count = %d,' % (name, len(s['points']) - 1))
+        w('    },')
+    w('};')
+    w('')
+    w('#endif')
+
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out) + '\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,203 @@
+#include "gas_channels.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fastfmt.h"
+
+// Upper bound on the number of columns in a sensor_data.csv row
+#define GAS_CSV_MAX_COLUMNS 16
+
+// Packed types are limited to 8, 16 and 32 bit integers
+#define GAS_TYPE_MIN(type) _Generic((type)0, int8_t: INT8_MIN, uint8_t: 0, int16_t: INT16_MIN, uint16_t: 0, default: INT32_MIN)
+#define GAS_TYPE_MAX(type) _Generic((type)0, int8_t: INT8_MAX, uint8_t: UINT8_MAX, int16_t: INT16_MAX, uint16_t: UINT16_MAX, default: INT32_MAX)
+
+const char *const gas_channel_names[GAS_CH_COUNT] = {
+#define GAS_CH_NAME(id, field, label, csv_value, csv_flag, type, scale) #field,
+    GAS_CHANNELS(GAS_CH_NAME)
+#undef GAS_CH_NAME
+};
+
+// "Temp:", "Humidity:", ... as they appear in the TCP frame
+static const char *const frame_keys[GAS_CH_COUNT] = {
+#define GAS_CH_FRAME_KEY(id, field, label, csv_value, csv_flag, type, scale) label ":",
+    GAS_CHANNELS(GAS_CH_FRAME_KEY)
+#undef GAS_CH_FRAME_KEY
+};
+
+static const char *const uart_keys[GAS_CH_COUNT] = {
+#define GAS_CH_UART_KEY(id, field, label, csv_value, csv_flag, type, scale) label ": ",
+    GAS_CHANNELS(GAS_CH_UART_KEY)
+#undef GAS_CH_UART_KEY
+};
+
+static const char *const json_keys[GAS_CH_COUNT] = {
+#define GAS_CH_JSON_KEY(id, field, label, csv_value, csv_flag, type, scale) "\"" #field "\":",
+    GAS_CHANNELS(GAS_CH_JSON_KEY)
+#undef GAS_CH_JSON_KEY
+};
+
+static const int8_t csv_value_columns[GAS_CH_COUNT] = {
+#define GAS_CH_CSV_VALUE(id, field, label, csv_value, csv_flag, type, scale) csv_value,
+    GAS_CHANNELS(GAS_CH_CSV_VALUE)
+#undef GAS_CH_CSV_VALUE
+};
+
+static const int8_t csv_flag_columns[GAS_CH_COUNT] = {
+#define GAS_CH_CSV_FLAG(id, field, label, csv_value, csv_flag, type, scale) csv_flag,
+    GAS_CHANNELS(GAS_CH_CSV_FLAG)
+#undef GAS_CH_CSV_FLAG
+};
+
+int gas_channel_find(const char *name) {
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        if (strcmp(name, gas_channel_names[ch]) == 0) {
+            return ch;
+        }
+    }
+    return -1;
+}
+
+// "Temp:%.2f,Humidity:%.2f,...,CH4:%.2f"
+int gas_frame_format(const gas_sample_t *sample, char *buf, size_t size) {
+    return gas_frame_format_channels(sample, GAS_CH_ALL, buf, size);
+}
+
+// The fields of the channels in `channels` only (GAS_CH_BIT()s), still in
+// wire order
+int gas_frame_format_channels(const gas_sample_t *sample, uint32_t channels, char *buf, size_t size) {
+    fastfmt_t f;
+    fastfmt_begin(&f, buf, size);
+    int fields = 0;
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        if (!(channels & GAS_CH_BIT(ch))) {
+            continue;
+        }
+        if (fields++ > 0) {
+            fastfmt_char(&f, ',');
+        }
+        fastfmt_str(&f, frame_keys[ch]);
+        fastfmt_fixed2(&f, sample->values[ch]);
+    }
+    return fastfmt_end(&f);
+}
+
+// Inverse of gas_frame_format(). Anything after the last field (e.g. a trace
+// suffix) is ignored. Returns the number of leading fields parsed, so a
+// complete frame gives GAS_CH_COUNT.
+int gas_frame_parse(const char *frame, gas_sample_t *sample) {
+    const char *p = frame;
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        if (ch > 0) {
+            if (*p != ',') {
+                return ch;
+            }
+            p++;
+        }
+        size_t key_len = strlen(frame_keys[ch]);
+        if (strncmp(p, frame_keys[ch], key_len) != 0) {
+            return ch;
+        }
+        p += key_len;
+
+        char *end;
+        float value = strtof(p, &end);
+        if (end == p) {
+            return ch;
+        }
+        sample->values[ch] = value;
+        p = end;
+    }
+    return GAS_CH_COUNT;
+}
+
+// "Temp: %.2f, Humidity: %.2f, ..., CH4: %.2f\n"
+int gas_uart_format(const gas_sample_t *sample, char *buf, size_t size) {
+    fastfmt_t f;
+    fastfmt_begin(&f, buf, size);
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        if (ch > 0) {
+            fastfmt_str(&f, ", ");
+        }
+        fastfmt_str(&f, uart_keys[ch]);
+        fastfmt_fixed2(&f, sample->values[ch]);
+    }
+    fastfmt_char(&f, '\n');
+    return fastfmt_end(&f);
+}
+
+// {"temperature":%.2f,...,"methane":%.2f}
+int gas_json_format(const gas_sample_t *sample, char *buf, size_t size) {
+    fastfmt_t f;
+    fastfmt_begin(&f, buf, size);
+    fastfmt_char(&f, '{');
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        if (ch > 0) {
+            fastfmt_char(&f, ',');
+        }
+        fastfmt_str(&f, json_keys[ch]);
+        fastfmt_fixed2(&f, sample->values[ch]);
+    }
+    fastfmt_char(&f, '}');
+    return fastfmt_end(&f);
+}
+
+// One sensor_data.csv row: the sensor type in column 0, then numeric columns.
+// Channels without a value column are left untouched. Returns the number of
+// channel values read.
+int gas_csv_parse(const char *line, gas_sample_t *sample, gas_csv_flags_t *flags) {
+    float columns[GAS_CSV_MAX_COLUMNS];
+    int column_count = 1;
+    const char *p = strchr(line, ',');
+    while (p != NULL && column_count < GAS_CSV_MAX_COLUMNS) {
+        p++;
+        char *end;
+        columns[column_count] = strtof(p, &end);
+        if (end == p) {
+            break;
+        }
+        column_count++;
+        p = strchr(end, ',');
+    }
+
+    int parsed = 0;
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        int value_column = csv_value_columns[ch];
+        int flag_column = csv_flag_columns[ch];
+        if (value_column > 0 && value_column < column_count) {
+            sample->values[ch] = columns[value_column];
+            parsed++;
+        }
+        if (flags != NULL) {
+            flags->flags[ch] = (flag_column > 0 && flag_column < column_count) ? columns[flag_column] : 0;
+        }
+    }
+    return parsed;
+}
+
+static int32_t scale_round(float value, float scale, int32_t min, int32_t max) {
+    float scaled = value * scale;
+    if (scaled != scaled) {
+        return 0;   // nan
+    }
+    if (scaled <= (float)min) {
+        return min;
+    }
+    if (scaled >= (float)max) {
+        return max;
+    }
+    return (int32_t)lroundf(scaled);
+}
+
+void gas_sample_pack(const gas_sample_t *sample, gas_sample_packed_t *packed) {
+#define GAS_CH_PACK(id, field, label, csv_value, csv_flag, type, scale) \
+    packed->field = (type)scale_round(sample->field, (scale), GAS_TYPE_MIN(type), GAS_TYPE_MAX(type));
+    GAS_CHANNELS(GAS_CH_PACK)
+#undef GAS_CH_PACK
+}
+
+void gas_sample_unpack(const gas_sample_packed_t *packed, gas_sample_t *sample) {
+#define GAS_CH_UNPACK(id, field, label, csv_value, csv_flag, type, scale) \
+    sample->field = packed->field / (float)(scale);
+    GAS_CHANNELS(GAS_CH_UNPACK)
+#undef GAS_CH_UNPACK
+}
@@ -0,0 +1,81 @@
+#ifndef GAS_CHANNELS_H
+#define GAS_CHANNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Single list of every measured channel. The sample struct, the channel enum,
+// the TCP frame / UART line / JSON encoders, the frame parser, the CSV column
+// map and the packed storage format are all generated from it, so adding a
+// channel is one new line here.
+//
+//   X(id, field, label, csv_value, csv_flag, packed_type, scale)
+//
+//   id           GAS_CH_<id>
+//   field        member of gas_sample_t, JSON key and /history channel name
+//   label        key in the TCP frame ("Temp:71.25,...") and the UART line
+//   csv_value    column of the value in sensor_data.csv, -1 if not in the file
+//   csv_flag     column of the chip-select flag in sensor_data.csv, -1 if none
+//   packed_type  integer type in gas_sample_packed_t
+//   scale        packed = round(value * scale)
+//
+// The order here is the order of the fields on the wire.
+#define GAS_CHANNELS(X) \
+    X(TEMPERATURE, temperature, "Temp",     -1, -1, int16_t,  100) \
+    X(HUMIDITY,    humidity,    "Humidity", -1, -1, uint16_t, 100) \
+    X(AMMONIA,     ammonia,     "NH3",       1,  5, int32_t,  100) \
+    X(H2S,         h2s,         "H2S",       4,  7, int32_t,  100) \
+    X(CO2,         co2,         "CO2",       3,  8, int32_t,  100) \
+    X(METHANE,     methane,     "CH4",       2,  6, int32_t,  100)
+
+typedef enum {
+#define GAS_CH_ENUM(id, field, label, csv_value, csv_flag, type, scale) GAS_CH_##id,
+    GAS_CHANNELS(GAS_CH_ENUM)
+#undef GAS_CH_ENUM
+    GAS_CH_COUNT
+} gas_channel_t;
+
+#define GAS_CH_BIT(ch) (1u << (ch))
+#define GAS_CH_ALL     (GAS_CH_BIT(GAS_CH_COUNT) - 1)
+
+// Latest reading of every channel. values[] aliases the named fields so a
+// channel index needs no dispatch.
+typedef union {
+    struct {
+#define GAS_CH_FIELD(id, field, label, csv_value, csv_flag, type, scale) float field;
+        GAS_CHANNELS(GAS_CH_FIELD)
+#undef GAS_CH_FIELD
+    };
+    float values[GAS_CH_COUNT];
+} gas_sample_t;
+
+// Fixed-point copy of a sample for storage
+typedef struct {
+#define GAS_CH_PACKED(id, field, label, csv_value, csv_flag, type, scale) type field;
+    GAS_CHANNELS(GAS_CH_PACKED)
+#undef GAS_CH_PACKED
+} gas_sample_packed_t;
+
+// Chip-select flags read next to the values in sensor_data.csv
+typedef struct {
+    float flags[GAS_CH_COUNT];
+} gas_csv_flags_t;
+
+extern const char *const gas_channel_names[GAS_CH_COUNT];
+
+static inline float gas_sample_get(const gas_sample_t *sample, gas_channel_t channel) {
+    return channel < GAS_CH_COUNT ? sample->values[channel] : -1; // -1 = invalid channel
+}
+
+// Function prototypes
+int gas_channel_find(const char *name);
+int gas_frame_format(const gas_sample_t *sample, char *buf, size_t size);
+int gas_frame_format_channels(const gas_sample_t *sample, uint32_t channels, char *buf, size_t size);
+int gas_frame_parse(const char *frame, gas_sample_t *sample);
+int gas_uart_format(const gas_sample_t *sample, char *buf, size_t size);
+int gas_json_format(const gas_sample_t *sample, char *buf, size_t size);
+int gas_csv_parse(const char *line, gas_sample_t *sample, gas_csv_flags_t *flags);
+void gas_sample_pack(const gas_sample_t *sample, gas_sample_packed_t *packed);
+void gas_sample_unpack(const gas_sample_packed_t *packed, gas_sample_t *sample);
+
+#endif
@@ -0,0 +1,130 @@
+#include "gas_cmd.h"
+#include <stdlib.h>
+#include <string.h>
+#include "gas_link.h"
+
+static const char *const cmd_names[GAS_CMD_COUNT] = {
+    [GAS_CMD_UNKNOWN] = "UNKNOWN",
+    [GAS_CMD_HELLO] = "GET_SENSOR_DATA",
+    [GAS_CMD_NOW] = "NOW",
+    [GAS_CMD_RATE] = "RATE",
+    [GAS_CMD_SUB] = "SUB",
+    [GAS_CMD_UNSUB] = "UNSUB",
+    [GAS_CMD_HIST] = "HIST",
+    [GAS_CMD_STATS] = "STATS",
+    [GAS_CMD_RETX] = "RETX",
+};
+
+const char *gas_cmd_name(gas_cmd_id_t id) {
+    return id < GAS_CMD_COUNT ? cmd_names[id] : cmd_names[GAS_CMD_UNKNOWN];
+}
+
+// Decimal at *p, advancing past it; false if there are no digits
+static bool parse_u32(const char **p, uint32_t *value) {
+    char *end;
+    unsigned long parsed = strtoul(*p, &end, 10);
+    if (end == *p || parsed > UINT32_MAX || **p == '-') {
+        return false;
+    }
+    *value = (uint32_t)parsed;
+    *p = end;
+    return true;
+}
+
+// "ALL" or channel names separated by ','
+static bool parse_channels(const char *p, uint32_t *channels) {
+    if (strcmp(p, "ALL") == 0) {
+        *channels = GAS_CH_ALL;
+        return true;
+    }
+    *channels = 0;
+    while (*p != '\0') {
+        size_t len = strcspn(p, ",");
+        char name[16];
+        if (len == 0 || len >= sizeof(name)) {
+            return false;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+        int ch = gas_channel_find(name);
+        if (ch < 0) {
+            return false;
+        }
+        *channels |= GAS_CH_BIT(ch);
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return *channels != 0;
+}
+
+// "<ch>:<from>:<to>[:<points>]"
+static bool parse_hist(const char *p, gas_cmd_t *cmd) {
+    size_t len = strcspn(p, ":");
+    char name[16];
+    if (p[len] != ':' || len == 0 || len >= sizeof(name)) {
+        return false;
+    }
+    memcpy(name, p, len);
+    name[len] = '\0';
+    int ch = gas_channel_find(name);
+    if (ch < 0) {
+        return false;
+    }
+    cmd->channel = (gas_channel_t)ch;
+    p += len + 1;
+    if (!parse_u32(&p, &cmd->first) || *p++ != ':' || !parse_u32(&p, &cmd->last) || cmd->first > cmd->last) {
+        return false;
+    }
+    cmd->value = 0;
+    if (*p == ':') {
+        p++;
+        if (!parse_u32(&p, &cmd->value)) {
+            return false;
+        }
+    }
+    return *p == '\0';
+}
+
+// Argument of "<verb>:<arg>", NULL if the line is another command
+static const char *command_arg(const char *line, const char *verb) {
+    size_t len = strlen(verb);
+    return strncmp(line, verb, len) == 0 && line[len] == ':' ? line + len + 1 : NULL;
+}
+
+// Fills `cmd` from one request line without its newline. False for an
+// unknown command or bad arguments; cmd->id still names the command in the
+// second case.
+bool gas_cmd_parse(const char *line, gas_cmd_t *cmd) {
+    memset(cmd, 0, sizeof(*cmd));
+    const char *arg;
+    if (strcmp(line, "NOW") == 0) {
+        cmd->id = GAS_CMD_NOW;
+    } else if (strcmp(line, "STATS") == 0) {
+        cmd->id = GAS_CMD_STATS;
+    } else if (strcmp(line, "GET_SENSOR_DATA") == 0) {
+        cmd->id = GAS_CMD_HELLO;
+    } else if ((arg = command_arg(line, "RATE")) != NULL) {
+        cmd->id = GAS_CMD_RATE;
+        if (strcmp(arg, "OFF") == 0) {
+            cmd->value = GAS_CMD_RATE_OFF;
+        } else if (!parse_u32(&arg, &cmd->value) || *arg != '\0' || cmd->value == GAS_CMD_RATE_OFF) {
+            return false;
+        }
+    } else if ((arg = command_arg(line, "SUB")) != NULL) {
+        cmd->id = GAS_CMD_SUB;
+        return parse_channels(arg, &cmd->channels);
+    } else if ((arg = command_arg(line, "UNSUB")) != NULL) {
+        cmd->id = GAS_CMD_UNSUB;
+        return parse_channels(arg, &cmd->channels);
+    } else if ((arg = command_arg(line, "HIST")) != NULL) {
+        cmd->id = GAS_CMD_HIST;
+        return parse_hist(arg, cmd);
+    } else if (gas_link_parse_range(line, "RETX", &cmd->first, &cmd->last)) {
+        cmd->id = GAS_CMD_RETX;
+    } else {
+        return false;
+    }
+    return true;
+}
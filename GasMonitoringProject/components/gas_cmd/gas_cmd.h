@@ -0,0 +1,63 @@
+#ifndef GAS_CMD_H
+#define GAS_CMD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gas_channels.h"
+
+// Requests a client of the node TCP server can send, one per line. Pushed
+// frames keep flowing in between; every command below except HELLO and RETX
+// gets an answer line starting with "OK:" or "ERR:", sent in the order the
+// commands came in.
+//
+//   NOW                            "OK:NOW:<frame>", the current readings of
+//                                  the subscribed channels, without ",S:"
+//   RATE:<ms> | RATE:OFF           push the newest frame at most every <ms>,
+//                                  skipping the ones in between (0, the
+//                                  default, pushes every frame); OFF stops
+//                                  pushes, for clients that only poll
+//   SUB:<ch>[,<ch>...] | SUB:ALL   add channels to the frames sent, all by
+//   UNSUB:<ch>[,<ch>...] | UNSUB:ALL   default; "OK:SUB:<hex mask>"
+//   HIST:<ch>:<from>:<to>[:<points>]
+//                                  "H:<ts>:<value>" lines from the history,
+//                                  then "OK:HIST:<count>"; times are node
+//                                  time seconds, STATS has the current one.
+//                                  Sent a slice at a time with pushed frames
+//                                  in between; the client's next commands
+//                                  are read once it is done
+//   STATS                          "STATS:<key>=<value>,..."
+//   RETX:<first>:<last>            see gas_link.h
+//   GET_SENSOR_DATA                greeting of the gateway, no answer
+//
+// Channels go by their gas_channel_names. Plain C, the sockets are the
+// caller's.
+
+#define GAS_CMD_RATE_OFF UINT32_MAX
+
+typedef enum {
+    GAS_CMD_UNKNOWN,
+    GAS_CMD_HELLO,
+    GAS_CMD_NOW,
+    GAS_CMD_RATE,
+    GAS_CMD_SUB,
+    GAS_CMD_UNSUB,
+    GAS_CMD_HIST,
+    GAS_CMD_STATS,
+    GAS_CMD_RETX,
+    GAS_CMD_COUNT
+} gas_cmd_id_t;
+
+typedef struct {
+    gas_cmd_id_t id;
+    uint32_t channels;          // SUB, UNSUB: GAS_CH_BIT()s
+    gas_channel_t channel;      // HIST
+    uint32_t first;             // HIST: from, RETX: first seq
+    uint32_t last;              // HIST: to, RETX: last seq
+    uint32_t value;             // RATE: period ms or GAS_CMD_RATE_OFF, HIST: points (0 = all)
+} gas_cmd_t;
+
+// Function prototypes
+bool gas_cmd_parse(const char *line, gas_cmd_t *cmd);
+const char *gas_cmd_name(gas_cmd_id_t id);
+
+#endif
@@ -0,0 +1,193 @@
+#include "gas_comp.h"
+#include <math.h>
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "nvs.h"
+#endif
+
+#define GAS_COMP_POINTS (GAS_COMP_T_POINTS * GAS_COMP_RH_POINTS)
+#define GAS_COMP_T_MAX  (GAS_COMP_T_MIN + ((GAS_COMP_T_POINTS - 1) << GAS_COMP_T_STEP_LOG2))
+#define GAS_COMP_RH_MAX ((GAS_COMP_RH_POINTS - 1) << GAS_COMP_RH_STEP_LOG2)
+
+// Read off the Rs/R0 against temperature and humidity figures of the
+// datasheets (33 % and 85 %RH curves, R0 at 20 degC / 33 %RH) and the slopes
+// of their sensitivity curves
+const gas_comp_curve_t gas_comp_curves[GAS_COMP_SENSORS] = {
+    [GAS_COMP_NH3] = { "nh3", 20.0f, 33.0f, -0.0122f, 0.00011f, -0.095f, -0.263f },
+    [GAS_COMP_H2S] = { "h2s", 20.0f, 33.0f, -0.0105f, 0.00012f, -0.085f, -0.300f },
+    [GAS_COMP_CH4] = { "ch4", 20.0f, 33.0f, -0.0085f, 0.00009f, -0.110f, -0.318f },
+};
+
+static gas_comp_table_t gas_comp_tables[GAS_COMP_SENSORS];
+
+// Gain the reference curve gives for a reading taken at (T, RH)
+float gas_comp_reference(gas_comp_sensor_t sensor, float temperature_c, float humidity) {
+    const gas_comp_curve_t *curve = &gas_comp_curves[sensor];
+    float dt = temperature_c - curve->t_ref;
+    float rs = (1.0f + curve->a1 * dt + curve->a2 * dt * dt) *
+               powf(fmaxf(humidity, GAS_COMP_RH_FLOOR) / curve->rh_ref, curve->h);
+    return powf(rs, -1.0f / curve->slope);
+}
+
+void gas_comp_build_table(gas_comp_sensor_t sensor, gas_comp_table_t *table) {
+    table->version = GAS_COMP_TABLE_VERSION;
+    table->points = GAS_COMP_POINTS;
+    for (int t = 0; t < GAS_COMP_T_POINTS; t++) {
+        for (int rh = 0; rh < GAS_COMP_RH_POINTS; rh++) {
+            float gain = gas_comp_reference(sensor, GAS_COMP_T_MIN + (t << GAS_COMP_T_STEP_LOG2),
+                                            rh << GAS_COMP_RH_STEP_LOG2);
+            float scaled = gain * (1 << GAS_COMP_GAIN_BITS) + 0.5f;
+            table->gain[t][rh] = scaled >= UINT16_MAX ? UINT16_MAX : (uint16_t)scaled;
+        }
+    }
+}
+
+void gas_comp_init(void) {
+    for (int sensor = 0; sensor < GAS_COMP_SENSORS; sensor++) {
+        gas_comp_build_table(sensor, &gas_comp_tables[sensor]);
+    }
+}
+
+// Replaces a sensor's table; rejected unless it was built for this grid
+bool gas_comp_set_table(gas_comp_sensor_t sensor, const gas_comp_table_t *table) {
+    if (sensor < 0 || sensor >= GAS_COMP_SENSORS || table->version != GAS_COMP_TABLE_VERSION ||
+        table->points != GAS_COMP_POINTS) {
+        return false;
+    }
+    gas_comp_tables[sensor] = *table;
+    return true;
+}
+
+// Clamps the snapshot to the grid. The weights come from the bits below the
+// grid step, so no division is needed.
+void gas_comp_locate(gas_comp_point_t *point, float temperature_c, float humidity) {
+    const int32_t one = 1 << GAS_COMP_FRAC_BITS;
+    int32_t t = (int32_t)((fminf(fmaxf(temperature_c, GAS_COMP_T_MIN), GAS_COMP_T_MAX) - GAS_COMP_T_MIN) * one);
+    int32_t rh = (int32_t)(fminf(fmaxf(humidity, 0.0f), GAS_COMP_RH_MAX) * one);
+    // The top edge belongs to the last cell, one LSB short of full weight
+    if (t >= (GAS_COMP_T_MAX - GAS_COMP_T_MIN) * one) {
+        t = (GAS_COMP_T_MAX - GAS_COMP_T_MIN) * one - 1;
+    }
+    if (rh >= GAS_COMP_RH_MAX * one) {
+        rh = GAS_COMP_RH_MAX * one - 1;
+    }
+
+    int t_shift = GAS_COMP_T_STEP_LOG2 + GAS_COMP_FRAC_BITS;
+    int rh_shift = GAS_COMP_RH_STEP_LOG2 + GAS_COMP_FRAC_BITS;
+    point->t_index = (uint8_t)(t >> t_shift);
+    point->rh_index = (uint8_t)(rh >> rh_shift);
+    point->t_weight = (uint16_t)((t & ((1 << t_shift) - 1)) >> GAS_COMP_T_STEP_LOG2);
+    point->rh_weight = (uint16_t)((rh & ((1 << rh_shift) - 1)) >> GAS_COMP_RH_STEP_LOG2);
+    point->valid = true;
+}
+
+// Bilinear gain in Q16: blend along RH at both temperatures in Q20, then
+// along T with the difference taken down 4 bits so the product stays in
+// 32 bits for gains up to 16
+uint32_t gas_comp_gain(gas_comp_sensor_t sensor, const gas_comp_point_t *point) {
+    const uint16_t (*gain)[GAS_COMP_RH_POINTS] = gas_comp_tables[sensor].gain;
+    const uint16_t *lo = &gain[point->t_index][point->rh_index];
+    const uint16_t *hi = &gain[point->t_index + 1][point->rh_index];
+    int32_t a = ((int32_t)lo[0] << 8) + ((int32_t)lo[1] - lo[0]) * point->rh_weight;
+    int32_t b = ((int32_t)hi[0] << 8) + ((int32_t)hi[1] - hi[0]) * point->rh_weight;
+    int32_t blend = a + ((((b - a) >> 4) * point->t_weight) >> 4);
+    return (uint32_t)(blend + 8) >> 4;
+}
+
+#ifdef ESP_PLATFORM
+
+static const char *TAG = "GAS_COMP";
+
+// Calibrated tables from NVS replace the reference ones; a missing
+// namespace or key keeps the reference table
+esp_err_t gas_comp_load_nvs(int *loaded) {
+    *loaded = 0;
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open("gas_comp", NVS_READONLY, &handle);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    static gas_comp_table_t table;
+    for (int sensor = 0; sensor < GAS_COMP_SENSORS; sensor++) {
+        size_t size = sizeof(table);
+        ret = nvs_get_blob(handle, gas_comp_curves[sensor].name, &table, &size);
+        if (ret == ESP_ERR_NVS_NOT_FOUND) {
+            continue;
+        }
+        if (ret != ESP_OK || size != sizeof(table) || !gas_comp_set_table(sensor, &table)) {
+            ESP_LOGW(TAG, "Ignoring NVS table \"%s\" (%s, %u bytes)", gas_comp_curves[sensor].name,
+                     esp_err_to_name(ret), (unsigned)size);
+            continue;
+        }
+        (*loaded)++;
+    }
+    nvs_close(handle);
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t gas_comp_load_nvs(int *loaded) {
+    *loaded = 0;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_COMP_BENCHMARK
+
+#define BENCH_SAMPLES 256
+
+void gas_comp_benchmark(void) {
+    static gas_comp_point_t points[BENCH_SAMPLES];
+    static float temperatures[BENCH_SAMPLES];
+    static float humidities[BENCH_SAMPLES];
+
+    // Barn conditions: 0..40 degC, 30..95 %RH
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        temperatures[i] = (seed >> 16) * (40.0f / 65536.0f);
+        humidities[i] = 30.0f + (seed & 0xffff) * (65.0f / 65536.0f);
+        gas_comp_locate(&points[i], temperatures[i], humidities[i]);
+    }
+
+    volatile uint32_t sink = 0;
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        sink = gas_comp_apply(GAS_COMP_NH3, &points[i], 100 << 8);
+    }
+    uint32_t table_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        gas_comp_locate(&points[i], temperatures[i], humidities[i]);
+    }
+    uint32_t locate_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+
+    volatile float reference = 0;
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        reference = 100.0f * gas_comp_reference(GAS_COMP_NH3, temperatures[i], humidities[i]);
+    }
+    uint32_t reference_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+
+    ESP_LOGI(TAG, "table %u cycles/sample (+%u per T/RH snapshot), reference curve %u cycles/sample",
+             (unsigned)table_cycles, (unsigned)locate_cycles, (unsigned)reference_cycles);
+    (void)sink;
+    (void)reference;
+}
+
+#else
+
+void gas_comp_benchmark(void) {
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef GAS_COMP_H
+#define GAS_COMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#else
+// Host builds of the tables and the interpolation
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#endif
+
+// Temperature and humidity compensation of the MQ gas readings. The sensing
+// resistance Rs of a tin-oxide sensor drifts with the air it sits in, which
+// the ppm conversion reads as a change in gas. Each sensor has a reference
+// curve of that drift, f(T, RH) = Rs / Rs(t_ref, rh_ref):
+//
+//   f = (1 + a1 (T - t_ref) + a2 (T - t_ref)^2) * (RH / rh_ref)^h
+//
+// and its gas curve has log-log slope m (ppm ~ (Rs/R0)^(1/m)), so a reading
+// taken at (T, RH) is corrected by the gain f^(-1/m). That is a powf per
+// sample; instead the gain is tabulated once on a T x RH grid and looked up
+// with bilinear interpolation in fixed point. The grid steps are powers of
+// two so locating a cell is shifts and masks, and the cell and weights of a
+// T/RH snapshot are worked out once and shared by every sensor's table.
+//
+// The tables start from the reference curves and can be replaced by
+// per-unit calibration tables stored in NVS (namespace "gas_comp", one blob
+// per sensor keyed by its name, laid out as gas_comp_table_t).
+
+#define GAS_COMP_FRAC_BITS      8       // T in degC and RH in % as Q8 inputs
+#define GAS_COMP_GAIN_BITS      12      // table gains, Q4.12 (below 16)
+#define GAS_COMP_OUT_BITS       16      // interpolated gain, Q16
+
+#define GAS_COMP_T_MIN          -20     // degC
+#define GAS_COMP_T_STEP_LOG2    2       // 4 degC
+#define GAS_COMP_T_POINTS       21      // -20..60 degC
+#define GAS_COMP_RH_STEP_LOG2   3       // 8 %RH
+#define GAS_COMP_RH_POINTS      14      // 0..104 %RH
+#define GAS_COMP_RH_FLOOR       10.0f   // the curves are not defined down to dry air
+
+#define GAS_COMP_TABLE_VERSION  1
+
+typedef enum {
+    GAS_COMP_NONE = -1,         // channel without compensation
+    GAS_COMP_NH3,               // MQ-137
+    GAS_COMP_H2S,               // MQ136
+    GAS_COMP_CH4,               // MQ-4
+    GAS_COMP_SENSORS
+} gas_comp_sensor_t;
+
+typedef struct {
+    const char *name;           // also the NVS key
+    float t_ref, rh_ref;        // conditions R0 was taken at
+    float a1, a2;               // temperature terms, per degC and degC^2
+    float h;                    // humidity exponent
+    float slope;                // log-log slope of Rs/R0 against ppm
+} gas_comp_curve_t;
+
+// One sensor's gains; also the NVS blob layout
+typedef struct {
+    uint16_t version;           // GAS_COMP_TABLE_VERSION
+    uint16_t points;            // GAS_COMP_T_POINTS * GAS_COMP_RH_POINTS
+    uint16_t gain[GAS_COMP_T_POINTS][GAS_COMP_RH_POINTS];
+} gas_comp_table_t;
+
+// Grid cell and weights of one T/RH snapshot
+typedef struct {
+    uint8_t t_index, rh_index;  // lower corner of the cell
+    uint16_t t_weight, rh_weight;   // toward the upper corner, Q8
+    bool valid;
+} gas_comp_point_t;
+
+extern const gas_comp_curve_t gas_comp_curves[GAS_COMP_SENSORS];
+
+// Function prototypes
+void gas_comp_init(void);
+esp_err_t gas_comp_load_nvs(int *loaded);
+bool gas_comp_set_table(gas_comp_sensor_t sensor, const gas_comp_table_t *table);
+void gas_comp_build_table(gas_comp_sensor_t sensor, gas_comp_table_t *table);
+void gas_comp_locate(gas_comp_point_t *point, float temperature_c, float humidity);
+uint32_t gas_comp_gain(gas_comp_sensor_t sensor, const gas_comp_point_t *point);
+float gas_comp_reference(gas_comp_sensor_t sensor, float temperature_c, float humidity);
+void gas_comp_benchmark(void);
+
+// Scales a reading in any fixed-point format by the gain at `point`
+static inline int32_t gas_comp_apply(gas_comp_sensor_t sensor, const gas_comp_point_t *point, int32_t value) {
+    if (sensor == GAS_COMP_NONE || !point->valid) {
+        return value;
+    }
+    int64_t scaled = (int64_t)value * gas_comp_gain(sensor, point);
+    return (int32_t)((scaled + (1 << (GAS_COMP_OUT_BITS - 1))) >> GAS_COMP_OUT_BITS);
+}
+
+#endif
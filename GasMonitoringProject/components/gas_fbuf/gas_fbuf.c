@@ -0,0 +1,53 @@
+#include "gas_fbuf.h"
+#include <string.h>
+
+void gas_fbuf_pool_init(gas_fbuf_pool_t *pool, gas_fbuf_t *bufs, int count) {
+    memset(bufs, 0, count * sizeof(bufs[0]));
+    memset(pool, 0, sizeof(*pool));
+    pool->bufs = bufs;
+    pool->count = count;
+}
+
+// The frame of `record` with `channels`, with a reference taken: the buffer
+// that already holds it, or the least recently encoded unreferenced one
+// encoded afresh. NULL if every buffer is referenced or the frame does not
+// fit; the caller encodes on its own then.
+gas_fbuf_t *gas_fbuf_get(gas_fbuf_pool_t *pool, const gas_link_record_t *record, uint32_t channels, uint16_t boot) {
+    gas_fbuf_t *victim = NULL;
+    for (int i = 0; i < pool->count; i++) {
+        gas_fbuf_t *buf = &pool->bufs[i];
+        if (buf->len > 0 && buf->seq == record->seq && buf->channels == channels) {
+            buf->refs++;
+            pool->hits++;
+            return buf;
+        }
+        if (buf->refs == 0 && (victim == NULL || buf->len == 0 ||
+                               (victim->len > 0 && buf->filled - victim->filled > UINT32_MAX / 2))) {
+            victim = buf;   // free first, else the one filled longest ago
+        }
+    }
+    if (victim == NULL) {
+        pool->exhausted++;
+        return NULL;
+    }
+    int len = gas_link_format(record, channels, boot, victim->data, sizeof(victim->data) - 1);
+    if (len < 0 || len >= (int)sizeof(victim->data) - 1) {
+        victim->len = 0;
+        return NULL;
+    }
+    victim->data[len++] = '\n';
+    victim->len = (uint16_t)len;
+    victim->seq = record->seq;
+    victim->channels = channels;
+    victim->filled = pool->clock++;
+    victim->refs = 1;
+    pool->encodes++;
+    return victim;
+}
+
+// Drops a reference; the frame stays in the buffer for later gets
+void gas_fbuf_release(gas_fbuf_t *buf) {
+    if (buf != NULL && buf->refs > 0) {
+        buf->refs--;
+    }
+}
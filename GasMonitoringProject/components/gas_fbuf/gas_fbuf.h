@@ -0,0 +1,42 @@
+#ifndef GAS_FBUF_H
+#define GAS_FBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gas_link.h"
+
+// Reference-counted buffers of encoded link frames from a fixed pool. A
+// frame is encoded once, newline included, and the same bytes go to every
+// client with the same channels and to the UDP publisher; each sender holds
+// a reference while the buffer is in its hands. A buffer nobody references
+// keeps its frame, so a later client or a RETX finds it already encoded,
+// until the pool needs the buffer for another frame. Plain C, the caller
+// serialises access.
+
+// A full frame: the fields, the ",S:" and ",A:" suffixes and the newline
+#define GAS_FBUF_DATA_MAX 192
+
+typedef struct {
+    uint32_t seq;
+    uint32_t channels;
+    uint16_t refs;
+    uint16_t len;               // 0 = holds no frame
+    uint32_t filled;            // pool clock when encoded, the oldest is reused first
+    char data[GAS_FBUF_DATA_MAX];
+} gas_fbuf_t;
+
+typedef struct {
+    gas_fbuf_t *bufs;
+    int count;
+    uint32_t clock;
+    uint32_t hits;              // gets served from a buffer already encoded
+    uint32_t encodes;
+    uint32_t exhausted;         // gets that found every buffer referenced
+} gas_fbuf_pool_t;
+
+// Function prototypes
+void gas_fbuf_pool_init(gas_fbuf_pool_t *pool, gas_fbuf_t *bufs, int count);
+gas_fbuf_t *gas_fbuf_get(gas_fbuf_pool_t *pool, const gas_link_record_t *record, uint32_t channels, uint16_t boot);
+void gas_fbuf_release(gas_fbuf_t *buf);
+
+#endif
@@ -0,0 +1,308 @@
+#include "gas_filter.h"
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#endif
+
+// Median layout: heap slot 0 holds the median, negative slots a max-heap of
+// the lower half (root -1, children of i at 2i and 2i-1) and positive slots a
+// min-heap of the upper half (root 1, children of i at 2i and 2i+1). Slots
+// are stored offset by half the largest window.
+#define MEDIAN_SLOT(filter, i) ((filter)->median.heap[(i) + GAS_FILTER_MAX_WINDOW / 2])
+
+static inline int median_min_count(const gas_filter_t *filter) {
+    return (filter->count - 1) / 2;
+}
+
+static inline int median_max_count(const gas_filter_t *filter) {
+    return filter->count / 2;
+}
+
+// Value at heap slot i is below the one at slot j
+static inline bool median_less(const gas_filter_t *filter, int i, int j) {
+    return filter->ring[MEDIAN_SLOT(filter, i)] < filter->ring[MEDIAN_SLOT(filter, j)];
+}
+
+static void median_swap(gas_filter_t *filter, int i, int j) {
+    uint8_t slot = MEDIAN_SLOT(filter, i);
+    MEDIAN_SLOT(filter, i) = MEDIAN_SLOT(filter, j);
+    MEDIAN_SLOT(filter, j) = slot;
+    filter->median.pos[MEDIAN_SLOT(filter, i)] = i;
+    filter->median.pos[MEDIAN_SLOT(filter, j)] = j;
+}
+
+static void median_min_down(gas_filter_t *filter, int i) {
+    int count = median_min_count(filter);
+    for (int child = 2 * i; child <= count; child = 2 * i) {
+        if (child < count && median_less(filter, child + 1, child)) {
+            child++;
+        }
+        if (!median_less(filter, child, i)) {
+            break;
+        }
+        median_swap(filter, child, i);
+        i = child;
+    }
+}
+
+static void median_max_down(gas_filter_t *filter, int i) {
+    int count = median_max_count(filter);
+    for (int child = 2 * i; child >= -count; child = 2 * i) {
+        if (child > -count && median_less(filter, child, child - 1)) {
+            child--;
+        }
+        if (!median_less(filter, i, child)) {
+            break;
+        }
+        median_swap(filter, child, i);
+        i = child;
+    }
+}
+
+// Sift towards the median, returns true if the value reached slot 0
+static bool median_min_up(gas_filter_t *filter, int i) {
+    while (i > 0 && median_less(filter, i, i / 2)) {
+        median_swap(filter, i, i / 2);
+        i /= 2;
+    }
+    return i == 0;
+}
+
+static bool median_max_up(gas_filter_t *filter, int i) {
+    while (i < 0 && median_less(filter, i / 2, i)) {
+        median_swap(filter, i, i / 2);
+        i /= 2;
+    }
+    return i == 0;
+}
+
+// A new median may belong to the other side; swap it with that root
+static void median_fix_lower(gas_filter_t *filter) {
+    if (median_max_count(filter) > 0 && median_less(filter, 0, -1)) {
+        median_swap(filter, 0, -1);
+        median_max_down(filter, -1);
+    }
+}
+
+static void median_fix_upper(gas_filter_t *filter) {
+    if (median_min_count(filter) > 0 && median_less(filter, 1, 0)) {
+        median_swap(filter, 0, 1);
+        median_min_down(filter, 1);
+    }
+}
+
+static void median_init(gas_filter_t *filter) {
+    // The k-th sample of the first window lands at slot 0, -1, 1, -2, 2, ...
+    // so the occupied slots always run from -max_count to min_count
+    for (int k = 0; k < filter->window; k++) {
+        int slot = ((k + 1) / 2) * ((k & 1) ? -1 : 1);
+        filter->median.pos[k] = slot;
+        MEDIAN_SLOT(filter, slot) = k;
+    }
+}
+
+// Replaces the oldest ring value and restores the heaps in O(log n)
+static gas_fixed_t median_step(gas_filter_t *filter, gas_fixed_t value) {
+    bool filling = filter->count < filter->window;
+    int slot = filter->median.pos[filter->next];
+    gas_fixed_t old = filter->ring[filter->next];
+
+    filter->ring[filter->next] = value;
+    filter->next = filter->next + 1 == filter->window ? 0 : filter->next + 1;
+    filter->count += filling;
+
+    if (slot > 0) {
+        if (!filling && old < value) {
+            median_min_down(filter, slot);
+        } else if (median_min_up(filter, slot)) {
+            median_fix_lower(filter);
+        }
+    } else if (slot < 0) {
+        if (!filling && value < old) {
+            median_max_down(filter, slot);
+        } else if (median_max_up(filter, slot)) {
+            median_fix_upper(filter);
+        }
+    } else {
+        median_fix_lower(filter);
+        median_fix_upper(filter);
+    }
+
+    gas_fixed_t median = filter->ring[MEDIAN_SLOT(filter, 0)];
+    if ((filter->count & 1) == 0) {
+        median = (gas_fixed_t)(((int64_t)median + filter->ring[MEDIAN_SLOT(filter, -1)]) / 2);
+    }
+    return median;
+}
+
+static gas_fixed_t moving_average_step(gas_filter_t *filter, gas_fixed_t value) {
+    if (filter->count == filter->window) {
+        filter->sum -= filter->ring[filter->next];
+    } else {
+        filter->count++;
+    }
+    filter->sum += value;
+    filter->ring[filter->next] = value;
+    filter->next = filter->next + 1 == filter->window ? 0 : filter->next + 1;
+    return filter->sum / filter->count;
+}
+
+static gas_fixed_t ewma_step(gas_filter_t *filter, gas_fixed_t value) {
+    if (filter->count == 0) {
+        filter->acc = value * (1 << filter->shift);
+        filter->count = 1;
+    } else {
+        filter->acc += value - (filter->acc >> filter->shift);
+    }
+    return filter->acc >> filter->shift;
+}
+
+// The level keeps KALMAN_EXTRA_BITS more fraction bits than the output.
+// Rounding it to the output LSB every step drifts by up to half an LSB over
+// the gain, 5 LSB at the CO2 settings.
+#define KALMAN_EXTRA_BITS 8
+#define KALMAN_GAIN_BITS  28
+
+static gas_fixed_t kalman_step(gas_filter_t *filter, gas_fixed_t value) {
+    int64_t z = (int64_t)value << KALMAN_EXTRA_BITS;
+    if (filter->count == 0) {
+        filter->kalman.x = z;
+        filter->kalman.p = filter->kalman.r;
+        filter->count = 1;
+        return value;
+    }
+    // Predict: the level random-walks by q per sample
+    uint32_t p = filter->kalman.p + filter->kalman.q;
+    if (p < filter->kalman.q) {
+        p = UINT32_MAX;
+    }
+
+    // Update: gain in Q28, so innovation (below 2^34) times gain fits in
+    // 64 bits; a Q16 gain was off by 0.07 units on a 5000 unit spike
+    const uint64_t one = 1ull << KALMAN_GAIN_BITS;
+    const int64_t half = 1ll << (KALMAN_GAIN_BITS - 1);
+    uint64_t gain = ((uint64_t)p << KALMAN_GAIN_BITS) / ((uint64_t)p + filter->kalman.r);
+    int64_t innovation = z - filter->kalman.x;
+    filter->kalman.x += (innovation * (int64_t)gain + half) >> KALMAN_GAIN_BITS;
+    filter->kalman.p = (uint32_t)(((one - gain) * p + half) >> KALMAN_GAIN_BITS);
+    return (gas_fixed_t)((filter->kalman.x + (1 << (KALMAN_EXTRA_BITS - 1))) >> KALMAN_EXTRA_BITS);
+}
+
+// Channel units^2 to LSB^2, saturating
+static uint32_t variance_lsb(float variance) {
+    float scaled = variance * (float)(1 << (2 * GAS_FILTER_FRAC_BITS));
+    if (!(scaled > 1.0f)) {
+        return 1;
+    }
+    return scaled >= 4.0e9f ? 4000000000u : (uint32_t)scaled;
+}
+
+void gas_filter_init(gas_filter_t *filter, const gas_filter_config_t *config) {
+    memset(filter, 0, sizeof(*filter));
+    filter->kind = config->kind;
+
+    filter->window = config->window;
+    if (filter->window < 1) {
+        filter->window = 1;
+    } else if (filter->window > GAS_FILTER_MAX_WINDOW) {
+        filter->window = GAS_FILTER_MAX_WINDOW;
+    }
+    filter->shift = config->ewma_shift;
+    if (filter->shift < 1) {
+        filter->shift = 1;
+    } else if (filter->shift > GAS_FILTER_MAX_SHIFT) {
+        filter->shift = GAS_FILTER_MAX_SHIFT;
+    }
+
+    if (filter->kind == GAS_FILTER_KALMAN) {
+        filter->kalman.q = variance_lsb(config->kalman_q);
+        filter->kalman.r = variance_lsb(config->kalman_r);
+    } else if (filter->kind == GAS_FILTER_MEDIAN) {
+        median_init(filter);
+    }
+}
+
+gas_fixed_t gas_filter_step(gas_filter_t *filter, gas_fixed_t value) {
+    if (value > GAS_FIXED_LIMIT) {
+        value = GAS_FIXED_LIMIT;
+    } else if (value < -GAS_FIXED_LIMIT) {
+        value = -GAS_FIXED_LIMIT;
+    }
+    switch (filter->kind) {
+        case GAS_FILTER_MOVING_AVERAGE:
+            return moving_average_step(filter, value);
+        case GAS_FILTER_EWMA:
+            return ewma_step(filter, value);
+        case GAS_FILTER_KALMAN:
+            return kalman_step(filter, value);
+        case GAS_FILTER_MEDIAN:
+            return median_step(filter, value);
+        default:
+            return value;
+    }
+}
+
+// Float in and out for callers that still hold float readings
+float gas_filter_apply(gas_filter_t *filter, float value) {
+    if (filter->kind == GAS_FILTER_NONE) {
+        return value;
+    }
+    return gas_fixed_to_float(gas_filter_step(filter, gas_fixed_from_float(value)));
+}
+
+const char *gas_filter_kind_name(gas_filter_kind_t kind) {
+    switch (kind) {
+        case GAS_FILTER_MOVING_AVERAGE: return "moving_average";
+        case GAS_FILTER_EWMA:           return "ewma";
+        case GAS_FILTER_KALMAN:         return "kalman";
+        case GAS_FILTER_MEDIAN:         return "median";
+        default:                        return "none";
+    }
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_FILTER_BENCHMARK
+
+#define BENCH_SAMPLES 256
+
+static const char *TAG = "GAS_FILTER";
+
+void gas_filter_benchmark(void) {
+    static gas_fixed_t input[BENCH_SAMPLES];
+    static gas_filter_t filter;
+
+    // Noisy level with a spike every 16 samples
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = (gas_fixed_t)((100 << GAS_FILTER_FRAC_BITS) + (int32_t)(seed >> 20) - 2048);
+        if (i % 16 == 15) {
+            input[i] += 500 << GAS_FILTER_FRAC_BITS;
+        }
+    }
+
+    for (int kind = GAS_FILTER_NONE; kind <= GAS_FILTER_MEDIAN; kind++) {
+        gas_filter_config_t config = {
+            .kind = kind, .window = CONFIG_GAS_FILTER_WINDOW, .ewma_shift = CONFIG_GAS_FILTER_EWMA_SHIFT,
+            .kalman_q = 0.05f, .kalman_r = 25.0f,
+        };
+        gas_filter_init(&filter, &config);
+        volatile gas_fixed_t sink = 0;
+        uint32_t start = esp_cpu_get_cycle_count();
+        for (int i = 0; i < BENCH_SAMPLES; i++) {
+            sink = gas_filter_step(&filter, input[i]);
+        }
+        uint32_t cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+        ESP_LOGI(TAG, "%-14s %u cycles/sample, last output %.2f", gas_filter_kind_name(kind),
+                 (unsigned)cycles, gas_fixed_to_float(sink));
+    }
+}
+
+#else
+
+void gas_filter_benchmark(void) {
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef GAS_FILTER_H
+#define GAS_FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Per-channel conditioning of raw gas readings before they leave the node.
+// Every filter runs in Q24.8 fixed point with its state inside gas_filter_t,
+// so there is no heap and no float arithmetic per sample:
+//
+//   moving average  O(1)      running sum over the window
+//   EWMA            O(1)      y += (x - y) / 2^shift
+//   Kalman          O(1)      1-D random walk, gain in Q28
+//   median          O(log n)  two heaps around the median, rejects spikes
+
+#define GAS_FILTER_FRAC_BITS  8
+#define GAS_FILTER_MAX_WINDOW 31
+#define GAS_FILTER_MAX_SHIFT  6
+
+// Inputs are clamped to +-65536 units so the EWMA accumulator and the moving
+// average sum stay inside 32 bits
+#define GAS_FIXED_LIMIT (1 << 24)
+
+typedef int32_t gas_fixed_t;    // Q24.8
+
+typedef enum {
+    GAS_FILTER_NONE,
+    GAS_FILTER_MOVING_AVERAGE,
+    GAS_FILTER_EWMA,
+    GAS_FILTER_KALMAN,
+    GAS_FILTER_MEDIAN,
+} gas_filter_kind_t;
+
+typedef struct {
+    gas_filter_kind_t kind;
+    uint8_t window;         // moving average and median, 1..GAS_FILTER_MAX_WINDOW samples
+    uint8_t ewma_shift;     // alpha = 1 / 2^shift, 1..GAS_FILTER_MAX_SHIFT
+    float kalman_q;         // process noise variance per sample, channel units^2
+    float kalman_r;         // measurement noise variance, channel units^2
+} gas_filter_config_t;
+
+typedef struct {
+    gas_filter_kind_t kind;
+    uint8_t window;
+    uint8_t shift;
+    uint8_t count;                          // samples seen, up to window
+    uint8_t next;                           // ring slot of the next sample
+    gas_fixed_t ring[GAS_FILTER_MAX_WINDOW];
+    union {
+        int32_t sum;                        // moving average
+        int32_t acc;                        // EWMA output << shift
+        struct {
+            int64_t x;                      // level, 8 more fraction bits
+            uint32_t p, q, r;               // variances in LSB^2
+        } kalman;
+        struct {
+            int8_t pos[GAS_FILTER_MAX_WINDOW];  // heap slot of each ring slot
+            uint8_t heap[GAS_FILTER_MAX_WINDOW];// ring slot at each heap slot
+        } median;
+    };
+} gas_filter_t;
+
+static inline gas_fixed_t gas_fixed_from_float(float value) {
+    float scaled = value * (1 << GAS_FILTER_FRAC_BITS);
+    if (!(scaled > -GAS_FIXED_LIMIT)) {
+        return scaled != scaled ? 0 : -GAS_FIXED_LIMIT; // nan reads as 0
+    }
+    if (scaled >= GAS_FIXED_LIMIT) {
+        return GAS_FIXED_LIMIT;
+    }
+    return (gas_fixed_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+static inline float gas_fixed_to_float(gas_fixed_t value) {
+    return value / (float)(1 << GAS_FILTER_FRAC_BITS);
+}
+
+// Function prototypes
+void gas_filter_init(gas_filter_t *filter, const gas_filter_config_t *config);
+gas_fixed_t gas_filter_step(gas_filter_t *filter, gas_fixed_t value);
+float gas_filter_apply(gas_filter_t *filter, float value);
+const char *gas_filter_kind_name(gas_filter_kind_t kind);
+void gas_filter_benchmark(void);
+
+#endif
@@ -0,0 +1,306 @@
+#include "gas_history.h"
+#include <string.h>
+
+// Marks blocks keyed by node_time_now(). Blocks in any older layout, or
+// keyed by a clock that restarted at every boot, are ignored.
+#define GAS_HISTORY_MAGIC 0x33545348   // "HST3"
+
+// Streams query points, averaging them into equal time buckets when downsampling
+typedef struct {
+    gas_history_emit_t emit;
+    void *ctx;
+    uint32_t from;
+    uint32_t to;
+    uint32_t width;     // bucket width in seconds, 0 = no downsampling
+    int64_t bucket;
+    double sum;        // double so long buckets do not lose precision
+    int count;
+    bool stopped;
+} downsampler_t;
+
+static void lock(gas_history_t *history) {
+    if (history->lock != NULL) {
+        history->lock(history->lock_ctx);
+    }
+}
+
+static void unlock(gas_history_t *history) {
+    if (history->unlock != NULL) {
+        history->unlock(history->lock_ctx);
+    }
+}
+
+static long slot_offset(int slot) {
+    return (long)slot * (long)sizeof(gas_history_block_t);
+}
+
+static void ds_flush(downsampler_t *ds) {
+    if (ds->count > 0 && !ds->stopped) {
+        uint32_t timestamp = ds->from + (uint32_t)ds->bucket * ds->width;
+        ds->stopped = !ds->emit(timestamp, ds->sum / ds->count, ds->ctx);
+    }
+    ds->sum = 0;
+    ds->count = 0;
+}
+
+static void ds_point(downsampler_t *ds, uint32_t timestamp, float value) {
+    if (timestamp < ds->from || timestamp > ds->to || ds->stopped) {
+        return;
+    }
+    if (ds->width == 0) {
+        ds->stopped = !ds->emit(timestamp, value, ds->ctx);
+        return;
+    }
+    int64_t bucket = (timestamp - ds->from) / ds->width;
+    if (bucket != ds->bucket) {
+        ds_flush(ds);
+        ds->bucket = bucket;
+    }
+    ds->sum += value;
+    ds->count++;
+}
+
+static void ds_block(downsampler_t *ds, const gas_history_block_t *block, gas_channel_t channel) {
+    gas_sample_t sample;
+    for (uint32_t i = 0; i < block->hdr.count && !ds->stopped; i++) {
+        gas_sample_unpack(&block->records[i].sample, &sample);
+        ds_point(ds, block->records[i].timestamp, sample.values[channel]);
+    }
+}
+
+static bool slot_covers(const gas_history_t *history, int slot, uint32_t from) {
+    return history->index[slot].seq != 0 && history->index[slot].last_ts >= from;
+}
+
+// `blocks` slots of GAS_HISTORY_RECORDS_PER_BLOCK records in the file at
+// `path`, created if missing. The blocks left by a previous run are indexed
+// and appends resume after the newest. Returns false if the file cannot be
+// opened, the store then keeps only the block being filled. The lock hooks
+// are set after it.
+bool gas_history_open(gas_history_t *history, const char *path, gas_history_hdr_t *index, int blocks) {
+    memset(history, 0, sizeof(*history));
+    memset(index, 0, sizeof(*index) * blocks);
+    history->index = index;
+    history->blocks = blocks;
+    history->next_seq = 1;
+
+    history->file = fopen(path, "r+b");
+    if (history->file == NULL) {
+        history->file = fopen(path, "w+b");
+    }
+    if (history->file == NULL) {
+        return false;
+    }
+
+    // Rebuild the index from the block headers and resume after the newest block
+    uint32_t newest_seq = 0;
+    int newest_slot = -1;
+    for (int slot = 0; slot < blocks; slot++) {
+        gas_history_hdr_t hdr;
+        if (fseek(history->file, slot_offset(slot), SEEK_SET) != 0 ||
+            fread(&hdr, sizeof(hdr), 1, history->file) != 1) {
+            break;
+        }
+        if (hdr.magic != GAS_HISTORY_MAGIC || hdr.seq == 0 || hdr.count != GAS_HISTORY_RECORDS_PER_BLOCK) {
+            continue;
+        }
+        index[slot] = hdr;
+        if (hdr.seq > newest_seq) {
+            newest_seq = hdr.seq;
+            newest_slot = slot;
+        }
+    }
+    history->head_slot = (newest_slot + 1) % blocks;
+    history->next_seq = newest_seq + 1;
+    return true;
+}
+
+void gas_history_close(gas_history_t *history) {
+    if (history->file != NULL) {
+        fclose(history->file);
+        history->file = NULL;
+    }
+}
+
+// Timestamp of the newest record held, 0 if there is none. The node's clock
+// resumes after it at boot.
+uint32_t gas_history_newest(const gas_history_t *history) {
+    if (history->head.hdr.count > 0) {
+        return history->head.hdr.last_ts;
+    }
+    int newest = (history->head_slot + history->blocks - 1) % history->blocks;
+    return history->index[newest].seq != 0 ? history->index[newest].last_ts : 0;
+}
+
+// Returns false if a full block could not be written; it is then only in the
+// index until its slot comes round again, and queries skip it.
+bool gas_history_append(gas_history_t *history, uint32_t timestamp, const gas_sample_t *sample) {
+    bool ok = true;
+    lock(history);
+
+    gas_history_hdr_t *hdr = &history->head.hdr;
+    if (hdr->count == 0) {
+        hdr->first_ts = timestamp;
+    }
+    hdr->last_ts = timestamp;
+    history->head.records[hdr->count].timestamp = timestamp;
+    gas_sample_pack(sample, &history->head.records[hdr->count].sample);
+    hdr->count++;
+
+    if (hdr->count == GAS_HISTORY_RECORDS_PER_BLOCK) {
+        hdr->magic = GAS_HISTORY_MAGIC;
+        hdr->seq = history->next_seq++;
+        if (history->file != NULL) {
+            ok = fseek(history->file, slot_offset(history->head_slot), SEEK_SET) == 0 &&
+                 fwrite(&history->head, sizeof(history->head), 1, history->file) == 1;
+            fflush(history->file);
+        }
+        history->index[history->head_slot] = *hdr;
+        history->head_slot = (history->head_slot + 1) % history->blocks;
+        memset(&history->head, 0, sizeof(history->head));
+    }
+
+    unlock(history);
+    return ok;
+}
+
+// Times of the oldest and newest records held, false if there are none
+static bool held_span(const gas_history_t *history, uint32_t *oldest, uint32_t *newest) {
+    for (int i = 0; i < history->blocks; i++) {
+        const gas_history_hdr_t *hdr = &history->index[(history->head_slot + i) % history->blocks];
+        if (hdr->seq != 0) {
+            *oldest = hdr->first_ts;
+            *newest = gas_history_newest(history);
+            return true;
+        }
+    }
+    if (history->head.hdr.count == 0) {
+        return false;
+    }
+    *oldest = history->head.hdr.first_ts;
+    *newest = history->head.hdr.last_ts;
+    return true;
+}
+
+static uint32_t bucket_width(uint32_t from, uint32_t to, int max_points) {
+    return max_points > 0 ? (to - from) / (uint32_t)max_points + 1 : 0;
+}
+
+// gas_history_query() with the bucket width given, buckets starting at `from`
+static int query_buckets(gas_history_t *history, gas_channel_t channel, uint32_t from, uint32_t to,
+                         uint32_t width, gas_history_emit_t emit, void *ctx) {
+    downsampler_t ds = {
+        .emit = emit,
+        .ctx = ctx,
+        .from = from,
+        .to = to,
+        .width = width,
+        .bucket = -1,
+    };
+
+    // Blocks in logical order start at head_slot (oldest). Unwritten slots all sit
+    // before the written ones, and timestamps only grow, so binary search works.
+    lock(history);
+    int lo = 0, hi = history->blocks;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (slot_covers(history, (history->head_slot + mid) % history->blocks, from)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    int start_slot = history->head_slot;
+    unlock(history);
+
+    int touched = 0;
+    for (int i = lo; i < history->blocks && !ds.stopped; i++) {
+        int slot = (start_slot + i) % history->blocks;
+
+        lock(history);
+        gas_history_hdr_t hdr = history->index[slot];
+        bool ok = hdr.seq != 0 && hdr.first_ts <= to && history->file != NULL &&
+                  fseek(history->file, slot_offset(slot), SEEK_SET) == 0 &&
+                  fread(&history->scratch, sizeof(history->scratch), 1, history->file) == 1 &&
+                  history->scratch.hdr.seq == hdr.seq;
+        unlock(history);
+
+        if (hdr.seq != 0 && hdr.first_ts > to) {
+            break;
+        }
+        if (ok) {
+            ds_block(&ds, &history->scratch, channel);
+            touched++;
+        }
+    }
+
+    // Records not yet written to the file
+    lock(history);
+    memcpy(&history->scratch, &history->head, sizeof(history->scratch));
+    unlock(history);
+    if (history->scratch.hdr.count > 0 && history->scratch.hdr.first_ts <= to) {
+        ds_block(&ds, &history->scratch, channel);
+    }
+    ds_flush(&ds);
+    return touched;
+}
+
+// Streams the points of `channel` in [from, to] to `emit`, averaged into at
+// most `max_points` equal time buckets when it is above 0. Returns the
+// number of blocks read from the file, or -1 for bad arguments.
+int gas_history_query(gas_history_t *history, gas_channel_t channel, uint32_t from, uint32_t to, int max_points,
+                      gas_history_emit_t emit, void *ctx) {
+    if (channel >= GAS_CH_COUNT || from > to) {
+        return -1;
+    }
+    return query_buckets(history, channel, from, to, bucket_width(from, to, max_points), emit, ctx);
+}
+
+// Sets up the query of gas_history_query() to be run a slice at a time. The
+// range is trimmed to the records held, so a wide one costs no empty
+// slices; buckets stay where the whole query puts them. False if no record
+// falls in it, or for bad arguments.
+bool gas_history_cursor_init(gas_history_t *history, gas_history_cursor_t *cursor, gas_channel_t channel,
+                             uint32_t from, uint32_t to, int max_points) {
+    if (channel >= GAS_CH_COUNT || from > to) {
+        return false;
+    }
+    uint32_t oldest, newest;
+    lock(history);
+    bool held = held_span(history, &oldest, &newest);
+    unlock(history);
+    if (!held || oldest > to || newest < from) {
+        return false;
+    }
+
+    cursor->channel = channel;
+    cursor->width = bucket_width(from, to, max_points);
+    cursor->next = from;
+    cursor->to = to < newest ? to : newest;
+    if (from < oldest) {
+        uint32_t skip = oldest - from;
+        cursor->next += cursor->width > 0 ? skip / cursor->width * cursor->width : skip;
+    }
+    return true;
+}
+
+// Streams the points of the next `slice_s` seconds of the cursor's range,
+// rounded to whole buckets (at least one). The slices together give the
+// points of the whole query. False once the range is done.
+bool gas_history_cursor_next(gas_history_t *history, gas_history_cursor_t *cursor, uint32_t slice_s,
+                             gas_history_emit_t emit, void *ctx) {
+    uint32_t span = slice_s;
+    if (cursor->width > 0) {
+        span = cursor->width < slice_s ? slice_s / cursor->width * cursor->width : cursor->width;
+    }
+    if (span == 0) {
+        span = 1;
+    }
+    uint32_t last = cursor->to - cursor->next < span ? cursor->to : cursor->next + span - 1;
+    query_buckets(history, cursor->channel, cursor->next, last, cursor->width, emit, ctx);
+    if (last == cursor->to) {
+        return false;
+    }
+    cursor->next = last + 1;
+    return true;
+}
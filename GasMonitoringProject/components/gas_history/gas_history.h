@@ -0,0 +1,80 @@
+#ifndef GAS_HISTORY_H
+#define GAS_HISTORY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include "gas_channels.h"
+
+// Sample history in a circular file of fixed-size blocks. Records are
+// appended into a RAM block that goes to the next slot of the file when
+// full. A RAM index keeps the sequence number and time span of every slot,
+// rebuilt from the block headers at open, so a range query binary-searches
+// it and reads only the blocks that overlap the range.
+//
+// Timestamps have to grow from one record to the next across the whole
+// file, including over reboots: the search relies on it. The node keys them
+// by node_time_now(), not by a clock that restarts at boot.
+//
+// Plain C over stdio. Index and file are touched between the `lock` and
+// `unlock` hooks, left NULL when the caller serialises every call; a query
+// takes them once per block so appends are not held up for its whole run.
+// One query at a time per store, it reads into the store's scratch block.
+#define GAS_HISTORY_RECORDS_PER_BLOCK 64
+
+typedef struct {
+    uint32_t timestamp;     // node_time_now(), seconds
+    gas_sample_packed_t sample;
+} gas_history_record_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // 0 means the slot was never written
+    uint32_t first_ts;
+    uint32_t last_ts;
+    uint32_t count;
+} gas_history_hdr_t;
+
+typedef struct {
+    gas_history_hdr_t hdr;
+    gas_history_record_t records[GAS_HISTORY_RECORDS_PER_BLOCK];
+} gas_history_block_t;
+
+// Called for every point of a query result. Return false to stop the query.
+typedef bool (*gas_history_emit_t)(uint32_t timestamp, float value, void *ctx);
+
+// A query answered a slice at a time, so a long one can be spread over
+// several passes of a server loop
+typedef struct {
+    gas_channel_t channel;
+    uint32_t next;              // start of the next slice, on a bucket boundary
+    uint32_t to;
+    uint32_t width;             // bucket width in seconds, 0 for every point
+} gas_history_cursor_t;
+
+typedef struct {
+    FILE *file;                 // NULL keeps only the block being filled
+    gas_history_hdr_t *index;   // one entry per slot, caller storage
+    int blocks;
+    int head_slot;              // slot the RAM block goes to when full
+    uint32_t next_seq;
+    gas_history_block_t head;   // block being filled
+    gas_history_block_t scratch;    // block read by a query
+    void (*lock)(void *ctx);
+    void (*unlock)(void *ctx);
+    void *lock_ctx;
+} gas_history_t;
+
+// Function prototypes
+bool gas_history_open(gas_history_t *history, const char *path, gas_history_hdr_t *index, int blocks);
+void gas_history_close(gas_history_t *history);
+uint32_t gas_history_newest(const gas_history_t *history);
+bool gas_history_append(gas_history_t *history, uint32_t timestamp, const gas_sample_t *sample);
+int gas_history_query(gas_history_t *history, gas_channel_t channel, uint32_t from, uint32_t to, int max_points,
+                      gas_history_emit_t emit, void *ctx);
+bool gas_history_cursor_init(gas_history_t *history, gas_history_cursor_t *cursor, gas_channel_t channel,
+                             uint32_t from, uint32_t to, int max_points);
+bool gas_history_cursor_next(gas_history_t *history, gas_history_cursor_t *cursor, uint32_t slice_s,
+                             gas_history_emit_t emit, void *ctx);
+
+#endif
@@ -0,0 +1,259 @@
+#include "gas_link.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+void gas_link_ring_init(gas_link_ring_t *ring, gas_link_record_t *records, uint32_t capacity) {
+    memset(records, 0, capacity * sizeof(records[0]));
+    ring->records = records;
+    ring->capacity = capacity;
+    ring->next_seq = 1;
+}
+
+// Numbers the sample as the next frame, overwriting the oldest one held.
+// Returns its sequence number.
+uint32_t gas_link_ring_push(gas_link_ring_t *ring, const gas_sample_t *sample, uint32_t anomalies,
+                            int64_t capture_ms) {
+    uint32_t seq = ring->next_seq++;
+    gas_link_record_t *record = &ring->records[seq % ring->capacity];
+    record->seq = seq;
+    record->anomalies = anomalies;
+    record->capture_ms = capture_ms;
+    gas_sample_pack(sample, &record->sample);
+    return seq;
+}
+
+// Frame `seq` if the ring still holds it, NULL once it was overwritten or
+// before it was pushed
+const gas_link_record_t *gas_link_ring_get(const gas_link_ring_t *ring, uint32_t seq) {
+    if (seq == 0 || seq >= ring->next_seq || ring->next_seq - seq > ring->capacity) {
+        return NULL;
+    }
+    const gas_link_record_t *record = &ring->records[seq % ring->capacity];
+    return record->seq == seq ? record : NULL;
+}
+
+uint32_t gas_link_ring_oldest(const gas_link_ring_t *ring) {
+    return ring->next_seq > ring->capacity ? ring->next_seq - ring->capacity : 1;
+}
+
+// The fields of `channels` (GAS_CH_ALL for a full frame) with the ",S:" and
+// ",A:" suffixes, without the newline. Returns the length, or the length it
+// would have had if `size` is short.
+int gas_link_format(const gas_link_record_t *record, uint32_t channels, uint16_t boot, char *buf, size_t size) {
+    gas_sample_t sample;
+    gas_sample_unpack(&record->sample, &sample);
+    int len = gas_frame_format_channels(&sample, channels, buf, size);
+    if (len < 0 || (size_t)len >= size) {
+        return len;
+    }
+    len += snprintf(buf + len, size - len, ",S:%x:%" PRIu32 ":%" PRId64, (unsigned)boot, record->seq,
+                    record->capture_ms);
+    if (record->anomalies != 0 && (size_t)len < size) {
+        len += snprintf(buf + len, size - len, ",A:%" PRIx32, record->anomalies);
+    }
+    return len;
+}
+
+bool gas_link_parse_suffix(const char *frame, uint16_t *boot, uint32_t *seq, int64_t *capture_ms) {
+    const char *p = strstr(frame, ",S:");
+    if (p == NULL) {
+        return false;
+    }
+    char *end;
+    unsigned long value = strtoul(p + 3, &end, 16);
+    if (end == p + 3 || *end != ':' || value > UINT16_MAX) {
+        return false;
+    }
+    *boot = (uint16_t)value;
+    p = end + 1;
+    *seq = (uint32_t)strtoul(p, &end, 10);
+    if (end == p || *end != ':') {
+        return false;
+    }
+    p = end + 1;
+    *capture_ms = strtoll(p, &end, 10);
+    return end != p;
+}
+
+// "<verb>:<first>:<last>\n"
+int gas_link_format_range(const char *verb, uint32_t first, uint32_t last, char *buf, size_t size) {
+    return snprintf(buf, size, "%s:%" PRIu32 ":%" PRIu32 "\n", verb, first, last);
+}
+
+bool gas_link_parse_range(const char *line, const char *verb, uint32_t *first, uint32_t *last) {
+    size_t verb_len = strlen(verb);
+    if (strncmp(line, verb, verb_len) != 0 || line[verb_len] != ':') {
+        return false;
+    }
+    const char *p = line + verb_len + 1;
+    char *end;
+    *first = (uint32_t)strtoul(p, &end, 10);
+    if (end == p || *end != ':') {
+        return false;
+    }
+    p = end + 1;
+    *last = (uint32_t)strtoul(p, &end, 10);
+    return end != p && *first != 0 && *first <= *last;
+}
+
+void gas_link_tracker_init(gas_link_tracker_t *tracker) {
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+static uint32_t gap_size(const gas_link_gap_t *gap) {
+    return gap->last - gap->first + 1;
+}
+
+static void gap_remove(gas_link_tracker_t *tracker, int i) {
+    memmove(&tracker->gaps[i], &tracker->gaps[i + 1], (tracker->gap_count - i - 1) * sizeof(tracker->gaps[0]));
+    tracker->gap_count--;
+}
+
+static void gap_open(gas_link_tracker_t *tracker, uint32_t first, uint32_t last) {
+    if (tracker->gap_count == GAS_LINK_MAX_GAPS) {
+        tracker->lost += gap_size(&tracker->gaps[0]);
+        gap_remove(tracker, 0);
+    }
+    tracker->gaps[tracker->gap_count++] = (gas_link_gap_t){ .first = first, .last = last };
+}
+
+// Takes [lo, hi], inside gap i, out of it. A cut from the middle splits the
+// gap; with no room for the second half, that half counts as lost.
+static void gap_cut(gas_link_tracker_t *tracker, int i, uint32_t lo, uint32_t hi) {
+    gas_link_gap_t *gap = &tracker->gaps[i];
+    if (lo == gap->first && hi == gap->last) {
+        gap_remove(tracker, i);
+    } else if (lo == gap->first) {
+        gap->first = hi + 1;
+    } else if (hi == gap->last) {
+        gap->last = lo - 1;
+    } else if (tracker->gap_count == GAS_LINK_MAX_GAPS) {
+        tracker->lost += gap->last - hi;
+        gap->last = lo - 1;
+    } else {
+        gas_link_gap_t tail = *gap;
+        tail.first = hi + 1;
+        gap->last = lo - 1;
+        memmove(&tracker->gaps[i + 2], &tracker->gaps[i + 1], (tracker->gap_count - i - 1) * sizeof(tracker->gaps[0]));
+        tracker->gaps[i + 1] = tail;
+        tracker->gap_count++;
+    }
+}
+
+gas_link_verdict_t gas_link_track(gas_link_tracker_t *tracker, uint16_t boot, uint32_t seq) {
+    if (!tracker->synced || boot != tracker->boot) {
+        // First contact starts where the node is; after a node restart the
+        // frames of the new boot the gateway missed are asked for as well,
+        // and those of the old boot are gone with its ring
+        if (tracker->synced) {
+            tracker->lost += gas_link_missing(tracker);
+            tracker->restarts++;
+            tracker->next_seq = 1;
+        } else {
+            tracker->next_seq = seq;
+        }
+        tracker->synced = true;
+        tracker->boot = boot;
+        tracker->gap_count = 0;
+    }
+
+    if (seq >= tracker->next_seq) {
+        if (seq > tracker->next_seq) {
+            gap_open(tracker, tracker->next_seq, seq - 1);
+        }
+        tracker->next_seq = seq + 1;
+        tracker->received++;
+        return GAS_LINK_NEW;
+    }
+    for (int i = 0; i < tracker->gap_count; i++) {
+        if (seq >= tracker->gaps[i].first && seq <= tracker->gaps[i].last) {
+            gap_cut(tracker, i, seq, seq);
+            tracker->recovered++;
+            return GAS_LINK_RECOVERED;
+        }
+    }
+    tracker->duplicates++;
+    return GAS_LINK_DUPLICATE;
+}
+
+// The node no longer holds [first, last]
+void gas_link_gone(gas_link_tracker_t *tracker, uint32_t first, uint32_t last) {
+    for (int i = tracker->gap_count - 1; i >= 0; i--) {
+        uint32_t lo = first > tracker->gaps[i].first ? first : tracker->gaps[i].first;
+        uint32_t hi = last < tracker->gaps[i].last ? last : tracker->gaps[i].last;
+        if (lo <= hi) {
+            tracker->lost += hi - lo + 1;
+            gap_cut(tracker, i, lo, hi);
+        }
+    }
+}
+
+// RETX lines for the gaps not asked for yet or whose last request is older
+// than timeout_ms. A gap still open after GAS_LINK_RETRIES requests counts
+// as lost. Returns the length written to buf.
+int gas_link_requests(gas_link_tracker_t *tracker, uint32_t now_ms, uint32_t timeout_ms, char *buf, size_t size) {
+    int len = 0;
+    for (int i = 0; i < tracker->gap_count; i++) {
+        gas_link_gap_t *gap = &tracker->gaps[i];
+        if (gap->tries > 0 && now_ms - gap->requested_ms < timeout_ms) {
+            continue;
+        }
+        if (gap->tries >= GAS_LINK_RETRIES) {
+            tracker->lost += gap_size(gap);
+            gap_remove(tracker, i--);
+            continue;
+        }
+        int n = gas_link_format_range("RETX", gap->first, gap->last, buf + len, size - len);
+        if (n < 0 || (size_t)n >= size - len) {
+            break; // the rest goes with the next call
+        }
+        len += n;
+        gap->requested_ms = now_ms;
+        gap->tries++;
+    }
+    return len;
+}
+
+uint32_t gas_link_missing(const gas_link_tracker_t *tracker) {
+    uint32_t missing = 0;
+    for (int i = 0; i < tracker->gap_count; i++) {
+        missing += gap_size(&tracker->gaps[i]);
+    }
+    return missing;
+}
+
+// Room for the next read; a line longer than the buffer is dropped
+char *gas_link_lines_space(gas_link_lines_t *lines, size_t *avail) {
+    if (lines->start > 0) {
+        memmove(lines->buf, lines->buf + lines->start, lines->len - lines->start);
+        lines->len -= lines->start;
+        lines->start = 0;
+    }
+    if (lines->len == sizeof(lines->buf)) {
+        lines->len = 0;
+    }
+    *avail = sizeof(lines->buf) - lines->len;
+    return lines->buf + lines->len;
+}
+
+void gas_link_lines_commit(gas_link_lines_t *lines, size_t n) {
+    lines->len += n;
+}
+
+// Next complete line without its "\n" or "\r\n", NULL if there is none yet.
+// Valid until the next gas_link_lines_space().
+char *gas_link_lines_next(gas_link_lines_t *lines) {
+    char *line = lines->buf + lines->start;
+    char *newline = memchr(line, '\n', lines->len - lines->start);
+    if (newline == NULL) {
+        return NULL;
+    }
+    *newline = '\0';
+    if (newline > line && newline[-1] == '\r') {
+        newline[-1] = '\0';
+    }
+    lines->start = newline - lines->buf + 1;
+    return line;
+}
@@ -0,0 +1,113 @@
+#ifndef GAS_LINK_H
+#define GAS_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gas_channels.h"
+
+// Loss detection and selective retransmission on the node -> gateway TCP
+// link. Frames are newline-terminated and each carries the node's boot id,
+// a sequence number and the capture time of its sample:
+//
+//   <frame>,S:<boot>:<seq>:<capture ms>[,A:<mask>][,T:...]\n
+//
+// The node numbers its frames whether or not the gateway is connected and
+// keeps the last ones in a ring (gas_link_ring_t). The gateway tracks the
+// sequence per node (gas_link_tracker_t): a jump opens a gap, and gaps are
+// asked for again with
+//
+//   RETX:<first>:<last>\n      (gateway -> node)
+//
+// The node re-sends what its ring still holds and answers the rest with
+//
+//   GONE:<first>:<last>\n      (node -> gateway)
+//
+// which the gateway counts as lost. A new boot id starts the sequence over
+// at 1, so the frames of the new boot the gateway missed are asked for too.
+//
+// The node can also publish the same frames over UDP, one per datagram, to
+// any number of listeners at once. There is no RETX there: a gap is lost as
+// soon as it opens. Between frames the node sends now and then
+//
+//   SNAP:<frame>,S:<boot>:<newest seq>:<capture ms>\n
+//
+// with its current readings, for listeners that join late.
+// Plain C, the sockets are the caller's.
+
+#define GAS_LINK_SUFFIX_LEN  40     // ",S:<boot>:<seq>:<capture ms>"
+#define GAS_LINK_MAX_GAPS    8      // open gaps per node; the oldest is given up past this
+#define GAS_LINK_RETRIES     3      // requests per gap before it counts as lost
+#define GAS_LINK_LINE_MAX    256
+#define GAS_LINK_SNAPSHOT    "SNAP:"
+
+// One numbered frame held for retransmission
+typedef struct {
+    uint32_t seq;
+    uint32_t anomalies;         // ",A:" channel mask, 0 = none
+    int64_t capture_ms;         // node clock
+    gas_sample_packed_t sample;
+} gas_link_record_t;
+
+typedef struct {
+    gas_link_record_t *records;
+    uint32_t capacity;
+    uint32_t next_seq;          // given to the next push, the first is 1
+} gas_link_ring_t;
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+    uint32_t requested_ms;
+    uint8_t tries;              // requests sent so far
+} gas_link_gap_t;
+
+// Gateway view of one node's sequence
+typedef struct {
+    bool synced;                // seen a frame from this node
+    uint16_t boot;
+    uint32_t next_seq;          // one past the highest seq received
+    gas_link_gap_t gaps[GAS_LINK_MAX_GAPS];    // oldest first
+    int gap_count;
+    uint32_t received;          // new frames
+    uint32_t recovered;         // frames that filled a gap
+    uint32_t duplicates;        // frames received before
+    uint32_t lost;              // frames given up on
+    uint32_t restarts;          // boot id changes
+} gas_link_tracker_t;
+
+typedef enum {
+    GAS_LINK_NEW,               // next in sequence, or ahead of a new gap
+    GAS_LINK_RECOVERED,         // filled part of a gap
+    GAS_LINK_DUPLICATE,         // received before
+} gas_link_verdict_t;
+
+// Splits a byte stream into lines
+typedef struct {
+    char buf[GAS_LINK_LINE_MAX];
+    size_t start;               // first byte not yet returned
+    size_t len;
+} gas_link_lines_t;
+
+// Function prototypes
+void gas_link_ring_init(gas_link_ring_t *ring, gas_link_record_t *records, uint32_t capacity);
+uint32_t gas_link_ring_push(gas_link_ring_t *ring, const gas_sample_t *sample, uint32_t anomalies,
+                            int64_t capture_ms);
+const gas_link_record_t *gas_link_ring_get(const gas_link_ring_t *ring, uint32_t seq);
+uint32_t gas_link_ring_oldest(const gas_link_ring_t *ring);
+int gas_link_format(const gas_link_record_t *record, uint32_t channels, uint16_t boot, char *buf, size_t size);
+bool gas_link_parse_suffix(const char *frame, uint16_t *boot, uint32_t *seq, int64_t *capture_ms);
+int gas_link_format_range(const char *verb, uint32_t first, uint32_t last, char *buf, size_t size);
+bool gas_link_parse_range(const char *line, const char *verb, uint32_t *first, uint32_t *last);
+
+void gas_link_tracker_init(gas_link_tracker_t *tracker);
+gas_link_verdict_t gas_link_track(gas_link_tracker_t *tracker, uint16_t boot, uint32_t seq);
+void gas_link_gone(gas_link_tracker_t *tracker, uint32_t first, uint32_t last);
+int gas_link_requests(gas_link_tracker_t *tracker, uint32_t now_ms, uint32_t timeout_ms, char *buf, size_t size);
+uint32_t gas_link_missing(const gas_link_tracker_t *tracker);
+
+char *gas_link_lines_space(gas_link_lines_t *lines, size_t *avail);
+void gas_link_lines_commit(gas_link_lines_t *lines, size_t n);
+char *gas_link_lines_next(gas_link_lines_t *lines);
+
+#endif
@@ -0,0 +1,308 @@
+#include "gas_mqtt.h"
+#include <stdlib.h>
+#include <string.h>
+#include "fastfmt.h"
+
+// MQTT 3.1.1 control packet types, in the high nibble of the first byte
+#define MQTT_CONNECT        0x10
+#define MQTT_CONNACK        0x20
+#define MQTT_PUBLISH_QOS1   0x32
+#define MQTT_PUBACK         0x40
+#define MQTT_PINGREQ        0xc0
+#define MQTT_PINGRESP       0xd0
+#define MQTT_DISCONNECT     0xe0
+
+#define MQTT_CLEAN_SESSION  0x02
+#define MQTT_VARINT_MAX     4
+
+static void fmt_hex(fastfmt_t *f, uint32_t value) {
+    char digits[8];
+    int n = 0;
+    do {
+        digits[n++] = "0123456789abcdef"[value & 0xf];
+        value >>= 4;
+    } while (value != 0);
+    while (n > 0) {
+        fastfmt_char(f, digits[--n]);
+    }
+}
+
+static void fmt_i64(fastfmt_t *f, int64_t value) {
+    if (value < 0) {
+        fastfmt_char(f, '-');
+        value = -value;
+    }
+    fastfmt_u32(f, value > UINT32_MAX ? UINT32_MAX : (uint32_t)value);
+}
+
+// The payload of one message holding `count` consecutive records. Returns its
+// length, or -1 if it does not fit in `size`.
+int gas_mqtt_batch_format(const gas_link_record_t *records, int count, uint16_t boot, char *buf, size_t size) {
+    if (count <= 0 || count > GAS_MQTT_BATCH_MAX) {
+        return -1;
+    }
+    fastfmt_t f;
+    fastfmt_begin(&f, buf, size);
+    int64_t t0 = records[0].capture_ms;
+    fmt_hex(&f, boot);
+    fastfmt_char(&f, ':');
+    fastfmt_u32(&f, records[0].seq);
+    fastfmt_char(&f, ':');
+    fmt_i64(&f, t0);
+    fastfmt_char(&f, ':');
+    fastfmt_u32(&f, (uint32_t)count);
+    fastfmt_char(&f, '\n');
+
+    for (int i = 0; i < count; i++) {
+        gas_sample_t sample;
+        gas_sample_unpack(&records[i].sample, &sample);
+        fmt_i64(&f, records[i].capture_ms - t0);
+        for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+            fastfmt_char(&f, ',');
+            fastfmt_fixed2(&f, sample.values[ch]);
+        }
+        fastfmt_char(&f, ',');
+        fmt_hex(&f, records[i].anomalies);
+        fastfmt_char(&f, '\n');
+    }
+    // fastfmt truncates silently; a full buffer means the batch did not fit
+    return f.len + 1 < size ? fastfmt_end(&f) : -1;
+}
+
+// Inverse of gas_mqtt_batch_format(): calls `emit` for each row. Returns the
+// number of rows, or -1 if the payload is malformed.
+int gas_mqtt_batch_parse(const char *payload, size_t len, gas_mqtt_frame_t emit, void *ctx) {
+    const char *p = payload;
+    const char *end = payload + len;
+    char *next;
+    unsigned long boot = strtoul(p, &next, 16);
+    if (next == p || *next != ':' || boot > UINT16_MAX) {
+        return -1;
+    }
+    p = next + 1;
+    uint32_t seq = (uint32_t)strtoul(p, &next, 10);
+    if (next == p || *next != ':') {
+        return -1;
+    }
+    p = next + 1;
+    int64_t t0 = strtoll(p, &next, 10);
+    if (next == p || *next != ':') {
+        return -1;
+    }
+    p = next + 1;
+    long count = strtol(p, &next, 10);
+    if (next == p || *next != '\n' || count <= 0 || count > GAS_MQTT_BATCH_MAX) {
+        return -1;
+    }
+    p = next + 1;
+
+    for (long i = 0; i < count; i++) {
+        if (p >= end) {
+            return -1;
+        }
+        gas_sample_t sample;
+        int64_t dt = strtoll(p, &next, 10);
+        if (next == p) {
+            return -1;
+        }
+        p = next;
+        for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+            if (*p != ',') {
+                return -1;
+            }
+            sample.values[ch] = strtof(p + 1, &next);
+            if (next == p + 1) {
+                return -1;
+            }
+            p = next;
+        }
+        if (*p != ',') {
+            return -1;
+        }
+        uint32_t anomalies = (uint32_t)strtoul(p + 1, &next, 16);
+        if (next == p + 1 || *next != '\n') {
+            return -1;
+        }
+        p = next + 1;
+        if (emit != NULL) {
+            emit((uint16_t)boot, seq + (uint32_t)i, t0 + dt, &sample, anomalies, ctx);
+        }
+    }
+    return (int)count;
+}
+
+static int put_varint(uint8_t *buf, size_t value) {
+    int n = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buf[n++] = byte | (value > 0 ? 0x80 : 0);
+    } while (value > 0 && n < MQTT_VARINT_MAX);
+    return n;
+}
+
+static int varint_len(size_t value) {
+    int n = 1;
+    while (value >= 128) {
+        value >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static void put_u16(uint8_t *buf, uint16_t value) {
+    buf[0] = value >> 8;
+    buf[1] = value & 0xff;
+}
+
+// CONNECT with a clean session: whatever the broker held for `client_id`
+// is dropped, unacknowledged messages are the caller's to send again.
+// Returns the packet length, or -1 if `size` is short.
+int gas_mqtt_connect(uint8_t *buf, size_t size, const char *client_id, uint16_t keepalive_s) {
+    static const uint8_t protocol[] = { 0, 4, 'M', 'Q', 'T', 'T', 4 };
+    size_t id_len = strlen(client_id);
+    size_t remaining = sizeof(protocol) + 1 + 2 + 2 + id_len;
+    if (id_len > UINT16_MAX || 1 + varint_len(remaining) + remaining > size) {
+        return -1;
+    }
+    int len = 0;
+    buf[len++] = MQTT_CONNECT;
+    len += put_varint(buf + len, remaining);
+    memcpy(buf + len, protocol, sizeof(protocol));
+    len += sizeof(protocol);
+    buf[len++] = MQTT_CLEAN_SESSION;
+    put_u16(buf + len, keepalive_s);
+    len += 2;
+    put_u16(buf + len, (uint16_t)id_len);
+    len += 2;
+    memcpy(buf + len, client_id, id_len);
+    return len + (int)id_len;
+}
+
+// Writes the header of a QoS 1 PUBLISH so that it ends at
+// buf + GAS_MQTT_HEADROOM, where the caller has put the payload, and the
+// whole packet goes out with one send. Returns the offset the packet starts
+// at, or -1 if the topic is too long.
+int gas_mqtt_publish_header(uint8_t *buf, const char *topic, size_t payload_len, uint16_t packet_id) {
+    size_t topic_len = strlen(topic);
+    if (topic_len > GAS_MQTT_TOPIC_MAX) {
+        return -1;
+    }
+    size_t remaining = 2 + topic_len + 2 + payload_len;
+    int start = GAS_MQTT_HEADROOM - (int)(1 + varint_len(remaining) + remaining - payload_len);
+    int len = start;
+    buf[len++] = MQTT_PUBLISH_QOS1;
+    len += put_varint(buf + len, remaining);
+    put_u16(buf + len, (uint16_t)topic_len);
+    len += 2;
+    memcpy(buf + len, topic, topic_len);
+    len += topic_len;
+    put_u16(buf + len, packet_id);
+    return start;
+}
+
+int gas_mqtt_pingreq(uint8_t *buf) {
+    buf[0] = MQTT_PINGREQ;
+    buf[1] = 0;
+    return 2;
+}
+
+int gas_mqtt_disconnect(uint8_t *buf) {
+    buf[0] = MQTT_DISCONNECT;
+    buf[1] = 0;
+    return 2;
+}
+
+// Identifies the first packet in `buf` and sets `used` to its length.
+// Returns GAS_MQTT_INCOMPLETE until the whole packet is there.
+gas_mqtt_packet_t gas_mqtt_parse(const uint8_t *buf, size_t len, size_t *used, uint16_t *value) {
+    size_t remaining = 0;
+    size_t pos = 1;
+    for (int shift = 0;; shift += 7) {
+        if (pos >= len) {
+            return GAS_MQTT_INCOMPLETE;
+        }
+        if (pos > MQTT_VARINT_MAX) {
+            return GAS_MQTT_MALFORMED;
+        }
+        uint8_t byte = buf[pos++];
+        remaining |= (size_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    if (len - pos < remaining) {
+        return GAS_MQTT_INCOMPLETE;
+    }
+    *used = pos + remaining;
+    const uint8_t *body = buf + pos;
+    switch (buf[0] & 0xf0) {
+    case MQTT_CONNACK:
+        if (remaining != 2) {
+            return GAS_MQTT_MALFORMED;
+        }
+        *value = body[1];
+        return GAS_MQTT_CONNACK;
+    case MQTT_PUBACK:
+        if (remaining != 2) {
+            return GAS_MQTT_MALFORMED;
+        }
+        *value = (uint16_t)(body[0] << 8 | body[1]);
+        return GAS_MQTT_PUBACK;
+    case MQTT_PINGRESP:
+        return GAS_MQTT_PINGRESP;
+    default:
+        return GAS_MQTT_OTHER;
+    }
+}
+
+void gas_mqtt_window_init(gas_mqtt_window_t *window, int size) {
+    memset(window->msgs, 0, sizeof(window->msgs));
+    window->size = size < 1 ? 1 : size > GAS_MQTT_WINDOW_MAX ? GAS_MQTT_WINDOW_MAX : size;
+    window->count = 0;
+    if (window->next_id == 0) {
+        window->next_id = 1;
+    }
+}
+
+bool gas_mqtt_window_full(const gas_mqtt_window_t *window) {
+    return window->count >= window->size;
+}
+
+// Takes a slot for a message about to be published and returns its packet
+// id, or 0 if the window is full
+uint16_t gas_mqtt_window_add(gas_mqtt_window_t *window, bool spooled, uint32_t first, uint32_t count) {
+    if (gas_mqtt_window_full(window)) {
+        return 0;
+    }
+    for (int i = 0; i < window->size; i++) {
+        gas_mqtt_msg_t *msg = &window->msgs[i];
+        if (msg->packet_id != 0) {
+            continue;
+        }
+        msg->packet_id = window->next_id++;
+        if (window->next_id == 0) {
+            window->next_id = 1;    // 0 is not a valid packet id
+        }
+        msg->spooled = spooled;
+        msg->first = first;
+        msg->count = count;
+        window->count++;
+        return msg->packet_id;
+    }
+    return 0;
+}
+
+// Frees the slot of `packet_id` and copies what it held into `msg`. Returns
+// false for an id not in flight, e.g. a PUBACK from before a reconnect.
+bool gas_mqtt_window_ack(gas_mqtt_window_t *window, uint16_t packet_id, gas_mqtt_msg_t *msg) {
+    for (int i = 0; i < window->size; i++) {
+        if (packet_id != 0 && window->msgs[i].packet_id == packet_id) {
+            *msg = window->msgs[i];
+            window->msgs[i].packet_id = 0;
+            window->count--;
+            return true;
+        }
+    }
+    return false;
+}
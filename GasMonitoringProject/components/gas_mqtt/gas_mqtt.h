@@ -0,0 +1,76 @@
+#ifndef GAS_MQTT_H
+#define GAS_MQTT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gas_channels.h"
+#include "gas_link.h"
+
+// Batched publishing of the node's numbered frames (see gas_link.h) to an
+// MQTT 3.1.1 broker at QoS 1. One PUBLISH carries consecutive frames as text,
+// a header line and then a row per frame:
+//
+//   <boot>:<first seq>:<first capture ms>:<count>\n
+//   <capture ms - first>,<temperature>,<humidity>,<ammonia>,<h2s>,<co2>,<methane>,<anomaly mask>\n
+//   ...
+//
+// with the channels in gas_channel_names order and boot and mask in hex. The
+// seq of a row is the header's plus its index. Up to a window of PUBLISHes
+// are sent before the first PUBACK, instead of one round trip each; the
+// window only hands out packet ids and remembers what each message held.
+// Plain C, the socket is the caller's; gas_mqtt_session.h drives all of it.
+
+#define GAS_MQTT_BATCH_MAX      20      // frames per message
+// Widest row: time offset, every channel at the widest its packed type gives,
+// mask and newline
+#define GAS_MQTT_ROW_MAX        (12 + GAS_CH_COUNT * 13 + 9)
+#define GAS_MQTT_PAYLOAD_MAX    (48 + GAS_MQTT_BATCH_MAX * GAS_MQTT_ROW_MAX)   // 48: header line
+#define GAS_MQTT_TOPIC_MAX      64
+// Room for a PUBLISH's fixed header, topic and packet id ahead of its payload
+#define GAS_MQTT_HEADROOM       (5 + 2 + GAS_MQTT_TOPIC_MAX + 2)
+#define GAS_MQTT_WINDOW_MAX     16
+
+// A message waiting for its PUBACK
+typedef struct {
+    uint16_t packet_id;         // 0 = free
+    bool spooled;               // the caller's: where the message came from
+    uint32_t first;             // the caller's: first seq or queue id
+    uint32_t count;             // the caller's: frames
+} gas_mqtt_msg_t;
+
+typedef struct {
+    gas_mqtt_msg_t msgs[GAS_MQTT_WINDOW_MAX];
+    int size;                   // messages allowed in flight
+    int count;
+    uint16_t next_id;
+} gas_mqtt_window_t;
+
+typedef enum {
+    GAS_MQTT_INCOMPLETE,        // need more bytes
+    GAS_MQTT_CONNACK,           // value = return code, 0 = accepted
+    GAS_MQTT_PUBACK,            // value = packet id
+    GAS_MQTT_PINGRESP,
+    GAS_MQTT_OTHER,             // skipped
+    GAS_MQTT_MALFORMED,
+} gas_mqtt_packet_t;
+
+typedef void (*gas_mqtt_frame_t)(uint16_t boot, uint32_t seq, int64_t capture_ms, const gas_sample_t *sample,
+                                 uint32_t anomalies, void *ctx);
+
+// Function prototypes
+int gas_mqtt_batch_format(const gas_link_record_t *records, int count, uint16_t boot, char *buf, size_t size);
+int gas_mqtt_batch_parse(const char *payload, size_t len, gas_mqtt_frame_t emit, void *ctx);
+
+int gas_mqtt_connect(uint8_t *buf, size_t size, const char *client_id, uint16_t keepalive_s);
+int gas_mqtt_publish_header(uint8_t *buf, const char *topic, size_t payload_len, uint16_t packet_id);
+int gas_mqtt_pingreq(uint8_t *buf);
+int gas_mqtt_disconnect(uint8_t *buf);
+gas_mqtt_packet_t gas_mqtt_parse(const uint8_t *buf, size_t len, size_t *used, uint16_t *value);
+
+void gas_mqtt_window_init(gas_mqtt_window_t *window, int size);
+bool gas_mqtt_window_full(const gas_mqtt_window_t *window);
+uint16_t gas_mqtt_window_add(gas_mqtt_window_t *window, bool spooled, uint32_t first, uint32_t count);
+bool gas_mqtt_window_ack(gas_mqtt_window_t *window, uint16_t packet_id, gas_mqtt_msg_t *msg);
+
+#endif
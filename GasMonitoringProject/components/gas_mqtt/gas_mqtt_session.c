@@ -0,0 +1,353 @@
+#include "gas_mqtt_session.h"
+#include <string.h>
+
+static uint32_t session_now(gas_mqtt_session_t *session) {
+    return session->hooks.now_ms(session->hooks.ctx);
+}
+
+static bool session_send(gas_mqtt_session_t *session, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        int sent = session->hooks.send(data, len, session->hooks.ctx);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    session->last_send_ms = session_now(session);
+    return true;
+}
+
+static void session_backoff(gas_mqtt_session_t *session, uint32_t now) {
+    session->retry_at = now + session->retry_ms;
+    session->retry_ms = session->retry_ms * 2 < GAS_MQTT_RETRY_MAX_MS ? session->retry_ms * 2 : GAS_MQTT_RETRY_MAX_MS;
+}
+
+// Formats frames [first, first + count) as a payload in session->packet.
+// Returns its length, or -1 if the ring no longer holds all of them.
+static int session_payload(gas_mqtt_session_t *session, uint32_t first, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!session->hooks.get(first + i, &session->records[i], session->hooks.ctx)) {
+            return -1;
+        }
+    }
+    return gas_mqtt_batch_format(session->records, (int)count, session->config.boot,
+                                 (char *)session->packet + GAS_MQTT_HEADROOM, GAS_MQTT_PAYLOAD_MAX);
+}
+
+// Spool ids move on when a batch is popped or overwritten; keeps the ack
+// bits and the send position lined up with the new head
+static void session_spool_moved(gas_mqtt_session_t *session, uint32_t old_head) {
+    uint32_t moved = session->spool->head_id - old_head;
+    session->spool_acked = moved >= 32 ? 0 : session->spool_acked >> moved;
+    if ((int32_t)(session->spool_next - session->spool->head_id) < 0) {
+        session->spool_next = session->spool->head_id;
+    }
+}
+
+static bool session_spool_push(gas_mqtt_session_t *session, int len) {
+    if (session->spool == NULL || len < 0) {
+        return false;
+    }
+    uint32_t old_head = session->spool->head_id;
+    uint32_t dropped = session->spool->dropped;
+    if (!gas_spool_push(session->spool, session->packet + GAS_MQTT_HEADROOM, len)) {
+        return false;
+    }
+    session->spooled++;
+    session->spool_dropped += session->spool->dropped - dropped;
+    session_spool_moved(session, old_head);
+    return true;
+}
+
+// A spooled batch reached the broker; pops it with any acknowledged ones
+// right behind it
+static void session_spool_ack(gas_mqtt_session_t *session, uint32_t id) {
+    uint32_t offset = id - session->spool->head_id;
+    if ((int32_t)offset < 0 || offset >= 32) {
+        return;     // overwritten meanwhile
+    }
+    session->spool_acked |= 1u << offset;
+    uint32_t old_head = session->spool->head_id;
+    while (session->spool->head_id - old_head < 32 &&
+           ((session->spool_acked >> (session->spool->head_id - old_head)) & 1) && gas_spool_pop(session->spool)) {
+    }
+    session_spool_moved(session, old_head);
+}
+
+// Sends the payload in session->packet as the next message of the window
+static bool session_publish(gas_mqtt_session_t *session, int payload_len, bool spooled, uint32_t first,
+                            uint32_t count) {
+    uint16_t packet_id = gas_mqtt_window_add(&session->window, spooled, first, count);
+    if (packet_id == 0) {
+        return false;
+    }
+    int start = gas_mqtt_publish_header(session->packet, session->config.topic, payload_len, packet_id);
+    if (!session->waiting) {
+        session->waiting = true;
+        session->waiting_since = session_now(session);
+    }
+    size_t len = GAS_MQTT_HEADROOM - start + payload_len;
+    if (!session_send(session, session->packet + start, len)) {
+        gas_mqtt_session_close(session, "send failed");
+        return false;
+    }
+    session->messages++;
+    session->bytes += len;
+    return true;
+}
+
+// Closes batches of config.batch frames, or fewer once the oldest has waited
+// config.batch_ms. They are published straight away while the broker is up
+// and nothing older is spooled, spooled otherwise. Frames stay in the ring
+// while the window is full or the spool cannot be written.
+static void session_batch(gas_mqtt_session_t *session, uint32_t now) {
+    uint32_t oldest, newest;
+    session->hooks.range(&oldest, &newest, session->hooks.ctx);
+    if (newest == 0) {
+        return;
+    }
+    if (session->next_seq < oldest) {
+        session->frames_lost += oldest - session->next_seq;
+        session->next_seq = oldest;
+    }
+    uint32_t batch = (uint32_t)session->config.batch;
+    while (session->next_seq <= newest) {
+        uint32_t avail = newest - session->next_seq + 1;
+        if (!session->pending) {
+            session->pending = true;
+            session->pending_since = now;
+        }
+        if (avail < batch && now - session->pending_since < session->config.batch_ms) {
+            return;
+        }
+        uint32_t count = avail < batch ? avail : batch;
+        bool direct = session->state == GAS_MQTT_UP && gas_mqtt_session_spooled(session) == 0;
+        if (direct && gas_mqtt_window_full(&session->window)) {
+            return;
+        }
+        int len = session_payload(session, session->next_seq, count);
+        if (len < 0) {
+            return;     // overwritten meanwhile, counted as lost next time
+        }
+        if (direct) {
+            // Once in the window the batch is spooled if the send fails
+            session_publish(session, len, false, session->next_seq, count);
+        } else if (!session_spool_push(session, len)) {
+            return;
+        }
+        session->frames += count;
+        session->next_seq += count;
+        session->pending = false;
+    }
+}
+
+// Publishes spooled batches, oldest first, as far as the window allows
+static void session_drain(gas_mqtt_session_t *session) {
+    while (session->spool != NULL && session->state == GAS_MQTT_UP && !gas_mqtt_window_full(&session->window) &&
+           session->spool_next - session->spool->head_id < gas_mqtt_session_spooled(session)) {
+        uint32_t index = session->spool_next - session->spool->head_id;
+        if (index < 32 && ((session->spool_acked >> index) & 1)) {
+            session->spool_next++;      // acknowledged before the session was lost
+            continue;
+        }
+        int len = gas_spool_read(session->spool, index, session->packet + GAS_MQTT_HEADROOM, GAS_MQTT_PAYLOAD_MAX);
+        if (len < 0) {
+            if (index > 0) {
+                return;     // dropped once it is the oldest
+            }
+            uint32_t old_head = session->spool->head_id;
+            gas_spool_pop(session->spool);
+            session_spool_moved(session, old_head);
+            session->spool_dropped++;
+            continue;
+        }
+        if (!session_publish(session, len, true, session->spool_next, 0)) {
+            return;
+        }
+        session->spool_next++;
+    }
+}
+
+// PINGREQ after half a keepalive without sending; a broker that leaves a
+// PUBACK or PINGRESP out for a whole keepalive, or CONNACK for
+// GAS_MQTT_CONNACK_MS, is given up on
+static void session_keepalive(gas_mqtt_session_t *session, uint32_t now) {
+    uint32_t keepalive_ms = session->config.keepalive_s * 1000u;
+    if (session->state == GAS_MQTT_CONNECTING) {
+        if (now - session->waiting_since > GAS_MQTT_CONNACK_MS) {
+            gas_mqtt_session_close(session, "no CONNACK");
+        }
+        return;
+    }
+    if (keepalive_ms == 0) {
+        return;
+    }
+    if (session->waiting && now - session->waiting_since > keepalive_ms) {
+        gas_mqtt_session_close(session, "no answer within the keepalive");
+        return;
+    }
+    if (!session->ping_sent && now - session->last_send_ms >= keepalive_ms / 2) {
+        uint8_t ping[2];
+        if (!session_send(session, ping, gas_mqtt_pingreq(ping))) {
+            gas_mqtt_session_close(session, "send failed");
+            return;
+        }
+        session->ping_sent = true;
+        if (!session->waiting) {
+            session->waiting = true;
+            session->waiting_since = now;
+        }
+    }
+}
+
+// Opens the socket and sends CONNECT; the session is up once CONNACK is in
+static void session_open(gas_mqtt_session_t *session, uint32_t now) {
+    if (!session->hooks.connect(session->hooks.ctx)) {
+        session_backoff(session, now);
+        return;
+    }
+    session->state = GAS_MQTT_CONNECTING;
+    session->waiting = true;
+    session->waiting_since = now;
+    session->ping_sent = false;
+    session->rx_len = 0;
+    gas_mqtt_window_init(&session->window, session->config.window);
+
+    uint8_t connect_packet[64];
+    int len = gas_mqtt_connect(connect_packet, sizeof(connect_packet), session->config.client_id,
+                               session->config.keepalive_s);
+    if (len < 0 || !session_send(session, connect_packet, len)) {
+        gas_mqtt_session_close(session, "CONNECT not sent");
+    }
+}
+
+bool gas_mqtt_session_init(gas_mqtt_session_t *session, const gas_mqtt_config_t *config,
+                           const gas_mqtt_hooks_t *hooks, gas_spool_t *spool) {
+    if (config->topic == NULL || strlen(config->topic) > GAS_MQTT_TOPIC_MAX || config->batch < 1 ||
+        config->batch > GAS_MQTT_BATCH_MAX || config->window < 1 || config->window > GAS_MQTT_WINDOW_MAX) {
+        return false;
+    }
+    memset(session, 0, sizeof(*session));
+    session->config = *config;
+    session->hooks = *hooks;
+    session->spool = spool;
+    session->state = GAS_MQTT_DOWN;
+    session->next_seq = 1;
+    session->spool_next = spool != NULL ? spool->head_id : 0;
+    session->retry_at = session_now(session);
+    session->retry_ms = GAS_MQTT_RETRY_MIN_MS;
+    gas_mqtt_window_init(&session->window, config->window);
+    return true;
+}
+
+// Connects when the backoff allows, then moves frames: spooled batches are
+// older than the ring's, so they go first
+void gas_mqtt_session_step(gas_mqtt_session_t *session) {
+    uint32_t now = session_now(session);
+    if (session->state == GAS_MQTT_DOWN && (int32_t)(now - session->retry_at) >= 0) {
+        session_open(session, now);
+        now = session_now(session);
+    }
+    session_drain(session);
+    session_batch(session, now);
+    if (session->state != GAS_MQTT_DOWN) {
+        session_keepalive(session, now);
+    }
+}
+
+// Reads what the broker sent and handles every whole packet in it
+void gas_mqtt_session_receive(gas_mqtt_session_t *session) {
+    if (session->state == GAS_MQTT_DOWN) {
+        return;
+    }
+    int len = session->hooks.recv(session->rx + session->rx_len, sizeof(session->rx) - session->rx_len,
+                                  session->hooks.ctx);
+    if (len < 0) {
+        gas_mqtt_session_close(session, "closed by the broker");
+        return;
+    }
+    if (len == 0) {
+        return;
+    }
+    session->rx_len += len;
+
+    size_t used;
+    uint16_t value;
+    gas_mqtt_packet_t packet;
+    while ((packet = gas_mqtt_parse(session->rx, session->rx_len, &used, &value)) != GAS_MQTT_INCOMPLETE) {
+        if (packet == GAS_MQTT_MALFORMED) {
+            gas_mqtt_session_close(session, "malformed packet");
+            return;
+        }
+        gas_mqtt_msg_t msg;
+        if (packet == GAS_MQTT_CONNACK && session->state == GAS_MQTT_CONNECTING) {
+            if (value != 0) {
+                gas_mqtt_session_close(session, "session refused");
+                return;
+            }
+            session->state = GAS_MQTT_UP;
+            session->retry_ms = GAS_MQTT_RETRY_MIN_MS;
+            session->spool_next = session->spool != NULL ? session->spool->head_id : 0;
+            session->connects++;
+        } else if (packet == GAS_MQTT_PUBACK && gas_mqtt_window_ack(&session->window, value, &msg)) {
+            session->acks++;
+            if (msg.spooled) {
+                session_spool_ack(session, msg.first);
+            }
+        } else if (packet == GAS_MQTT_PINGRESP) {
+            session->ping_sent = false;
+        }
+        session->rx_len -= used;
+        memmove(session->rx, session->rx + used, session->rx_len);
+    }
+    // Anything heard restarts the clock on what is still outstanding
+    session->waiting = session->state == GAS_MQTT_CONNECTING || session->window.count > 0 || session->ping_sent;
+    session->waiting_since = session_now(session);
+    if (session->rx_len == sizeof(session->rx)) {
+        gas_mqtt_session_close(session, "oversized packet");
+    }
+}
+
+// Drops the session. Batches from the ring still in flight go to the spool
+// in frame order; spooled ones are still there and go out again. A lost
+// session is reopened at the next step, a refused one after the backoff.
+void gas_mqtt_session_close(gas_mqtt_session_t *session, const char *reason) {
+    if (session->state == GAS_MQTT_DOWN) {
+        return;
+    }
+    session->hooks.close(session->hooks.ctx);
+    uint32_t now = session_now(session);
+    if (session->state == GAS_MQTT_CONNECTING) {
+        session_backoff(session, now);
+    } else {
+        session->retry_at = now;
+    }
+    session->state = GAS_MQTT_DOWN;
+    session->reason = reason;
+    session->disconnects++;
+
+    while (session->window.count > 0) {
+        gas_mqtt_msg_t *oldest = NULL;
+        for (int i = 0; i < session->window.size; i++) {
+            gas_mqtt_msg_t *msg = &session->window.msgs[i];
+            if (msg->packet_id != 0 && (oldest == NULL || msg->first < oldest->first)) {
+                oldest = msg;
+            }
+        }
+        gas_mqtt_msg_t held;
+        gas_mqtt_window_ack(&session->window, oldest->packet_id, &held);
+        if (!held.spooled && !session_spool_push(session, session_payload(session, held.first, held.count))) {
+            session->frames_lost += held.count;
+        }
+    }
+    session->spool_next = session->spool != NULL ? session->spool->head_id : 0;
+    session->waiting = false;
+    session->ping_sent = false;
+    session->rx_len = 0;
+}
+
+// Batches in the spool, 0 without one
+uint32_t gas_mqtt_session_spooled(const gas_mqtt_session_t *session) {
+    return session->spool != NULL ? gas_spool_count(session->spool) : 0;
+}
@@ -0,0 +1,103 @@
+#ifndef GAS_MQTT_SESSION_H
+#define GAS_MQTT_SESSION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "gas_mqtt.h"
+#include "gas_spool.h"
+
+// The publisher behind the node's mqtt_task, shared with tools/mqtt_bench.c:
+// closes batches of frames from the retransmit ring, publishes them through
+// the PUBACK window while the broker is up and spools them while it is not,
+// drains the spool first once it is back, and keeps the session alive.
+//
+// Batches from the ring still in flight when the session drops go to the
+// spool in frame order; spooled ones stay there until their PUBACK, so QoS 1
+// may deliver a batch twice but never loses one the spool could hold.
+//
+// Plain C. The socket, the clock and the frames are reached through hooks,
+// the caller calls gas_mqtt_session_step() regularly and
+// gas_mqtt_session_receive() when the socket has something to read.
+#define GAS_MQTT_CONNACK_MS     5000    // longest wait for CONNACK
+#define GAS_MQTT_RETRY_MIN_MS   1000    // reconnect backoff, doubled per failure
+#define GAS_MQTT_RETRY_MAX_MS   30000
+
+typedef struct {
+    // Frames: get is false once the ring no longer holds seq, range gives
+    // newest 0 before the first frame
+    bool (*get)(uint32_t seq, gas_link_record_t *record, void *ctx);
+    void (*range)(uint32_t *oldest, uint32_t *newest, void *ctx);
+    // Socket: connect opens it, send returns the bytes taken or <= 0 on
+    // failure, recv the bytes read, 0 when nothing is waiting or < 0 once
+    // the connection is gone
+    bool (*connect)(void *ctx);
+    int (*send)(const uint8_t *data, size_t len, void *ctx);
+    int (*recv)(uint8_t *buf, size_t size, void *ctx);
+    void (*close)(void *ctx);
+    uint32_t (*now_ms)(void *ctx);
+    void *ctx;
+} gas_mqtt_hooks_t;
+
+typedef struct {
+    const char *client_id;
+    const char *topic;              // at most GAS_MQTT_TOPIC_MAX bytes
+    uint16_t keepalive_s;
+    uint16_t boot;                  // boot id of the frames
+    int batch;                      // frames per message, up to GAS_MQTT_BATCH_MAX
+    uint32_t batch_ms;              // longest wait for a full batch
+    int window;                     // messages in flight, up to GAS_MQTT_WINDOW_MAX
+} gas_mqtt_config_t;
+
+typedef enum {
+    GAS_MQTT_DOWN,
+    GAS_MQTT_CONNECTING,            // CONNECT sent, waiting for CONNACK
+    GAS_MQTT_UP,
+} gas_mqtt_state_t;
+
+typedef struct {
+    gas_mqtt_config_t config;
+    gas_mqtt_hooks_t hooks;
+    gas_spool_t *spool;             // NULL: frames wait in the ring while the broker is away
+    gas_mqtt_state_t state;
+    const char *reason;             // why the last session was dropped
+    gas_mqtt_window_t window;
+    uint32_t next_seq;              // first frame not yet in a batch
+    bool pending;                   // frames waiting for their batch to fill
+    uint32_t pending_since;
+    uint32_t spool_next;            // next spool id to publish
+    uint32_t spool_acked;           // bit i: spool id head + i acknowledged, not yet popped
+    uint32_t retry_at;
+    uint32_t retry_ms;
+    uint32_t last_send_ms;
+    uint32_t waiting_since;         // a CONNACK, PUBACK or PINGRESP outstanding since then
+    bool waiting;
+    bool ping_sent;
+    uint8_t rx[64];
+    size_t rx_len;
+    gas_link_record_t records[GAS_MQTT_BATCH_MAX];
+    // A PUBLISH is built in place: the payload at GAS_MQTT_HEADROOM, its
+    // header right in front of it
+    uint8_t packet[GAS_MQTT_HEADROOM + GAS_MQTT_PAYLOAD_MAX];
+
+    // Totals since init
+    uint32_t messages;              // PUBLISH packets sent, spooled batches included
+    uint32_t bytes;                 // PUBLISH bytes sent, MQTT headers included
+    uint32_t acks;                  // PUBACKs for messages in flight
+    uint32_t frames;                // frames put in a batch
+    uint32_t frames_lost;           // overwritten in the ring before they were batched
+    uint32_t spooled;               // batches written to the spool
+    uint32_t spool_dropped;         // spooled batches overwritten or unreadable before they were sent
+    uint32_t connects;              // sessions the broker accepted
+    uint32_t disconnects;           // sessions lost, refused ones included
+} gas_mqtt_session_t;
+
+// Function prototypes
+bool gas_mqtt_session_init(gas_mqtt_session_t *session, const gas_mqtt_config_t *config,
+                           const gas_mqtt_hooks_t *hooks, gas_spool_t *spool);
+void gas_mqtt_session_step(gas_mqtt_session_t *session);
+void gas_mqtt_session_receive(gas_mqtt_session_t *session);
+void gas_mqtt_session_close(gas_mqtt_session_t *session, const char *reason);
+uint32_t gas_mqtt_session_spooled(const gas_mqtt_session_t *session);
+
+#endif
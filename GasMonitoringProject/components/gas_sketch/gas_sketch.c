@@ -0,0 +1,346 @@
+#include "gas_sketch.h"
+#include <string.h>
+#include <math.h>
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#endif
+
+#define SKETCH_VERSION 1
+#define SKETCH_SHIFT   (23 - GAS_SKETCH_OCTAVE_LOG2)
+#define FLOAT_ONE_BITS 0x3f800000
+
+static inline uint32_t float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float bits_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// (exponent + mantissa - 1) * 2^k, floored: log2 interpolated linearly
+// within the octave. Positive normal values only.
+static inline int32_t sketch_index(float value) {
+    return ((int32_t)float_bits(value) - FLOAT_ONE_BITS) >> SKETCH_SHIFT;
+}
+
+static inline float sketch_lower_bound(int32_t index) {
+    return bits_float((uint32_t)(index * (1 << SKETCH_SHIFT) + FLOAT_ONE_BITS));
+}
+
+// Harmonic middle of the bucket, the value with the same relative distance
+// to both ends
+static float sketch_value(int32_t index) {
+    float lo = sketch_lower_bound(index);
+    float hi = sketch_lower_bound(index + 1);
+    return 2 * lo * hi / (lo + hi);
+}
+
+void gas_sketch_init(gas_sketch_t *sketch) {
+    memset(sketch, 0, sizeof(*sketch));
+    sketch->min = INFINITY;
+    sketch->max = -INFINITY;
+}
+
+static int sketch_top(const gas_sketch_t *sketch) {
+    int top = GAS_SKETCH_BUCKETS - 1;
+    while (top >= 0 && sketch->counts[top] == 0) {
+        top--;
+    }
+    return top;
+}
+
+// Moves the kept range up by `shift` buckets, folding the ones that fall off
+// the bottom into the new lowest bucket
+static void sketch_shift_up(gas_sketch_t *sketch, int32_t shift) {
+    uint32_t folded = 0;
+    int fold = shift < GAS_SKETCH_BUCKETS ? shift : GAS_SKETCH_BUCKETS;
+    for (int i = 0; i < fold; i++) {
+        folded += sketch->counts[i];
+    }
+    if (shift < GAS_SKETCH_BUCKETS) {
+        memmove(sketch->counts, sketch->counts + shift, (GAS_SKETCH_BUCKETS - shift) * sizeof(sketch->counts[0]));
+        memset(sketch->counts + GAS_SKETCH_BUCKETS - shift, 0, shift * sizeof(sketch->counts[0]));
+    } else {
+        memset(sketch->counts, 0, sizeof(sketch->counts));
+    }
+    sketch->counts[0] += folded;
+    sketch->collapsed = folded;
+    sketch->offset += shift;
+}
+
+static void sketch_shift_down(gas_sketch_t *sketch, int32_t shift) {
+    memmove(sketch->counts + shift, sketch->counts, (GAS_SKETCH_BUCKETS - shift) * sizeof(sketch->counts[0]));
+    memset(sketch->counts, 0, shift * sizeof(sketch->counts[0]));
+    sketch->offset -= shift;
+}
+
+static void sketch_add_bucket(gas_sketch_t *sketch, int32_t index, uint32_t n) {
+    if (sketch->count == sketch->zero_count) {
+        // First bucket in the middle, room to grow either way
+        memset(sketch->counts, 0, sizeof(sketch->counts));
+        sketch->offset = index - GAS_SKETCH_BUCKETS / 2;
+        sketch->collapsed = 0;
+    } else if (index >= sketch->offset + GAS_SKETCH_BUCKETS) {
+        sketch_shift_up(sketch, index - (sketch->offset + GAS_SKETCH_BUCKETS - 1));
+    } else if (index < sketch->offset && sketch->collapsed == 0) {
+        // Slide down as far as the empty buckets at the top allow
+        int32_t room = GAS_SKETCH_BUCKETS - 1 - sketch_top(sketch);
+        int32_t shift = sketch->offset - index;
+        if (room > 0) {
+            sketch_shift_down(sketch, shift < room ? shift : room);
+        }
+    }
+    if (index < sketch->offset) {
+        sketch->counts[0] += n;
+        sketch->collapsed += n;
+    } else {
+        sketch->counts[index - sketch->offset] += n;
+    }
+}
+
+void gas_sketch_add(gas_sketch_t *sketch, float value) {
+    if (value != value) {
+        return; // nan
+    }
+    if (value < sketch->min) {
+        sketch->min = value;
+    }
+    if (value > sketch->max) {
+        sketch->max = value;
+    }
+    if (value < GAS_SKETCH_MIN_VALUE) {
+        sketch->zero_count++;
+        sketch->count++;
+        return;
+    }
+    sketch_add_bucket(sketch, sketch_index(value < GAS_SKETCH_MAX_VALUE ? value : GAS_SKETCH_MAX_VALUE), 1);
+    sketch->count++;
+}
+
+void gas_sketch_merge(gas_sketch_t *dst, const gas_sketch_t *src) {
+    int top = sketch_top(src);
+    if (top >= 0) {
+        int first = 0;
+        while (src->counts[first] == 0) {
+            first++;
+        }
+        if (dst->count == dst->zero_count) {
+            memcpy(dst->counts, src->counts, sizeof(dst->counts));
+            dst->offset = src->offset;
+            dst->collapsed = src->collapsed;
+        } else {
+            // Make room for src's range once, then add the buckets
+            int32_t lo = src->offset + first;
+            int32_t hi = src->offset + top;
+            if (hi >= dst->offset + GAS_SKETCH_BUCKETS) {
+                sketch_shift_up(dst, hi - (dst->offset + GAS_SKETCH_BUCKETS - 1));
+            }
+            if (lo < dst->offset && dst->collapsed == 0) {
+                int32_t room = GAS_SKETCH_BUCKETS - 1 - sketch_top(dst);
+                int32_t shift = dst->offset - lo;
+                if (room > 0) {
+                    sketch_shift_down(dst, shift < room ? shift : room);
+                }
+            }
+            for (int i = first; i <= top; i++) {
+                int32_t index = src->offset + i - dst->offset;
+                if (index < 0) {
+                    dst->counts[0] += src->counts[i];
+                    dst->collapsed += src->counts[i];
+                } else {
+                    dst->counts[index] += src->counts[i];
+                }
+            }
+            dst->collapsed += src->collapsed;
+        }
+    }
+    dst->count += src->count;
+    dst->zero_count += src->zero_count;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+// Value of rank q * (count - 1), clamped to the exact extremes; nan when
+// the sketch is empty
+float gas_sketch_quantile(const gas_sketch_t *sketch, float q) {
+    if (sketch->count == 0) {
+        return NAN;
+    }
+    q = q < 0 ? 0 : q > 1 ? 1 : q;
+    float rank = q * (sketch->count - 1);
+    float value = 0;
+    uint32_t seen = sketch->zero_count;
+    if (rank >= seen) {
+        int i = 0;
+        while (i < GAS_SKETCH_BUCKETS - 1 && (seen += sketch->counts[i]) <= rank) {
+            i++;
+        }
+        value = sketch_value(sketch->offset + i);
+    }
+    return value < sketch->min ? sketch->min : value > sketch->max ? sketch->max : value;
+}
+
+// Whether quantile q keeps the GAS_SKETCH_ACCURACY guarantee: its rank is
+// above both the zero bucket and any folded samples
+bool gas_sketch_reliable(const gas_sketch_t *sketch, float q) {
+    float rank = q * (sketch->count - 1);
+    return sketch->count > 0 && rank >= sketch->zero_count + sketch->collapsed;
+}
+
+static size_t put_varint(uint8_t *buf, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        buf[n++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (uint8_t)value;
+    return n;
+}
+
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint32_t *value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*p >= end) {
+            return false;
+        }
+        uint8_t byte = *(*p)++;
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+static size_t put_float(uint8_t *buf, float value) {
+    uint32_t bits = float_bits(value);
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t)(bits >> (8 * i));
+    }
+    return 4;
+}
+
+static bool get_float(const uint8_t **p, const uint8_t *end, float *value) {
+    if (end - *p < 4) {
+        return false;
+    }
+    uint32_t bits = 0;
+    for (int i = 0; i < 4; i++) {
+        bits |= (uint32_t)(*p)[i] << (8 * i);
+    }
+    *p += 4;
+    *value = bits_float(bits);
+    return true;
+}
+
+// version, GAS_SKETCH_OCTAVE_LOG2, then varints: zero_count, collapsed,
+// min and max as little-endian floats, the index of the lowest occupied
+// bucket (zigzag), the number of buckets from there to the highest
+// occupied one and their counts. Returns the length, 0 if `size` is short
+// of GAS_SKETCH_SERIALIZED_MAX.
+size_t gas_sketch_serialize(const gas_sketch_t *sketch, uint8_t *buf, size_t size) {
+    if (size < GAS_SKETCH_SERIALIZED_MAX) {
+        return 0;
+    }
+    int first = 0;
+    int top = sketch_top(sketch);
+    while (first <= top && sketch->counts[first] == 0) {
+        first++;
+    }
+    int32_t index = sketch->offset + first;
+    size_t n = 0;
+    buf[n++] = SKETCH_VERSION;
+    buf[n++] = GAS_SKETCH_OCTAVE_LOG2;
+    n += put_varint(buf + n, sketch->zero_count);
+    n += put_varint(buf + n, sketch->collapsed);
+    n += put_float(buf + n, sketch->min);
+    n += put_float(buf + n, sketch->max);
+    n += put_varint(buf + n, ((uint32_t)index << 1) ^ (uint32_t)(index >> 31));
+    n += put_varint(buf + n, (uint32_t)(top - first + 1));
+    for (int i = first; i <= top; i++) {
+        n += put_varint(buf + n, sketch->counts[i]);
+    }
+    return n;
+}
+
+bool gas_sketch_deserialize(gas_sketch_t *sketch, const uint8_t *buf, size_t len) {
+    const uint8_t *p = buf + 2;
+    const uint8_t *end = buf + len;
+    uint32_t zigzag, buckets;
+    gas_sketch_init(sketch);
+    if (len < 2 || buf[0] != SKETCH_VERSION || buf[1] != GAS_SKETCH_OCTAVE_LOG2 ||
+        !get_varint(&p, end, &sketch->zero_count) || !get_varint(&p, end, &sketch->collapsed) ||
+        !get_float(&p, end, &sketch->min) || !get_float(&p, end, &sketch->max) ||
+        !get_varint(&p, end, &zigzag) || !get_varint(&p, end, &buckets) || buckets > GAS_SKETCH_BUCKETS) {
+        return false;
+    }
+    sketch->offset = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    sketch->count = sketch->zero_count;
+    for (uint32_t i = 0; i < buckets; i++) {
+        if (!get_varint(&p, end, &sketch->counts[i])) {
+            gas_sketch_init(sketch);
+            return false;
+        }
+        sketch->count += sketch->counts[i];
+    }
+    return p == end;
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_SKETCH_BENCHMARK
+
+#define BENCH_SAMPLES 1024
+
+static const char *TAG = "GAS_SKETCH";
+
+void gas_sketch_benchmark(void) {
+    static float input[BENCH_SAMPLES];
+    static gas_sketch_t sketch, merged;
+    static uint8_t serialized[GAS_SKETCH_SERIALIZED_MAX];
+
+    // Roughly log-normal around 10 ppm
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = 10.0f * exp2f(((int32_t)(seed >> 16) - 32768) / 16384.0f);
+    }
+
+    gas_sketch_init(&sketch);
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        gas_sketch_add(&sketch, input[i]);
+    }
+    uint32_t add_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLES;
+
+    start = esp_cpu_get_cycle_count();
+    volatile float p99 = gas_sketch_quantile(&sketch, 0.99f);
+    uint32_t quantile_cycles = esp_cpu_get_cycle_count() - start;
+
+    gas_sketch_init(&merged);
+    start = esp_cpu_get_cycle_count();
+    gas_sketch_merge(&merged, &sketch);
+    uint32_t merge_cycles = esp_cpu_get_cycle_count() - start;
+
+    size_t len = gas_sketch_serialize(&sketch, serialized, sizeof(serialized));
+    ESP_LOGI(TAG, "add %u cycles/sample, P99 %u cycles (%.2f), merge %u cycles, %u bytes serialized, %u in RAM",
+             (unsigned)add_cycles, (unsigned)quantile_cycles, p99, (unsigned)merge_cycles, (unsigned)len,
+             (unsigned)sizeof(gas_sketch_t));
+}
+
+#else
+
+void gas_sketch_benchmark(void) {
+}
+
+#endif
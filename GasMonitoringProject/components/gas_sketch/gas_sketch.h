@@ -0,0 +1,60 @@
+#ifndef GAS_SKETCH_H
+#define GAS_SKETCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Fixed-memory quantile sketch (DDSketch) for percentile reports over long
+// windows without keeping the samples. Values are counted in logarithmic
+// buckets, 2^GAS_SKETCH_OCTAVE_LOG2 per octave, so any quantile comes back
+// within GAS_SKETCH_ACCURACY of the true value relative to it, however the
+// samples are distributed.
+//
+// The bucket index is the float's exponent and top mantissa bits, read
+// straight from its bit pattern: log2 interpolated linearly within each
+// octave. A bucket then spans at most a factor 1 + 2^-GAS_SKETCH_OCTAVE_LOG2,
+// and answering with the harmonic middle of the bucket bounds the error to
+// half of that. Adding a sample is a shift and an increment.
+//
+// GAS_SKETCH_BUCKETS consecutive buckets are kept, 8 octaves. When the
+// samples span more, the lowest buckets are folded into the lowest kept one:
+// the high quantiles a report asks for keep their guarantee, and
+// gas_sketch_reliable() tells whether a low one still has it. Values below
+// GAS_SKETCH_MIN_VALUE, zero and negatives included, share one bucket that
+// reads as zero.
+//
+// Sketches built anywhere with the same GAS_SKETCH_OCTAVE_LOG2 merge by
+// adding bucket counts, so a day is the merge of its hours and a farm the
+// merge of its nodes. gas_sketch_serialize() writes the occupied buckets as
+// varints for the trip off the node.
+
+#define GAS_SKETCH_OCTAVE_LOG2  5
+#define GAS_SKETCH_BUCKETS      256
+#define GAS_SKETCH_ACCURACY     0.0154f     // 2^-k / (2 + 2^-k), k = GAS_SKETCH_OCTAVE_LOG2
+#define GAS_SKETCH_MIN_VALUE    (1.0f / 256)
+#define GAS_SKETCH_MAX_VALUE    16777216.0f
+
+// Largest gas_sketch_serialize() output
+#define GAS_SKETCH_SERIALIZED_MAX (2 + 2 * 5 + 8 + 5 + 2 + GAS_SKETCH_BUCKETS * 5)
+
+typedef struct {
+    uint32_t count;             // all samples, the zero bucket included
+    uint32_t zero_count;        // samples below GAS_SKETCH_MIN_VALUE
+    uint32_t collapsed;         // at most this many samples in counts[0] belong lower
+    int32_t offset;             // bucket index of counts[0]
+    float min, max;
+    uint32_t counts[GAS_SKETCH_BUCKETS];
+} gas_sketch_t;
+
+// Function prototypes
+void gas_sketch_init(gas_sketch_t *sketch);
+void gas_sketch_add(gas_sketch_t *sketch, float value);
+void gas_sketch_merge(gas_sketch_t *dst, const gas_sketch_t *src);
+float gas_sketch_quantile(const gas_sketch_t *sketch, float q);
+bool gas_sketch_reliable(const gas_sketch_t *sketch, float q);
+size_t gas_sketch_serialize(const gas_sketch_t *sketch, uint8_t *buf, size_t size);
+bool gas_sketch_deserialize(gas_sketch_t *sketch, const uint8_t *buf, size_t len);
+void gas_sketch_benchmark(void);
+
+#endif
@@ -0,0 +1,114 @@
+#include "gas_spool.h"
+#include <string.h>
+
+// Marks slots written by this layout; anything else counts as free
+#define GAS_SPOOL_MAGIC 0x4c4f5053   // "SPOL"
+
+typedef struct {
+    uint32_t magic;
+    uint32_t id;        // 0 once popped
+    uint32_t len;
+} gas_spool_hdr_t;
+
+static long slot_offset(const gas_spool_t *spool, uint32_t id) {
+    return (long)(id % spool->slots) * (long)spool->slot_size;
+}
+
+static bool write_hdr(gas_spool_t *spool, uint32_t slot_id, const gas_spool_hdr_t *hdr) {
+    return fseek(spool->file, slot_offset(spool, slot_id), SEEK_SET) == 0 &&
+           fwrite(hdr, sizeof(*hdr), 1, spool->file) == 1;
+}
+
+// Messages of up to `max_len` bytes in `slots` slots. The queue left in the
+// file by a previous run is picked up; returns false if the file cannot be
+// opened or created.
+bool gas_spool_open(gas_spool_t *spool, const char *path, uint32_t slots, size_t max_len) {
+    memset(spool, 0, sizeof(*spool));
+    spool->slots = slots;
+    spool->slot_size = sizeof(gas_spool_hdr_t) + max_len;
+    spool->file = fopen(path, "r+b");
+    if (spool->file == NULL) {
+        spool->file = fopen(path, "w+b");
+    }
+    if (spool->file == NULL || slots == 0) {
+        return false;
+    }
+
+    // The held ids are consecutive, so the oldest and newest give the queue
+    uint32_t oldest = 0;
+    uint32_t newest = 0;
+    for (uint32_t slot = 0; slot < slots; slot++) {
+        gas_spool_hdr_t hdr;
+        if (fseek(spool->file, (long)slot * (long)spool->slot_size, SEEK_SET) != 0 ||
+            fread(&hdr, sizeof(hdr), 1, spool->file) != 1) {
+            break;
+        }
+        if (hdr.magic != GAS_SPOOL_MAGIC || hdr.id == 0 || hdr.id % slots != slot || hdr.len > max_len) {
+            continue;
+        }
+        if (oldest == 0 || hdr.id < oldest) {
+            oldest = hdr.id;
+        }
+        if (hdr.id > newest) {
+            newest = hdr.id;
+        }
+    }
+    spool->head_id = oldest != 0 ? oldest : 1;
+    spool->next_id = newest + 1;
+    return true;
+}
+
+void gas_spool_close(gas_spool_t *spool) {
+    if (spool->file != NULL) {
+        fclose(spool->file);
+        spool->file = NULL;
+    }
+}
+
+uint32_t gas_spool_count(const gas_spool_t *spool) {
+    return spool->next_id - spool->head_id;
+}
+
+// Appends a message, overwriting the oldest one when the spool is full
+bool gas_spool_push(gas_spool_t *spool, const void *data, size_t len) {
+    if (spool->file == NULL || sizeof(gas_spool_hdr_t) + len > spool->slot_size) {
+        return false;
+    }
+    if (gas_spool_count(spool) == spool->slots) {
+        spool->head_id++;
+        spool->dropped++;
+    }
+    gas_spool_hdr_t hdr = { .magic = GAS_SPOOL_MAGIC, .id = spool->next_id, .len = (uint32_t)len };
+    if (!write_hdr(spool, hdr.id, &hdr) || fwrite(data, 1, len, spool->file) != len || fflush(spool->file) != 0) {
+        return false;
+    }
+    spool->next_id++;
+    return true;
+}
+
+// Copies the message `index` places after the oldest into `buf`. Returns its
+// length, or -1 if there is no such message or it does not fit.
+int gas_spool_read(gas_spool_t *spool, uint32_t index, void *buf, size_t size) {
+    if (spool->file == NULL || index >= gas_spool_count(spool)) {
+        return -1;
+    }
+    uint32_t id = spool->head_id + index;
+    gas_spool_hdr_t hdr;
+    if (fseek(spool->file, slot_offset(spool, id), SEEK_SET) != 0 ||
+        fread(&hdr, sizeof(hdr), 1, spool->file) != 1 ||
+        hdr.magic != GAS_SPOOL_MAGIC || hdr.id != id || hdr.len > size ||
+        fread(buf, 1, hdr.len, spool->file) != hdr.len) {
+        return -1;
+    }
+    return (int)hdr.len;
+}
+
+// Drops the oldest message
+bool gas_spool_pop(gas_spool_t *spool) {
+    if (gas_spool_count(spool) == 0) {
+        return false;
+    }
+    gas_spool_hdr_t hdr = { .magic = GAS_SPOOL_MAGIC, .id = 0, .len = 0 };
+    uint32_t id = spool->head_id++;
+    return spool->file != NULL && write_hdr(spool, id, &hdr) && fflush(spool->file) == 0;
+}
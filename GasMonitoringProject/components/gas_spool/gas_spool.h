@@ -0,0 +1,34 @@
+#ifndef GAS_SPOOL_H
+#define GAS_SPOOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// First-in first-out queue of messages in a file of fixed-size slots, for
+// data that has to survive a reboot until something downstream accepts it.
+// Each slot starts with a header carrying a queue id; ids are consecutive
+// from the oldest message to the newest, so the queue is rebuilt from the
+// headers at open. Popping the oldest message rewrites only its header.
+// When every slot is taken a push overwrites the oldest message.
+// Plain C over stdio, the caller serialises access.
+
+typedef struct {
+    FILE *file;
+    uint32_t slots;
+    size_t slot_size;           // header included
+    uint32_t head_id;           // oldest message held
+    uint32_t next_id;           // given to the next push; head_id == next_id when empty
+    uint32_t dropped;           // messages overwritten before they were popped
+} gas_spool_t;
+
+// Function prototypes
+bool gas_spool_open(gas_spool_t *spool, const char *path, uint32_t slots, size_t max_len);
+void gas_spool_close(gas_spool_t *spool);
+uint32_t gas_spool_count(const gas_spool_t *spool);
+bool gas_spool_push(gas_spool_t *spool, const void *data, size_t len);
+int gas_spool_read(gas_spool_t *spool, uint32_t index, void *buf, size_t size);
+bool gas_spool_pop(gas_spool_t *spool);
+
+#endif
@@ -0,0 +1,362 @@
+#include "http_keepalive.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_log.h"
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) do { } while (0)
+#endif
+
+static const char *TAG = "HTTP_KA";
+
+// Caller buffer used by http_ka_get()
+typedef struct {
+    char *buffer;
+    int size;
+    int len;
+    bool truncated;
+} buffer_sink_t;
+
+static void buffer_sink(int index, const char *data, int len, void *ctx) {
+    buffer_sink_t *sink = (buffer_sink_t *)ctx;
+    int room = sink->size - 1 - sink->len;
+    if (len > room) {
+        sink->truncated = true;
+        len = room;
+    }
+    if (len > 0) {
+        memcpy(sink->buffer + sink->len, data, len);
+        sink->len += len;
+    }
+}
+
+static esp_err_t ka_connect(http_ka_client_t *client) {
+    if (client->sock >= 0) {
+        return ESP_OK;
+    }
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return ESP_FAIL;
+    }
+
+    struct timeval timeout = {
+        .tv_sec = HTTP_KA_TIMEOUT_MS / 1000,
+        .tv_usec = (HTTP_KA_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if (connect(sock, (struct sockaddr *)&client->addr, sizeof(client->addr)) != 0) {
+        ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
+        close(sock);
+        return ESP_FAIL;
+    }
+
+    client->sock = sock;
+    client->rx_len = 0;
+    client->rx_pos = 0;
+    client->keep_alive = true;
+    client->connects++;
+    return ESP_OK;
+}
+
+static void ka_disconnect(http_ka_client_t *client) {
+    if (client->sock >= 0) {
+        shutdown(client->sock, 0);
+        close(client->sock);
+    }
+    client->sock = -1;
+    client->rx_len = 0;
+    client->rx_pos = 0;
+}
+
+// Make sure at least one unread byte is in the receive buffer
+static int ka_fill(http_ka_client_t *client) {
+    if (client->rx_pos < client->rx_len) {
+        return client->rx_len - client->rx_pos;
+    }
+    int len = recv(client->sock, client->rx, sizeof(client->rx), 0);
+    if (len <= 0) {
+        return -1;
+    }
+    client->rx_len = len;
+    client->rx_pos = 0;
+    return len;
+}
+
+// Read one CRLF terminated line. Overlong lines are truncated but fully consumed.
+static int ka_read_line(http_ka_client_t *client, char *line, int max) {
+    int len = 0;
+    while (1) {
+        if (ka_fill(client) < 0) {
+            return -1;
+        }
+        char ch = client->rx[client->rx_pos++];
+        if (ch == '\n') {
+            break;
+        }
+        if (ch != '\r' && len < max - 1) {
+            line[len++] = ch;
+        }
+    }
+    line[len] = '\0';
+    return len;
+}
+
+// Stream exactly 'remaining' body bytes to the sink, or until the peer closes
+// when 'remaining' is negative.
+static esp_err_t ka_read_body(http_ka_client_t *client, long remaining, int index, http_ka_sink_t sink, void *ctx) {
+    while (remaining != 0) {
+        int avail = ka_fill(client);
+        if (avail < 0) {
+            return remaining < 0 ? ESP_OK : ESP_FAIL;
+        }
+        if (remaining > 0 && avail > remaining) {
+            avail = (int)remaining;
+        }
+        sink(index, client->rx + client->rx_pos, avail, ctx);
+        client->rx_pos += avail;
+        if (remaining > 0) {
+            remaining -= avail;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ka_send_request(http_ka_client_t *client, const char *path) {
+    char request[160];
+    int len = snprintf(request, sizeof(request),
+                       "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                       path, client->host);
+    if (len < 0 || len >= (int)sizeof(request)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    int sent = 0;
+    while (sent < len) {
+        int err = send(client->sock, request + sent, len - sent, 0);
+        if (err < 0) {
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+            return ESP_FAIL;
+        }
+        sent += err;
+    }
+    return ESP_OK;
+}
+
+// Read one complete response. Returns ESP_ERR_INVALID_STATE if the connection
+// was closed before a status line arrived, so the caller can retry.
+static esp_err_t ka_read_response(http_ka_client_t *client, int index, http_ka_sink_t sink, void *ctx) {
+    char line[128];
+    int major, minor, status;
+
+    if (ka_read_line(client, line, sizeof(line)) < 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (sscanf(line, "HTTP/%d.%d %d", &major, &minor, &status) != 3) {
+        ESP_LOGE(TAG, "Bad status line: %s", line);
+        return ESP_FAIL;
+    }
+
+    bool keep_alive = (major == 1 && minor >= 1);
+    bool chunked = false;
+    long content_length = -1;
+
+    // Headers
+    while (1) {
+        int len = ka_read_line(client, line, sizeof(line));
+        if (len < 0) {
+            return ESP_FAIL;
+        }
+        if (len == 0) {
+            break;
+        }
+        if (strncasecmp(line, "Content-Length:", 15) == 0) {
+            content_length = strtol(line + 15, NULL, 10);
+        } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+            const char *value = line + 18;
+            while (*value == ' ') value++;
+            chunked = (strncasecmp(value, "chunked", 7) == 0);
+        } else if (strncasecmp(line, "Connection:", 11) == 0) {
+            const char *value = line + 11;
+            while (*value == ' ') value++;
+            if (strncasecmp(value, "close", 5) == 0) {
+                keep_alive = false;
+            } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+                keep_alive = true;
+            }
+        }
+    }
+
+    // Body
+    esp_err_t err = ESP_OK;
+    if (status == 204 || status == 304 || (status >= 100 && status < 200)) {
+        // no body
+    } else if (chunked) {
+        while (1) {
+            if (ka_read_line(client, line, sizeof(line)) < 0) {
+                return ESP_FAIL;
+            }
+            // Hex size, then optional ";extension"s. Anything else would
+            // read as a zero size and end the body early.
+            char *end;
+            long chunk_size = strtol(line, &end, 16);
+            while (*end == ' ' || *end == '\t') end++;
+            if (end == line || chunk_size < 0 || (*end != '\0' && *end != ';')) {
+                ESP_LOGE(TAG, "Bad chunk size line: %s", line);
+                return ESP_FAIL;
+            }
+            if (chunk_size == 0) {
+                // Skip optional trailers up to the terminating empty line
+                int len;
+                while ((len = ka_read_line(client, line, sizeof(line))) > 0) {
+                }
+                if (len < 0) {
+                    return ESP_FAIL;
+                }
+                break;
+            }
+            err = ka_read_body(client, chunk_size, index, sink, ctx);
+            if (err != ESP_OK || ka_read_line(client, line, sizeof(line)) < 0) {
+                return ESP_FAIL;
+            }
+        }
+    } else if (content_length >= 0) {
+        err = ka_read_body(client, content_length, index, sink, ctx);
+    } else {
+        // No framing, body ends when the server closes
+        err = ka_read_body(client, -1, index, sink, ctx);
+        keep_alive = false;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    client->keep_alive = keep_alive;
+    client->pipelining = keep_alive && major == 1 && minor >= 1;
+    client->requests++;
+    if (!keep_alive) {
+        ka_disconnect(client);
+    }
+
+    ESP_LOGD(TAG, "HTTP Status = %d, requests = %u, connects = %u",
+             status, (unsigned)client->requests, (unsigned)client->connects);
+    return (status >= 200 && status < 300) ? ESP_OK : ESP_ERR_INVALID_RESPONSE;
+}
+
+// Send one request and read its response, reconnecting once if the server
+// dropped the idle connection in between.
+static esp_err_t ka_request(http_ka_client_t *client, const char *path, int index, http_ka_sink_t sink, void *ctx) {
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = (client->sock >= 0);
+        err = ka_connect(client);
+        if (err != ESP_OK) {
+            return err;
+        }
+        err = ka_send_request(client, path);
+        if (err == ESP_OK) {
+            err = ka_read_response(client, index, sink, ctx);
+        }
+        if (err == ESP_OK || err == ESP_ERR_INVALID_RESPONSE) {
+            return err;
+        }
+        ka_disconnect(client);
+        if (!reused || err != ESP_ERR_INVALID_STATE) {
+            break;
+        }
+    }
+    return err;
+}
+
+esp_err_t http_ka_init(http_ka_client_t *client, const char *host_ip, uint16_t port) {
+    memset(client, 0, sizeof(*client));
+    client->sock = -1;
+    client->addr.sin_addr.s_addr = inet_addr(host_ip);
+    client->addr.sin_family = AF_INET;
+    client->addr.sin_port = htons(port);
+    strncpy(client->host, host_ip, sizeof(client->host) - 1);
+    return ESP_OK;
+}
+
+esp_err_t http_ka_get(http_ka_client_t *client, const char *path, char *buffer, int buffer_size, int *body_len) {
+    buffer_sink_t sink = {
+        .buffer = buffer,
+        .size = buffer_size,
+    };
+    esp_err_t err = ka_request(client, path, 0, buffer_sink, &sink);
+
+    buffer[sink.len] = '\0';
+    if (body_len != NULL) {
+        *body_len = sink.len;
+    }
+    if (err == ESP_OK && sink.truncated) {
+        ESP_LOGW(TAG, "Response to %s truncated to %d bytes", path, sink.len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return err;
+}
+
+esp_err_t http_ka_get_pipelined(http_ka_client_t *client, const char *const *paths, int count, http_ka_sink_t sink, void *ctx) {
+    esp_err_t result = ESP_OK;
+    int done = 0;
+
+    while (done < count) {
+        // Until a response shows the server keeps connections open, and
+        // whenever it stops doing so, requests go out one at a time.
+        if (!client->pipelining || client->sock < 0) {
+            esp_err_t err = ka_request(client, paths[done], done, sink, ctx);
+            if (err != ESP_OK) {
+                result = err;
+            }
+            done++;
+            continue;
+        }
+
+        int batch = count - done;
+        if (batch > HTTP_KA_MAX_PIPELINE) {
+            batch = HTTP_KA_MAX_PIPELINE;
+        }
+
+        int sent = 0;
+        while (sent < batch && ka_send_request(client, paths[done + sent]) == ESP_OK) {
+            sent++;
+        }
+
+        int received = 0;
+        while (received < sent && client->sock >= 0) {
+            esp_err_t err = ka_read_response(client, done + received, sink, ctx);
+            if (err != ESP_OK && err != ESP_ERR_INVALID_RESPONSE) {
+                break;
+            }
+            if (err != ESP_OK) {
+                result = err;
+            }
+            received++;
+        }
+        done += received;
+
+        // Connection lost mid-batch: unanswered requests are retried singly
+        if (sent == 0 || received < sent) {
+            ka_disconnect(client);
+            client->pipelining = false;
+        }
+    }
+    return result;
+}
+
+void http_ka_close(http_ka_client_t *client) {
+    ka_disconnect(client);
+    client->pipelining = false;
+}
@@ -0,0 +1,53 @@
+#ifndef HTTP_KEEPALIVE_H
+#define HTTP_KEEPALIVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#include "lwip/sockets.h"
+#else
+// Host builds (tools/http_ka_bench.c)
+#include <netinet/in.h>
+typedef int esp_err_t;
+#define ESP_OK                      0
+#define ESP_FAIL                    -1
+#define ESP_ERR_INVALID_STATE       0x103
+#define ESP_ERR_INVALID_SIZE        0x104
+#define ESP_ERR_INVALID_RESPONSE    0x108
+#endif
+
+// Size of the receive buffer used for status line, headers and chunk sizes.
+// Body bytes are streamed straight through to the caller.
+#define HTTP_KA_RX_BUF_SIZE   512
+#define HTTP_KA_HOST_LEN      32
+#define HTTP_KA_TIMEOUT_MS    5000
+#define HTTP_KA_MAX_PIPELINE  4
+
+// Called for every piece of body data as it arrives. index is the position of
+// the request in a pipelined batch (always 0 for http_ka_get).
+typedef void (*http_ka_sink_t)(int index, const char *data, int len, void *ctx);
+
+// One persistent connection to an HTTP/1.1 server. All storage lives in the
+// struct so a request never touches the heap.
+typedef struct {
+    int sock;
+    struct sockaddr_in addr;
+    char host[HTTP_KA_HOST_LEN];
+    char rx[HTTP_KA_RX_BUF_SIZE];
+    int rx_len;
+    int rx_pos;
+    bool keep_alive;    // false once the server asked us to close
+    bool pipelining;    // server answered HTTP/1.1 with a persistent connection
+    uint32_t requests;  // completed responses
+    uint32_t connects;  // TCP handshakes performed
+} http_ka_client_t;
+
+// Function prototypes
+esp_err_t http_ka_init(http_ka_client_t *client, const char *host_ip, uint16_t port);
+esp_err_t http_ka_get(http_ka_client_t *client, const char *path, char *buffer, int buffer_size, int *body_len);
+esp_err_t http_ka_get_pipelined(http_ka_client_t *client, const char *const *paths, int count, http_ka_sink_t sink, void *ctx);
+void http_ka_close(http_ka_client_t *client);
+
+#endif
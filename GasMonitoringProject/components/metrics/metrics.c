@@ -0,0 +1,172 @@
+#include "metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#define METRICS_MAX_COLLECTORS 4
+
+typedef struct {
+    httpd_req_t *req;
+    char buf[512];
+    int len;
+} http_writer_t;
+
+// Registration is rare, so a spinlock is fine. Rendering walks the list
+// without it; a metric only becomes visible once fully linked in.
+static portMUX_TYPE registry_lock = portMUX_INITIALIZER_UNLOCKED;
+static metric_t *metrics_head = NULL;
+static metric_t *metrics_tail = NULL;
+static metrics_collector_t collectors[METRICS_MAX_COLLECTORS];
+static int collector_count = 0;
+
+static const char *type_names[] = {
+    [METRIC_COUNTER] = "counter",
+    [METRIC_GAUGE] = "gauge",
+    [METRIC_HISTOGRAM] = "histogram",
+};
+
+// Format one piece of output and pass it on, clipped to the line buffer
+static esp_err_t emit(metrics_write_t write, void *ctx, const char *fmt, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len < 0) {
+        return ESP_FAIL;
+    }
+    if (len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
+    }
+    return write(line, len, ctx);
+}
+
+// A metric goes right after the last one of the same name, so a family is
+// always contiguous and metrics_render() prints its HELP and TYPE once
+void metrics_register(metric_t *metric) {
+    portENTER_CRITICAL(&registry_lock);
+    metric_t *after = NULL;
+    for (metric_t *m = metrics_head; m != NULL; m = m->next) {
+        if (strcmp(m->name, metric->name) == 0) {
+            after = m;
+        }
+    }
+    if (after == NULL) {
+        after = metrics_tail;
+    }
+    if (after == NULL) {
+        metric->next = NULL;
+        metrics_head = metric;
+    } else {
+        metric->next = after->next;
+        after->next = metric;
+    }
+    if (after == metrics_tail) {
+        metrics_tail = metric;
+    }
+    portEXIT_CRITICAL(&registry_lock);
+}
+
+void metrics_register_collector(metrics_collector_t collector) {
+    portENTER_CRITICAL(&registry_lock);
+    if (collector_count < METRICS_MAX_COLLECTORS) {
+        collectors[collector_count++] = collector;
+    }
+    portEXIT_CRITICAL(&registry_lock);
+}
+
+void metric_observe(metric_t *histogram, uint32_t value) {
+    int i = 0;
+    while (i < histogram->bucket_count && value > histogram->bounds[i]) {
+        i++;
+    }
+    if (i < histogram->bucket_count) {
+        atomic_fetch_add_explicit(&histogram->buckets[i], 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->value, 1, memory_order_relaxed);
+}
+
+static esp_err_t render_histogram(const metric_t *metric, metrics_write_t write, void *ctx) {
+    uint32_t cumulative = 0;
+
+    for (int i = 0; i < metric->bucket_count; i++) {
+        cumulative += atomic_load_explicit(&metric->buckets[i], memory_order_relaxed);
+        if (emit(write, ctx, "%s_bucket{le=\"%u\"} %u\n",
+                 metric->name, (unsigned)metric->bounds[i], (unsigned)cumulative) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    unsigned count = atomic_load_explicit(&metric->value, memory_order_relaxed);
+    unsigned sum = atomic_load_explicit(&metric->sum, memory_order_relaxed);
+    return emit(write, ctx, "%s_bucket{le=\"+Inf\"} %u\n%s_sum %u\n%s_count %u\n",
+                metric->name, count, metric->name, sum, metric->name, count);
+}
+
+esp_err_t metrics_render(metrics_write_t write, void *ctx) {
+    esp_err_t err;
+    const char *previous_name = NULL;
+
+    for (int i = 0; i < collector_count; i++) {
+        collectors[i]();
+    }
+
+    for (const metric_t *metric = metrics_head; metric != NULL; metric = metric->next) {
+        // Metrics that share a name (different labels) sit together, see metrics_register()
+        if (previous_name == NULL || strcmp(previous_name, metric->name) != 0) {
+            if (emit(write, ctx, "# HELP %s %s\n# TYPE %s %s\n",
+                     metric->name, metric->help, metric->name, type_names[metric->type]) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            previous_name = metric->name;
+        }
+
+        if (metric->type == METRIC_HISTOGRAM) {
+            if (render_histogram(metric, write, ctx) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            continue;
+        }
+
+        unsigned value = atomic_load_explicit(&metric->value, memory_order_relaxed);
+        if (metric->labels != NULL) {
+            err = emit(write, ctx, "%s{%s} %u\n", metric->name, metric->labels, value);
+        } else {
+            err = emit(write, ctx, "%s %u\n", metric->name, value);
+        }
+        if (err != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t http_write(const char *data, int len, void *ctx) {
+    http_writer_t *writer = (http_writer_t *)ctx;
+    if (writer->len + len > (int)sizeof(writer->buf)) {
+        if (httpd_resp_send_chunk(writer->req, writer->buf, writer->len) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        writer->len = 0;
+    }
+    memcpy(writer->buf + writer->len, data, len);
+    writer->len += len;
+    return ESP_OK;
+}
+
+// GET /metrics, Prometheus text exposition format
+esp_err_t metrics_http_handler(httpd_req_t *req) {
+    static http_writer_t writer; // httpd serves one request at a time
+    writer.req = req;
+    writer.len = 0;
+
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    if (metrics_render(http_write, &writer) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (writer.len > 0 && httpd_resp_send_chunk(req, writer.buf, writer.len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
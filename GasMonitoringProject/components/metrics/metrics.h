@@ -0,0 +1,76 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// Counters, gauges and histograms shared by the node and the gateway firmware.
+// Metrics are plain statics defined with the macros below and registered once
+// at startup. Updates are relaxed atomic adds, so they are safe to call from
+// any task on the hot path without taking a lock.
+
+typedef enum {
+    METRIC_COUNTER,
+    METRIC_GAUGE,
+    METRIC_HISTOGRAM
+} metric_type_t;
+
+typedef struct metric {
+    const char *name;
+    const char *labels;         // e.g. "source=\"csv\"", or NULL
+    const char *help;
+    metric_type_t type;
+    atomic_uint value;          // counter/gauge value, histogram sample count
+    atomic_uint sum;            // histogram sum of observations
+    const uint32_t *bounds;     // histogram upper bounds, ascending
+    atomic_uint *buckets;       // histogram per-bucket counts (not cumulative)
+    int bucket_count;
+    struct metric *next;
+} metric_t;
+
+#define METRIC_DEFINE_COUNTER(var, metric_name, metric_labels, metric_help) \
+    metric_t var = { .name = metric_name, .labels = metric_labels, .help = metric_help, .type = METRIC_COUNTER }
+
+#define METRIC_DEFINE_GAUGE(var, metric_name, metric_labels, metric_help) \
+    metric_t var = { .name = metric_name, .labels = metric_labels, .help = metric_help, .type = METRIC_GAUGE }
+
+// bounds must be a static array of ascending upper bounds. The bucket counts
+// live in a file-scope compound literal, so the macro stays a single declaration.
+#define METRIC_DEFINE_HISTOGRAM(var, metric_name, metric_help, metric_bounds) \
+    metric_t var = { .name = metric_name, .help = metric_help, .type = METRIC_HISTOGRAM, \
+                     .bounds = metric_bounds, \
+                     .buckets = (atomic_uint[sizeof(metric_bounds) / sizeof(metric_bounds[0])]){ 0 }, \
+                     .bucket_count = sizeof(metric_bounds) / sizeof(metric_bounds[0]) }
+
+// Refreshes gauges (heap, stack high-water marks, queue depths) right before rendering
+typedef void (*metrics_collector_t)(void);
+
+// Receives rendered Prometheus text
+typedef esp_err_t (*metrics_write_t)(const char *data, int len, void *ctx);
+
+static inline void metric_inc(metric_t *metric) {
+    atomic_fetch_add_explicit(&metric->value, 1, memory_order_relaxed);
+}
+
+static inline void metric_add(metric_t *metric, uint32_t amount) {
+    atomic_fetch_add_explicit(&metric->value, amount, memory_order_relaxed);
+}
+
+static inline void metric_set(metric_t *metric, uint32_t value) {
+    atomic_store_explicit(&metric->value, value, memory_order_relaxed);
+}
+
+static inline uint32_t metric_get(metric_t *metric) {
+    return atomic_load_explicit(&metric->value, memory_order_relaxed);
+}
+
+// Function prototypes
+void metrics_register(metric_t *metric);
+void metrics_register_collector(metrics_collector_t collector);
+void metric_observe(metric_t *histogram, uint32_t value);
+esp_err_t metrics_render(metrics_write_t write, void *ctx);
+esp_err_t metrics_http_handler(httpd_req_t *req);
+
+#endif
@@ -0,0 +1,221 @@
+#include "spi_adc.h"
+#include <string.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/spi_master.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#endif
+
+// Bits on the wire per conversion, chip-select gap included
+#define SPI_ADC_CONVERSION_CLOCKS (ADC_SIM_FRAME_BYTES * 8 + SPI_ADC_CS_GAP_CLOCKS)
+
+static spi_adc_config_t spi_adc;
+static spi_adc_stats_t spi_adc_stats;
+
+// Command bytes per input, built once at init
+static uint8_t spi_adc_commands[SPI_ADC_MAX_CHANNELS][ADC_SIM_FRAME_BYTES];
+
+// Scan in flight: destination block and number of conversions
+static uint16_t *scan_frames;
+static int scan_conversions;
+static bool scan_active;
+
+#ifdef ESP_PLATFORM
+
+static spi_device_handle_t spi_adc_device;
+static spi_transaction_t spi_adc_trans[SPI_ADC_MAX_TRANSACTIONS];
+static int spi_adc_last = -1;   // transaction carrying the completion flag
+static TaskHandle_t spi_adc_waiter;
+static int64_t scan_start_us;
+static volatile int64_t scan_done_us;
+
+// Runs from the SPI interrupt after every transaction; only the last one of
+// a scan has `user` set, so the waiting task wakes once per scan
+static void IRAM_ATTR spi_adc_post(spi_transaction_t *trans) {
+    if (trans->user != NULL) {
+        scan_done_us = esp_timer_get_time();
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(spi_adc_waiter, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+static esp_err_t spi_adc_bus_init(const spi_adc_config_t *config) {
+    spi_bus_config_t bus = {
+        .mosi_io_num = config->pin_mosi,
+        .miso_io_num = config->pin_miso,
+        .sclk_io_num = config->pin_sclk,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+    };
+    esp_err_t ret = spi_bus_initialize(config->host, &bus, SPI_DMA_CH_AUTO);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    spi_device_interface_config_t device = {
+        .clock_speed_hz = config->clock_hz,
+        .mode = 0,
+        .spics_io_num = config->pin_cs,
+        .queue_size = SPI_ADC_MAX_TRANSACTIONS,
+        .post_cb = spi_adc_post,
+    };
+    ret = spi_bus_add_device(config->host, &device, &spi_adc_device);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Transaction i always converts input i % channels; only the rx bytes
+    // and the completion flag change from scan to scan
+    for (int i = 0; i < SPI_ADC_MAX_TRANSACTIONS; i++) {
+        spi_transaction_t *trans = &spi_adc_trans[i];
+        memset(trans, 0, sizeof(*trans));
+        trans->flags = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+        trans->length = ADC_SIM_FRAME_BYTES * 8;
+        memcpy(trans->tx_data, spi_adc_commands[i % config->channels], ADC_SIM_FRAME_BYTES);
+    }
+
+    // The ADC is alone on its bus; holding the bus saves the per-transaction
+    // arbitration
+    return spi_device_acquire_bus(spi_adc_device, portMAX_DELAY);
+}
+
+// Collects `count` finished transactions so their queue slots are free again
+static void spi_adc_drain(int count) {
+    spi_transaction_t *done;
+    for (int i = 0; i < count; i++) {
+        spi_device_get_trans_result(spi_adc_device, &done, portMAX_DELAY);
+    }
+}
+
+static esp_err_t spi_adc_bus_start(void) {
+    if (spi_adc_last >= 0) {
+        spi_adc_trans[spi_adc_last].user = NULL;
+    }
+    spi_adc_last = scan_conversions - 1;
+    spi_adc_trans[spi_adc_last].user = (void *)1;
+
+    spi_adc_waiter = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);
+    scan_start_us = esp_timer_get_time();
+    for (int i = 0; i < scan_conversions; i++) {
+        esp_err_t ret = spi_device_queue_trans(spi_adc_device, &spi_adc_trans[i], 0);
+        if (ret != ESP_OK) {
+            // The flagged transaction never went out; wait out the rest
+            spi_adc_stats.errors++;
+            spi_adc_drain(i);
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t spi_adc_bus_wait(uint32_t timeout_ms) {
+    TickType_t ticks = pdMS_TO_TICKS(timeout_ms);
+    if (ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1) == 0) {
+        return ESP_ERR_TIMEOUT;
+    }
+    spi_adc_drain(scan_conversions);
+    for (int i = 0; i < scan_conversions; i++) {
+        scan_frames[i] = adc_sim_result(spi_adc_trans[i].rx_data);
+    }
+    spi_adc_stats.bus_us += scan_done_us - scan_start_us;
+    return ESP_OK;
+}
+
+#endif
+
+// The simulated device answers at once; bus time is what the conversions
+// would take at the configured clock
+static void spi_adc_sim_scan(void) {
+    uint8_t rx[ADC_SIM_FRAME_BYTES];
+    for (int i = 0; i < scan_conversions; i++) {
+        adc_sim_transfer(spi_adc.sim, spi_adc_commands[i % spi_adc.channels], rx, ADC_SIM_FRAME_BYTES);
+        scan_frames[i] = adc_sim_result(rx);
+    }
+    spi_adc_stats.bus_us += (uint64_t)scan_conversions * SPI_ADC_CONVERSION_CLOCKS * 1000000 / spi_adc.clock_hz;
+}
+
+esp_err_t spi_adc_init(const spi_adc_config_t *config) {
+    if (config->channels < 1 || config->channels > SPI_ADC_MAX_CHANNELS || config->clock_hz <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    spi_adc = *config;
+    memset(&spi_adc_stats, 0, sizeof(spi_adc_stats));
+    for (int ch = 0; ch < config->channels; ch++) {
+        adc_sim_command(ch, spi_adc_commands[ch]);
+    }
+    if (config->sim != NULL) {
+        return ESP_OK;
+    }
+#ifdef ESP_PLATFORM
+    return spi_adc_bus_init(config);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+// Queues a scan of `count` frames into `frames` (count * channels codes)
+// and returns without waiting. The block must stay untouched until
+// spi_adc_scan_wait() returns ESP_OK.
+esp_err_t spi_adc_scan_start(uint16_t *frames, int count) {
+    if (scan_active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (count < 1 || count * spi_adc.channels > SPI_ADC_MAX_TRANSACTIONS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    scan_frames = frames;
+    scan_conversions = count * spi_adc.channels;
+
+    esp_err_t ret = ESP_OK;
+    if (spi_adc.sim != NULL) {
+        spi_adc_sim_scan();
+    } else {
+#ifdef ESP_PLATFORM
+        ret = spi_adc_bus_start();
+#else
+        ret = ESP_ERR_NOT_SUPPORTED;
+#endif
+    }
+    scan_active = ret == ESP_OK;
+    return ret;
+}
+
+// Blocks until the scan started last has filled its block. On timeout the
+// scan stays in flight and may be waited for again.
+esp_err_t spi_adc_scan_wait(uint32_t timeout_ms) {
+    if (!scan_active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+#ifdef ESP_PLATFORM
+    if (spi_adc.sim == NULL) {
+        esp_err_t ret = spi_adc_bus_wait(timeout_ms);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+#else
+    (void)timeout_ms;
+#endif
+    spi_adc_stats.scans++;
+    spi_adc_stats.conversions += scan_conversions;
+    scan_active = false;
+    return ESP_OK;
+}
+
+esp_err_t spi_adc_scan(uint16_t *frames, int count) {
+    esp_err_t ret = spi_adc_scan_start(frames, count);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return spi_adc_scan_wait(1000);
+}
+
+void spi_adc_get_stats(spi_adc_stats_t *stats) {
+    *stats = spi_adc_stats;
+}
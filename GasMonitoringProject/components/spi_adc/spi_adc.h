@@ -0,0 +1,65 @@
+#ifndef SPI_ADC_H
+#define SPI_ADC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "adc_sim.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_err.h"
+#else
+// Host builds of the simulated back end
+typedef int esp_err_t;
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_TIMEOUT         0x107
+#define ESP_ERR_NOT_SUPPORTED   0x106
+#endif
+
+// Driver for an external multi-channel SPI ADC (MCP3208 wire format, see
+// adc_sim.h). A scan reads `channels` inputs for each of `frames` frames and
+// fills a caller-provided block of interleaved codes, the layout the ADC
+// front end takes.
+//
+// The converter needs chip select raised between conversions, so a scan is
+// one queued transaction per conversion. They are all queued up front and
+// run back to back from the SPI interrupt on a DMA-enabled bus; the
+// post-transaction callback of the last one wakes the waiting task. That is
+// one task switch per scan, however many channels and frames it holds.
+//
+// With `sim` set the same calls run against the simulated device instead of
+// the bus, which is also the only back end in host builds. Bus time is then
+// modelled from the clock rate.
+
+#define SPI_ADC_MAX_CHANNELS    ADC_SIM_CHANNELS
+#define SPI_ADC_MAX_TRANSACTIONS 64     // conversions per scan
+#define SPI_ADC_CS_GAP_CLOCKS   8       // modelled chip-select setup and hold
+
+typedef struct {
+    int host;               // SPI host, e.g. SPI2_HOST
+    int clock_hz;
+    int pin_cs;
+    int pin_sclk;
+    int pin_miso;
+    int pin_mosi;
+    int channels;           // inputs 0..channels-1 per frame
+    adc_sim_t *sim;         // simulated device instead of the bus
+} spi_adc_config_t;
+
+typedef struct {
+    uint32_t scans;
+    uint32_t conversions;
+    uint32_t errors;        // transactions that failed to queue
+    uint64_t bus_us;        // from queueing a scan to its completion callback
+} spi_adc_stats_t;
+
+// Function prototypes
+esp_err_t spi_adc_init(const spi_adc_config_t *config);
+esp_err_t spi_adc_scan_start(uint16_t *frames, int count);
+esp_err_t spi_adc_scan_wait(uint32_t timeout_ms);
+esp_err_t spi_adc_scan(uint16_t *frames, int count);
+void spi_adc_get_stats(spi_adc_stats_t *stats);
+
+#endif
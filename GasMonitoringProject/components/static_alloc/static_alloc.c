@@ -0,0 +1,86 @@
+#include "static_alloc.h"
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_system.h"
+
+#define STATIC_ALLOC_MAX_ENTRIES 16
+#define HEAP_GUARD_PERIOD_MS     60000
+
+static const char *TAG = "RAM_BUDGET";
+
+typedef struct {
+    const char *name;
+    size_t bytes;
+} budget_entry_t;
+
+static budget_entry_t budget[STATIC_ALLOC_MAX_ENTRIES];
+static int budget_count = 0;
+static size_t budget_total = 0;
+static portMUX_TYPE budget_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void static_alloc_account(const char *name, size_t bytes) {
+    portENTER_CRITICAL(&budget_lock);
+    if (budget_count < STATIC_ALLOC_MAX_ENTRIES) {
+        budget[budget_count].name = name;
+        budget[budget_count].bytes = bytes;
+        budget_count++;
+    }
+    budget_total += bytes;
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+void static_alloc_report(void) {
+    for (int i = 0; i < budget_count; i++) {
+        ESP_LOGI(TAG, "%-20s %6u bytes", budget[i].name, (unsigned)budget[i].bytes);
+    }
+    ESP_LOGI(TAG, "static total %u bytes, free heap %u bytes, min free heap %u bytes",
+             (unsigned)budget_total, (unsigned)esp_get_free_heap_size(),
+             (unsigned)esp_get_minimum_free_heap_size());
+}
+
+#if CONFIG_GAS_STATIC_ALLOCATION
+
+// With everything allocated up front the free heap must settle after start-up.
+// Any steady drop afterwards is a leak or fragmentation in a library. In a
+// soak test build that is a failure, not a warning.
+static void heap_guard_task(void *pvParameters) {
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_GAS_HEAP_GUARD_WARMUP_S * 1000));
+    uint32_t baseline = esp_get_free_heap_size();
+    ESP_LOGI(TAG, "Heap guard baseline %u bytes", (unsigned)baseline);
+
+#if CONFIG_GAS_HEAP_SOAK_TEST
+    uint32_t periods = 0;
+    const uint32_t soak_periods = CONFIG_GAS_HEAP_SOAK_TEST_HOURS * 3600000u / HEAP_GUARD_PERIOD_MS;
+#endif
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(HEAP_GUARD_PERIOD_MS));
+        uint32_t free_heap = esp_get_free_heap_size();
+        if (free_heap + CONFIG_GAS_HEAP_GUARD_TOLERANCE < baseline) {
+            ESP_LOGE(TAG, "Free heap drifted from %u to %u bytes", (unsigned)baseline, (unsigned)free_heap);
+#if CONFIG_GAS_HEAP_SOAK_TEST
+            ESP_LOGE(TAG, "Heap soak test failed after %u min", (unsigned)(periods * HEAP_GUARD_PERIOD_MS / 60000));
+            abort();
+#endif
+        }
+#if CONFIG_GAS_HEAP_SOAK_TEST
+        periods++;
+        ESP_LOGI(TAG, "Heap soak %u min, free %u bytes, min free %u bytes",
+                 (unsigned)(periods * HEAP_GUARD_PERIOD_MS / 60000), (unsigned)free_heap,
+                 (unsigned)esp_get_minimum_free_heap_size());
+        if (periods == soak_periods) {
+            ESP_LOGI(TAG, "Heap soak test passed after %u h", (unsigned)CONFIG_GAS_HEAP_SOAK_TEST_HOURS);
+        }
+#endif
+    }
+}
+
+void static_alloc_heap_guard_start(void) {
+    GAS_TASK_CREATE(heap_guard_task, "heap_guard", 2048, NULL, tskIDLE_PRIORITY + 1, NULL);
+}
+
+#else
+
+void static_alloc_heap_guard_start(void) {
+}
+
+#endif
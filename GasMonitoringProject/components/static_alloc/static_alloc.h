@@ -0,0 +1,69 @@
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+// Creation macros for tasks and kernel objects. With CONFIG_GAS_STATIC_ALLOCATION
+// each call site gets its own static storage and the size is added to the RAM
+// budget printed by static_alloc_report(). Otherwise they fall back to the
+// regular heap-allocating FreeRTOS calls.
+//
+// The task and object names are pasted into the storage symbols, so every call
+// site must use a distinct function or variable name.
+
+void static_alloc_account(const char *name, size_t bytes);
+void static_alloc_report(void);
+void static_alloc_heap_guard_start(void);
+
+static inline void static_alloc_store_handle(TaskHandle_t *out, TaskHandle_t handle) {
+    if (out != NULL) {
+        *out = handle;
+    }
+}
+
+#if CONFIG_GAS_STATIC_ALLOCATION
+
+#define GAS_TASK_CREATE(fn, name, stack_bytes, arg, prio, handle_out) do { \
+        static StackType_t fn##_stack[(stack_bytes) / sizeof(StackType_t)]; \
+        static StaticTask_t fn##_tcb; \
+        static_alloc_store_handle((handle_out), \
+            xTaskCreateStatic(fn, name, stack_bytes, arg, prio, fn##_stack, &fn##_tcb)); \
+        static_alloc_account(name, sizeof(fn##_stack) + sizeof(fn##_tcb)); \
+    } while (0)
+
+#define GAS_MUTEX_CREATE(var) do { \
+        static StaticSemaphore_t var##_storage; \
+        (var) = xSemaphoreCreateMutexStatic(&var##_storage); \
+        static_alloc_account(#var, sizeof(var##_storage)); \
+    } while (0)
+
+#define GAS_EVENT_GROUP_CREATE(var) do { \
+        static StaticEventGroup_t var##_storage; \
+        (var) = xEventGroupCreateStatic(&var##_storage); \
+        static_alloc_account(#var, sizeof(var##_storage)); \
+    } while (0)
+
+#define GAS_QUEUE_CREATE(var, length, item_size) do { \
+        static uint8_t var##_items[(length) * (item_size)]; \
+        static StaticQueue_t var##_storage; \
+        (var) = xQueueCreateStatic(length, item_size, var##_items, &var##_storage); \
+        static_alloc_account(#var, sizeof(var##_items) + sizeof(var##_storage)); \
+    } while (0)
+
+#else
+
+#define GAS_TASK_CREATE(fn, name, stack_bytes, arg, prio, handle_out) \
+    xTaskCreate(fn, name, stack_bytes, arg, prio, handle_out)
+#define GAS_MUTEX_CREATE(var)                    ((var) = xSemaphoreCreateMutex())
+#define GAS_EVENT_GROUP_CREATE(var)              ((var) = xEventGroupCreate())
+#define GAS_QUEUE_CREATE(var, length, item_size) ((var) = xQueueCreate(length, item_size))
+
+#endif
+
+#endif
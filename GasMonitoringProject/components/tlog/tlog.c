@@ -0,0 +1,385 @@
+#include "tlog.h"
+#include <stdio.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "metrics.h"
+#include "static_alloc.h"
+#else
+// Host builds: deferred ring, hex records on stdout, counters without /metrics
+#include <time.h>
+#define CONFIG_GAS_TLOG_DEFERRED 1
+#define CONFIG_GAS_TLOG_HOST_DECODE 1
+#ifndef CONFIG_GAS_TLOG_RING_SLOTS
+#define CONFIG_GAS_TLOG_RING_SLOTS 64
+#endif
+
+typedef struct {
+    atomic_uint value;
+} metric_t;
+
+#define METRIC_DEFINE_COUNTER(var, metric_name, metric_labels, metric_help) metric_t var
+
+static inline void metric_inc(metric_t *metric) {
+    atomic_fetch_add_explicit(&metric->value, 1, memory_order_relaxed);
+}
+
+static uint32_t esp_log_timestamp(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+#endif
+
+#ifdef ESP_PLATFORM
+static const char *TAG = "TLOG";
+#endif
+
+typedef struct {
+    const char *level;
+    const char *tag;
+    const char *format;
+} tlog_format_t;
+
+static const tlog_format_t formats[TLOG_FORMAT_COUNT] = {
+#define TLOG_ENTRY(id, lvl, log_tag, fmt) [id] = { #lvl, log_tag, fmt },
+    TLOG_FORMATS(TLOG_ENTRY)
+#undef TLOG_ENTRY
+};
+
+static METRIC_DEFINE_COUNTER(tlog_records, "tlog_records_total", NULL, "Messages written with TLOG()");
+static METRIC_DEFINE_COUNTER(tlog_dropped, "tlog_dropped_total", NULL, "TLOG() messages dropped on a full ring");
+
+int tlog_format(tlog_id_t id, const uint32_t *args, int argc, char *out, int size) {
+    if (id >= TLOG_FORMAT_COUNT || size <= 0) {
+        return 0;
+    }
+
+    const char *p = formats[id].format;
+    int len = 0;
+    int arg = 0;
+    while (*p != '\0' && len < size - 1) {
+        if (*p != '%') {
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // Copy flags, width and precision; length modifiers are dropped since
+        // every argument arrives as a 32-bit word
+        char spec[16];
+        int n = 0;
+        spec[n++] = *p++;
+        while (*p != '\0' && strchr("-+ #0123456789.hlzjt", *p) != NULL) {
+            if (strchr("hlzjt", *p) == NULL && n < (int)sizeof(spec) - 2) {
+                spec[n++] = *p;
+            }
+            p++;
+        }
+        char conv = *p;
+        if (conv == '\0') {
+            break;
+        }
+        p++;
+        spec[n++] = conv;
+        spec[n] = '\0';
+
+        uint32_t word = arg < argc ? args[arg++] : 0;
+        int room = size - len;
+        int written;
+        switch (conv) {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                float value;
+                memcpy(&value, &word, sizeof(value));
+                written = snprintf(out + len, room, spec, (double)value);
+                break;
+            }
+            case 'd': case 'i': case 'c':
+                written = snprintf(out + len, room, spec, (int)(int32_t)word);
+                break;
+            default:
+                written = snprintf(out + len, room, spec, (unsigned)word);
+                break;
+        }
+        if (written < 0) {
+            break;
+        }
+        len += written < room ? written : room - 1;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+#if !CONFIG_GAS_TLOG_DEFERRED || !CONFIG_GAS_TLOG_HOST_DECODE
+
+static esp_log_level_t level_of(const tlog_format_t *format) {
+    switch (format->level[0]) {
+        case 'E': return ESP_LOG_ERROR;
+        case 'W': return ESP_LOG_WARN;
+        case 'D': return ESP_LOG_DEBUG;
+        case 'V': return ESP_LOG_VERBOSE;
+        default:  return ESP_LOG_INFO;
+    }
+}
+
+static void print_text(tlog_id_t id, uint32_t timestamp, const uint32_t *args, int argc) {
+    const tlog_format_t *format = &formats[id];
+    char text[160];
+    tlog_format(id, args, argc, text, sizeof(text));
+    esp_log_write(level_of(format), format->tag, "%c (%u) %s: %s\n",
+                  format->level[0], (unsigned)timestamp, format->tag, text);
+}
+
+#endif
+
+#if CONFIG_GAS_TLOG_DEFERRED
+
+#define RING_SLOTS CONFIG_GAS_TLOG_RING_SLOTS
+#define RING_MASK  (RING_SLOTS - 1)
+
+_Static_assert((RING_SLOTS & RING_MASK) == 0, "CONFIG_GAS_TLOG_RING_SLOTS must be a power of two");
+
+typedef struct {
+    atomic_uint seq;
+    uint32_t timestamp;
+    uint16_t id;
+    uint8_t argc;
+    uint32_t args[TLOG_MAX_ARGS];
+} tlog_record_t;
+
+// Bounded multi-producer queue: slot i is free for position p when its sequence
+// is p and holds a record once it is p + 1. Sequences are stored relative to the
+// slot index, so the zero-initialised ring starts out with every slot free and
+// TLOG() works before tlog_init().
+static tlog_record_t ring[RING_SLOTS];
+static atomic_uint ring_head;   // next position handed to a producer
+static unsigned ring_tail;      // next position to drain, written by the drain task only
+
+static inline unsigned slot_seq(unsigned index) {
+    return atomic_load_explicit(&ring[index].seq, memory_order_acquire) + index;
+}
+
+static inline void slot_set_seq(unsigned index, unsigned seq) {
+    atomic_store_explicit(&ring[index].seq, seq - index, memory_order_release);
+}
+
+void tlog_write(tlog_id_t id, const uint32_t *args, int argc) {
+    if (argc > TLOG_MAX_ARGS) {
+        argc = TLOG_MAX_ARGS;
+    }
+
+    unsigned pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    unsigned index;
+    while (1) {
+        index = pos & RING_MASK;
+        int diff = (int)(slot_seq(index) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            metric_inc(&tlog_dropped); // drain task is behind, never block the caller
+            return;
+        } else {
+            pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        }
+    }
+
+    tlog_record_t *record = &ring[index];
+    record->timestamp = esp_log_timestamp();
+    record->id = (uint16_t)id;
+    record->argc = (uint8_t)argc;
+    memcpy(record->args, args, argc * sizeof(uint32_t));
+    slot_set_seq(index, pos + 1);
+    metric_inc(&tlog_records);
+}
+
+#if CONFIG_GAS_TLOG_HOST_DECODE
+
+static int put_hex(char *out, uint32_t value, int digits) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--) {
+        out[i] = hex[value & 0xF];
+        value >>= 4;
+    }
+    return digits;
+}
+
+// "#TL <timestamp> <id> <arg>...", all hex, decoded by tools/tlog_decode.py
+static void print_record(tlog_id_t id, uint32_t timestamp, const uint32_t *args, int argc) {
+    char line[4 + 9 + 5 + TLOG_MAX_ARGS * 9 + 1];
+    int len = 0;
+    memcpy(line, "#TL ", 4);
+    len += 4;
+    len += put_hex(line + len, timestamp, 8);
+    line[len++] = ' ';
+    len += put_hex(line + len, id, 4);
+    for (int i = 0; i < argc; i++) {
+        line[len++] = ' ';
+        len += put_hex(line + len, args[i], 8);
+    }
+    line[len++] = '\n';
+    fwrite(line, 1, len, stdout);
+}
+
+#else
+
+#define print_record print_text
+
+#endif
+
+static bool drain_one(void) {
+    unsigned index = ring_tail & RING_MASK;
+    if (slot_seq(index) != ring_tail + 1) {
+        return false;
+    }
+
+    tlog_record_t *record = &ring[index];
+    uint32_t args[TLOG_MAX_ARGS];
+    tlog_id_t id = (tlog_id_t)record->id;
+    uint32_t timestamp = record->timestamp;
+    int argc = record->argc;
+    memcpy(args, record->args, argc * sizeof(uint32_t));
+    slot_set_seq(index, ring_tail + RING_SLOTS);
+    ring_tail++;
+
+    if (id < TLOG_FORMAT_COUNT) {
+        print_record(id, timestamp, args, argc);
+    }
+    return true;
+}
+
+// Prints every record in the ring; returns how many
+int tlog_drain(void) {
+    int drained = 0;
+    while (drain_one()) {
+        drained++;
+    }
+    return drained;
+}
+
+#ifdef ESP_PLATFORM
+
+static void tlog_drain_task(void *pvParameters) {
+    unsigned reported_drops = 0;
+
+#if CONFIG_GAS_TLOG_HOST_DECODE
+    // Lets the decoder check it was built from the same format table
+    printf("#TLV %d\n", TLOG_FORMAT_COUNT);
+#endif
+
+    while (1) {
+        tlog_drain();
+
+        unsigned drops = tlog_dropped_count();
+        if (drops != reported_drops) {
+            ESP_LOGW(TAG, "%u messages dropped", drops - reported_drops);
+            reported_drops = drops;
+        }
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_GAS_TLOG_DRAIN_PERIOD_MS));
+    }
+}
+
+#endif
+
+#else
+
+void tlog_write(tlog_id_t id, const uint32_t *args, int argc) {
+    if (id >= TLOG_FORMAT_COUNT) {
+        return;
+    }
+    metric_inc(&tlog_records);
+    print_text(id, esp_log_timestamp(), args, argc);
+}
+
+int tlog_drain(void) {
+    return 0;
+}
+
+#endif
+
+unsigned tlog_dropped_count(void) {
+    return atomic_load_explicit(&tlog_dropped.value, memory_order_relaxed);
+}
+
+// Records waiting for the drain, the ones still being written included
+unsigned tlog_queued(void) {
+#if CONFIG_GAS_TLOG_DEFERRED
+    return atomic_load_explicit(&ring_head, memory_order_relaxed) - ring_tail;
+#else
+    return 0;
+#endif
+}
+
+#if defined(ESP_PLATFORM) && CONFIG_GAS_TLOG_BENCHMARK
+
+#define BENCH_ROUNDS 16
+
+// Cost of one SI7021 sample log line done three ways. The TLOG() records
+// written here are printed by the drain task like any other.
+static void tlog_benchmark(void) {
+    volatile float temperature = 71.25f;
+    volatile float humidity = 40.5f;
+    char text[96];
+    uint32_t start;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        TLOG(TLOG_SI7021_SAMPLE, temperature, humidity);
+    }
+    uint32_t tlog_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_ROUNDS;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        snprintf(text, sizeof(text), "Temperature: %.2f°F, Humidity: %.2f%%", temperature, humidity);
+    }
+    uint32_t snprintf_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_ROUNDS;
+
+    start = esp_cpu_get_cycle_count();
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        ESP_LOGI("SI7021", "Temperature: %.2f°F, Humidity: %.2f%%", temperature, humidity);
+    }
+    uint32_t esp_log_cycles = (esp_cpu_get_cycle_count() - start) / BENCH_ROUNDS;
+
+    ESP_LOGI(TAG, "Cycles per call: TLOG %u, snprintf %u, ESP_LOGI %u",
+             (unsigned)tlog_cycles, (unsigned)snprintf_cycles, (unsigned)esp_log_cycles);
+}
+
+#endif
+
+#ifdef ESP_PLATFORM
+
+static METRIC_DEFINE_GAUGE(tlog_queue_depth, "tlog_queue_depth", NULL, "Records in the ring waiting for the drain task");
+
+static void collect_tlog_metrics(void) {
+    metric_set(&tlog_queue_depth, tlog_queued());
+}
+
+esp_err_t tlog_init(void) {
+    metrics_register(&tlog_records);
+    metrics_register(&tlog_dropped);
+    metrics_register(&tlog_queue_depth);
+    metrics_register_collector(collect_tlog_metrics);
+
+#if CONFIG_GAS_TLOG_BENCHMARK
+    tlog_benchmark();
+#endif
+
+#if CONFIG_GAS_TLOG_DEFERRED
+    // Lowest application priority: the drain only runs when sampling is idle
+    GAS_TASK_CREATE(tlog_drain_task, "tlog_drain", 3072, NULL, tskIDLE_PRIORITY + 1, NULL);
+#endif
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef TLOG_H
+#define TLOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include "tlog_formats.h"
+
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#include "esp_err.h"
+#else
+// Host builds (tools/tlog_check.c)
+typedef int esp_err_t;
+#define ESP_OK                      0
+#endif
+
+// Tokenized logging for the per-sample hot path. Instead of formatting text,
+//
+//   TLOG(TLOG_SI7021_SAMPLE, temperature, humidity);
+//
+// stores the message ID, a millisecond timestamp and the arguments as raw
+// 32-bit words in a lock-free ring buffer. A low-priority drain task prints
+// the records later, either as hex lines for tools/tlog_decode.py or as text.
+// Messages are declared in tlog_formats.h.
+//
+// The host build keeps the deferred ring with hex records; there is no drain
+// task, the caller empties the ring with tlog_drain().
+
+#define TLOG_MAX_ARGS 6
+
+typedef enum {
+#define TLOG_ENUM(id, level, tag, format) id,
+    TLOG_FORMATS(TLOG_ENUM)
+#undef TLOG_ENUM
+    TLOG_FORMAT_COUNT
+} tlog_id_t;
+
+static inline uint32_t tlog_word_float(float value) {
+    uint32_t word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+static inline uint32_t tlog_word_double(double value) {
+    return tlog_word_float((float)value);
+}
+
+static inline uint32_t tlog_word_int(uint32_t value) {
+    return value;
+}
+
+// Floats keep their bit pattern, integers are stored as is
+#define TLOG_WORD(x) _Generic((x), float: tlog_word_float, double: tlog_word_double, default: tlog_word_int)(x)
+
+#define TLOG_W(x) , TLOG_WORD(x)
+#define TLOG_MAP0()
+#define TLOG_MAP1(a) TLOG_W(a)
+#define TLOG_MAP2(a, b) TLOG_W(a) TLOG_W(b)
+#define TLOG_MAP3(a, b, c) TLOG_W(a) TLOG_W(b) TLOG_W(c)
+#define TLOG_MAP4(a, b, c, d) TLOG_W(a) TLOG_W(b) TLOG_W(c) TLOG_W(d)
+#define TLOG_MAP5(a, b, c, d, e) TLOG_W(a) TLOG_W(b) TLOG_W(c) TLOG_W(d) TLOG_W(e)
+#define TLOG_MAP6(a, b, c, d, e, f) TLOG_W(a) TLOG_W(b) TLOG_W(c) TLOG_W(d) TLOG_W(e) TLOG_W(f)
+#define TLOG_PICK(_0, _1, _2, _3, _4, _5, _6, map, ...) map
+#define TLOG_MAP(...) TLOG_PICK(_0, ##__VA_ARGS__, TLOG_MAP6, TLOG_MAP5, TLOG_MAP4, TLOG_MAP3, \
+                                TLOG_MAP2, TLOG_MAP1, TLOG_MAP0)(__VA_ARGS__)
+
+// The leading 0 keeps the array non-empty for messages without arguments
+#define TLOG(id, ...) do { \
+        const uint32_t tlog_args_[] = { 0 TLOG_MAP(__VA_ARGS__) }; \
+        tlog_write((id), tlog_args_ + 1, sizeof(tlog_args_) / sizeof(tlog_args_[0]) - 1); \
+    } while (0)
+
+// Function prototypes
+esp_err_t tlog_init(void);
+void tlog_write(tlog_id_t id, const uint32_t *args, int argc);
+int tlog_format(tlog_id_t id, const uint32_t *args, int argc, char *out, int size);
+int tlog_drain(void);
+unsigned tlog_dropped_count(void);
+unsigned tlog_queued(void);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef TLOG_FORMATS_H
+#define TLOG_FORMATS_H
+
+// Every tokenized log message as X(id, level, tag, format). The host decoder
+// (tools/tlog_decode.py) parses this file and numbers the entries in order, so
+// add new ones at the end. Arguments travel as 32-bit words: only numeric
+// conversions (d i u x X c f e g) are allowed, no strings or pointers.
+#define TLOG_FORMATS(X) \
+    X(TLOG_SI7021_SAMPLE,     I, "SI7021",            "Temperature: %.2f°F, Humidity: %.2f%%") \
+    X(TLOG_NODE_FRAME_SENT,   I, "TCP_SOCKET_SERVER", "Data sent: Temp:%.2f,Humidity:%.2f,NH3:%.2f,H2S:%.2f,CO2:%.2f,CH4:%.2f") \
+    X(TLOG_ADC_CSV_ROW,       I, "ADC",               "New sensor data read from CSV:") \
+    X(TLOG_ADC_CSV_END,       I, "ADC",               "End of CSV file reached.") \
+    X(TLOG_ADC_AMMONIA,       I, "ADC",               "Ammonia (NH3) Level: %.2f ppm") \
+    X(TLOG_ADC_METHANE,       I, "ADC",               "Methane (CH4) Level: %.2f ppm") \
+    X(TLOG_ADC_H2S,           I, "ADC",               "Hydrogen Sulfide (H2S) Level: %.2f ppm") \
+    X(TLOG_ADC_CO2,           I, "ADC",               "Carbon Dioxide (CO2) Level: %.2f ppm") \
+    X(TLOG_GW_FRAME_RECEIVED, I, "TCP_SOCKET_CLIENT", "Received data: %d bytes") \
+    X(TLOG_GW_PARSED,         I, "TCP_SOCKET_CLIENT", "Parsed Data - Temp: %.2f, Humidity: %.2f, NH3: %.2f, H2S: %.2f, CO2: %.2f, CH4: %.2f") \
+    X(TLOG_SCD41_SAMPLE,      I, "SCD41",             "CO2: %u ppm, Temperature: %.2f°C, Humidity: %.2f%%") \
+    X(TLOG_ANOMALY,           W, "ANOMALY",           "Channel %d flagged at %.2f (flags 0x%x)") \
+    X(TLOG_LINK_RETX,         I, "TCP_SOCKET_SERVER", "Gateway asked for frames %u to %u again")
+
+#endif
@@ -0,0 +1,114 @@
+#include "trace.h"
+
+#if CONFIG_GAS_TRACE_ENABLE
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#define TRACE_SYNC_TIMEOUT_MS 1000
+
+static const char *TAG = "TRACE";
+
+// Added to the local clock so node stamps read as gateway time. Stays 0 on the gateway.
+static int64_t clock_offset_us = 0;
+
+int64_t trace_now_us(void) {
+    return esp_timer_get_time() + clock_offset_us;
+}
+
+// Wait for a "TSYNC:<t1>:<t2>:<t3>" reply that answers our t1
+static bool sync_wait_reply(int sock, int64_t t1, int64_t *t2, int64_t *t3) {
+    char buf[128];
+    int64_t deadline = esp_timer_get_time() + TRACE_SYNC_TIMEOUT_MS * 1000LL;
+
+    while (esp_timer_get_time() < deadline) {
+        int len = recv(sock, buf, sizeof(buf) - 1, 0);
+        if (len <= 0) {
+            return false;
+        }
+        buf[len] = '\0';
+
+        // Anything else the peer sent first (e.g. its GET_SENSOR_DATA) is skipped
+        const char *reply = strstr(buf, "TSYNC:");
+        int64_t echo;
+        if (reply != NULL && sscanf(reply, "TSYNC:%" SCNd64 ":%" SCNd64 ":%" SCNd64, &echo, t2, t3) == 3 && echo == t1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+esp_err_t trace_sync_client(int sock) {
+    struct timeval timeout = {
+        .tv_sec = TRACE_SYNC_TIMEOUT_MS / 1000,
+        .tv_usec = (TRACE_SYNC_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    int64_t best_delay = INT64_MAX;
+    int64_t best_offset = 0;
+
+    for (int round = 0; round < CONFIG_GAS_TRACE_SYNC_ROUNDS; round++) {
+        char request[32];
+        int64_t t1 = esp_timer_get_time();
+        int len = snprintf(request, sizeof(request), "TSYNC:%" PRId64 "\n", t1);
+        if (send(sock, request, len, 0) < 0) {
+            break;
+        }
+
+        int64_t t2, t3;
+        if (!sync_wait_reply(sock, t1, &t2, &t3)) {
+            continue;
+        }
+        int64_t t4 = esp_timer_get_time();
+
+        // Classic NTP estimate, keep the exchange with the least queueing
+        int64_t delay = (t4 - t1) - (t3 - t2);
+        if (delay < best_delay) {
+            best_delay = delay;
+            best_offset = ((t2 - t1) + (t3 - t4)) / 2;
+        }
+    }
+
+    if (best_delay == INT64_MAX) {
+        ESP_LOGW(TAG, "Clock sync failed, stamps stay on the local clock");
+        return ESP_ERR_TIMEOUT;
+    }
+    clock_offset_us = best_offset;
+    ESP_LOGI(TAG, "Clock offset %" PRId64 " us (round trip %" PRId64 " us)", best_offset, best_delay);
+    return ESP_OK;
+}
+
+bool trace_sync_reply(int sock, const char *msg) {
+    int64_t t2 = trace_now_us();
+    const char *request = strstr(msg, "TSYNC:");
+    int64_t t1;
+    if (request == NULL || sscanf(request, "TSYNC:%" SCNd64, &t1) != 1) {
+        return false;
+    }
+
+    char reply[80];
+    int64_t t3 = trace_now_us();
+    int len = snprintf(reply, sizeof(reply), "TSYNC:%" PRId64 ":%" PRId64 ":%" PRId64, t1, t2, t3);
+    send(sock, reply, len, 0);
+    return true;
+}
+
+int trace_format_node(const trace_stamps_t *stamps, char *buf, size_t len) {
+    return snprintf(buf, len, ",T:%" PRIu32 ":%" PRId64 ":%" PRId64 ":%" PRId64,
+                    stamps->seq, stamps->t[TRACE_ACQUIRE], stamps->t[TRACE_PUBLISH], stamps->t[TRACE_SEND]);
+}
+
+int trace_format_gateway(const char *frame, int64_t recv_us, int64_t uart_us, char *buf, size_t len) {
+    // Frames from a node without tracing are forwarded as they are
+    if (strstr(frame, ",T:") == NULL) {
+        return snprintf(buf, len, "%s\n", frame);
+    }
+    return snprintf(buf, len, "%s:%" PRId64 ":%" PRId64 "\n", frame, recv_us, uart_us);
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+// End-to-end latency tracing. Each sample frame carries the times it passed
+// through every hop, in microseconds on the gateway clock:
+//
+//   <frame>,T:<seq>:<acquire>:<publish>:<send>                  (node -> gateway)
+//   <frame>,T:<seq>:<acquire>:<publish>:<send>:<recv>:<uart>\n  (gateway -> UART)
+//
+// The host adds its own ingest time (tools/trace_report.py). The node aligns
+// its clock to the gateway with an NTP-style exchange right after connecting.
+// With CONFIG_GAS_TRACE_ENABLE off, everything here compiles away.
+
+typedef enum {
+    TRACE_ACQUIRE,      // sensor read done
+    TRACE_PUBLISH,      // globals updated for the network side
+    TRACE_SEND,         // handed to send() on the node
+    TRACE_GW_RECV,      // returned from recv() on the gateway
+    TRACE_UART_WRITE,   // handed to uart_write_bytes() on the gateway
+    TRACE_POINT_COUNT
+} trace_point_t;
+
+typedef struct {
+    uint32_t seq;
+    int64_t t[TRACE_POINT_COUNT];
+} trace_stamps_t;
+
+#if CONFIG_GAS_TRACE_ENABLE
+
+#define TRACE_SUFFIX_LEN 96
+#define TRACE_STAMP(stamps, point) ((stamps)->t[(point)] = trace_now_us())
+
+int64_t trace_now_us(void);
+esp_err_t trace_sync_client(int sock);
+bool trace_sync_reply(int sock, const char *msg);
+int trace_format_node(const trace_stamps_t *stamps, char *buf, size_t len);
+int trace_format_gateway(const char *frame, int64_t recv_us, int64_t uart_us, char *buf, size_t len);
+
+#else
+
+#define TRACE_SUFFIX_LEN 0
+#define TRACE_STAMP(stamps, point) ((void)(stamps))
+
+#endif
+
+#endif
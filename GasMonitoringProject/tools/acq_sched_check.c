@@ -0,0 +1,382 @@
+// Host harness for the acquisition scheduler (TempSensor/main/acq_sched.c).
+//
+// Jobs run on a simulated millisecond clock. Their start() and collect()
+// callbacks follow a script: conversion time, ACQ_STEP() exchanges before
+// it, start failures, and bus time spent inside collect() that holds up
+// everything else. A reference model, written from the rules in acq_sched.h
+// rather than from the code, follows every job. After each acq_run() it
+// checks that:
+//   - the job that ran was the earliest due (heap order), and
+//     acq_time_until_due() gave the wait to it;
+//   - a collect came no earlier than the conversion time after its start;
+//   - the job's next period boundary, overruns, runs and start errors match
+//     the model: the next boundary is the first one after the run, in phase,
+//     and every boundary passed while the job was late is an overrun.
+//
+// Scenarios are the node's job table (si7021 conversion, scd41 steps, MQ
+// inputs, history and link) with and without bus time, and random job sets.
+// Each one runs from clock 0 and again across the 32-bit millisecond wrap.
+// Last, the time per acq_run() with eight jobs.
+//
+//   gcc -O2 -I../TempSensor/main -I../components/gas_channels -o acq_sched_check
+//       acq_sched_check.c ../TempSensor/main/acq_sched.c ../TempSensor/main/adaptive_sampling.c -lm
+//   ./acq_sched_check [--hours 24]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "acq_sched.h"
+
+#define RANDOM_SETS     200
+#define BENCH_RUNS      2000000
+
+typedef struct {
+    acq_job_t job;
+
+    // Script
+    int32_t conversion_ms;      // start() result, 0 = collect straight away
+    int steps;                  // ACQ_STEP() exchanges before the conversion
+    uint32_t step_ms;
+    uint32_t fail_every;        // every n-th start() fails, 0 = never
+    uint32_t busy_ms;           // bus time of every collect()
+    uint32_t stall_every;       // every n-th collect() takes stall_ms instead
+    uint32_t stall_ms;
+
+    // What happened
+    uint32_t start_calls;
+    int steps_left;
+    uint32_t started_ms;
+    int32_t last_start;
+    bool ran;
+
+    // Reference model
+    uint32_t ref_slot;
+    uint32_t ref_due;
+    bool ref_converting;
+    uint32_t ref_runs;
+    uint32_t ref_errors;
+    uint32_t ref_overruns;
+} sim_job_t;
+
+typedef struct {
+    long runs;
+    long mismatches;
+    uint32_t max_late_ms;
+    long interleaved;           // runs while another job was converting
+    uint32_t overruns;
+} result_t;
+
+static uint32_t sim_now;
+static uint32_t rng = 2463534242u;
+
+static uint32_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static int32_t sim_start(void *ctx) {
+    sim_job_t *s = ctx;
+    s->ran = true;
+    s->start_calls++;
+    if (s->fail_every != 0 && s->start_calls % s->fail_every == 0) {
+        s->last_start = -1;
+    } else if (s->steps_left > 0) {
+        s->steps_left--;
+        s->last_start = ACQ_STEP(s->step_ms);
+    } else {
+        s->steps_left = s->steps;
+        s->started_ms = sim_now;
+        s->last_start = s->conversion_ms;
+    }
+    return s->last_start;
+}
+
+static bool sim_collect(void *ctx, gas_sample_t *sample) {
+    sim_job_t *s = ctx;
+    s->ran = true;
+    uint32_t collects = s->ref_runs + 1;
+    sim_now += s->stall_every != 0 && collects % s->stall_every == 0 ? s->stall_ms : s->busy_ms;
+    return true;
+}
+
+static void ref_add(sim_job_t *s, uint32_t now_ms) {
+    s->ref_slot = now_ms + s->job.phase_ms;
+    s->ref_due = s->ref_slot;
+    s->ref_converting = false;
+    s->ref_runs = s->ref_errors = s->ref_overruns = 0;
+    s->steps_left = s->steps;
+    s->start_calls = 0;
+}
+
+// First boundary of the job's period after `t`, every one skipped on the way
+// counted as an overrun
+static void ref_next_slot(sim_job_t *s, uint32_t t) {
+    uint32_t next = s->ref_slot + s->job.period_ms;
+    while ((int32_t)(next - t) <= 0) {
+        next += s->job.period_ms;
+        s->ref_overruns++;
+    }
+    s->ref_slot = next;
+    s->ref_due = next;
+}
+
+// What acq_run() should have done to the job that ran at `t`, given what its
+// callbacks returned
+static void ref_run(sim_job_t *s, uint32_t t) {
+    if (!s->ref_converting && s->job.start != NULL) {
+        int32_t r = s->last_start;
+        if (r < 0) {
+            s->ref_errors++;
+            ref_next_slot(s, t);
+            return;
+        }
+        if (r & ACQ_STEP_FLAG) {
+            s->ref_due = t + (uint32_t)(r & ~ACQ_STEP_FLAG);
+            return;
+        }
+        if (r > 0) {
+            s->ref_converting = true;
+            s->ref_due = t + (uint32_t)r;
+            return;
+        }
+    }
+    s->ref_converting = false;
+    s->ref_runs++;
+    ref_next_slot(s, t);
+}
+
+static bool ref_matches(const sim_job_t *s) {
+    const acq_job_t *job = &s->job;
+    return job->slot_ms == s->ref_slot && job->due_ms == s->ref_due && job->converting == s->ref_converting &&
+           job->runs == s->ref_runs && job->start_errors == s->ref_errors && job->overruns == s->ref_overruns;
+}
+
+static void run_jobs(sim_job_t *jobs, int count, uint32_t t0, uint32_t span_ms, result_t *result) {
+    acq_sched_t sched;
+    gas_sample_t sample;
+    acq_init(&sched);
+    sim_now = t0;
+    for (int i = 0; i < count; i++) {
+        jobs[i].job.ctx = &jobs[i];
+        acq_add(&sched, &jobs[i].job, sim_now);
+        ref_add(&jobs[i], sim_now);
+    }
+
+    while ((uint32_t)(sim_now - t0) < span_ms) {
+        // Earliest due job in the model
+        int earliest = 0;
+        for (int i = 1; i < count; i++) {
+            if ((int32_t)(jobs[i].ref_due - jobs[earliest].ref_due) < 0) {
+                earliest = i;
+            }
+        }
+        int32_t want_wait = (int32_t)(jobs[earliest].ref_due - sim_now);
+        want_wait = want_wait > 0 ? want_wait : 0;
+        if (acq_time_until_due(&sched, sim_now) != want_wait) {
+            result->mismatches++;
+        }
+        sim_now += (uint32_t)want_wait;
+
+        uint32_t t = sim_now;
+        for (int i = 0; i < count; i++) {
+            jobs[i].ran = false;
+        }
+        acq_run(&sched, t, &sample);
+
+        int ran = -1;
+        for (int i = 0; i < count; i++) {
+            if (jobs[i].ran) {
+                ran = i;
+            }
+        }
+        if (ran < 0 || jobs[ran].ref_due != jobs[earliest].ref_due) {
+            result->mismatches++;
+            break;
+        }
+        sim_job_t *s = &jobs[ran];
+        if (s->ref_converting && (int32_t)(t - s->started_ms) < s->conversion_ms) {
+            result->mismatches++;       // collected before the conversion was done
+        }
+        uint32_t late = t - s->ref_due;
+        if (late > result->max_late_ms) {
+            result->max_late_ms = late;
+        }
+        for (int i = 0; i < count; i++) {
+            if (i != ran && jobs[i].ref_converting) {
+                result->interleaved++;
+                break;
+            }
+        }
+
+        ref_run(s, t);
+        if (!ref_matches(s)) {
+            if (result->mismatches++ < 3) {
+                printf("  %s at %u: slot %u/%u due %u/%u overruns %u/%u runs %u/%u errors %u/%u\n", s->job.name,
+                       (unsigned)t, (unsigned)s->job.slot_ms, (unsigned)s->ref_slot, (unsigned)s->job.due_ms,
+                       (unsigned)s->ref_due, (unsigned)s->job.overruns, (unsigned)s->ref_overruns,
+                       (unsigned)s->job.runs, (unsigned)s->ref_runs, (unsigned)s->job.start_errors,
+                       (unsigned)s->ref_errors);
+            }
+            // Carry on from the scheduler's state so one slip is reported once
+            s->ref_slot = s->job.slot_ms;
+            s->ref_due = s->job.due_ms;
+            s->ref_converting = s->job.converting;
+            s->ref_overruns = s->job.overruns;
+        }
+        result->runs++;
+    }
+    for (int i = 0; i < count; i++) {
+        result->overruns += jobs[i].job.overruns;
+    }
+}
+
+// The node's acq_jobs[] with the Kconfig defaults
+static int node_jobs(sim_job_t *jobs, bool bus_time) {
+    static const struct {
+        const char *name;
+        uint32_t period_ms, phase_ms;
+        bool start;
+        int32_t conversion_ms;
+        int steps;
+    } table[] = {
+        { "si7021", 2000, 0, true, 25, 0 },     // SI7021_RH_CONVERSION_MS
+        { "nh3", 1000, 100, false, 0, 0 },
+        { "h2s", 1000, 200, false, 0, 0 },
+        { "co2", 5000, 300, false, 0, 0 },
+        { "scd41", 1000, 300, true, 1, 1 },     // data-ready check, then the read
+        { "ch4", 1000, 400, false, 0, 0 },
+        { "history", 5000, 4500, false, 0, 0 },
+        { "link", 5000, 4000, false, 0, 0 },
+    };
+    int count = sizeof(table) / sizeof(table[0]);
+    memset(jobs, 0, sizeof(*jobs) * count);
+    for (int i = 0; i < count; i++) {
+        sim_job_t *s = &jobs[i];
+        s->job.name = table[i].name;
+        s->job.period_ms = table[i].period_ms;
+        s->job.phase_ms = table[i].phase_ms;
+        s->job.start = table[i].start ? sim_start : NULL;
+        s->job.collect = sim_collect;
+        s->conversion_ms = table[i].conversion_ms;
+        s->steps = table[i].steps;
+        s->step_ms = 1;
+        if (bus_time) {
+            // ADC reads and I2C fetches take a few ms; every 60th history
+            // record writes a SPIFFS block that can take seconds
+            s->busy_ms = table[i].start ? 3 : 2;
+            if (strcmp(s->job.name, "history") == 0) {
+                s->stall_every = 60;
+                s->stall_ms = 2600;
+            }
+            if (strcmp(s->job.name, "scd41") == 0) {
+                s->fail_every = 97;
+            }
+        }
+    }
+    return count;
+}
+
+static int random_jobs(sim_job_t *jobs) {
+    int count = 1 + next_random() % ACQ_MAX_JOBS;
+    memset(jobs, 0, sizeof(*jobs) * count);
+    for (int i = 0; i < count; i++) {
+        sim_job_t *s = &jobs[i];
+        s->job.name = "random";
+        s->job.period_ms = 1 + next_random() % 5000;
+        s->job.phase_ms = next_random() % 5000;
+        s->job.collect = sim_collect;
+        if (next_random() % 2) {
+            s->job.start = sim_start;
+            s->conversion_ms = next_random() % 3 == 0 ? 0 : 1 + next_random() % 200;
+            s->steps = next_random() % 3;
+            s->step_ms = 1 + next_random() % 5;
+            s->fail_every = next_random() % 4 == 0 ? 2 + next_random() % 20 : 0;
+        }
+        s->busy_ms = next_random() % 4 == 0 ? next_random() % 50 : 0;
+        if (next_random() % 4 == 0) {
+            s->stall_every = 2 + next_random() % 30;
+            s->stall_ms = next_random() % 12000;
+        }
+    }
+    return count;
+}
+
+static void print_result(const char *name, const char *clock, const result_t *r) {
+    printf("%-20s %-8s %10ld %9u %12ld %9u %11ld\n", name, clock, r->runs, (unsigned)r->max_late_ms, r->interleaved,
+           (unsigned)r->overruns, r->mismatches);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool bench_collect(void *ctx, gas_sample_t *sample) {
+    return true;
+}
+
+static void bench(void) {
+    acq_job_t jobs[ACQ_MAX_JOBS];
+    acq_sched_t sched;
+    gas_sample_t sample;
+    memset(jobs, 0, sizeof(jobs));
+    acq_init(&sched);
+    for (int i = 0; i < ACQ_MAX_JOBS; i++) {
+        jobs[i].name = "bench";
+        jobs[i].period_ms = 1000 + 100 * i;
+        jobs[i].phase_ms = 37 * i;
+        jobs[i].collect = bench_collect;
+        acq_add(&sched, &jobs[i], 0);
+    }
+    uint32_t now = 0;
+    double t0 = now_ns();
+    for (int r = 0; r < BENCH_RUNS; r++) {
+        now += (uint32_t)acq_time_until_due(&sched, now);
+        acq_run(&sched, now, &sample);
+    }
+    printf("\n%d jobs: %.1f ns per acq_time_until_due() + acq_run()\n", ACQ_MAX_JOBS,
+           (now_ns() - t0) / BENCH_RUNS);
+}
+
+int main(int argc, char **argv) {
+    uint32_t hours = 24;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hours") == 0 && i + 1 < argc) {
+            hours = (uint32_t)atoi(argv[++i]);
+        }
+    }
+    uint32_t span_ms = hours * 3600000u;
+    // Starts 10 min before the wrap, so the run crosses it
+    static const uint32_t starts[2] = { 0, UINT32_MAX - 600000u };
+    static const char *const clocks[2] = { "0", "wrap" };
+
+    printf("%u h simulated per node scenario, %d random job sets of 1 h\n\n", (unsigned)hours, RANDOM_SETS);
+    printf("%-20s %-8s %10s %9s %12s %9s %11s\n", "scenario", "clock", "runs", "max late", "interleaved",
+           "overruns", "mismatches");
+    long failures = 0;
+    sim_job_t jobs[ACQ_MAX_JOBS];
+    for (int c = 0; c < 2; c++) {
+        for (int bus = 0; bus < 2; bus++) {
+            result_t r = { 0 };
+            int count = node_jobs(jobs, bus);
+            run_jobs(jobs, count, starts[c], span_ms, &r);
+            print_result(bus ? "node, bus time" : "node", clocks[c], &r);
+            failures += r.mismatches;
+        }
+        result_t r = { 0 };
+        for (int set = 0; set < RANDOM_SETS; set++) {
+            int count = random_jobs(jobs);
+            run_jobs(jobs, count, starts[c] + next_random() % 1000, 3600000u, &r);
+        }
+        print_result("random sets", clocks[c], &r);
+        failures += r.mismatches;
+    }
+
+    bench();
+    printf("\n%s\n", failures == 0 ? "all checks passed" : "CHECKS FAILED");
+    return failures != 0;
+}
@@ -0,0 +1,244 @@
+// Replay of the adaptive sampling scheduler (TempSensor/main/adaptive_sampling.c)
+// against the fixed 5 s schedule.
+//
+// Runs both schedules over a gas time series and reports the samples taken
+// and how long after an ammonia alarm crossing each one first saw a sample
+// above the alarm level. The series is either a CSV file with one row per
+// second (time_s,temperature,humidity,ammonia,h2s,co2,methane) or, without
+// --file, a generated day of barn air with ammonia plumes.
+//
+//   gcc -O2 -I../TempSensor/main -I../components/gas_channels -o adaptive_replay
+//       adaptive_replay.c ../TempSensor/main/adaptive_sampling.c -lm
+//   ./adaptive_replay [--file series.csv] [--alarm 25] [--seed 1]
+//                     [--max-period 30000] [--budget 60]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "adaptive_sampling.h"
+
+#define FIXED_PERIOD_MS 5000
+#define DAY_S           86400
+#define MAX_EVENTS      64
+#define EVENT_GAP_S     120     // dips shorter than this belong to the same event
+
+typedef struct {
+    gas_sample_t *rows;     // one per second
+    int count;
+} series_t;
+
+typedef struct {
+    uint32_t start_s;       // first second above the alarm level
+    uint32_t end_s;         // first second back below it
+} event_t;
+
+typedef struct {
+    const char *name;
+    uint32_t samples;
+    double delay_sum_s;
+    double delay_max_s;
+    int detected;
+    int missed;
+} result_t;
+
+static uint32_t rng_state;
+
+static double uniform(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return (rng_state >> 8) / 16777216.0;
+}
+
+static double gaussian(void) {
+    double u = uniform() + 1e-12;
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * uniform());
+}
+
+// A day of barn air: slow daily drift, sensor noise and a few ammonia plumes
+static void generate_series(series_t *series, unsigned seed) {
+    rng_state = seed;
+    series->count = DAY_S;
+    series->rows = calloc(series->count, sizeof(gas_sample_t));
+
+    double plume[DAY_S] = { 0 };
+    for (int p = 0; p < 8; p++) {
+        int start = (int)(uniform() * (DAY_S - 3600));
+        double peak = 30.0 + uniform() * 50.0;
+        int rise = 60 + (int)(uniform() * 240);
+        int hold = 300 + (int)(uniform() * 600);
+        int decay = 600;
+        for (int t = 0; t < rise + hold + decay && start + t < DAY_S; t++) {
+            double level = t < rise ? peak * t / rise
+                         : t < rise + hold ? peak
+                         : peak * (1.0 - (double)(t - rise - hold) / decay);
+            if (level > plume[start + t]) {
+                plume[start + t] = level;
+            }
+        }
+    }
+
+    for (int t = 0; t < series->count; t++) {
+        double day = sin(2.0 * M_PI * t / DAY_S);
+        gas_sample_t *row = &series->rows[t];
+        row->temperature = (float)(68.0 + 6.0 * day + 0.05 * gaussian());
+        row->humidity = (float)(55.0 - 10.0 * day + 0.2 * gaussian());
+        row->ammonia = (float)(8.0 + 2.0 * day + plume[t] + 0.3 * gaussian());
+        row->h2s = (float)(0.5 + 0.02 * gaussian());
+        row->co2 = (float)(1500.0 + 300.0 * day + 20.0 * gaussian());
+        row->methane = (float)(300.0 + 5.0 * gaussian());
+    }
+}
+
+static int load_series(series_t *series, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int capacity = 4096;
+    series->rows = malloc(capacity * sizeof(gas_sample_t));
+    series->count = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        gas_sample_t row = { 0 };
+        char *p = line;
+        strtod(p, &p); // time column, rows are one second apart
+        int ch = 0;
+        while (ch < GAS_CH_COUNT && *p == ',') {
+            row.values[ch++] = strtof(p + 1, &p);
+        }
+        if (ch < GAS_CH_COUNT) {
+            continue; // header or short row
+        }
+        if (series->count == capacity) {
+            capacity *= 2;
+            series->rows = realloc(series->rows, capacity * sizeof(gas_sample_t));
+        }
+        series->rows[series->count++] = row;
+    }
+    fclose(file);
+    return series->count > 0 ? 0 : -1;
+}
+
+static int find_events(const series_t *series, float alarm, event_t *events) {
+    int count = 0;
+    bool above = false;
+    for (int t = 0; t < series->count && count < MAX_EVENTS; t++) {
+        bool now_above = series->rows[t].ammonia >= alarm;
+        if (now_above && !above) {
+            if (count > 0 && t - events[count - 1].end_s < EVENT_GAP_S) {
+                count--;    // noise around the level, reopen the previous event
+            } else {
+                events[count].start_s = t;
+            }
+            events[count].end_s = series->count;
+        } else if (!now_above && above) {
+            events[count++].end_s = t;
+        }
+        above = now_above;
+    }
+    return above ? count + 1 : count;
+}
+
+// Delays are measured from the true crossing to the first sample above the alarm
+static void score(result_t *result, const uint32_t *sample_ms, int samples, const series_t *series,
+                  float alarm, const event_t *events, int event_count) {
+    result->samples = samples;
+    for (int e = 0; e < event_count; e++) {
+        bool seen = false;
+        for (int i = 0; i < samples; i++) {
+            uint32_t t = sample_ms[i] / 1000;
+            if (t >= events[e].start_s && t < events[e].end_s && series->rows[t].ammonia >= alarm) {
+                double delay = sample_ms[i] / 1000.0 - events[e].start_s;
+                result->delay_sum_s += delay;
+                if (delay > result->delay_max_s) {
+                    result->delay_max_s = delay;
+                }
+                seen = true;
+                break;
+            }
+        }
+        if (seen) {
+            result->detected++;
+        } else {
+            result->missed++;
+        }
+    }
+}
+
+static void print_result(const result_t *result) {
+    printf("%-10s %9u %10.2f %10.1f %10.1f %8d\n", result->name, (unsigned)result->samples,
+           result->samples / 24.0 / 60.0,
+           result->detected ? result->delay_sum_s / result->detected : 0.0, result->delay_max_s, result->missed);
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    float alarm = 25.0f;
+    unsigned seed = 1;
+    uint32_t max_period_ms = 30000;
+    uint32_t budget = 60;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--file") == 0) {
+            path = argv[i + 1];
+        } else if (strcmp(argv[i], "--alarm") == 0) {
+            alarm = strtof(argv[i + 1], NULL);
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            seed = (unsigned)strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--max-period") == 0) {
+            max_period_ms = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        } else if (strcmp(argv[i], "--budget") == 0) {
+            budget = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        }
+    }
+
+    series_t series;
+    if (path != NULL ? load_series(&series, path) != 0 : (generate_series(&series, seed), 0)) {
+        return 1;
+    }
+    event_t events[MAX_EVENTS];
+    int event_count = find_events(&series, alarm, events);
+    uint32_t duration_ms = (uint32_t)series.count * 1000;
+
+    uint32_t *sample_ms = malloc((duration_ms / 500 + 1) * sizeof(uint32_t));
+    if (sample_ms == NULL) {
+        return 1;
+    }
+
+    // Fixed schedule, as sensor_task and csv_task did it
+    int samples = 0;
+    for (uint32_t t = 0; t < duration_ms; t += FIXED_PERIOD_MS) {
+        sample_ms[samples++] = t;
+    }
+    result_t fixed = { .name = "fixed 5 s" };
+    score(&fixed, sample_ms, samples, &series, alarm, events, event_count);
+
+    // Adaptive schedule with the firmware defaults, driven by the gas channels
+    adaptive_config_t config = {
+        .min_period_ms = 500,
+        .max_period_ms = max_period_ms,
+        .start_period_ms = FIXED_PERIOD_MS,
+        .budget_per_min = budget,
+        .flat_samples = 3,
+    };
+    adaptive_sched_t sched;
+    adaptive_init(&sched, &config, ADAPTIVE_CHANNEL(GAS_CH_AMMONIA) | ADAPTIVE_CHANNEL(GAS_CH_H2S) |
+                                   ADAPTIVE_CHANNEL(GAS_CH_CO2) | ADAPTIVE_CHANNEL(GAS_CH_METHANE));
+    samples = 0;
+    for (uint32_t t = 0; t < duration_ms; ) {
+        sample_ms[samples++] = t;
+        t += adaptive_update(&sched, t, &series.rows[t / 1000]);
+    }
+    result_t adaptive = { .name = "adaptive" };
+    score(&adaptive, sample_ms, samples, &series, alarm, events, event_count);
+
+    printf("%d s of data, %d alarm events at %.1f ppm NH3\n\n", series.count, event_count, alarm);
+    printf("%-10s %9s %10s %10s %10s %8s\n", "schedule", "samples", "per min", "mean s", "max s", "missed");
+    print_result(&fixed);
+    print_result(&adaptive);
+    printf("\nadaptive periods stretched by the budget: %u\n", (unsigned)sched.budget_limited);
+
+    free(sample_ms);
+    free(series.rows);
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Oversampling front end (components/adc_frontend) against the simulated SPI
+// ADC (adc_sim), the same path the node runs with CONFIG_GAS_ADC_SOURCE_SIM.
+//
+// For every decimation filter and ratio prints the rms error of the outputs
+// against the true input level, the effective number of bits that implies,
+// the output rate and the host time per input frame. Each conversion is its
+// own chip-select window, as on the converter; the SPI bus time per frame
+// and the bus share at the chosen sampling rate are printed first.
+//
+//   gcc -O2 -I../components/adc_frontend -I../components/block_kernels
+//       -o adc_frontend_sim adc_frontend_sim.c ../components/adc_frontend/adc_frontend.c
+//       ../components/adc_frontend/adc_sim.c ../components/block_kernels/block_kernels.c -lm
+//   ./adc_frontend_sim [--noise 1.0] [--rate 5000] [--spi-hz 1000000]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "adc_frontend.h"
+#include "adc_sim.h"
+
+#define CHANNELS    4
+#define VREF        3.3f
+#define LEVELS      64          // DC levels tried per filter and ratio
+#define OUTPUTS     32          // settled outputs measured per level
+#define CS_GAP_BITS 8           // chip-select setup and hold per conversion, in SPI clocks
+#define BENCH_FRAMES 65536
+
+static const adc_fe_filter_t filters[] = { ADC_FE_AVERAGE, ADC_FE_CIC2, ADC_FE_CIC3 };
+static const int ratios[] = { 1, 4, 16, 64, 256 };
+
+static adc_sim_t sim;
+static adc_fe_t fe;
+static uint16_t frames[BENCH_FRAMES * CHANNELS];
+static int32_t out[(BENCH_FRAMES + 1) * CHANNELS];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void read_frames(uint16_t *dst, int count) {
+    uint8_t tx[CHANNELS][ADC_SIM_FRAME_BYTES];
+    uint8_t rx[ADC_SIM_FRAME_BYTES];
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        adc_sim_command(ch, tx[ch]);
+    }
+    for (int f = 0; f < count; f++) {
+        for (int ch = 0; ch < CHANNELS; ch++) {
+            adc_sim_transfer(&sim, tx[ch], rx, ADC_SIM_FRAME_BYTES);
+            dst[f * CHANNELS + ch] = adc_sim_result(rx);
+        }
+    }
+}
+
+// rms error in LSB over LEVELS random DC inputs, OUTPUTS settled outputs each
+static double measure(const adc_fe_config_t *config, uint32_t seed) {
+    double sq = 0;
+    long n = 0;
+    srand(seed);
+    for (int level = 0; level < LEVELS; level++) {
+        adc_fe_init(&fe, config);
+        float codes[CHANNELS];
+        for (int ch = 0; ch < CHANNELS; ch++) {
+            // Keep clear of the rails, where clipping biases the mean
+            codes[ch] = 64.0f + (float)rand() / RAND_MAX * 3968.0f;
+            adc_sim_set_input(&sim, ch, codes[ch] * VREF / (1 << ADC_SIM_BITS));
+        }
+        int got = 0;
+        while (got < OUTPUTS) {
+            read_frames(frames, config->ratio);
+            if (adc_fe_push(&fe, frames, config->ratio, out) == 0) {
+                continue;
+            }
+            for (int ch = 0; ch < CHANNELS; ch++) {
+                double error = adc_fe_to_code(out[ch]) - codes[ch];
+                sq += error * error;
+                n++;
+            }
+            got++;
+        }
+    }
+    return sqrt(sq / n);
+}
+
+int main(int argc, char **argv) {
+    float noise = 1.0f;
+    int rate = 5000;
+    int spi_hz = 1000000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+            noise = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--spi-hz") == 0 && i + 1 < argc) {
+            spi_hz = atoi(argv[++i]);
+        }
+    }
+    adc_sim_init(&sim, VREF, noise, 1);
+
+    int bits_per_frame = CHANNELS * (ADC_SIM_FRAME_BYTES * 8 + CS_GAP_BITS);
+    double frame_us = bits_per_frame * 1e6 / spi_hz;
+    printf("SPI %d Hz: %d clocks and %.1f us per %d-channel frame, at most %.0f frames/s\n",
+           spi_hz, bits_per_frame, frame_us, CHANNELS, spi_hz / (double)bits_per_frame);
+    printf("%d frames/s uses %.1f%% of the bus; input noise %.2f LSB rms\n\n",
+           rate, 100.0 * rate * frame_us / 1e6, noise);
+
+    printf("%-8s %6s %10s %10s %8s %10s\n", "filter", "ratio", "out Hz", "rms LSB", "ENOB", "ns/frame");
+    for (int f = 0; f < sizeof(filters) / sizeof(filters[0]); f++) {
+        for (int r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++) {
+            adc_fe_config_t config = { .filter = filters[f], .channels = CHANNELS, .ratio = ratios[r],
+                                       .code_bits = ADC_SIM_BITS };
+            if (!adc_fe_init(&fe, &config)) {
+                printf("%-8s %6d   (sum would overflow 32 bits)\n", adc_fe_filter_name(config.filter), config.ratio);
+                continue;
+            }
+            double rms = measure(&config, 7);
+            // Ideal quantisation alone is 1/sqrt(12) LSB rms
+            double enob = ADC_SIM_BITS - log2(rms * sqrt(12.0));
+
+            read_frames(frames, BENCH_FRAMES);
+            adc_fe_init(&fe, &config);
+            double start = now_ns();
+            adc_fe_push(&fe, frames, BENCH_FRAMES, out);
+            double ns = (now_ns() - start) / BENCH_FRAMES;
+
+            printf("%-8s %6d %10.1f %10.4f %8.2f %10.1f\n", adc_fe_filter_name(config.filter), config.ratio,
+                   (double)rate / config.ratio, rms, enob, ns);
+        }
+    }
+
+    double start = now_ns();
+    read_frames(frames, BENCH_FRAMES);
+    printf("\nsimulated device: %.1f ns per %d-channel frame\n", (now_ns() - start) / BENCH_FRAMES, CHANNELS);
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Host check of components/block_kernels: the block path against the scalar
+// reference for every kernel, over random data, every length up to 300 and
+// every start offset within a vector, then the time per sample of each path.
+// On the host the block path runs the portable lane code; the ESP32-S3 PIE
+// lanes are checked on target by CONFIG_GAS_BLOCK_KERNELS_BENCHMARK.
+//
+//   gcc -O2 -I../components/block_kernels -o block_kernels_check
+//       block_kernels_check.c ../components/block_kernels/block_kernels.c
+//   ./block_kernels_check
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "block_kernels.h"
+
+#define MAX_LEN     300
+#define BENCH_LEN   4096
+#define BENCH_ROUNDS 2000
+
+static int16_t buffer[MAX_LEN + BLOCK_LANES] __attribute__((aligned(BLOCK_ALIGN)));
+static int16_t bench[BENCH_LEN] __attribute__((aligned(BLOCK_ALIGN)));
+static int16_t out_scalar[BENCH_LEN];
+static int16_t out_block[BENCH_LEN];
+static block_fir_t fir;
+
+static uint32_t rng_state = 1;
+
+static uint32_t rng(void) {
+    rng_state = rng_state * 1664525u + 1013904223u;
+    return rng_state;
+}
+
+// Full range most of the time, extremes and a narrow band otherwise
+static int16_t random_sample(int mode) {
+    switch (mode) {
+        case 0:
+            return (int16_t)(rng() >> 16);
+        case 1:
+            return (rng() >> 31) ? INT16_MAX : INT16_MIN;
+        default:
+            return (int16_t)((int)(rng() >> 24) - 128);
+    }
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static long check_equivalence(void) {
+    long checks = 0;
+    long mismatches = 0;
+    for (int offset = 0; offset < BLOCK_LANES; offset++) {
+        int16_t *x = buffer + offset;
+        for (int n = 0; n <= MAX_LEN - offset; n++) {
+            int mode = n % 3;
+            for (int i = 0; i < n; i++) {
+                x[i] = random_sample(mode);
+            }
+            int16_t threshold = random_sample(mode);
+
+            int16_t min_a, max_a, min_b, max_b;
+            block_minmax_s16_scalar(x, n, &min_a, &max_a);
+            block_minmax_s16(x, n, &min_b, &max_b);
+            mismatches += block_sum_s16_scalar(x, n) != block_sum_s16(x, n);
+            mismatches += min_a != min_b || max_a != max_b;
+            mismatches += block_count_above_s16_scalar(x, n, threshold) != block_count_above_s16(x, n, threshold);
+            checks += 3;
+
+            int16_t coeffs[BLOCK_FIR_MAX_TAPS];
+            int taps = 1 + rng() % BLOCK_FIR_MAX_TAPS;
+            for (int k = 0; k < taps; k++) {
+                coeffs[k] = random_sample(mode == 1 ? 1 : 0);
+            }
+            block_fir_init(&fir, coeffs, taps, rng() % 24, 1 + rng() % 9);
+            int count_a = block_fir_run_scalar(&fir, x, n, out_scalar);
+            int count_b = block_fir_run(&fir, x, n, out_block);
+            mismatches += count_a != count_b || memcmp(out_scalar, out_block, count_a * sizeof(int16_t)) != 0;
+
+            block_decimate_init(&fir, 1 << (rng() % 6));
+            count_a = block_fir_run_scalar(&fir, x, n, out_scalar);
+            count_b = block_fir_run(&fir, x, n, out_block);
+            mismatches += count_a != count_b || memcmp(out_scalar, out_block, count_a * sizeof(int16_t)) != 0;
+            checks += 2;
+        }
+    }
+    printf("%ld checks, %ld mismatches\n\n", checks, mismatches);
+    return mismatches;
+}
+
+static volatile int32_t sink;
+
+#define TIME(label, expr) do { \
+        double start = now_ns(); \
+        for (int r = 0; r < BENCH_ROUNDS; r++) { \
+            sink += (int32_t)(expr); \
+        } \
+        ns[label] = (now_ns() - start) / ((double)BENCH_ROUNDS * BENCH_LEN); \
+    } while (0)
+
+static void report(const char *name, double scalar_ns, double block_ns) {
+    printf("%-10s %10.3f %10.3f %8.1fx\n", name, scalar_ns, block_ns, scalar_ns / block_ns);
+}
+
+int main(void) {
+    long mismatches = check_equivalence();
+
+    for (int i = 0; i < BENCH_LEN; i++) {
+        bench[i] = random_sample(0);
+    }
+    int16_t min, max;
+    double ns[2];
+    static const int16_t lowpass[16] = {
+        -120, -250, 0, 1100, 3000, 5200, 6900, 7600, 7600, 6900, 5200, 3000, 1100, 0, -250, -120
+    };
+
+    printf("%s path, %d samples, ns per input sample\n", block_kernels_path(), BENCH_LEN);
+    printf("%-10s %10s %10s %9s\n", "kernel", "scalar", "block", "speedup");
+    TIME(0, block_sum_s16_scalar(bench, BENCH_LEN));
+    TIME(1, block_sum_s16(bench, BENCH_LEN));
+    report("sum", ns[0], ns[1]);
+    TIME(0, (block_minmax_s16_scalar(bench, BENCH_LEN, &min, &max), min));
+    TIME(1, (block_minmax_s16(bench, BENCH_LEN, &min, &max), min));
+    report("minmax", ns[0], ns[1]);
+    TIME(0, block_count_above_s16_scalar(bench, BENCH_LEN, 1000));
+    TIME(1, block_count_above_s16(bench, BENCH_LEN, 1000));
+    report("threshold", ns[0], ns[1]);
+    block_fir_init(&fir, lowpass, 16, 15, 1);
+    TIME(0, block_fir_run_scalar(&fir, bench, BENCH_LEN, out_scalar));
+    TIME(1, block_fir_run(&fir, bench, BENCH_LEN, out_block));
+    report("fir16", ns[0], ns[1]);
+    block_decimate_init(&fir, 8);
+    TIME(0, block_fir_run_scalar(&fir, bench, BENCH_LEN, out_scalar));
+    TIME(1, block_fir_run(&fir, bench, BENCH_LEN, out_block));
+    report("decimate8", ns[0], ns[1]);
+
+    return mismatches != 0;
+}
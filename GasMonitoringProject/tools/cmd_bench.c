@@ -0,0 +1,597 @@
+// Per-command latency of the node's TCP command channel (components/gas_cmd)
+// under concurrent clients, on the host.
+//
+// A server thread follows tcp_server_task: one select() over the listening
+// socket, the client slots and an eventfd a producer thread writes to for
+// every frame it numbers into the gas_link ring, with commands answered as
+// they are read and pushed frames in between. HIST reads a gas_history
+// store of twelve hours of 5 s samples (the node's 128 blocks keep the last
+// 11 h) and, as on the node, is answered one slice of --slice seconds per
+// pass of the loop, later commands of the same client waiting behind it;
+// --slice 0 answers it in one go, as before. Frames are numbered every 50 ms
+// rather than 5 s, so pushes keep interleaving with the answers. 1, 2 and 4
+// clients (the node's slots) each send the command mix over loopback TCP
+// and wait for every answer; prints the round-trip p50, p99 and max per
+// command and the bytes each client received for it, pushed frames not
+// counted. Every HIST answer is compared with the same query run whole.
+//
+//   gcc -O2 -pthread -I../components/gas_cmd -I../components/gas_link
+//       -I../components/gas_history -I../components/gas_channels
+//       -I../components/fastfmt -o cmd_bench cmd_bench.c
+//       ../components/gas_cmd/gas_cmd.c ../components/gas_link/gas_link.c
+//       ../components/gas_history/gas_history.c
+//       ../components/gas_channels/gas_channels.c ../components/fastfmt/fastfmt.c -lm
+//   ./cmd_bench [--rounds 2000] [--slice 320] [--file /tmp/cmd_bench_history.bin]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "gas_cmd.h"
+#include "gas_link.h"
+#include "gas_history.h"
+
+#define MAX_CLIENTS      4          // NODE_MAX_CLIENTS
+#define RING_FRAMES      128        // CONFIG_GAS_LINK_RETX_FRAMES
+#define FRAME_PERIOD_US  50000
+#define HISTORY_RECORDS  8640       // 12 h at 5 s
+#define HISTORY_STEP_S   5
+#define HISTORY_BLOCKS   128        // HISTORY_BLOCKS on the node
+
+// The mix every client sends each round, answered in this order
+static const char *const commands[] = {
+    "NOW",
+    "STATS",
+    "SUB:ammonia,h2s",
+    "UNSUB:ALL",
+    "SUB:ALL",
+    "RATE:1000",
+    "RATE:0",
+    "HIST:ammonia:0:43200:100",
+    "HIST:co2:36000:43200",
+    "HIST:h2s:30000:36000:50",
+    "HIST:methane:0:4294967295",
+    "BOGUS",
+};
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+typedef struct {
+    bool active;
+    gas_history_cursor_t cursor;
+    uint32_t count;
+} hist_t;
+
+typedef struct {
+    int sock;
+    gas_link_lines_t requests;
+    uint32_t next_seq;
+    uint32_t rate_ms;
+    uint32_t last_push_ms;
+    uint32_t channels;
+    hist_t hist;
+} client_t;
+
+static gas_link_record_t records[RING_FRAMES];
+static gas_link_ring_t ring;
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static int wake_fd;
+static volatile int stopping;
+
+static gas_history_t history;
+static gas_history_hdr_t history_index[HISTORY_BLOCKS];
+static uint32_t slice_s = HISTORY_STEP_S * GAS_HISTORY_RECORDS_PER_BLOCK;    // HIST_SLICE_S
+
+// Expected answer of every HIST in the mix: the H: lines of the whole query
+static char *hist_expected[COMMAND_COUNT];
+static size_t hist_expected_len[COMMAND_COUNT];
+static unsigned hist_mismatches;
+static client_t clients[MAX_CLIENTS];
+static int client_count;
+static uint32_t commands_run;
+
+static uint32_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static gas_sample_t sample_at(uint32_t i) {
+    gas_sample_t sample = { .temperature = 70 + (i % 50) / 10.0f, .humidity = 40 + (i % 30),
+                            .ammonia = 10 + (i % 17) / 4.0f, .h2s = 0.2f + (i % 9) / 20.0f,
+                            .co2 = 700 + (i % 200), .methane = 150 + (i % 40) };
+    return sample;
+}
+
+// link_push() and its eventfd wakeup, at the frame cadence
+static void *producer(void *arg) {
+    for (uint32_t i = 0; !stopping; i++) {
+        gas_sample_t sample = sample_at(i);
+        pthread_mutex_lock(&ring_lock);
+        gas_link_ring_push(&ring, &sample, 0, (int64_t)now_ms());
+        pthread_mutex_unlock(&ring_lock);
+        uint64_t pushed = 1;
+        if (write(wake_fd, &pushed, sizeof(pushed)) < 0) {
+            perror("eventfd");
+        }
+        usleep(FRAME_PERIOD_US);
+    }
+    return NULL;
+}
+
+static bool client_send(client_t *client, const char *buf, int len) {
+    return send(client->sock, buf, len, MSG_NOSIGNAL) == len;
+}
+
+static bool client_printf(client_t *client, const char *fmt, ...) {
+    char line[160];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    line[len++] = '\n';
+    return client_send(client, line, len);
+}
+
+static bool send_record(client_t *client, const gas_link_record_t *record) {
+    char frame[128 + GAS_LINK_SUFFIX_LEN + 1];
+    int len = gas_link_format(record, client->channels, 0x1234, frame, sizeof(frame) - 1);
+    frame[len++] = '\n';
+    return client_send(client, frame, len);
+}
+
+typedef struct {
+    client_t *client;
+    char buf[512];
+    int len;
+    uint32_t count;
+    bool failed;
+} hist_writer_t;
+
+static bool hist_write_point(uint32_t timestamp, float value, void *ctx) {
+    hist_writer_t *writer = ctx;
+    if (writer->len > (int)sizeof(writer->buf) - 32) {
+        if (!client_send(writer->client, writer->buf, writer->len)) {
+            writer->failed = true;
+            return false;
+        }
+        writer->len = 0;
+    }
+    writer->len += snprintf(writer->buf + writer->len, sizeof(writer->buf) - writer->len, "H:%" PRIu32 ":%.2f\n",
+                            timestamp, value);
+    writer->count++;
+    return true;
+}
+
+// client_history_step(): the next slice, "OK:HIST:<count>" after the last
+static bool client_history_step(client_t *client) {
+    static hist_writer_t writer;
+    hist_t *hist = &client->hist;
+    writer.client = client;
+    writer.len = 0;
+    writer.count = 0;
+    writer.failed = false;
+    hist->active = gas_history_cursor_next(&history, &hist->cursor, slice_s, hist_write_point, &writer);
+    if (writer.failed || (writer.len > 0 && !client_send(client, writer.buf, writer.len))) {
+        return false;
+    }
+    hist->count += writer.count;
+    return hist->active || client_printf(client, "OK:HIST:%" PRIu32, hist->count);
+}
+
+static bool client_history(client_t *client, const gas_cmd_t *cmd) {
+    hist_t *hist = &client->hist;
+    hist->count = 0;
+    hist->active = gas_history_cursor_init(&history, &hist->cursor, cmd->channel, cmd->first, cmd->last, cmd->value);
+    return hist->active ? client_history_step(client) : client_printf(client, "OK:HIST:0");
+}
+
+static bool client_command(client_t *client, const char *line) {
+    gas_cmd_t cmd;
+    commands_run++;
+    if (!gas_cmd_parse(line, &cmd)) {
+        return client_printf(client, "ERR:%s", gas_cmd_name(cmd.id));
+    }
+    char frame[8 + 128 + 1];
+    gas_sample_t sample;
+    int len;
+    switch (cmd.id) {
+    case GAS_CMD_NOW:
+        sample = sample_at(ring.next_seq);
+        len = snprintf(frame, sizeof(frame), "OK:NOW:");
+        len += gas_frame_format_channels(&sample, client->channels, frame + len, sizeof(frame) - 1 - len);
+        frame[len++] = '\n';
+        return client_send(client, frame, len);
+    case GAS_CMD_RATE:
+        client->rate_ms = cmd.value;
+        client->last_push_ms = 0;
+        return cmd.value == GAS_CMD_RATE_OFF ? client_printf(client, "OK:RATE:OFF")
+                                             : client_printf(client, "OK:RATE:%" PRIu32, cmd.value);
+    case GAS_CMD_SUB:
+        client->channels |= cmd.channels;
+        return client_printf(client, "OK:SUB:%" PRIx32, client->channels);
+    case GAS_CMD_UNSUB:
+        client->channels &= ~cmd.channels;
+        return client_printf(client, "OK:SUB:%" PRIx32, client->channels);
+    case GAS_CMD_HIST:
+        return client_history(client, &cmd);
+    case GAS_CMD_STATS:
+        pthread_mutex_lock(&ring_lock);
+        uint32_t newest = ring.next_seq - 1, oldest = gas_link_ring_oldest(&ring);
+        pthread_mutex_unlock(&ring_lock);
+        return client_printf(client,
+                             "STATS:uptime_ms=%" PRIu32 ",boot=1234,seq=%" PRIu32 ",oldest=%" PRIu32 ",clients=%d,"
+                             "frames_sent=0,retransmits=0,anomalies=0,commands=%" PRIu32 ",free_heap=150000",
+                             now_ms(), newest, oldest, client_count, commands_run);
+    default:
+        return true;
+    }
+}
+
+static bool client_answer(client_t *client) {
+    for (char *line; !client->hist.active && (line = gas_link_lines_next(&client->requests)) != NULL;) {
+        if (!client_command(client, line)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool client_serve(client_t *client) {
+    while (!client->hist.active) {
+        size_t avail;
+        char *space = gas_link_lines_space(&client->requests, &avail);
+        int len = recv(client->sock, space, avail, MSG_DONTWAIT);
+        if (len == 0) {
+            return false;
+        }
+        if (len < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        gas_link_lines_commit(&client->requests, len);
+        if (!client_answer(client)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool client_continue(client_t *client) {
+    return !client->hist.active || (client_history_step(client) && client_answer(client));
+}
+
+static bool client_push(client_t *client, uint32_t now) {
+    pthread_mutex_lock(&ring_lock);
+    uint32_t oldest = gas_link_ring_oldest(&ring);
+    uint32_t newest = ring.next_seq - 1;
+    pthread_mutex_unlock(&ring_lock);
+    if (client->next_seq < oldest) {
+        client->next_seq = oldest;
+    }
+    if (client->next_seq > newest) {
+        return true;
+    }
+    if (client->rate_ms == GAS_CMD_RATE_OFF || client->channels == 0) {
+        client->next_seq = newest + 1;
+        return true;
+    }
+    if (client->rate_ms > 0) {
+        if (client->last_push_ms != 0 && now - client->last_push_ms < client->rate_ms) {
+            return true;
+        }
+        client->next_seq = newest;
+        client->last_push_ms = now;
+    }
+    while (client->next_seq <= newest) {
+        gas_link_record_t record;
+        pthread_mutex_lock(&ring_lock);
+        const gas_link_record_t *held = gas_link_ring_get(&ring, client->next_seq);
+        if (held != NULL) {
+            record = *held;
+        }
+        pthread_mutex_unlock(&ring_lock);
+        if (held == NULL) {
+            break;
+        }
+        if (!send_record(client, &record)) {
+            return false;
+        }
+        client->next_seq++;
+    }
+    return true;
+}
+
+static int32_t client_wait_ms(uint32_t now) {
+    int32_t wait_ms = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        const client_t *client = &clients[i];
+        if (client->sock >= 0 && client->hist.active) {
+            return 0;
+        }
+        if (client->sock < 0 || client->rate_ms == 0 || client->rate_ms == GAS_CMD_RATE_OFF ||
+            client->next_seq >= ring.next_seq) {
+            continue;
+        }
+        uint32_t elapsed = now - client->last_push_ms;
+        int32_t due = elapsed >= client->rate_ms ? 0 : (int32_t)(client->rate_ms - elapsed);
+        if (wait_ms < 0 || due < wait_ms) {
+            wait_ms = due;
+        }
+    }
+    return wait_ms;
+}
+
+// tcp_server_task's loop
+static void *server(void *arg) {
+    int listen_sock = *(int *)arg;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i].sock = -1;
+    }
+    while (!stopping) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listen_sock, &readable);
+        FD_SET(wake_fd, &readable);
+        int max_fd = listen_sock > wake_fd ? listen_sock : wake_fd;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (clients[i].sock >= 0) {
+                FD_SET(clients[i].sock, &readable);
+                max_fd = clients[i].sock > max_fd ? clients[i].sock : max_fd;
+            }
+        }
+        int32_t wait_ms = client_wait_ms(now_ms());
+        if (wait_ms < 0 || wait_ms > 100) {
+            wait_ms = 100; // to notice `stopping`
+        }
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = wait_ms * 1000 };
+        if (select(max_fd + 1, &readable, NULL, NULL, &timeout) < 0) {
+            perror("select");
+            exit(1);
+        }
+        if (FD_ISSET(wake_fd, &readable)) {
+            uint64_t pushed;
+            if (read(wake_fd, &pushed, sizeof(pushed)) < 0) {
+                perror("eventfd");
+            }
+        }
+        if (FD_ISSET(listen_sock, &readable)) {
+            int sock = accept(listen_sock, NULL, NULL);
+            client_t *client = NULL;
+            for (int i = 0; i < MAX_CLIENTS && client == NULL; i++) {
+                if (clients[i].sock < 0) {
+                    client = &clients[i];
+                }
+            }
+            if (client == NULL) {
+                close(sock);
+            } else {
+                int one = 1;
+                setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                memset(client, 0, sizeof(*client));
+                client->sock = sock;
+                client->next_seq = ring.next_seq > 1 ? ring.next_seq - 1 : 1;
+                client->channels = GAS_CH_ALL;
+                client_count++;
+            }
+        }
+        uint32_t now = now_ms();
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            client_t *client = &clients[i];
+            if (client->sock < 0) {
+                continue;
+            }
+            bool alive = client_continue(client) && (!FD_ISSET(client->sock, &readable) || client_serve(client));
+            if (!alive || !client_push(client, now)) {
+                close(client->sock);
+                client->sock = -1;
+                client_count--;
+            }
+        }
+    }
+    return NULL;
+}
+
+typedef struct {
+    struct sockaddr_in addr;
+    int rounds;
+    double *rtt_us[COMMAND_COUNT];      // per round
+    uint64_t answer_bytes[COMMAND_COUNT];
+    uint64_t pushed_frames;
+} bench_client_t;
+
+// Sends each command of the mix and reads until its last answer line,
+// counting the pushed frames that come in between and checking the HIST
+// points against the whole query
+static void *bench_client(void *arg) {
+    bench_client_t *bench = arg;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(sock, (struct sockaddr *)&bench->addr, sizeof(bench->addr)) != 0) {
+        perror("connect");
+        exit(1);
+    }
+    static __thread gas_link_lines_t lines;
+    lines.start = lines.len = 0;
+    size_t points_size = 1 << 20;
+    char *points = malloc(points_size);
+    for (int r = 0; r < bench->rounds; r++) {
+        for (int c = 0; c < COMMAND_COUNT; c++) {
+            char request[64];
+            int len = snprintf(request, sizeof(request), "%s\n", commands[c]);
+            double start = now_us();
+            if (send(sock, request, len, 0) != len) {
+                perror("send");
+                exit(1);
+            }
+            bool done = false;
+            size_t points_len = 0;
+            while (!done) {
+                char *line;
+                while (!done && (line = gas_link_lines_next(&lines)) != NULL) {
+                    if (strstr(line, ",S:") != NULL) {
+                        bench->pushed_frames++;
+                        continue;
+                    }
+                    size_t line_len = strlen(line);
+                    bench->answer_bytes[c] += line_len + 1;
+                    done = strncmp(line, "H:", 2) != 0;
+                    if (!done && points_len + line_len + 1 <= points_size) {
+                        memcpy(points + points_len, line, line_len);
+                        points[points_len + line_len] = '\n';
+                    }
+                    points_len += done ? 0 : line_len + 1;
+                }
+                if (done) {
+                    break;
+                }
+                size_t avail;
+                char *space = gas_link_lines_space(&lines, &avail);
+                int n = recv(sock, space, avail, 0);
+                if (n <= 0) {
+                    fprintf(stderr, "connection lost\n");
+                    exit(1);
+                }
+                gas_link_lines_commit(&lines, n);
+            }
+            bench->rtt_us[c][r] = now_us() - start;
+            if (hist_expected[c] != NULL &&
+                (points_len != hist_expected_len[c] || memcmp(points, hist_expected[c], points_len) != 0)) {
+                __atomic_add_fetch(&hist_mismatches, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    free(points);
+    close(sock);
+    return NULL;
+}
+
+static bool append_point(uint32_t timestamp, float value, void *ctx) {
+    int c = *(int *)ctx;
+    hist_expected[c] = realloc(hist_expected[c], hist_expected_len[c] + 32);
+    hist_expected_len[c] += snprintf(hist_expected[c] + hist_expected_len[c], 32, "H:%" PRIu32 ":%.2f\n",
+                                     timestamp, value);
+    return true;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const struct sockaddr_in *addr, int client_count_wanted, int rounds) {
+    bench_client_t bench[MAX_CLIENTS];
+    pthread_t threads[MAX_CLIENTS];
+    for (int i = 0; i < client_count_wanted; i++) {
+        memset(&bench[i], 0, sizeof(bench[i]));
+        bench[i].addr = *addr;
+        bench[i].rounds = rounds;
+        for (int c = 0; c < COMMAND_COUNT; c++) {
+            bench[i].rtt_us[c] = calloc(rounds, sizeof(double));
+        }
+        pthread_create(&threads[i], NULL, bench_client, &bench[i]);
+    }
+    uint64_t pushed = 0;
+    for (int i = 0; i < client_count_wanted; i++) {
+        pthread_join(threads[i], NULL);
+        pushed += bench[i].pushed_frames;
+    }
+
+    printf("%d client%s, %" PRIu64 " frames pushed in between\n", client_count_wanted,
+           client_count_wanted > 1 ? "s" : "", pushed);
+    double *all = calloc((size_t)rounds * client_count_wanted, sizeof(double));
+    for (int c = 0; c < COMMAND_COUNT; c++) {
+        uint64_t bytes = 0;
+        for (int i = 0; i < client_count_wanted; i++) {
+            memcpy(all + (size_t)i * rounds, bench[i].rtt_us[c], rounds * sizeof(double));
+            bytes += bench[i].answer_bytes[c];
+            free(bench[i].rtt_us[c]);
+        }
+        size_t n = (size_t)rounds * client_count_wanted;
+        qsort(all, n, sizeof(double), compare_doubles);
+        printf("  %-26s %8.1f %8.1f %8.1f %9.0f\n", commands[c], all[n / 2], all[n * 99 / 100], all[n - 1],
+               (double)bytes / n);
+    }
+    free(all);
+}
+
+int main(int argc, char **argv) {
+    int rounds = 2000;
+    const char *path = "/tmp/cmd_bench_history.bin";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--slice") == 0 && i + 1 < argc) {
+            slice_s = strtoul(argv[++i], NULL, 10);
+            if (slice_s == 0) {
+                slice_s = UINT32_MAX; // the whole range in one slice
+            }
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        }
+    }
+    remove(path);
+    if (!gas_history_open(&history, path, history_index, HISTORY_BLOCKS)) {
+        perror(path);
+        return 1;
+    }
+    for (uint32_t i = 0; i < HISTORY_RECORDS; i++) {
+        gas_sample_t sample = sample_at(i);
+        gas_history_append(&history, i * HISTORY_STEP_S, &sample);
+    }
+    for (int c = 0; c < (int)COMMAND_COUNT; c++) {
+        gas_cmd_t cmd;
+        if (gas_cmd_parse(commands[c], &cmd) && cmd.id == GAS_CMD_HIST) {
+            hist_expected[c] = malloc(1);
+            gas_history_query(&history, cmd.channel, cmd.first, cmd.last, cmd.value, append_point, &c);
+        }
+    }
+    gas_link_ring_init(&ring, records, RING_FRAMES);
+    wake_fd = eventfd(0, 0);
+
+    int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_sock, MAX_CLIENTS) != 0 ||
+        getsockname(listen_sock, (struct sockaddr *)&addr, &addr_len) != 0) {
+        perror("listen");
+        return 1;
+    }
+    pthread_t producer_thread, server_thread;
+    pthread_create(&producer_thread, NULL, producer, NULL);
+    pthread_create(&server_thread, NULL, server, &listen_sock);
+
+    printf("%d rounds of %zu commands per client, a frame every %d ms, HIST ", rounds, COMMAND_COUNT,
+           FRAME_PERIOD_US / 1000);
+    if (slice_s < UINT32_MAX) {
+        printf("in slices of %u s\n\n", (unsigned)slice_s);
+    } else {
+        printf("whole\n\n");
+    }
+    printf("  %-26s %8s %8s %8s %9s\n", "command", "p50 us", "p99 us", "max us", "bytes");
+    for (int n = 1; n <= MAX_CLIENTS; n *= 2) {
+        run(&addr, n, rounds);
+    }
+    stopping = 1;
+    pthread_join(server_thread, NULL);
+    pthread_join(producer_thread, NULL);
+    gas_history_close(&history);
+    printf("\nHIST answers differing from the whole query: %u\n", hist_mismatches);
+    return hist_mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,103 @@
+// Host check and benchmark for components/fastfmt.
+//
+// Compares fastfmt_fixed2() against the C library's snprintf("%.2f") for a
+// sweep of float values, then times a six-value sample frame built both ways.
+//
+//   gcc -O2 -I../components/fastfmt fastfmt_bench.c ../components/fastfmt/fastfmt.c -o fastfmt_bench
+//   ./fastfmt_bench
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "fastfmt.h"
+
+#define FRAME_ROUNDS 1000000
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int check(float value) {
+    char fast[64];
+    char slow[64];
+    fastfmt_t f;
+    fastfmt_begin(&f, fast, sizeof(fast));
+    fastfmt_fixed2(&f, value);
+    fastfmt_end(&f);
+    snprintf(slow, sizeof(slow), "%.2f", value);
+    if (strcmp(fast, slow) != 0) {
+        printf("MISMATCH %a: fastfmt \"%s\", snprintf \"%s\"\n", value, fast, slow);
+        return 1;
+    }
+    return 0;
+}
+
+static int frame_fast(char *buf, size_t size, const float *v) {
+    fastfmt_t f;
+    fastfmt_begin(&f, buf, size);
+    fastfmt_str(&f, "Temp:");
+    fastfmt_fixed2(&f, v[0]);
+    fastfmt_str(&f, ",Humidity:");
+    fastfmt_fixed2(&f, v[1]);
+    fastfmt_str(&f, ",NH3:");
+    fastfmt_fixed2(&f, v[2]);
+    fastfmt_str(&f, ",H2S:");
+    fastfmt_fixed2(&f, v[3]);
+    fastfmt_str(&f, ",CO2:");
+    fastfmt_fixed2(&f, v[4]);
+    fastfmt_str(&f, ",CH4:");
+    fastfmt_fixed2(&f, v[5]);
+    return fastfmt_end(&f);
+}
+
+static int frame_slow(char *buf, size_t size, const float *v) {
+    return snprintf(buf, size, "Temp:%.2f,Humidity:%.2f,NH3:%.2f,H2S:%.2f,CO2:%.2f,CH4:%.2f",
+                    v[0], v[1], v[2], v[3], v[4], v[5]);
+}
+
+int main(void) {
+    int failures = 0;
+    long checked = 0;
+
+    // Every float bit pattern with a stride, both signs, plus exact ties
+    for (uint64_t bits = 0; bits <= 0xFFFFFFFFu; bits += 997) {
+        uint32_t word = (uint32_t)bits;
+        float value;
+        memcpy(&value, &word, sizeof(value));
+        failures += check(value);
+        checked++;
+    }
+    for (int cents = -100000; cents <= 100000; cents++) {
+        failures += check(cents / 100.0f);
+        failures += check(cents / 100.0f + 0.005f);
+        failures += check(cents / 8.0f);
+        checked += 3;
+    }
+    printf("%ld values checked, %d mismatches\n", checked, failures);
+
+    const float values[6] = { 71.27f, 43.61f, 12.345f, 0.125f, 415.5f, -0.004f };
+    char fast[128];
+    char slow[128];
+    volatile int sink = 0;
+
+    double start = now_s();
+    for (int i = 0; i < FRAME_ROUNDS; i++) {
+        sink += frame_fast(fast, sizeof(fast), values);
+    }
+    double fast_s = now_s() - start;
+
+    start = now_s();
+    for (int i = 0; i < FRAME_ROUNDS; i++) {
+        sink += frame_slow(slow, sizeof(slow), values);
+    }
+    double slow_s = now_s() - start;
+
+    printf("frame: %s\n", fast);
+    printf("fastfmt %.1f ns/frame, snprintf %.1f ns/frame, %.1fx faster, output %s\n",
+           fast_s * 1e9 / FRAME_ROUNDS, slow_s * 1e9 / FRAME_ROUNDS, slow_s / fast_s,
+           strcmp(fast, slow) == 0 ? "identical" : "DIFFERENT");
+    return failures != 0;
+}
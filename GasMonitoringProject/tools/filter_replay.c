@@ -0,0 +1,162 @@
+// Replay of sensor_data.csv through every gas filter (components/gas_filter).
+//
+// For each gas channel and filter kind prints the host time per sample, how
+// much the output still moves from sample to sample (mean |step|, as a share
+// of the raw signal's) and the mean distance from the raw values. With
+// --dump the filtered series for the chosen kinds is written as CSV instead.
+//
+//   gcc -O2 -I../components/gas_filter -I../components/gas_channels
+//       -I../components/fastfmt -o filter_replay filter_replay.c
+//       ../components/gas_filter/gas_filter.c
+//       ../components/gas_channels/gas_channels.c ../components/fastfmt/fastfmt.c -lm
+//   ./filter_replay [--file ../TempSensor/partition/sensor_data.csv] [--window 9]
+//                   [--shift 3] [--dump]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gas_filter.h"
+#include "gas_channels.h"
+
+#define MAX_ROWS 8192
+#define REPEAT   200    // passes over the file when timing
+
+static const gas_channel_t gas_inputs[] = { GAS_CH_AMMONIA, GAS_CH_H2S, GAS_CH_CO2, GAS_CH_METHANE };
+#define GAS_INPUT_COUNT (sizeof(gas_inputs) / sizeof(gas_inputs[0]))
+
+// Kalman noise levels, the same as the node's ADC jobs
+static const float kalman_q[GAS_CH_COUNT] = { [GAS_CH_AMMONIA] = 1.0f, [GAS_CH_H2S] = 0.04f, [GAS_CH_CO2] = 4.0f, [GAS_CH_METHANE] = 1.0f };
+static const float kalman_r[GAS_CH_COUNT] = { [GAS_CH_AMMONIA] = 25.0f, [GAS_CH_H2S] = 1.0f, [GAS_CH_CO2] = 400.0f, [GAS_CH_METHANE] = 100.0f };
+
+// Node defaults from the Kconfig
+static const gas_filter_kind_t default_kinds[GAS_CH_COUNT] = {
+    [GAS_CH_AMMONIA] = GAS_FILTER_MEDIAN, [GAS_CH_H2S] = GAS_FILTER_MEDIAN,
+    [GAS_CH_CO2] = GAS_FILTER_KALMAN, [GAS_CH_METHANE] = GAS_FILTER_EWMA,
+};
+
+static gas_sample_t rows[MAX_ROWS];
+static gas_fixed_t input[MAX_ROWS];
+static gas_fixed_t output[MAX_ROWS];
+
+static int load_rows(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int count = 0;
+    fgets(line, sizeof(line), file); // header
+    while (count < MAX_ROWS && fgets(line, sizeof(line), file) != NULL) {
+        if (gas_csv_parse(line, &rows[count], NULL) > 0) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(gas_filter_t *filter, const gas_filter_config_t *config, int count) {
+    gas_filter_init(filter, config);
+    for (int i = 0; i < count; i++) {
+        output[i] = gas_filter_step(filter, input[i]);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *path = "../TempSensor/partition/sensor_data.csv";
+    int window = 9;
+    int shift = 3;
+    int dump = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            window = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shift") == 0 && i + 1 < argc) {
+            shift = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dump") == 0) {
+            dump = 1;
+        }
+    }
+
+    int count = load_rows(path);
+    if (count <= 1) {
+        fprintf(stderr, "no rows in %s\n", path);
+        return 1;
+    }
+
+    static gas_filter_t filter;
+    if (dump) {
+        static float filtered[GAS_CH_COUNT][MAX_ROWS];
+        for (int c = 0; c < GAS_INPUT_COUNT; c++) {
+            gas_channel_t ch = gas_inputs[c];
+            gas_filter_config_t config = { .kind = default_kinds[ch], .window = window, .ewma_shift = shift,
+                                           .kalman_q = kalman_q[ch], .kalman_r = kalman_r[ch] };
+            for (int i = 0; i < count; i++) {
+                input[i] = gas_fixed_from_float(rows[i].values[ch]);
+            }
+            run(&filter, &config, count);
+            for (int i = 0; i < count; i++) {
+                filtered[ch][i] = gas_fixed_to_float(output[i]);
+            }
+        }
+        printf("row");
+        for (int c = 0; c < GAS_INPUT_COUNT; c++) {
+            const char *name = gas_channel_names[gas_inputs[c]];
+            printf(",%s,%s_%s", name, name, gas_filter_kind_name(default_kinds[gas_inputs[c]]));
+        }
+        printf("\n");
+        for (int i = 0; i < count; i++) {
+            printf("%d", i);
+            for (int c = 0; c < GAS_INPUT_COUNT; c++) {
+                printf(",%.2f,%.2f", rows[i].values[gas_inputs[c]], filtered[gas_inputs[c]][i]);
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    printf("%d rows from %s, window %d, EWMA shift %d\n\n", count, path, window, shift);
+    printf("%-8s %-15s %10s %12s %12s\n", "channel", "filter", "ns/sample", "step ratio", "mean |y-x|");
+    for (int c = 0; c < GAS_INPUT_COUNT; c++) {
+        gas_channel_t ch = gas_inputs[c];
+        double raw_step = 0;
+        for (int i = 0; i < count; i++) {
+            input[i] = gas_fixed_from_float(rows[i].values[ch]);
+            if (i > 0) {
+                raw_step += fabs(gas_fixed_to_float(input[i]) - gas_fixed_to_float(input[i - 1]));
+            }
+        }
+
+        for (int kind = GAS_FILTER_NONE; kind <= GAS_FILTER_MEDIAN; kind++) {
+            gas_filter_config_t config = { .kind = kind, .window = window, .ewma_shift = shift,
+                                           .kalman_q = kalman_q[ch], .kalman_r = kalman_r[ch] };
+            double start = now_ns();
+            for (int r = 0; r < REPEAT; r++) {
+                run(&filter, &config, count);
+            }
+            double ns = (now_ns() - start) / ((double)REPEAT * count);
+
+            double step = 0, distance = 0;
+            for (int i = 0; i < count; i++) {
+                distance += fabs(gas_fixed_to_float(output[i]) - gas_fixed_to_float(input[i]));
+                if (i > 0) {
+                    step += fabs(gas_fixed_to_float(output[i]) - gas_fixed_to_float(output[i - 1]));
+                }
+            }
+            printf("%-8s %-15s %10.1f %12.3f %12.2f\n", gas_channel_names[ch], gas_filter_kind_name(kind), ns,
+                   raw_step > 0 ? step / raw_step : 0.0, distance / count);
+        }
+        printf("\n");
+    }
+    return 0;
+}
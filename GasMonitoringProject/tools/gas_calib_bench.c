@@ -0,0 +1,141 @@
+// Accuracy and speed of the Rs/R0 to ppm tables (components/gas_calib)
+// against the log10()/pow() conversion on the datasheet segments.
+//
+// For each sensor sweeps Rs/R0 log-uniformly over its table and prints the
+// largest and rms relative ppm error, then does the same from converter
+// codes (12-bit codes in the front end's Q8 format) over the divider's
+// working range, which adds the integer Rs/R0 step. The last columns are
+// the host time per sample of the table path and of the reference, both
+// starting from a code. Also checks that a clean-air calibration recovers
+// the R0 it was given.
+//
+//   python3 ../components/gas_calib/gas_calib_gen.py ../components/gas_calib/gas_calib_curves.csv
+//       gas_calib_tables.h
+//   gcc -O2 -I. -I../components/gas_calib -o gas_calib_bench gas_calib_bench.c
+//       ../components/gas_calib/gas_calib.c -lm
+//   ./gas_calib_bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "gas_calib.h"
+
+#define SWEEP_POINTS  100000
+#define FULL_SCALE    (4096 << 8)
+#define BENCH_SAMPLES 4096
+#define BENCH_REPEAT  200
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void track(double table, double reference, double *max_pct, double *sq, long *n) {
+    double error = 100.0 * (table - reference) / reference;
+    if (fabs(error) > *max_pct) {
+        *max_pct = fabs(error);
+    }
+    *sq += error * error;
+    (*n)++;
+}
+
+// Over the grid, from exact Q16 ratios
+static void sweep_ratio(gas_calib_sensor_t sensor, double *max_pct, double *rms_pct) {
+    const gas_calib_curve_t *curve = gas_calib_curve(sensor);
+    double lo = curve->grid_first / 65536.0;
+    double hi = lo + (curve->grid_points - 1) / 16.0;
+    double sq = 0;
+    long n = 0;
+    *max_pct = 0;
+    for (int i = 0; i < SWEEP_POINTS; i++) {
+        uint32_t ratio = (uint32_t)lround(exp2(lo + (hi - lo) * i / (SWEEP_POINTS - 1)) * 65536);
+        double table = gas_calib_ppm(sensor, ratio) / 256.0;
+        track(table, gas_calib_reference_ppm(sensor, ratio / 65536.0f), max_pct, &sq, &n);
+    }
+    *rms_pct = sqrt(sq / n);
+}
+
+// From codes whose ratio falls inside the grid; ppm below 0.5 is left out,
+// where the Q8 output step alone is more than a percent
+static void sweep_code(gas_calib_sensor_t sensor, double *max_pct, double *rms_pct) {
+    const gas_calib_curve_t *curve = gas_calib_curve(sensor);
+    double lo = curve->grid_first / 65536.0;
+    double hi = lo + (curve->grid_points - 1) / 16.0;
+    double sq = 0;
+    long n = 0;
+    *max_pct = 0;
+    for (int32_t code = FULL_SCALE / 64; code < FULL_SCALE - FULL_SCALE / 64; code += 7) {
+        double rs = (double)curve->load_ohms * (FULL_SCALE - code) / code;
+        double ratio = rs / gas_calib_r0(sensor);
+        if (log2(ratio) < lo || log2(ratio) > hi) {
+            continue;
+        }
+        double reference = gas_calib_reference_ppm(sensor, (float)ratio);
+        if (reference < 0.5) {
+            continue;
+        }
+        track(gas_calib_ppm_from_code(sensor, code, FULL_SCALE) / 256.0, reference, max_pct, &sq, &n);
+    }
+    *rms_pct = n > 0 ? sqrt(sq / n) : 0;
+}
+
+int main(void) {
+    gas_calib_init();
+    static int32_t codes[BENCH_SAMPLES];
+    srand(1);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        codes[i] = FULL_SCALE / 16 + rand() % (FULL_SCALE * 7 / 8);
+    }
+
+    int errors = 0;
+    printf("%-6s %10s %10s %10s %10s %9s %9s\n", "sensor", "ratio max%", "ratio rms%", "code max%", "code rms%",
+           "table ns", "pow ns");
+    for (int sensor = 0; sensor < GAS_CALIB_SENSORS; sensor++) {
+        const gas_calib_curve_t *curve = gas_calib_curve(sensor);
+        double ratio_max, ratio_rms, code_max, code_rms;
+        sweep_ratio(sensor, &ratio_max, &ratio_rms);
+        sweep_code(sensor, &code_max, &code_rms);
+
+        volatile int32_t sink = 0;
+        double start = now_ns();
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            for (int i = 0; i < BENCH_SAMPLES; i++) {
+                sink = gas_calib_ppm_from_code(sensor, codes[i], FULL_SCALE);
+            }
+        }
+        double table_ns = (now_ns() - start) / ((double)BENCH_REPEAT * BENCH_SAMPLES);
+
+        volatile float reference = 0;
+        float r0 = gas_calib_r0(sensor);
+        start = now_ns();
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            for (int i = 0; i < BENCH_SAMPLES; i++) {
+                float rs = (float)curve->load_ohms * (FULL_SCALE - codes[i]) / codes[i];
+                reference = gas_calib_reference_ppm(sensor, rs / r0);
+            }
+        }
+        double pow_ns = (now_ns() - start) / ((double)BENCH_REPEAT * BENCH_SAMPLES);
+        (void)sink;
+        (void)reference;
+
+        printf("%-6s %10.3f %10.3f %10.3f %10.3f %9.1f %9.1f\n", curve->name, ratio_max, ratio_rms, code_max,
+               code_rms, table_ns, pow_ns);
+
+        // Clean air at a different R0: the code the divider would give
+        // there must calibrate back to that R0
+        uint32_t r0_true = curve->r0_ohms * 3 / 2;
+        double rs = curve->clean_air_ratio * r0_true;
+        int32_t code = (int32_t)lround((double)FULL_SCALE * curve->load_ohms /(rs + curve->load_ohms));
+        uint32_t r0_found = 0;
+        if (gas_calib_zero(sensor, code, FULL_SCALE, &r0_found) != ESP_OK ||
+            fabs((double)r0_found - r0_true) > r0_true * 0.001) {
+            printf("  clean-air calibration: R0 %u, expected %u\n", (unsigned)r0_found, (unsigned)r0_true);
+            errors++;
+        }
+        gas_calib_set_r0(sensor, curve->r0_ohms);
+    }
+    printf("\n%s\n", errors == 0 ? "calibration check passed" : "CALIBRATION CHECK FAILED");
+    return errors != 0;
+}
@@ -0,0 +1,295 @@
+// Host check of the channel registry (components/gas_channels) against the
+// hand-written code it replaced.
+//
+// Encoders: the TCP frame, UART line and JSON body of every sample are
+// compared byte for byte with snprintf() and the old format strings.
+// Samples are the sensor_data.csv rows with a temperature and humidity
+// added, plus random values over each channel's range.
+//
+// Parsers: gas_frame_parse() against the old sscanf() of the gateway, on
+// every frame above, on frames cut short at every byte and on frames with a
+// trace suffix. gas_csv_parse() against the old sscanf() of
+// read_sensor_data_csv(), on every row of sensor_data.csv: the four values
+// and the four chip-select flags.
+//
+// Records: every sample is packed as the history stores it and unpacked. A
+// value read back from a frame (two decimals) has to give the same frame
+// again (as values: -0.00 comes back as 0.00), and any value has to come
+// back within half a unit of its scale, clamped to its packed type.
+//
+//   gcc -O2 -I../components/gas_channels -I../components/fastfmt
+//       -o gas_channels_check gas_channels_check.c
+//       ../components/gas_channels/gas_channels.c ../components/fastfmt/fastfmt.c -lm
+//   ./gas_channels_check [--csv ../TempSensor/sensor_data.csv]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "gas_channels.h"
+
+#define RANDOM_SAMPLES  200000
+#define MAX_ROWS        4096
+
+#define OLD_FRAME_FORMAT "Temp:%.2f,Humidity:%.2f,NH3:%.2f,H2S:%.2f,CO2:%.2f,CH4:%.2f"
+#define OLD_UART_FORMAT  "Temp: %.2f, Humidity: %.2f, NH3: %.2f, H2S: %.2f, CO2: %.2f, CH4: %.2f\n"
+#define OLD_JSON_FORMAT  "{\"temperature\":%.2f,\"humidity\":%.2f,\"ammonia\":%.2f,\"h2s\":%.2f," \
+                         "\"co2\":%.2f,\"methane\":%.2f}"
+#define OLD_CSV_FORMAT   "%*[^,],%f,%f,%f,%f,%f,%f,%f,%f"
+
+typedef struct {
+    const char *name;
+    long checked;
+    long mismatches;
+} tally_t;
+
+static tally_t frame_tally = { .name = "TCP frame" };
+static tally_t uart_tally = { .name = "UART line" };
+static tally_t json_tally = { .name = "JSON body" };
+static tally_t parse_tally = { .name = "frame parse" };
+static tally_t csv_tally = { .name = "CSV row" };
+static tally_t record_tally = { .name = "record round trip" };
+static tally_t clamp_tally = { .name = "record clamping" };
+
+static gas_sample_t samples[MAX_ROWS + RANDOM_SAMPLES];
+static int sample_count;
+static int csv_rows;
+
+static uint32_t rng = 88172645u;
+
+static uint32_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static float random_between(float lo, float hi) {
+    return lo + (hi - lo) * (float)(next_random() >> 8) / (float)(1u << 24);
+}
+
+static void tally(tally_t *t, bool ok, const char *got, const char *want) {
+    t->checked++;
+    if (!ok) {
+        if (t->mismatches++ < 3) {
+            printf("  %s: got \"%s\" want \"%s\"\n", t->name, got, want);
+        }
+    }
+}
+
+static void old_values(const gas_sample_t *s, double v[6]) {
+    v[0] = s->temperature;
+    v[1] = s->humidity;
+    v[2] = s->ammonia;
+    v[3] = s->h2s;
+    v[4] = s->co2;
+    v[5] = s->methane;
+}
+
+static void check_encoders(const gas_sample_t *s) {
+    char got[256], want[256];
+    double v[6];
+    old_values(s, v);
+
+    gas_frame_format(s, got, sizeof(got));
+    snprintf(want, sizeof(want), OLD_FRAME_FORMAT, v[0], v[1], v[2], v[3], v[4], v[5]);
+    tally(&frame_tally, strcmp(got, want) == 0, got, want);
+
+    gas_uart_format(s, got, sizeof(got));
+    snprintf(want, sizeof(want), OLD_UART_FORMAT, v[0], v[1], v[2], v[3], v[4], v[5]);
+    tally(&uart_tally, strcmp(got, want) == 0, got, want);
+
+    gas_json_format(s, got, sizeof(got));
+    snprintf(want, sizeof(want), OLD_JSON_FORMAT, v[0], v[1], v[2], v[3], v[4], v[5]);
+    tally(&json_tally, strcmp(got, want) == 0, got, want);
+}
+
+// Same fields parsed, same values, as the gateway's old sscanf()
+static void check_parse(const char *frame) {
+    float old[6] = { 0 };
+    int old_count = sscanf(frame, "Temp:%f,Humidity:%f,NH3:%f,H2S:%f,CO2:%f,CH4:%f",
+                           &old[0], &old[1], &old[2], &old[3], &old[4], &old[5]);
+    if (old_count < 0) {
+        old_count = 0;
+    }
+    gas_sample_t parsed = { 0 };
+    int count = gas_frame_parse(frame, &parsed);
+    const float *order[6] = { &parsed.temperature, &parsed.humidity, &parsed.ammonia, &parsed.h2s, &parsed.co2,
+                              &parsed.methane };
+    bool ok = count == old_count;
+    for (int i = 0; i < old_count && ok; i++) {
+        ok = *order[i] == old[i];
+    }
+    char got[32], want[32];
+    snprintf(got, sizeof(got), "%d fields", count);
+    snprintf(want, sizeof(want), "%d fields", old_count);
+    tally(&parse_tally, ok, got, want);
+}
+
+static void check_parsers(const gas_sample_t *s, bool cuts) {
+    char frame[256];
+    int len = gas_frame_format(s, frame, sizeof(frame));
+    check_parse(frame);
+
+    char longer[300];
+    snprintf(longer, sizeof(longer), "%s,T:17:100:200:300:400:500", frame);
+    check_parse(longer);
+
+    // The gateway can get a partial line: cut at every byte
+    if (cuts) {
+        for (int cut = 0; cut < len; cut++) {
+            char partial[256];
+            memcpy(partial, frame, cut);
+            partial[cut] = '\0';
+            check_parse(partial);
+        }
+    }
+}
+
+// Within half a unit of the scale, a frame value comes back exactly. The
+// packed integer has no sign for zero, so -0.00 comes back as 0.00: values
+// are compared, not text.
+static void check_record(const gas_sample_t *s) {
+    gas_sample_packed_t packed;
+    gas_sample_t unpacked;
+
+    char frame[256], again[256];
+    gas_sample_t from_frame = { 0 };
+    gas_frame_format(s, frame, sizeof(frame));
+    gas_frame_parse(frame, &from_frame);
+    gas_sample_pack(&from_frame, &packed);
+    gas_sample_unpack(&packed, &unpacked);
+    gas_frame_format(&unpacked, again, sizeof(again));
+    gas_sample_t from_again = { 0 };
+    gas_frame_parse(again, &from_again);
+    bool same = true;
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        same = same && from_again.values[ch] == from_frame.values[ch];
+    }
+    tally(&record_tally, same, again, frame);
+
+    gas_sample_pack(s, &packed);
+    gas_sample_unpack(&packed, &unpacked);
+    bool ok = true;
+    for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+        // 100 is the scale of every channel; float spacing adds a little at large values
+        float bound = 0.005f + fabsf(s->values[ch]) * 2e-7f;
+        ok = ok && fabsf(unpacked.values[ch] - s->values[ch]) <= bound;
+    }
+    char got[64], want[64];
+    snprintf(got, sizeof(got), "%.4f", unpacked.co2);
+    snprintf(want, sizeof(want), "%.4f", s->co2);
+    tally(&record_tally, ok, got, want);
+}
+
+// Out-of-range values saturate at the packed type's limits, NaN packs as 0
+static void check_clamping(void) {
+    gas_sample_t s;
+    gas_sample_packed_t packed;
+    gas_sample_t unpacked;
+    char got[64], want[64];
+
+    memset(&s, 0, sizeof(s));
+    s.temperature = 1000.0f;
+    s.humidity = -5.0f;
+    s.co2 = 3e7f;
+    s.methane = NAN;
+    gas_sample_pack(&s, &packed);
+    gas_sample_unpack(&packed, &unpacked);
+    snprintf(got, sizeof(got), "%.2f %.2f %.0f %.2f", unpacked.temperature, unpacked.humidity, unpacked.co2,
+             unpacked.methane);
+    snprintf(want, sizeof(want), "%.2f %.2f %.0f %.2f", INT16_MAX / 100.0f, 0.0f, INT32_MAX / 100.0f, 0.0f);
+    tally(&clamp_tally, strcmp(got, want) == 0, got, want);
+
+    s.temperature = -1000.0f;
+    s.co2 = -3e7f;
+    gas_sample_pack(&s, &packed);
+    gas_sample_unpack(&packed, &unpacked);
+    snprintf(got, sizeof(got), "%.2f %.0f", unpacked.temperature, unpacked.co2);
+    snprintf(want, sizeof(want), "%.2f %.0f", INT16_MIN / 100.0f, INT32_MIN / 100.0f);
+    tally(&clamp_tally, strcmp(got, want) == 0, got, want);
+}
+
+// Rows of sensor_data.csv: the registry's map against the old sscanf()
+static void load_csv(const char *path) {
+    FILE *csv = fopen(path, "r");
+    if (csv == NULL) {
+        perror(path);
+        exit(1);
+    }
+    char line[512];
+    fgets(line, sizeof(line), csv);     // header
+    while (fgets(line, sizeof(line), csv) != NULL && csv_rows < MAX_ROWS) {
+        float old[8] = { 0 };
+        int old_count = sscanf(line, OLD_CSV_FORMAT, &old[0], &old[1], &old[2], &old[3], &old[4], &old[5],
+                               &old[6], &old[7]);
+        gas_sample_t s = { 0 };
+        gas_csv_flags_t flags;
+        int count = gas_csv_parse(line, &s, &flags);
+
+        // Old order: ammonia, methane, co2, h2s, then their MQ flags for ammonia, methane, h2s, co2
+        bool ok = old_count == 8 && count == 4 &&
+                  s.ammonia == old[0] && s.methane == old[1] && s.co2 == old[2] && s.h2s == old[3] &&
+                  flags.flags[GAS_CH_AMMONIA] == old[4] && flags.flags[GAS_CH_METHANE] == old[5] &&
+                  flags.flags[GAS_CH_H2S] == old[6] && flags.flags[GAS_CH_CO2] == old[7] &&
+                  flags.flags[GAS_CH_TEMPERATURE] == 0 && flags.flags[GAS_CH_HUMIDITY] == 0;
+        line[strcspn(line, "\r\n")] = '\0';
+        tally(&csv_tally, ok, line, "the old sscanf fields");
+
+        s.temperature = random_between(-40.0f, 185.0f);
+        s.humidity = random_between(0.0f, 100.0f);
+        samples[sample_count++] = s;
+        csv_rows++;
+    }
+    fclose(csv);
+}
+
+static void print_tally(const tally_t *t) {
+    printf("%-20s %10ld %10ld\n", t->name, t->checked, t->mismatches);
+}
+
+int main(int argc, char **argv) {
+    const char *csv_path = "../TempSensor/sensor_data.csv";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+            csv_path = argv[++i];
+        }
+    }
+
+    load_csv(csv_path);
+    static const float ranges[GAS_CH_COUNT][2] = {
+        [GAS_CH_TEMPERATURE] = { -40.0f, 185.0f },
+        [GAS_CH_HUMIDITY] = { 0.0f, 100.0f },
+        [GAS_CH_AMMONIA] = { 0.0f, 500.0f },
+        [GAS_CH_H2S] = { 0.0f, 200.0f },
+        [GAS_CH_CO2] = { 0.0f, 40000.0f },
+        [GAS_CH_METHANE] = { 0.0f, 10000.0f },
+    };
+    for (int i = 0; i < RANDOM_SAMPLES; i++) {
+        gas_sample_t s;
+        for (int ch = 0; ch < GAS_CH_COUNT; ch++) {
+            s.values[ch] = random_between(ranges[ch][0], ranges[ch][1]);
+        }
+        samples[sample_count++] = s;
+    }
+
+    for (int i = 0; i < sample_count; i++) {
+        check_encoders(&samples[i]);
+        check_parsers(&samples[i], i < csv_rows || i % 256 == 0);
+        check_record(&samples[i]);
+    }
+    check_clamping();
+
+    printf("%d sensor_data.csv rows, %d random samples\n\n", csv_rows, RANDOM_SAMPLES);
+    printf("%-20s %10s %10s\n", "check", "cases", "mismatches");
+    const tally_t *tallies[] = { &frame_tally, &uart_tally, &json_tally, &parse_tally, &csv_tally, &record_tally,
+                                 &clamp_tally };
+    long failures = 0;
+    for (size_t i = 0; i < sizeof(tallies) / sizeof(tallies[0]); i++) {
+        print_tally(tallies[i]);
+        failures += tallies[i]->mismatches;
+    }
+    printf("\n%s\n", failures == 0 ? "all checks passed" : "CHECKS FAILED");
+    return failures != 0;
+}
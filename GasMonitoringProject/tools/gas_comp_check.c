@@ -0,0 +1,143 @@
+// Accuracy and cost of the T/RH compensation tables (components/gas_comp)
+// against the reference curves they are built from.
+//
+// For each sensor sweeps temperature and humidity on a grid much finer than
+// the table's and prints the largest and rms relative error of the
+// interpolated gain against the reference gain, over the barn range
+// (0..40 degC, 30..95 %RH) and over the whole table, together with the gain
+// range and the host time per sample of the lookup and of the reference
+// curve's powf math. With --blob the reference table of one sensor is
+// written out in the NVS blob layout instead, as a starting point for
+// calibrated tables (nvs_partition_gen.py "file" entries in namespace
+// "gas_comp").
+//
+//   gcc -O2 -I../components/gas_comp -o gas_comp_check gas_comp_check.c
+//       ../components/gas_comp/gas_comp.c -lm
+//   ./gas_comp_check [--blob nh3 nh3.bin]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gas_comp.h"
+
+#define STEP_T      0.1f        // sweep steps, well inside a table cell
+#define STEP_RH     0.25f
+#define BENCH_SAMPLES 4096
+#define BENCH_REPEAT  200
+
+typedef struct {
+    float t_min, t_max, rh_min, rh_max;
+} sweep_range_t;
+
+static const sweep_range_t barn = { 0.0f, 40.0f, 30.0f, 95.0f };
+static const sweep_range_t full = { -20.0f, 60.0f, GAS_COMP_RH_FLOOR, 100.0f };
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Largest and rms relative error of the table gain, in percent
+static void sweep(gas_comp_sensor_t sensor, const sweep_range_t *range, double *max_pct, double *rms_pct,
+                  float *gain_min, float *gain_max) {
+    double sq = 0;
+    long n = 0;
+    *max_pct = 0;
+    *gain_min = INFINITY;
+    *gain_max = 0;
+    gas_comp_point_t point;
+    for (float t = range->t_min; t <= range->t_max + 1e-3f; t += STEP_T) {
+        for (float rh = range->rh_min; rh <= range->rh_max + 1e-3f; rh += STEP_RH) {
+            float reference = gas_comp_reference(sensor, t, rh);
+            gas_comp_locate(&point, t, rh);
+            double table = gas_comp_gain(sensor, &point) / (double)(1 << GAS_COMP_OUT_BITS);
+            double error = 100.0 * (table - reference) / reference;
+            sq += error * error;
+            n++;
+            if (fabs(error) > *max_pct) {
+                *max_pct = fabs(error);
+            }
+            *gain_min = fminf(*gain_min, reference);
+            *gain_max = fmaxf(*gain_max, reference);
+        }
+    }
+    *rms_pct = sqrt(sq / n);
+}
+
+static int write_blob(const char *name, const char *path) {
+    for (int sensor = 0; sensor < GAS_COMP_SENSORS; sensor++) {
+        if (strcmp(gas_comp_curves[sensor].name, name) != 0) {
+            continue;
+        }
+        gas_comp_table_t table;
+        gas_comp_build_table(sensor, &table);
+        FILE *out = fopen(path, "wb");
+        if (out == NULL || fwrite(&table, sizeof(table), 1, out) != 1) {
+            perror(path);
+            return 1;
+        }
+        fclose(out);
+        printf("%s: %zu bytes, version %u, %ux%u points\n", path, sizeof(table), table.version,
+               GAS_COMP_T_POINTS, GAS_COMP_RH_POINTS);
+        return 0;
+    }
+    fprintf(stderr, "unknown sensor %s\n", name);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--blob") == 0 && i + 2 < argc) {
+            return write_blob(argv[i + 1], argv[i + 2]);
+        }
+    }
+
+    gas_comp_init();
+    static float temperatures[BENCH_SAMPLES];
+    static float humidities[BENCH_SAMPLES];
+    static gas_comp_point_t points[BENCH_SAMPLES];
+    srand(1);
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        temperatures[i] = barn.t_min + (float)rand() / RAND_MAX * (barn.t_max - barn.t_min);
+        humidities[i] = barn.rh_min + (float)rand() / RAND_MAX * (barn.rh_max - barn.rh_min);
+        gas_comp_locate(&points[i], temperatures[i], humidities[i]);
+    }
+
+    printf("table %dx%d points (%d degC x %d %%RH steps), %zu bytes per sensor\n\n", GAS_COMP_T_POINTS,
+           GAS_COMP_RH_POINTS, 1 << GAS_COMP_T_STEP_LOG2, 1 << GAS_COMP_RH_STEP_LOG2, sizeof(gas_comp_table_t));
+    printf("%-6s %9s %9s %9s %9s %13s %10s %10s\n", "sensor", "barn max%", "barn rms%", "full max%",
+           "full rms%", "gain range", "table ns", "powf ns");
+    for (int sensor = 0; sensor < GAS_COMP_SENSORS; sensor++) {
+        double barn_max, barn_rms, full_max, full_rms;
+        float gain_min, gain_max, unused_min, unused_max;
+        sweep(sensor, &barn, &barn_max, &barn_rms, &unused_min, &unused_max);
+        sweep(sensor, &full, &full_max, &full_rms, &gain_min, &gain_max);
+
+        volatile int32_t sink = 0;
+        double start = now_ns();
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            for (int i = 0; i < BENCH_SAMPLES; i++) {
+                sink = gas_comp_apply(sensor, &points[i], 100 << 8);
+            }
+        }
+        double table_ns = (now_ns() - start) / ((double)BENCH_REPEAT * BENCH_SAMPLES);
+
+        volatile float reference = 0;
+        start = now_ns();
+        for (int r = 0; r < BENCH_REPEAT; r++) {
+            for (int i = 0; i < BENCH_SAMPLES; i++) {
+                reference = 100.0f * gas_comp_reference(sensor, temperatures[i], humidities[i]);
+            }
+        }
+        double powf_ns = (now_ns() - start) / ((double)BENCH_REPEAT * BENCH_SAMPLES);
+        (void)sink;
+        (void)reference;
+
+        printf("%-6s %9.3f %9.3f %9.3f %9.3f %6.2f..%-6.2f %10.1f %10.1f\n", gas_comp_curves[sensor].name,
+               barn_max, barn_rms, full_max, full_rms, gain_min, gain_max, table_ns, powf_ns);
+    }
+    return 0;
+}
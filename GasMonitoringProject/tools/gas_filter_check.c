@@ -0,0 +1,287 @@
+// Reference check for the gas filters (components/gas_filter).
+//
+// Every filter runs over the four gas channels of sensor_data.csv and over
+// synthetic signals: a narrow random one full of ties, a wide random one
+// that crosses the +-65536 unit clamp, a noisy level with spikes, and
+// a staircase of steps and ramps.
+//   - moving average and median, for every window from 1 to
+//     GAS_FILTER_MAX_WINDOW, are compared sample by sample with a brute
+//     force over the last window inputs (sum and sort, the same integer
+//     rounding: truncation towards zero, and an even window averages its
+//     two middle values). Any difference is a mismatch.
+//   - EWMA, for every shift, and Kalman are compared with the same
+//     recurrence in double precision; the table gives the largest error in
+//     channel units, which must stay under --tolerance.
+// Exits 1 on a mismatch or an error over the tolerance.
+//
+//   gcc -O2 -I../components/gas_filter -I../components/gas_channels
+//       -I../components/fastfmt -o gas_filter_check gas_filter_check.c
+//       ../components/gas_filter/gas_filter.c
+//       ../components/gas_channels/gas_channels.c ../components/fastfmt/fastfmt.c -lm
+//   ./gas_filter_check [--file ../TempSensor/partition/sensor_data.csv] [--tolerance 0.015]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gas_filter.h"
+#include "gas_channels.h"
+
+#define MAX_ROWS     8192
+#define SYNTH_LENGTH 20000
+#define SIGNAL_COUNT 8
+
+static const gas_channel_t gas_inputs[] = { GAS_CH_AMMONIA, GAS_CH_H2S, GAS_CH_CO2, GAS_CH_METHANE };
+#define GAS_INPUT_COUNT (sizeof(gas_inputs) / sizeof(gas_inputs[0]))
+
+// Kalman noise levels, the same as the node's ADC jobs
+static const float kalman_q[GAS_CH_COUNT] = { [GAS_CH_AMMONIA] = 1.0f, [GAS_CH_H2S] = 0.04f, [GAS_CH_CO2] = 4.0f, [GAS_CH_METHANE] = 1.0f };
+static const float kalman_r[GAS_CH_COUNT] = { [GAS_CH_AMMONIA] = 25.0f, [GAS_CH_H2S] = 1.0f, [GAS_CH_CO2] = 400.0f, [GAS_CH_METHANE] = 100.0f };
+
+typedef struct {
+    const char *name;
+    int length;
+    gas_fixed_t *input;     // before the clamp in gas_filter_step()
+    float q, r;             // Kalman noise for this signal
+} signal_t;
+
+static signal_t signals[SIGNAL_COUNT];
+static int signal_count;
+static unsigned long long compared;
+
+static unsigned rng_state = 12345;
+
+static unsigned rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static gas_fixed_t rng_range(gas_fixed_t low, gas_fixed_t high) {
+    return low + (gas_fixed_t)(rng() % (unsigned)(high - low + 1));
+}
+
+static signal_t *add_signal(const char *name, int length, float q, float r) {
+    signal_t *signal = &signals[signal_count++];
+    signal->name = name;
+    signal->length = length;
+    signal->input = calloc(length, sizeof(gas_fixed_t));
+    signal->q = q;
+    signal->r = r;
+    return signal;
+}
+
+static int load_csv(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    static gas_sample_t rows[MAX_ROWS];
+    char line[256];
+    int count = 0;
+    fgets(line, sizeof(line), file); // header
+    while (count < MAX_ROWS && fgets(line, sizeof(line), file) != NULL) {
+        if (gas_csv_parse(line, &rows[count], NULL) > 0) {
+            count++;
+        }
+    }
+    fclose(file);
+
+    for (int c = 0; c < (int)GAS_INPUT_COUNT && count > 0; c++) {
+        gas_channel_t ch = gas_inputs[c];
+        signal_t *signal = add_signal(gas_channel_names[ch], count, kalman_q[ch], kalman_r[ch]);
+        for (int i = 0; i < count; i++) {
+            signal->input[i] = gas_fixed_from_float(rows[i].values[ch]);
+        }
+    }
+    return count;
+}
+
+static void make_synthetic(void) {
+    signal_t *ties = add_signal("ties", SYNTH_LENGTH, 0.01f, 1.0f);
+    for (int i = 0; i < SYNTH_LENGTH; i++) {
+        ties->input[i] = rng_range(-8, 8);
+    }
+
+    // Past the clamp on both sides, and whole runs pinned at it
+    signal_t *wide = add_signal("wide", SYNTH_LENGTH, 100.0f, 10000.0f);
+    for (int i = 0; i < SYNTH_LENGTH; i++) {
+        wide->input[i] = (i / 500) % 4 == 3 ? ((i & 1) ? INT32_MAX : INT32_MIN)
+                                            : rng_range(-2 * GAS_FIXED_LIMIT, 2 * GAS_FIXED_LIMIT);
+    }
+
+    signal_t *spikes = add_signal("spikes", SYNTH_LENGTH, 1.0f, 25.0f);
+    for (int i = 0; i < SYNTH_LENGTH; i++) {
+        spikes->input[i] = 100 * 256 + rng_range(-5 * 256, 5 * 256);
+        if (rng() % 16 == 0) {
+            spikes->input[i] += (rng() & 1 ? 1 : -1) * rng_range(200 * 256, 5000 * 256);
+        }
+    }
+
+    signal_t *steps = add_signal("steps", SYNTH_LENGTH, 4.0f, 400.0f);
+    gas_fixed_t level = 0;
+    for (int i = 0; i < SYNTH_LENGTH; i++) {
+        if (i % 1000 == 0) {
+            level = rng_range(-3000 * 256, 3000 * 256);
+        }
+        steps->input[i] = (i / 1000) & 1 ? level + (i % 1000) * 64 : level;
+    }
+}
+
+static gas_fixed_t clamp(gas_fixed_t value) {
+    return value > GAS_FIXED_LIMIT ? GAS_FIXED_LIMIT : value < -GAS_FIXED_LIMIT ? -GAS_FIXED_LIMIT : value;
+}
+
+static int compare_fixed(const void *a, const void *b) {
+    gas_fixed_t x = *(const gas_fixed_t *)a, y = *(const gas_fixed_t *)b;
+    return (x > y) - (x < y);
+}
+
+static gas_fixed_t reference_window(gas_filter_kind_t kind, const gas_fixed_t *input, int i, int window) {
+    gas_fixed_t sorted[GAS_FILTER_MAX_WINDOW];
+    int n = i + 1 < window ? i + 1 : window;
+    int64_t sum = 0;
+    for (int k = 0; k < n; k++) {
+        sorted[k] = clamp(input[i - k]);
+        sum += sorted[k];
+    }
+    if (kind == GAS_FILTER_MOVING_AVERAGE) {
+        return (gas_fixed_t)(sum / n);
+    }
+    qsort(sorted, n, sizeof(sorted[0]), compare_fixed);
+    if (n & 1) {
+        return sorted[n / 2];
+    }
+    return (gas_fixed_t)(((int64_t)sorted[n / 2 - 1] + sorted[n / 2]) / 2);
+}
+
+// Moving average or median against the brute force, every window
+static long check_window(gas_filter_kind_t kind) {
+    long mismatches = 0;
+    printf("%-15s", gas_filter_kind_name(kind));
+    for (int s = 0; s < signal_count; s++) {
+        const signal_t *signal = &signals[s];
+        long signal_mismatches = 0;
+        for (int window = 1; window <= GAS_FILTER_MAX_WINDOW; window++) {
+            gas_filter_t filter;
+            gas_filter_config_t config = { .kind = kind, .window = window };
+            gas_filter_init(&filter, &config);
+            for (int i = 0; i < signal->length; i++) {
+                gas_fixed_t got = gas_filter_step(&filter, signal->input[i]);
+                gas_fixed_t want = reference_window(kind, signal->input, i, window);
+                compared++;
+                if (got != want) {
+                    if (signal_mismatches++ == 0) {
+                        fprintf(stderr, "%s %s window %d sample %d: got %d, expected %d\n",
+                                gas_filter_kind_name(kind), signal->name, window, i, got, want);
+                    }
+                }
+            }
+        }
+        printf(" %9ld", signal_mismatches);
+        mismatches += signal_mismatches;
+    }
+    printf("\n");
+    return mismatches;
+}
+
+static double units(double lsb) {
+    return lsb / (1 << GAS_FILTER_FRAC_BITS);
+}
+
+// EWMA y += (x - y) / 2^shift in double precision, largest error in units
+static double ewma_error(const signal_t *signal, int shift) {
+    gas_filter_t filter;
+    gas_filter_config_t config = { .kind = GAS_FILTER_EWMA, .ewma_shift = shift };
+    gas_filter_init(&filter, &config);
+    double y = 0, worst = 0;
+    for (int i = 0; i < signal->length; i++) {
+        gas_fixed_t got = gas_filter_step(&filter, signal->input[i]);
+        double x = units(clamp(signal->input[i]));
+        y = i == 0 ? x : y + (x - y) / (1 << shift);
+        compared++;
+        worst = fmax(worst, fabs(units(got) - y));
+    }
+    return worst;
+}
+
+// Kalman with the configured q and r in double precision
+static double kalman_error(const signal_t *signal) {
+    gas_filter_t filter;
+    gas_filter_config_t config = { .kind = GAS_FILTER_KALMAN, .kalman_q = signal->q, .kalman_r = signal->r };
+    gas_filter_init(&filter, &config);
+    double x = 0, p = 0, worst = 0;
+    for (int i = 0; i < signal->length; i++) {
+        gas_fixed_t got = gas_filter_step(&filter, signal->input[i]);
+        double z = units(clamp(signal->input[i]));
+        if (i == 0) {
+            x = z;
+            p = signal->r;
+        } else {
+            p += signal->q;
+            double gain = p / (p + signal->r);
+            x += gain * (z - x);
+            p *= 1 - gain;
+        }
+        compared++;
+        worst = fmax(worst, fabs(units(got) - x));
+    }
+    return worst;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "../TempSensor/partition/sensor_data.csv";
+    double tolerance = 0.015;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        }
+    }
+
+    int rows = load_csv(path);
+    if (rows <= 0) {
+        fprintf(stderr, "no rows in %s\n", path);
+        return 1;
+    }
+    make_synthetic();
+    printf("%d rows from %s, %d synthetic samples per signal\n\n", rows, path, SYNTH_LENGTH);
+
+    printf("Mismatches against the brute force, windows 1..%d\n%-15s", GAS_FILTER_MAX_WINDOW, "filter");
+    for (int s = 0; s < signal_count; s++) {
+        printf(" %9s", signals[s].name);
+    }
+    printf("\n");
+    long mismatches = check_window(GAS_FILTER_MOVING_AVERAGE) + check_window(GAS_FILTER_MEDIAN);
+
+    printf("\nLargest error against double precision, units\n%-15s", "filter");
+    for (int s = 0; s < signal_count; s++) {
+        printf(" %9s", signals[s].name);
+    }
+    printf("\n");
+    double worst = 0;
+    for (int shift = 1; shift <= GAS_FILTER_MAX_SHIFT; shift++) {
+        printf("ewma shift %-4d", shift);
+        for (int s = 0; s < signal_count; s++) {
+            double error = ewma_error(&signals[s], shift);
+            worst = fmax(worst, error);
+            printf(" %9.4f", error);
+        }
+        printf("\n");
+    }
+    printf("%-15s", "kalman");
+    for (int s = 0; s < signal_count; s++) {
+        double error = kalman_error(&signals[s]);
+        worst = fmax(worst, error);
+        printf(" %9.4f", error);
+    }
+    printf("\n\n");
+
+    bool passed = mismatches == 0 && worst <= tolerance;
+    printf("%llu outputs compared, %ld mismatches, largest error %.4f units (tolerance %.4f): %s\n",
+           compared, mismatches, worst, tolerance, passed ? "PASS" : "FAIL");
+    return passed ? 0 : 1;
+}
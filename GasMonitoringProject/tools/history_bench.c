@@ -0,0 +1,237 @@
+// Reboots and range-query latency of the on-flash sample history
+// (components/gas_history), on the host.
+//
+// Reboot replay: a node appends a record every 5 s, loses power after a
+// random run (the block being filled is lost with it) and boots again, six
+// times over a file of 16 blocks so the ring wraps. Its clock is either
+// node_time_now(), which resumes after the newest record on flash, or
+// time() as the node had it, back at 0 after every boot. After every boot,
+// random range queries run through the store's binary search and are
+// compared with a full scan of the records the store holds, in order.
+//
+// Latency: a full 128-block file (11 h of 5 s records, as on the node) is
+// queried over ranges from 5 min to all of it, every point and downsampled
+// to 100 points. Prints the blocks and bytes each query reads, which is
+// what its time on the SPIFFS partition scales with, and the host time.
+//
+//   gcc -O2 -I../components/gas_history -I../components/gas_channels
+//       -I../components/fastfmt -o history_bench history_bench.c
+//       ../components/gas_history/gas_history.c ../components/gas_channels/gas_channels.c
+//       ../components/fastfmt/fastfmt.c -lm
+//   ./history_bench [--file /tmp/history_bench.bin]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gas_history.h"
+
+#define PERIOD_S        5
+#define CHECK_BLOCKS    16
+#define BENCH_BLOCKS    128
+#define BOOTS           6
+#define QUERIES         400
+#define REPEAT          200
+
+typedef struct {
+    uint32_t timestamp;
+    float value;
+} point_t;
+
+// What the store should hold: its blocks in order and the one being filled
+static point_t ref_blocks[CHECK_BLOCKS][GAS_HISTORY_RECORDS_PER_BLOCK];
+static uint32_t ref_written;            // blocks written, the last CHECK_BLOCKS kept
+static point_t ref_head[GAS_HISTORY_RECORDS_PER_BLOCK];
+static int ref_head_count;
+
+static point_t got[CHECK_BLOCKS * GAS_HISTORY_RECORDS_PER_BLOCK + GAS_HISTORY_RECORDS_PER_BLOCK];
+static int got_count;
+
+static uint32_t rng = 2463534242u;
+
+static uint32_t next_random(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Methane readings that drift, stored as the history packs them
+static void make_sample(uint32_t i, gas_sample_t *sample, float *stored) {
+    memset(sample, 0, sizeof(*sample));
+    sample->values[GAS_CH_METHANE] = 150.0f + (float)((i * 37) % 1000) / 7.0f;
+    gas_sample_packed_t packed;
+    gas_sample_t unpacked;
+    gas_sample_pack(sample, &packed);
+    gas_sample_unpack(&packed, &unpacked);
+    *stored = unpacked.values[GAS_CH_METHANE];
+}
+
+static bool collect(uint32_t timestamp, float value, void *ctx) {
+    got[got_count].timestamp = timestamp;
+    got[got_count].value = value;
+    got_count++;
+    return true;
+}
+
+static bool count_point(uint32_t timestamp, float value, void *ctx) {
+    (*(int *)ctx)++;
+    return true;
+}
+
+static bool query_matches(gas_history_t *history, uint32_t from, uint32_t to) {
+    got_count = 0;
+    gas_history_query(history, GAS_CH_METHANE, from, to, 0, collect, NULL);
+
+    int n = 0;
+    uint32_t first = ref_written > CHECK_BLOCKS ? ref_written - CHECK_BLOCKS : 0;
+    for (uint32_t b = first; b <= ref_written; b++) {
+        const point_t *points = b < ref_written ? ref_blocks[b % CHECK_BLOCKS] : ref_head;
+        int count = b < ref_written ? GAS_HISTORY_RECORDS_PER_BLOCK : ref_head_count;
+        for (int i = 0; i < count; i++) {
+            if (points[i].timestamp < from || points[i].timestamp > to) {
+                continue;
+            }
+            if (n >= got_count || got[n].timestamp != points[i].timestamp || got[n].value != points[i].value) {
+                return false;
+            }
+            n++;
+        }
+    }
+    return n == got_count;
+}
+
+// Returns the queries whose answer differed from the full scan
+static int replay(const char *path, bool resume_clock) {
+    remove(path);
+    ref_written = 0;
+    ref_head_count = 0;
+    rng = 2463534242u;
+
+    static gas_history_hdr_t index[CHECK_BLOCKS];
+    gas_history_t history;
+    uint32_t newest = 0;
+    uint32_t sample_index = 0;
+    int mismatches = 0, queries = 0;
+
+    printf("%-12s", resume_clock ? "node time" : "time()");
+    for (int boot = 0; boot < BOOTS; boot++) {
+        gas_history_open(&history, path, index, CHECK_BLOCKS);
+        // node_time_resume() over this store alone
+        uint32_t base = resume_clock && gas_history_newest(&history) != 0 ? gas_history_newest(&history) + 1 : 0;
+        ref_head_count = 0;     // lost with the power
+
+        int records = 200 + next_random() % 600;
+        for (int r = 0; r < records; r++) {
+            gas_sample_t sample;
+            float stored;
+            uint32_t timestamp = base + (uint32_t)r * PERIOD_S;
+            make_sample(sample_index++, &sample, &stored);
+            gas_history_append(&history, timestamp, &sample);
+            ref_head[ref_head_count].timestamp = timestamp;
+            ref_head[ref_head_count].value = stored;
+            if (++ref_head_count == GAS_HISTORY_RECORDS_PER_BLOCK) {
+                memcpy(ref_blocks[ref_written % CHECK_BLOCKS], ref_head, sizeof(ref_head));
+                ref_written++;
+                ref_head_count = 0;
+            }
+            newest = timestamp;
+        }
+
+        int boot_mismatches = 0;
+        for (int q = 0; q < QUERIES; q++) {
+            uint32_t from = next_random() % (newest + 1);
+            uint32_t to = from + next_random() % (newest + 1 - from);
+            boot_mismatches += !query_matches(&history, from, to);
+            queries++;
+        }
+        boot_mismatches += !query_matches(&history, 0, UINT32_MAX);
+        queries++;
+        mismatches += boot_mismatches;
+        printf(" %6d", boot_mismatches);
+        gas_history_close(&history);
+    }
+    printf(" %9d/%d\n", mismatches, queries);
+    remove(path);
+    return mismatches;
+}
+
+static void latency(const char *path) {
+    static gas_history_hdr_t index[BENCH_BLOCKS];
+    gas_history_t history;
+    remove(path);
+    gas_history_open(&history, path, index, BENCH_BLOCKS);
+    uint32_t records = BENCH_BLOCKS * GAS_HISTORY_RECORDS_PER_BLOCK + GAS_HISTORY_RECORDS_PER_BLOCK / 2;
+    for (uint32_t r = 0; r < records; r++) {
+        gas_sample_t sample;
+        float stored;
+        make_sample(r, &sample, &stored);
+        gas_history_append(&history, r * PERIOD_S, &sample);
+    }
+    uint32_t newest = (records - 1) * PERIOD_S;
+
+    printf("\n%u records in %d blocks of %u bytes, ranges end at the newest record\n\n", (unsigned)records,
+           BENCH_BLOCKS, (unsigned)sizeof(gas_history_block_t));
+    printf("%-10s %8s %8s %9s %10s %8s %10s\n", "range", "points", "blocks", "KB read", "us/query", "points",
+           "us/query");
+    printf("%-10s %8s %8s %9s %10s %8s %10s\n", "", "all", "", "", "", "100", "");
+    static const uint32_t ranges_s[] = { 300, 3600, 4 * 3600, 8 * 3600, UINT32_MAX };
+    for (size_t i = 0; i < sizeof(ranges_s) / sizeof(ranges_s[0]); i++) {
+        uint32_t from = ranges_s[i] > newest ? 0 : newest - ranges_s[i];
+        int points_all = 0, points_ds = 0, blocks = 0;
+        double t0 = now_us();
+        for (int r = 0; r < REPEAT; r++) {
+            points_all = 0;
+            blocks = gas_history_query(&history, GAS_CH_METHANE, from, newest, 0, count_point, &points_all);
+        }
+        double all_us = (now_us() - t0) / REPEAT;
+        t0 = now_us();
+        for (int r = 0; r < REPEAT; r++) {
+            points_ds = 0;
+            gas_history_query(&history, GAS_CH_METHANE, from, newest, 100, count_point, &points_ds);
+        }
+        double ds_us = (now_us() - t0) / REPEAT;
+
+        char label[16];
+        if (ranges_s[i] == UINT32_MAX) {
+            snprintf(label, sizeof(label), "all");
+        } else if (ranges_s[i] < 3600) {
+            snprintf(label, sizeof(label), "%u min", (unsigned)(ranges_s[i] / 60));
+        } else {
+            snprintf(label, sizeof(label), "%u h", (unsigned)(ranges_s[i] / 3600));
+        }
+        printf("%-10s %8d %8d %9.1f %10.1f %8d %10.1f\n", label, points_all, blocks,
+               blocks * sizeof(gas_history_block_t) / 1024.0, all_us, points_ds, ds_us);
+    }
+    gas_history_close(&history);
+    remove(path);
+}
+
+int main(int argc, char **argv) {
+    const char *path = "/tmp/history_bench.bin";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        }
+    }
+
+    printf("%d boots over %d blocks, %d random queries after each, mismatches with a full scan\n\n", BOOTS,
+           CHECK_BLOCKS, QUERIES + 1);
+    printf("%-12s", "clock");
+    for (int boot = 0; boot < BOOTS; boot++) {
+        printf("  boot%d", boot + 1);
+    }
+    printf(" %11s\n", "total");
+    replay(path, false);
+    int failures = replay(path, true);
+
+    latency(path);
+    printf("\n%s\n", failures == 0 ? "node time: all queries matched" : "NODE TIME QUERIES FAILED");
+    return failures != 0;
+}
@@ -0,0 +1,524 @@
+// Requests per second and /stream fan-out latency of the node's HTTP API
+// (TempSensor/main/http_api.c), on the host.
+//
+// A server thread follows esp_http_server as the node configures it: one
+// task, a select() over the listening socket, the open sessions and a
+// control pipe that httpd_queue_work() writes to, at most
+// HTTP_API_MAX_SOCKETS sessions with the least recently used one purged
+// when another connects, at most HTTP_API_MAX_STREAMS /stream subscribers.
+// Sessions carry httpd's LRU counter: 0 when opened, bumped when a request
+// arrives, and by stream_keep() for the subscribers.
+//
+//   req/s      1 to 4 keep-alive clients (components/http_keepalive) poll
+//              GET /sensor; the body is formatted per request like the old
+//              commented-out handler, or copied from the snapshot
+//              http_api_publish() formats once per new sample
+//   fan-out    a publisher formats a new sample every 10 ms and queues the
+//              push; 1 to 3 subscribers time each event from publish to
+//              receipt
+//   purge      3 subscribers while 200 clients connect, get /sensor and stay
+//              open, ten at a time; counts the subscribers the purge closed
+//              with and without stream_keep()
+//
+//   gcc -O2 -pthread -I../components/http_keepalive -I../components/gas_channels
+//       -I../components/fastfmt -o http_api_bench http_api_bench.c
+//       ../components/http_keepalive/http_keepalive.c
+//       ../components/gas_channels/gas_channels.c ../components/fastfmt/fastfmt.c -lm
+//   ./http_api_bench [--polls 20000]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "http_keepalive.h"
+#include "gas_channels.h"
+
+#define MAX_SOCKETS     5       // HTTP_API_MAX_SOCKETS
+#define MAX_STREAMS     3       // HTTP_API_MAX_STREAMS
+#define JSON_LEN        192     // HTTP_API_JSON_LEN
+#define EVENTS          2000
+#define PUBLISH_US      10000
+
+typedef struct {
+    int fd;                     // -1 when free
+    uint64_t lru;
+    bool stream;
+    char buf[1024];
+    int len;
+} session_t;
+
+static int listen_fd;
+static int ctrl_pipe[2];
+static uint16_t port;
+static session_t sessions[MAX_SOCKETS];
+static uint64_t lru_counter;
+static volatile bool cached = true;
+static volatile bool keep_streams = true;
+static volatile int streams_evicted;
+
+// The snapshot and the stream event, as http_api_publish() keeps them
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static gas_sample_t last_sample;
+static uint32_t snapshot_version;
+static char snapshot_json[JSON_LEN];
+static int snapshot_json_len;
+static char stream_event[JSON_LEN + 32];
+static int stream_event_len;
+static int stream_count;
+static double publish_us[EVENTS + 2];
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool send_all(int fd, const char *data, int len) {
+    while (len > 0) {
+        int n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void session_close(session_t *session) {
+    if (session->stream) {
+        pthread_mutex_lock(&snapshot_lock);
+        stream_count--;
+        pthread_mutex_unlock(&snapshot_lock);
+    }
+    close(session->fd);
+    session->fd = -1;
+    session->stream = false;
+}
+
+static void stream_keep(void) {
+    if (!keep_streams) {
+        return;
+    }
+    for (int i = 0; i < MAX_SOCKETS; i++) {
+        if (sessions[i].fd >= 0 && sessions[i].stream) {
+            sessions[i].lru = ++lru_counter;
+        }
+    }
+}
+
+static void stream_push(void) {
+    char event[sizeof(stream_event)];
+    pthread_mutex_lock(&snapshot_lock);
+    int len = stream_event_len;
+    memcpy(event, stream_event, len);
+    pthread_mutex_unlock(&snapshot_lock);
+
+    for (int i = 0; i < MAX_SOCKETS; i++) {
+        if (sessions[i].fd < 0 || !sessions[i].stream) {
+            continue;
+        }
+        if (!send_all(sessions[i].fd, event, len)) {
+            session_close(&sessions[i]);
+        } else if (keep_streams) {
+            sessions[i].lru = ++lru_counter;
+        }
+    }
+}
+
+static void get_sensor(session_t *session) {
+    char body[JSON_LEN];
+    int len;
+    if (cached) {
+        pthread_mutex_lock(&snapshot_lock);
+        len = snapshot_json_len;
+        memcpy(body, snapshot_json, len);
+        pthread_mutex_unlock(&snapshot_lock);
+    } else {
+        pthread_mutex_lock(&snapshot_lock);
+        gas_sample_t sample = last_sample;
+        pthread_mutex_unlock(&snapshot_lock);
+        len = snprintf(body, sizeof(body),
+                       "{\"temperature\":%.2f,\"humidity\":%.2f,\"ammonia\":%.2f,\"h2s\":%.2f,\"co2\":%.2f,"
+                       "\"methane\":%.2f}",
+                       sample.temperature, sample.humidity, sample.ammonia, sample.h2s, sample.co2, sample.methane);
+    }
+    char out[512];
+    int n = snprintf(out, sizeof(out),
+                     "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n"
+                     "Cache-Control: no-cache\r\n\r\n%.*s", len, len, body);
+    if (!send_all(session->fd, out, n)) {
+        session_close(session);
+    }
+}
+
+static void get_stream(session_t *session) {
+    static const char headers[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n";
+    static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 16\r\n\r\nToo many streams";
+    pthread_mutex_lock(&snapshot_lock);
+    bool room = stream_count < MAX_STREAMS;
+    stream_count += room;
+    pthread_mutex_unlock(&snapshot_lock);
+    if (!room) {
+        send_all(session->fd, busy, sizeof(busy) - 1);
+        return;
+    }
+    session->stream = true;
+    send_all(session->fd, headers, sizeof(headers) - 1);
+}
+
+static void session_read(session_t *session) {
+    int n = recv(session->fd, session->buf + session->len, sizeof(session->buf) - 1 - session->len, 0);
+    if (n <= 0) {
+        session_close(session);
+        return;
+    }
+    session->lru = ++lru_counter;
+    session->len += n;
+    session->buf[session->len] = '\0';
+    char *end;
+    while (session->fd >= 0 && (end = strstr(session->buf, "\r\n\r\n")) != NULL) {
+        stream_keep();
+        if (strncmp(session->buf, "GET /stream", 11) == 0) {
+            get_stream(session);
+        } else {
+            get_sensor(session);
+        }
+        end += 4;
+        session->len -= end - session->buf;
+        memmove(session->buf, end, session->len + 1);
+    }
+}
+
+static void accept_session(void) {
+    int free_slot = -1, lru_slot = -1;
+    for (int i = 0; i < MAX_SOCKETS; i++) {
+        if (sessions[i].fd < 0) {
+            free_slot = i;
+        } else if (lru_slot < 0 || sessions[i].lru < sessions[lru_slot].lru) {
+            lru_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        streams_evicted += sessions[lru_slot].stream;
+        session_close(&sessions[lru_slot]);
+        free_slot = lru_slot;
+    }
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    sessions[free_slot] = (session_t){ .fd = fd, .lru = 0 };
+}
+
+static void *server_task(void *arg) {
+    while (1) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listen_fd, &readable);
+        FD_SET(ctrl_pipe[0], &readable);
+        int max_fd = listen_fd > ctrl_pipe[0] ? listen_fd : ctrl_pipe[0];
+        for (int i = 0; i < MAX_SOCKETS; i++) {
+            if (sessions[i].fd >= 0) {
+                FD_SET(sessions[i].fd, &readable);
+                max_fd = sessions[i].fd > max_fd ? sessions[i].fd : max_fd;
+            }
+        }
+        if (select(max_fd + 1, &readable, NULL, NULL, NULL) < 0) {
+            continue;
+        }
+        if (FD_ISSET(ctrl_pipe[0], &readable)) {
+            char work[64];
+            if (read(ctrl_pipe[0], work, sizeof(work)) > 0) {
+                stream_push();
+            }
+        }
+        for (int i = 0; i < MAX_SOCKETS; i++) {
+            if (sessions[i].fd >= 0 && FD_ISSET(sessions[i].fd, &readable)) {
+                session_read(&sessions[i]);
+            }
+        }
+        if (FD_ISSET(listen_fd, &readable)) {
+            accept_session();
+        }
+    }
+    return NULL;
+}
+
+// http_api_publish()
+static void publish(const gas_sample_t *sample) {
+    pthread_mutex_lock(&snapshot_lock);
+    last_sample = *sample;
+    snapshot_version++;
+    if (snapshot_version < sizeof(publish_us) / sizeof(publish_us[0])) {
+        publish_us[snapshot_version] = now_us();
+    }
+    snapshot_json_len = gas_json_format(sample, snapshot_json, sizeof(snapshot_json));
+    stream_event_len = snprintf(stream_event, sizeof(stream_event), "id: %u\ndata: %s\n\n",
+                                (unsigned)snapshot_version, snapshot_json);
+    bool push = stream_count > 0;
+    pthread_mutex_unlock(&snapshot_lock);
+    if (push) {
+        char work = 1;
+        write(ctrl_pipe[1], &work, 1);
+    }
+}
+
+static void server_start(void) {
+    for (int i = 0; i < MAX_SOCKETS; i++) {
+        sessions[i].fd = -1;
+    }
+    pipe(ctrl_pipe);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0) {
+        perror("listen");
+        exit(1);
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    port = ntohs(addr.sin_port);
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, NULL);
+}
+
+static gas_sample_t make_sample(uint32_t i) {
+    return (gas_sample_t){ .temperature = 21.37f + (i % 50) * 0.01f, .humidity = 45.1f, .ammonia = 12.5f,
+                           .h2s = 0.42f, .co2 = 812.25f, .methane = 150.75f + (i % 7) };
+}
+
+static int stream_connect(void) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        exit(1);
+    }
+    return fd;
+}
+
+// ---- req/s
+
+typedef struct {
+    uint32_t polls;
+    uint32_t failed;
+} poller_t;
+
+static void *poller_task(void *arg) {
+    poller_t *poller = arg;
+    http_ka_client_t client;
+    char response[256];
+    http_ka_init(&client, "127.0.0.1", port);
+    for (uint32_t i = 0; i < poller->polls; i++) {
+        int len;
+        poller->failed += http_ka_get(&client, "/sensor", response, sizeof(response), &len) != ESP_OK;
+    }
+    http_ka_close(&client);
+    return NULL;
+}
+
+static void requests(uint32_t polls) {
+    printf("%-10s %12s %12s\n", "clients", "per request", "cached");
+    printf("%-10s %12s %12s\n", "", "req/s", "req/s");
+    static const int clients[] = { 1, 2, 4 };
+    for (size_t c = 0; c < sizeof(clients) / sizeof(clients[0]); c++) {
+        printf("%-10d", clients[c]);
+        for (int mode = 0; mode < 2; mode++) {
+            cached = mode == 1;
+            pthread_t threads[4];
+            poller_t pollers[4];
+            double t0 = now_us();
+            for (int i = 0; i < clients[c]; i++) {
+                pollers[i] = (poller_t){ .polls = polls / clients[c] };
+                pthread_create(&threads[i], NULL, poller_task, &pollers[i]);
+            }
+            uint32_t failed = 0;
+            for (int i = 0; i < clients[c]; i++) {
+                pthread_join(threads[i], NULL);
+                failed += pollers[i].failed;
+            }
+            double elapsed = now_us() - t0;
+            printf(" %12.0f", (polls / clients[c]) * clients[c] / (elapsed / 1e6));
+            if (failed > 0) {
+                printf(" (%u failed)", (unsigned)failed);
+            }
+        }
+        printf("\n");
+    }
+    cached = true;
+}
+
+// ---- fan-out
+
+typedef struct {
+    int fd;
+    int events;
+    double *latency_us;
+} subscriber_t;
+
+static void *subscriber_task(void *arg) {
+    subscriber_t *sub = arg;
+    char buf[4096];
+    int len = 0;
+    send_all(sub->fd, "GET /stream HTTP/1.1\r\nHost: node\r\n\r\n", 36);
+    while (sub->events < EVENTS) {
+        int n = recv(sub->fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (n <= 0) {
+            break;
+        }
+        double now = now_us();
+        len += n;
+        buf[len] = '\0';
+        char *event, *end;
+        while ((event = strstr(buf, "id: ")) != NULL && (end = strstr(event, "\n\n")) != NULL) {
+            unsigned version = (unsigned)strtoul(event + 4, NULL, 10);
+            if (version < sizeof(publish_us) / sizeof(publish_us[0]) && sub->events < EVENTS) {
+                sub->latency_us[sub->events++] = now - publish_us[version];
+            }
+            end += 2;
+            len -= end - buf;
+            memmove(buf, end, len + 1);
+        }
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void fanout(void) {
+    static double latency[MAX_STREAMS][EVENTS];
+    static double all[MAX_STREAMS * EVENTS];
+    printf("\n%d events, one every %d ms, publish to receipt\n\n", EVENTS, PUBLISH_US / 1000);
+    printf("%-12s %8s %8s %8s %8s\n", "subscribers", "events", "p50 us", "p99 us", "max us");
+    for (int subs = 1; subs <= MAX_STREAMS; subs++) {
+        pthread_mutex_lock(&snapshot_lock);
+        snapshot_version = 0;
+        pthread_mutex_unlock(&snapshot_lock);
+        subscriber_t subscribers[MAX_STREAMS];
+        pthread_t threads[MAX_STREAMS];
+        for (int s = 0; s < subs; s++) {
+            subscribers[s] = (subscriber_t){ .fd = stream_connect(), .latency_us = latency[s] };
+            pthread_create(&threads[s], NULL, subscriber_task, &subscribers[s]);
+        }
+        // Until every subscriber is registered
+        while (1) {
+            pthread_mutex_lock(&snapshot_lock);
+            int count = stream_count;
+            pthread_mutex_unlock(&snapshot_lock);
+            if (count == subs) {
+                break;
+            }
+            usleep(1000);
+        }
+        for (uint32_t i = 1; i <= EVENTS + 1; i++) {
+            gas_sample_t sample = make_sample(i);
+            publish(&sample);
+            usleep(PUBLISH_US);
+        }
+        int n = 0;
+        for (int s = 0; s < subs; s++) {
+            shutdown(subscribers[s].fd, SHUT_RDWR);
+            pthread_join(threads[s], NULL);
+            close(subscribers[s].fd);
+            memcpy(all + n, latency[s], subscribers[s].events * sizeof(double));
+            n += subscribers[s].events;
+        }
+        qsort(all, n, sizeof(double), compare_double);
+        printf("%-12d %8d %8.0f %8.0f %8.0f\n", subs, n, all[n / 2], all[(int)(n * 0.99)], all[n - 1]);
+        while (1) {
+            pthread_mutex_lock(&snapshot_lock);
+            int count = stream_count;
+            pthread_mutex_unlock(&snapshot_lock);
+            if (count == 0) {
+                break;
+            }
+            usleep(1000);
+        }
+    }
+}
+
+// ---- purge
+
+static int purge(bool keep) {
+    keep_streams = keep;
+    streams_evicted = 0;
+    int streams[MAX_STREAMS];
+    for (int s = 0; s < MAX_STREAMS; s++) {
+        streams[s] = stream_connect();
+        send_all(streams[s], "GET /stream HTTP/1.1\r\nHost: node\r\n\r\n", 36);
+        char buf[256];
+        recv(streams[s], buf, sizeof(buf), 0);
+    }
+    int idle[10];
+    for (int i = 0; i < 10; i++) {
+        idle[i] = -1;
+    }
+    for (int c = 0; c < 200; c++) {
+        int fd = stream_connect();
+        char buf[512];
+        send_all(fd, "GET /sensor HTTP/1.1\r\nHost: node\r\n\r\n", 36);
+        recv(fd, buf, sizeof(buf), 0);
+        if (idle[c % 10] >= 0) {
+            close(idle[c % 10]);
+        }
+        idle[c % 10] = fd;
+        if (c % 20 == 0) {
+            gas_sample_t sample = make_sample(c);
+            publish(&sample);
+        }
+    }
+    usleep(20000);
+    int evicted = streams_evicted;
+    for (int i = 0; i < 10; i++) {
+        if (idle[i] >= 0) {
+            close(idle[i]);
+        }
+    }
+    for (int s = 0; s < MAX_STREAMS; s++) {
+        close(streams[s]);
+    }
+    usleep(20000);
+    printf("%-14s %8d %8d\n", keep ? "stream_keep()" : "plain LRU", 200, evicted);
+    keep_streams = true;
+    return evicted;
+}
+
+int main(int argc, char **argv) {
+    uint32_t polls = 20000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--polls") == 0 && i + 1 < argc) {
+            polls = (uint32_t)atoi(argv[++i]);
+        }
+    }
+    server_start();
+    gas_sample_t sample = make_sample(0);
+    publish(&sample);
+
+    printf("GET /sensor over loopback, %u polls per row, %d sessions at most\n\n", (unsigned)polls, MAX_SOCKETS);
+    requests(polls);
+    fanout();
+
+    printf("\n%d subscribers, 200 clients that stay open, ten at a time\n\n", MAX_STREAMS);
+    printf("%-14s %8s %8s\n", "purge", "clients", "streams closed");
+    purge(false);
+    int evicted = purge(true);
+    printf("\n%s\n", evicted == 0 ? "no subscriber purged with stream_keep()" : "SUBSCRIBERS PURGED");
+    return evicted != 0;
+}
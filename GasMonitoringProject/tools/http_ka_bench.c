@@ -0,0 +1,281 @@
+// Requests per second and heap allocations per request of the gateway's
+// persistent HTTP client (components/http_keepalive), on the host.
+//
+// A server thread answers GET /sensor over loopback with the node's JSON
+// snapshot, framed by Content-Length or chunked like esp_http_server does.
+// The client polls it three ways:
+//   reconnect   a new connection per poll, closed after the answer: the
+//               handshake pattern of the old esp_http_client_init/perform/
+//               cleanup loop (that library does not build on the host, so
+//               its own per-poll allocations are not in these numbers)
+//   keep-alive  one connection for every poll
+//   pipelined   four requests written back to back, then four answers read
+// Allocations are counted with the linker wrapping malloc/calloc/realloc
+// for calls made from the client thread.
+//
+// Then the chunked decoder is checked against malformed and extended chunk
+// size lines: a bad size line has to fail the request rather than end the
+// body early.
+//
+//   gcc -O2 -pthread -I../components/http_keepalive -I../components/gas_channels
+//       -I../components/fastfmt -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+//       -o http_ka_bench http_ka_bench.c ../components/http_keepalive/http_keepalive.c
+//       ../components/gas_channels/gas_channels.c ../components/fastfmt/fastfmt.c -lm
+//   ./http_ka_bench [--polls 20000]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "http_keepalive.h"
+#include "gas_channels.h"
+
+typedef enum {
+    FRAME_LENGTH,
+    FRAME_CHUNKED,
+    FRAME_SCRIPT,       // sends `script` once per connection, for the checks
+} framing_t;
+
+static int listen_fd;
+static uint16_t port;
+static volatile framing_t framing = FRAME_LENGTH;
+static const char *volatile script;
+static char body[192];
+static int body_len;
+
+static __thread bool counting;
+static uint64_t allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    allocations += counting;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    allocations += counting;
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    allocations += counting;
+    return __real_realloc(ptr, size);
+}
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static bool send_all(int fd, const char *data, int len) {
+    while (len > 0) {
+        int n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// One answer per request head in the buffer, as many as were pipelined
+static bool serve_requests(int fd, char *buf, int *len) {
+    char *end;
+    while ((end = strstr(buf, "\r\n\r\n")) != NULL) {
+        char out[512];
+        int n;
+        if (framing == FRAME_CHUNKED) {
+            int half = body_len / 2;
+            n = snprintf(out, sizeof(out),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n"
+                         "%x\r\n%.*s\r\n%x\r\n%s\r\n0\r\n\r\n",
+                         half, half, body, body_len - half, body + half);
+        } else {
+            n = snprintf(out, sizeof(out),
+                         "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+                         body_len, body);
+        }
+        if (!send_all(fd, out, n)) {
+            return false;
+        }
+        end += 4;
+        *len -= end - buf;
+        memmove(buf, end, *len + 1);
+    }
+    return true;
+}
+
+static void *server_task(void *arg) {
+    while (1) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        char buf[2048];
+        int len = 0;
+        bool scripted = false;
+        while (1) {
+            int n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+            if (n <= 0) {
+                break;
+            }
+            len += n;
+            buf[len] = '\0';
+            if (framing == FRAME_SCRIPT) {
+                if (!scripted && strstr(buf, "\r\n\r\n") != NULL) {
+                    send_all(fd, script, strlen(script));
+                    scripted = true;
+                }
+                len = 0;
+            } else if (!serve_requests(fd, buf, &len)) {
+                break;
+            }
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static void server_start(void) {
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0) {
+        perror("listen");
+        exit(1);
+    }
+    getsockname(listen_fd, (struct sockaddr *)&addr, &addr_len);
+    port = ntohs(addr.sin_port);
+    pthread_t thread;
+    pthread_create(&thread, NULL, server_task, NULL);
+}
+
+static uint64_t sink_bytes;
+
+static void count_sink(int index, const char *data, int len, void *ctx) {
+    sink_bytes += len;
+}
+
+typedef enum {
+    POLL_RECONNECT,
+    POLL_KEEPALIVE,
+    POLL_PIPELINED,
+} poll_mode_t;
+
+static void run(const char *name, poll_mode_t mode, uint32_t polls) {
+    static const char *const paths[4] = { "/sensor", "/sensor", "/sensor", "/sensor" };
+    http_ka_client_t client;
+    char response[256];
+    uint32_t failed = 0;
+
+    http_ka_init(&client, "127.0.0.1", port);
+    sink_bytes = 0;
+    allocations = 0;
+    counting = true;
+    double t0 = now_us();
+    for (uint32_t i = 0; i < polls; i += mode == POLL_PIPELINED ? 4 : 1) {
+        esp_err_t err;
+        if (mode == POLL_PIPELINED) {
+            err = http_ka_get_pipelined(&client, paths, 4, count_sink, NULL);
+        } else {
+            int len;
+            err = http_ka_get(&client, "/sensor", response, sizeof(response), &len);
+            if (err == ESP_OK && len != body_len) {
+                err = ESP_FAIL;
+            }
+            if (mode == POLL_RECONNECT) {
+                http_ka_close(&client);
+            }
+        }
+        failed += err != ESP_OK;
+    }
+    double elapsed = now_us() - t0;
+    counting = false;
+    http_ka_close(&client);
+
+    if (mode == POLL_PIPELINED && sink_bytes != (uint64_t)client.requests * body_len) {
+        failed++;
+    }
+    printf("%-12s %-10s %9.0f %9.1f %10.4f %9.2f %7u\n", name, framing == FRAME_CHUNKED ? "chunked" : "length",
+           client.requests / (elapsed / 1e6), elapsed / client.requests, (double)client.connects / client.requests,
+           (double)allocations / client.requests, (unsigned)failed);
+}
+
+// One scripted answer; returns the request's result and the body delivered
+static esp_err_t check_script(const char *answer, char *response, int size, int *len) {
+    http_ka_client_t client;
+    framing = FRAME_SCRIPT;
+    script = answer;
+    http_ka_init(&client, "127.0.0.1", port);
+    esp_err_t err = http_ka_get(&client, "/sensor", response, size, len);
+    http_ka_close(&client);
+    return err;
+}
+
+static int check(const char *name, const char *answer, esp_err_t want, const char *want_body) {
+    char response[256];
+    int len = 0;
+    esp_err_t err = check_script(answer, response, sizeof(response), &len);
+    bool ok = want == ESP_OK ? err == ESP_OK && strcmp(response, want_body) == 0 : err != ESP_OK;
+    printf("  %-34s %-6s %s\n", name, err == ESP_OK ? "ok" : "error", ok ? "pass" : "FAIL");
+    return !ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t polls = 20000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--polls") == 0 && i + 1 < argc) {
+            polls = (uint32_t)atoi(argv[++i]);
+        }
+    }
+
+    gas_sample_t sample = { .temperature = 21.37f, .humidity = 45.1f, .ammonia = 12.5f, .h2s = 0.42f,
+                            .co2 = 812.25f, .methane = 150.75f };
+    body_len = gas_json_format(&sample, body, sizeof(body));
+    server_start();
+
+    printf("%u polls of GET /sensor over loopback, %d byte body\n\n", (unsigned)polls, body_len);
+    printf("%-12s %-10s %9s %9s %10s %9s %7s\n", "client", "framing", "req/s", "us/req", "conn/req", "alloc/req",
+           "failed");
+    framing_t framings[2] = { FRAME_LENGTH, FRAME_CHUNKED };
+    for (int f = 0; f < 2; f++) {
+        framing = framings[f];
+        run("reconnect", POLL_RECONNECT, polls);
+        run("keep-alive", POLL_KEEPALIVE, polls);
+        run("pipelined", POLL_PIPELINED, polls);
+    }
+
+    printf("\nchunk size lines\n");
+    int failures = 0;
+    failures += check("two chunks", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n", ESP_OK, "abcde");
+    failures += check("extension and trailer", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "3;name=x\r\nabc\r\n0\r\nX-Trailer: 1\r\n\r\n", ESP_OK, "abc");
+    failures += check("size with trailing blank", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "3 \r\nabc\r\n0\r\n\r\n", ESP_OK, "abc");
+    failures += check("not hex", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "3\r\nabc\r\nzz\r\nmore\r\n0\r\n\r\n", ESP_FAIL, NULL);
+    failures += check("empty size line", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "\r\nabc\r\n0\r\n\r\n", ESP_FAIL, NULL);
+    failures += check("trailing garbage", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "3x\r\nabc\r\n0\r\n\r\n", ESP_FAIL, NULL);
+    failures += check("negative size", "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                      "-3\r\nabc\r\n0\r\n\r\n", ESP_FAIL, NULL);
+    printf("\n%s\n", failures == 0 ? "all checks passed" : "CHECKS FAILED");
+    return failures != 0;
+}
@@ -0,0 +1,289 @@
+// Loss recovery on the node -> gateway link (components/gas_link) after a
+// forced disconnect, on the host.
+//
+// A node and a gateway, each following what tcp_server_task and tcp_client
+// do, run over a socketpair on a simulated clock in 10 ms steps. The node
+// numbers a frame every 5 s into its retransmit ring and polls for requests
+// every 200 ms; the gateway reads as data comes in and asks for its gaps
+// with a 2 s retry. Each scenario runs the link for a while, then cuts it
+// with the last frames still in flight, keeps the node producing through
+// the outage and reconnects. Prints the frames the gateway missed, how many
+// came back and how many the node no longer held, the duplicates, the bytes
+// re-sent and the time from the reconnection until no gap is left. Every
+// run also checks that each frame reached the gateway once or was reported
+// lost.
+//
+//   gcc -O2 -I../components/gas_link -I../components/gas_channels
+//       -I../components/fastfmt -o link_harness link_harness.c
+//       ../components/gas_link/gas_link.c ../components/gas_channels/gas_channels.c
+//       ../components/fastfmt/fastfmt.c -lm
+//   ./link_harness [--ring 128]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "gas_link.h"
+
+#define STEP_MS          10
+#define FRAME_PERIOD_MS  5000
+#define NODE_POLL_MS     200
+#define RETX_TIMEOUT_MS  2000
+#define IN_FLIGHT        2          // frames sent but not read when the link breaks
+#define MAX_SEQ          4096
+
+typedef struct {
+    const char *name;
+    uint32_t outage_ms;
+    bool node_reboot;               // node restarts halfway through the outage
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "reconnect", 0, false },
+    { "10 s", 10000, false },
+    { "1 min", 60000, false },
+    { "5 min", 300000, false },
+    { "10 min", 600000, false },
+    { "15 min", 900000, false },
+    { "reboot 1 min", 60000, true },
+};
+#define SCENARIO_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static gas_link_record_t *records;
+static uint32_t ring_frames = 128;
+
+typedef struct {
+    gas_link_ring_t ring;
+    uint16_t boot;
+    int sock;
+    uint32_t next_send;
+    uint32_t next_poll_ms;
+    bool notified;
+    gas_link_lines_t requests;
+    uint64_t retransmit_bytes;
+} node_t;
+
+typedef struct {
+    gas_link_tracker_t tracker;
+    int sock;
+    gas_link_lines_t lines;
+    uint8_t got[MAX_SEQ];           // receptions per seq of the current boot
+    uint16_t got_boot;
+} gateway_t;
+
+static node_t node;
+static gateway_t gateway;
+
+static void node_boot(uint16_t boot) {
+    gas_link_ring_init(&node.ring, records, ring_frames);
+    node.boot = boot;
+}
+
+static void node_push(uint32_t now_ms) {
+    gas_sample_t sample = { .temperature = 71.5f, .humidity = 40, .ammonia = 12.5f, .h2s = 0.4f,
+                            .co2 = 800, .methane = 150 };
+    gas_link_ring_push(&node.ring, &sample, 0, now_ms);
+    node.notified = true;
+}
+
+static void node_send(const gas_link_record_t *record, bool live) {
+    char frame[128 + GAS_LINK_SUFFIX_LEN + 1];
+    int len = gas_link_format(record, GAS_CH_ALL, node.boot, frame, sizeof(frame) - 1);
+    frame[len++] = '\n';
+    if (send(node.sock, frame, len, 0) != len) {
+        perror("node send");
+        exit(1);
+    }
+    if (!live) {
+        node.retransmit_bytes += len;
+    }
+}
+
+static void node_connect(int sock) {
+    node.sock = sock;
+    node.next_send = node.ring.next_seq > 1 ? node.ring.next_seq - 1 : 1;
+    node.requests.start = node.requests.len = 0;
+}
+
+// One pass of tcp_server_task's loop
+static void node_step(uint32_t now_ms) {
+    if (node.sock < 0 || (!node.notified && now_ms < node.next_poll_ms)) {
+        return;
+    }
+    node.notified = false;
+    node.next_poll_ms = now_ms + NODE_POLL_MS;
+
+    size_t avail;
+    char *space;
+    int len;
+    while ((space = gas_link_lines_space(&node.requests, &avail), len = recv(node.sock, space, avail, MSG_DONTWAIT)) > 0) {
+        gas_link_lines_commit(&node.requests, len);
+        for (char *line; (line = gas_link_lines_next(&node.requests)) != NULL;) {
+            uint32_t first, last;
+            if (!gas_link_parse_range(line, "RETX", &first, &last)) {
+                continue;
+            }
+            uint32_t oldest = gas_link_ring_oldest(&node.ring);
+            if (last > node.ring.next_seq - 1) {
+                last = node.ring.next_seq - 1;
+            }
+            if (first < oldest && first <= last) {
+                char gone[32];
+                uint32_t gone_last = last < oldest - 1 ? last : oldest - 1;
+                len = gas_link_format_range("GONE", first, gone_last, gone, sizeof(gone));
+                send(node.sock, gone, len, 0);
+                first = oldest;
+            }
+            for (uint32_t seq = first; seq <= last; seq++) {
+                const gas_link_record_t *record = gas_link_ring_get(&node.ring, seq);
+                if (record != NULL) {
+                    node_send(record, false);
+                }
+            }
+        }
+    }
+
+    uint32_t oldest = gas_link_ring_oldest(&node.ring);
+    if (node.next_send < oldest) {
+        node.next_send = oldest;
+    }
+    for (const gas_link_record_t *record; (record = gas_link_ring_get(&node.ring, node.next_send)) != NULL;) {
+        node_send(record, true);
+        node.next_send++;
+    }
+}
+
+// One pass of tcp_client's loop
+static void gateway_step(uint32_t now_ms) {
+    if (gateway.sock < 0) {
+        return;
+    }
+    size_t avail;
+    char *space;
+    int len;
+    while ((space = gas_link_lines_space(&gateway.lines, &avail), len = recv(gateway.sock, space, avail, MSG_DONTWAIT)) > 0) {
+        gas_link_lines_commit(&gateway.lines, len);
+        for (char *line; (line = gas_link_lines_next(&gateway.lines)) != NULL;) {
+            uint32_t first, last;
+            uint16_t boot;
+            uint32_t seq;
+            int64_t capture_ms;
+            if (gas_link_parse_range(line, "GONE", &first, &last)) {
+                gas_link_gone(&gateway.tracker, first, last);
+            } else if (gas_link_parse_suffix(line, &boot, &seq, &capture_ms)) {
+                gas_link_track(&gateway.tracker, boot, seq);
+                if (boot != gateway.got_boot) {
+                    memset(gateway.got, 0, sizeof(gateway.got));
+                    gateway.got_boot = boot;
+                }
+                if (seq < MAX_SEQ) {
+                    gateway.got[seq]++;
+                }
+            }
+        }
+    }
+    char requests[GAS_LINK_MAX_GAPS * 32];
+    len = gas_link_requests(&gateway.tracker, now_ms, RETX_TIMEOUT_MS, requests, sizeof(requests));
+    if (len > 0) {
+        send(gateway.sock, requests, len, 0);
+    }
+}
+
+static void link_up(void) {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    int size = 1 << 20;
+    setsockopt(pair[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    node_connect(pair[0]);
+    gateway.sock = pair[1];
+    gateway.lines.start = gateway.lines.len = 0;
+}
+
+// Whatever is still in the socket is lost with it
+static void link_down(void) {
+    close(node.sock);
+    close(gateway.sock);
+    node.sock = gateway.sock = -1;
+}
+
+static void run(const scenario_t *scenario) {
+    memset(&node, 0, sizeof(node));
+    memset(&gateway, 0, sizeof(gateway));
+    node.sock = gateway.sock = -1;
+    gas_link_tracker_init(&gateway.tracker);
+    node_boot(0x1234);
+    link_up();
+
+    // Two minutes of steady link, broken just after a frame went out
+    uint32_t now = 0;
+    uint32_t next_frame = 0;
+    uint32_t cut_ms = 120000 + (IN_FLIGHT - 1) * FRAME_PERIOD_MS;
+    uint32_t reconnect_ms = cut_ms + scenario->outage_ms;
+    uint32_t reboot_ms = cut_ms + scenario->outage_ms / 2;
+    uint32_t recovered_ms = 0;
+    bool rebooted = false;
+    for (; now < reconnect_ms + 600000; now += STEP_MS) {
+        if (now >= next_frame) {
+            node_push(now);
+            next_frame += FRAME_PERIOD_MS;
+        }
+        node_step(now);
+        // The last IN_FLIGHT frames before the cut never reach the gateway
+        if (now + (IN_FLIGHT - 1) * FRAME_PERIOD_MS < cut_ms || now > cut_ms) {
+            gateway_step(now);
+        }
+        if (now == cut_ms) {
+            link_down();
+        }
+        if (scenario->node_reboot && !rebooted && now >= reboot_ms) {
+            node_boot(0x5678);
+            next_frame = now;
+            rebooted = true;
+        }
+        if (now == reconnect_ms) {
+            link_up();
+        }
+        if (now > reconnect_ms && recovered_ms == 0 && gateway.tracker.synced &&
+            gas_link_missing(&gateway.tracker) == 0 && gateway.tracker.next_seq == node.ring.next_seq) {
+            recovered_ms = now - reconnect_ms;
+        }
+    }
+
+    // Every frame of the current boot arrived once, or was reported lost
+    const gas_link_tracker_t *t = &gateway.tracker;
+    uint32_t missing = 0;
+    for (uint32_t seq = 1; seq < node.ring.next_seq && seq < MAX_SEQ; seq++) {
+        missing += gateway.got[seq] == 0;
+    }
+    uint32_t missed = t->recovered + t->lost;
+    bool consistent = scenario->node_reboot ? missing <= t->lost : missing == t->lost;
+    printf("%-13s %7u %9u %6u %10u %10llu %11.2f %6s\n", scenario->name, (unsigned)missed, (unsigned)t->recovered,
+           (unsigned)t->lost, (unsigned)t->duplicates, (unsigned long long)node.retransmit_bytes,
+           recovered_ms / 1000.0, consistent ? "yes" : "NO");
+    link_down();
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--ring") == 0 && i + 1 < argc) {
+            ring_frames = (uint32_t)atoi(argv[++i]);
+        }
+    }
+    records = calloc(ring_frames, sizeof(gas_link_record_t));
+    if (records == NULL || ring_frames < 2) {
+        return 1;
+    }
+
+    printf("ring of %u frames (%u s at one frame per %d s), %d frames in flight at the cut\n\n",
+           (unsigned)ring_frames, (unsigned)(ring_frames * FRAME_PERIOD_MS / 1000), FRAME_PERIOD_MS / 1000, IN_FLIGHT);
+    printf("%-13s %7s %9s %6s %10s %10s %11s %6s\n", "outage", "missed", "recovered", "lost", "duplicates",
+           "bytes re-sent", "recovery s", "check");
+    for (int i = 0; i < SCENARIO_COUNT; i++) {
+        run(&scenarios[i]);
+    }
+    return 0;
+}
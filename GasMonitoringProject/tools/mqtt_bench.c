@@ -0,0 +1,468 @@
+// Batched QoS 1 MQTT publishing (components/gas_mqtt, components/gas_spool)
+// on the host.
+//
+// The node's publisher, gas_mqtt_session as mqtt_task runs it, with the
+// spool in a file under /tmp, talks to a stand-in broker over a socketpair on
+// a simulated clock in 1 ms steps. The broker answers CONNECT with CONNACK,
+// PINGREQ with PINGRESP and each PUBLISH with a PUBACK one round trip after
+// the PUBLISH is through a link of the given rate, and decodes the payloads to count every frame it got. No Mosquitto
+// is needed; the broker forgets everything on a restart, as a clean session
+// lets it.
+//
+//   1. bytes per frame on air for a few batch sizes, against the TCP link's
+//      one frame per line, and the host CPU time to build a message
+//   2. messages/s while a spool of 60 batches drains, by window and round
+//      trip: stop-and-wait against a window of PUBACKs
+//   3. a broker restart during a run at one frame per 5 s: batches spooled,
+//      frames delivered, duplicates (QoS 1 is at least once) and lost, the
+//      time to reconnect and the time until the spool is empty again. Every
+//      run checks that each frame arrived or was counted lost; past about an
+//      hour the spool is full and its oldest batches are overwritten.
+//
+//   gcc -O2 -I../components/gas_mqtt -I../components/gas_spool
+//       -I../components/gas_link -I../components/gas_channels
+//       -I../components/fastfmt -o mqtt_bench mqtt_bench.c
+//       ../components/gas_mqtt/gas_mqtt.c ../components/gas_mqtt/gas_mqtt_session.c
+//       ../components/gas_spool/gas_spool.c
+//       ../components/gas_link/gas_link.c ../components/gas_channels/gas_channels.c
+//       ../components/fastfmt/fastfmt.c -lm
+//   ./mqtt_bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "gas_mqtt_session.h"
+
+#define FRAME_PERIOD_MS  5000
+#define RING_FRAMES      128        // CONFIG_GAS_LINK_RETX_FRAMES
+#define SPOOL_SLOTS      64         // CONFIG_GAS_MQTT_SPOOL_SLOTS
+#define SPOOL_PATH       "/tmp/mqtt_bench_spool.bin"
+#define TOPIC            "gas/node/frames"
+#define KEEPALIVE_S      60         // CONFIG_GAS_MQTT_KEEPALIVE_S
+#define TCPIP_HEADERS    40         // IPv4 + TCP, no options
+#define MAX_SEQ          8192
+#define MAX_ACKS         64
+
+typedef struct {
+    int batch;                      // frames per message
+    uint32_t batch_ms;
+    int window;
+    uint32_t rtt_ms;
+    uint32_t link_kbps;
+} config_t;
+
+// The node's side: its ring and the session mqtt_task runs
+typedef struct {
+    config_t cfg;
+    gas_link_ring_t ring;
+    gas_link_record_t records[RING_FRAMES];
+    uint16_t boot;
+    int sock;
+    gas_spool_t spool;
+    gas_mqtt_session_t session;
+    gas_link_record_t batch[GAS_MQTT_BATCH_MAX];
+    uint8_t packet[GAS_MQTT_HEADROOM + GAS_MQTT_PAYLOAD_MAX];
+} node_t;
+
+typedef struct {
+    uint16_t packet_id;
+    uint32_t due_ms;
+} pending_ack_t;
+
+typedef struct {
+    bool up;
+    int sock;
+    uint8_t rx[GAS_MQTT_HEADROOM + GAS_MQTT_PAYLOAD_MAX + 16];
+    size_t rx_len;
+    pending_ack_t acks[MAX_ACKS];
+    int ack_count;
+    uint64_t link_free_us;          // the link carries earlier bytes until then
+    uint8_t got[MAX_SEQ];
+    uint32_t messages;
+    uint64_t ack_bytes;
+} broker_t;
+
+static node_t node;
+static broker_t broker;
+static uint32_t now;
+
+// ---- node: the session hooks over a socketpair and the simulated clock ----
+
+static void broker_accept(int sock);
+
+static bool node_get(uint32_t seq, gas_link_record_t *record, void *ctx) {
+    const gas_link_record_t *held = gas_link_ring_get(&node.ring, seq);
+    if (held == NULL) {
+        return false;
+    }
+    *record = *held;
+    return true;
+}
+
+static void node_range(uint32_t *oldest, uint32_t *newest, void *ctx) {
+    *oldest = gas_link_ring_oldest(&node.ring);
+    *newest = node.ring.next_seq - 1;
+}
+
+// A broker that is down refuses at once
+static bool node_connect(void *ctx) {
+    if (!broker.up) {
+        return false;
+    }
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+    int size = 1 << 20;
+    setsockopt(pair[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(pair[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    node.sock = pair[0];
+    broker_accept(pair[1]);
+    return true;
+}
+
+static int node_send(const uint8_t *data, size_t len, void *ctx) {
+    return (int)send(node.sock, data, len, MSG_NOSIGNAL);
+}
+
+static int node_recv(uint8_t *buf, size_t size, void *ctx) {
+    ssize_t len = recv(node.sock, buf, size, MSG_DONTWAIT);
+    if (len < 0 && errno == EAGAIN) {
+        return 0;
+    }
+    return len > 0 ? (int)len : -1;
+}
+
+static void node_close(void *ctx) {
+    close(node.sock);
+    node.sock = -1;
+}
+
+static uint32_t node_now(void *ctx) {
+    return now;
+}
+
+static void node_start(const config_t *cfg) {
+    memset(&node, 0, sizeof(node));
+    node.cfg = *cfg;
+    node.sock = -1;
+    node.boot = 0x1234;
+    gas_link_ring_init(&node.ring, node.records, RING_FRAMES);
+    unlink(SPOOL_PATH);
+    if (!gas_spool_open(&node.spool, SPOOL_PATH, SPOOL_SLOTS, GAS_MQTT_PAYLOAD_MAX)) {
+        perror(SPOOL_PATH);
+        exit(1);
+    }
+    gas_mqtt_config_t config = { .client_id = "gas-node", .topic = TOPIC, .keepalive_s = KEEPALIVE_S,
+                                 .boot = node.boot, .batch = cfg->batch, .batch_ms = cfg->batch_ms,
+                                 .window = cfg->window };
+    gas_mqtt_hooks_t hooks = { .get = node_get, .range = node_range, .connect = node_connect, .send = node_send,
+                               .recv = node_recv, .close = node_close, .now_ms = node_now };
+    if (!gas_mqtt_session_init(&node.session, &config, &hooks, &node.spool)) {
+        fprintf(stderr, "bad session config\n");
+        exit(1);
+    }
+}
+
+static void node_stop(void) {
+    gas_mqtt_session_close(&node.session, "end of run");
+    gas_spool_close(&node.spool);
+}
+
+static void node_step(void) {
+    gas_mqtt_session_step(&node.session);
+    gas_mqtt_session_receive(&node.session);
+}
+
+// What the session does to build a message, for the CPU column
+static int node_payload(uint32_t first, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        node_get(first + i, &node.batch[i], NULL);
+    }
+    return gas_mqtt_batch_format(node.batch, (int)count, node.boot, (char *)node.packet + GAS_MQTT_HEADROOM,
+                                 GAS_MQTT_PAYLOAD_MAX);
+}
+
+static void node_push(uint32_t seq_time_ms) {
+    gas_sample_t sample = { .temperature = 21.37f, .humidity = 45.1f, .ammonia = 12.5f, .h2s = 0.42f,
+                            .co2 = 812.25f, .methane = 150.75f };
+    gas_link_ring_push(&node.ring, &sample, 0, 1700000000000LL + seq_time_ms);
+}
+
+// ---- stand-in broker ----
+
+static void broker_frame(uint16_t boot, uint32_t seq, int64_t capture_ms, const gas_sample_t *sample,
+                         uint32_t anomalies, void *ctx) {
+    if (seq < MAX_SEQ && broker.got[seq] < UINT8_MAX) {
+        broker.got[seq]++;
+    }
+}
+
+static void broker_accept(int sock) {
+    broker.sock = sock;
+    broker.rx_len = 0;
+    broker.ack_count = 0;
+}
+
+// Restart: the session, its unsent PUBACKs and whatever is in the socket go
+static void broker_down(void) {
+    broker.up = false;
+    if (broker.sock >= 0) {
+        close(broker.sock);
+        broker.sock = -1;
+    }
+    broker.ack_count = 0;
+}
+
+static void broker_step(void) {
+    if (broker.sock < 0) {
+        return;
+    }
+    int len;
+    while ((len = recv(broker.sock, broker.rx + broker.rx_len, sizeof(broker.rx) - broker.rx_len, MSG_DONTWAIT)) > 0) {
+        broker.rx_len += len;
+    }
+    // A PUBACK leaves a round trip after the link has carried the PUBLISH
+    while (broker.rx_len >= 2) {
+        size_t remaining = 0;
+        size_t pos = 1;
+        for (int shift = 0; pos < broker.rx_len; shift += 7) {
+            uint8_t byte = broker.rx[pos++];
+            remaining |= (size_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+        if (broker.rx_len - pos < remaining) {
+            break;
+        }
+        size_t used = pos + remaining;
+        uint64_t busy_from = broker.link_free_us > now * 1000ULL ? broker.link_free_us : now * 1000ULL;
+        broker.link_free_us = busy_from + (used + TCPIP_HEADERS) * 8000ULL / node.cfg.link_kbps;
+        const uint8_t *body = broker.rx + pos;
+        uint8_t type = broker.rx[0] & 0xf0;
+        if (type == 0x10) {
+            static const uint8_t connack[] = { 0x20, 2, 0, 0 };
+            send(broker.sock, connack, sizeof(connack), 0);
+        } else if (type == 0xc0) {
+            static const uint8_t pingresp[] = { 0xd0, 0 };
+            send(broker.sock, pingresp, sizeof(pingresp), 0);
+        } else if (type == 0x30) {
+            size_t topic_len = (size_t)body[0] << 8 | body[1];
+            uint16_t packet_id = (uint16_t)(body[2 + topic_len] << 8 | body[3 + topic_len]);
+            const char *payload = (const char *)body + 4 + topic_len;
+            if (gas_mqtt_batch_parse(payload, remaining - 4 - topic_len, broker_frame, NULL) < 0) {
+                fprintf(stderr, "broker: malformed payload\n");
+                exit(1);
+            }
+            broker.messages++;
+            if (broker.ack_count < MAX_ACKS) {
+                broker.acks[broker.ack_count++] = (pending_ack_t){ packet_id, (uint32_t)(broker.link_free_us / 1000) + node.cfg.rtt_ms };
+            }
+        }
+        broker.rx_len -= used;
+        memmove(broker.rx, broker.rx + used, broker.rx_len);
+    }
+    for (int i = 0; i < broker.ack_count;) {
+        if ((int32_t)(now - broker.acks[i].due_ms) < 0) {
+            i++;
+            continue;
+        }
+        uint8_t puback[4] = { 0x40, 2, broker.acks[i].packet_id >> 8, broker.acks[i].packet_id & 0xff };
+        send(broker.sock, puback, sizeof(puback), 0);
+        broker.ack_bytes += sizeof(puback) + TCPIP_HEADERS;
+        broker.acks[i] = broker.acks[--broker.ack_count];
+    }
+}
+
+// ---- runs ----
+
+static void broker_start(void) {
+    memset(&broker, 0, sizeof(broker));
+    broker.sock = -1;
+    broker.up = true;
+}
+
+static void step(bool produce) {
+    if (produce && now % FRAME_PERIOD_MS == 0) {
+        node_push(now);
+    }
+    node_step();
+    broker_step();
+    now++;
+}
+
+static double wall_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// Bytes on air per frame, headers included, and the CPU to build a message
+static void bench_bytes(void) {
+    static const int batches[] = { 1, 4, 12, 20 };
+    config_t cfg = { .batch = 1, .window = 1, .link_kbps = 5000 };
+    node_start(&cfg);
+    for (int i = 0; i < GAS_MQTT_BATCH_MAX; i++) {
+        node_push(i * FRAME_PERIOD_MS);
+    }
+
+    char line[128 + GAS_LINK_SUFFIX_LEN];
+    int frame_len = gas_link_format(gas_link_ring_get(&node.ring, 1), GAS_CH_ALL, node.boot, line, sizeof(line)) + 1;
+    printf("1. bytes per frame, TCP/IP headers of %d bytes per segment included\n\n", TCPIP_HEADERS);
+    printf("%-22s %9s %9s %9s %12s\n", "", "payload", "packet", "on air", "CPU us/msg");
+    printf("%-22s %9d %9d %9d %12s\n", "TCP link, per line", frame_len, frame_len, frame_len + 2 * TCPIP_HEADERS, "-");
+    for (int b = 0; b < (int)(sizeof(batches) / sizeof(batches[0])); b++) {
+        int count = batches[b];
+        int iterations = 20000;
+        int payload = 0;
+        int start = 0;
+        double t0 = wall_us();
+        for (int i = 0; i < iterations; i++) {
+            payload = node_payload(1, count);
+            start = gas_mqtt_publish_header(node.packet, TOPIC, payload, (uint16_t)(i + 1));
+        }
+        double us = (wall_us() - t0) / iterations;
+        int packet = GAS_MQTT_HEADROOM - start + payload;
+        double on_air = packet + TCPIP_HEADERS + 4 + TCPIP_HEADERS;    // PUBLISH and its PUBACK
+        char name[32];
+        snprintf(name, sizeof(name), "MQTT, %d per message", count);
+        printf("%-22s %9.1f %9.1f %9.1f %12.2f\n", name, (double)payload / count, (double)packet / count,
+               on_air / count, us);
+    }
+    gas_spool_close(&node.spool);
+    printf("\n");
+}
+
+// A spool of 60 full batches drained after the broker comes back
+static void bench_drain(void) {
+    static const uint32_t rtts[] = { 5, 30, 100 };
+    static const int windows[] = { 1, 2, 4, 8, 16 };
+    const int spooled = 60;
+    printf("2. draining %d spooled batches of 12 frames over a 5 Mb/s link, messages/s\n\n", spooled);
+    printf("%-10s", "RTT ms");
+    for (int w = 0; w < (int)(sizeof(windows) / sizeof(windows[0])); w++) {
+        char name[16];
+        snprintf(name, sizeof(name), "window %d", windows[w]);
+        printf(" %10s", name);
+    }
+    printf("\n");
+    for (int r = 0; r < (int)(sizeof(rtts) / sizeof(rtts[0])); r++) {
+        printf("%-10u", (unsigned)rtts[r]);
+        for (int w = 0; w < (int)(sizeof(windows) / sizeof(windows[0])); w++) {
+            config_t cfg = { .batch = 12, .batch_ms = 60000, .window = windows[w], .rtt_ms = rtts[r], .link_kbps = 5000 };
+            now = 0;
+            node_start(&cfg);
+            broker_start();
+            broker.up = false;
+            for (int i = 0; i < spooled * cfg.batch; i++) {
+                node_push((uint32_t)i * FRAME_PERIOD_MS);
+                gas_mqtt_session_step(&node.session);
+            }
+            broker.up = true;
+            node.session.retry_at = now;
+            uint32_t start = now;
+            while (gas_spool_count(&node.spool) > 0 || node.session.window.count > 0) {
+                step(false);
+            }
+            double seconds = (now - start) / 1000.0;
+            printf(" %10.1f", node.session.messages / seconds);
+            node_stop();
+            broker_down();
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+typedef struct {
+    const char *name;
+    uint32_t outage_ms;
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "10 s", 10000 },
+    { "1 min", 60000 },
+    { "10 min", 600000 },
+    { "1 h", 3600000 },
+    { "2 h", 7200000 },
+};
+#define SCENARIO_COUNT (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static void run_restart(const scenario_t *scenario) {
+    config_t cfg = { .batch = 12, .batch_ms = 60000, .window = 4, .rtt_ms = 30, .link_kbps = 5000 };
+    now = 0;
+    node_start(&cfg);
+    broker_start();
+
+    // The cut comes while the third batch is in flight, after the broker
+    // took it but before its PUBACK
+    uint32_t cut_ms = 2 * 60000 + 55000 + cfg.rtt_ms / 2;
+    uint32_t back_ms = cut_ms + scenario->outage_ms;
+    uint32_t end_ms = back_ms + 600000;
+    uint32_t reconnect_ms = 0;
+    uint32_t recovered_ms = 0;
+    uint32_t spool_peak = 0;
+    while (now < end_ms) {
+        if (now == cut_ms) {
+            broker_down();
+        }
+        if (now == back_ms) {
+            broker.up = true;
+        }
+        step(true);
+        if (gas_spool_count(&node.spool) > spool_peak) {
+            spool_peak = gas_spool_count(&node.spool);
+        }
+        if (now > back_ms && reconnect_ms == 0 && node.session.state == GAS_MQTT_UP) {
+            reconnect_ms = now - back_ms;
+        }
+        if (now > back_ms && reconnect_ms != 0 && recovered_ms == 0 && gas_spool_count(&node.spool) == 0 &&
+            node.session.window.count == 0) {
+            recovered_ms = now - back_ms;
+        }
+    }
+    // No new frames: the last batch times out and everything is acknowledged
+    for (uint32_t stop = now + cfg.batch_ms + 1000; now < stop || node.session.window.count > 0;) {
+        step(false);
+    }
+
+    uint32_t frames = node.ring.next_seq - 1;
+    uint32_t delivered = 0;
+    uint32_t duplicates = 0;
+    uint32_t missing = 0;
+    for (uint32_t seq = 1; seq <= frames && seq < MAX_SEQ; seq++) {
+        delivered += broker.got[seq] > 0;
+        duplicates += broker.got[seq] > 1 ? broker.got[seq] - 1 : 0;
+        missing += broker.got[seq] == 0;
+    }
+    // Overwritten spool entries are full batches; the oldest may be the one
+    // the broker took just before the cut, so then some of them did arrive
+    uint32_t lost = node.session.frames_lost + node.spool.dropped * cfg.batch;
+    bool consistent = node.spool.dropped > 0 ? missing <= lost : missing == lost;
+    printf("%-8s %7u %10u %8u %11u %5u %11.1f %11.1f %6s\n", scenario->name, (unsigned)frames, (unsigned)spool_peak,
+           (unsigned)delivered, (unsigned)duplicates, (unsigned)lost, reconnect_ms / 1000.0, recovered_ms / 1000.0,
+           consistent ? "yes" : "NO");
+    node_stop();
+    broker_down();
+}
+
+int main(void) {
+    bench_bytes();
+    bench_drain();
+
+    printf("3. broker restart, one frame per %d s, batches of 12, window 4, RTT 30 ms, spool of %d\n\n",
+           FRAME_PERIOD_MS / 1000, SPOOL_SLOTS);
+    printf("%-8s %7s %10s %8s %11s %5s %11s %11s %6s\n", "outage", "frames", "spool peak", "arrived", "duplicates",
+           "lost", "reconnect s", "recovery s", "check");
+    for (int i = 0; i < (int)SCENARIO_COUNT; i++) {
+        run_restart(&scenarios[i]);
+    }
+    unlink(SPOOL_PATH);
+    return 0;
+}
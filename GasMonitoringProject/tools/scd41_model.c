@@ -0,0 +1,315 @@
+// Scripted SCD41 on a simulated clock, driving the node's SCD41 driver
+// (TempSensor/main/scd41.c) through the acquisition scheduler the way
+// acq_task does.
+//
+// The model follows the datasheet where the driver depends on it: commands
+// need their execution time before the read (earlier reads NACK), only the
+// read, data-ready, pressure and stop commands are accepted while measuring,
+// read_measurement NACKs while no new measurement is in, and every word
+// carries its CRC. The sensor clock runs 0.3% slow against the node's, so
+// the measurements drift through every phase of the poll period. CO2
+// follows a script: 450 ppm, a step to 1500 ppm ten minutes in, decaying
+// back over the following twenty.
+//
+// For each mode and data-ready poll period prints the measurements the
+// sensor made and the node read, the ones overwritten before they were read,
+// the mean and worst time from data ready to read, the I2C transactions per
+// measurement, the bus time per minute at 100 kHz and any value
+// mismatches. --corrupt N flips a CRC bit in every Nth measurement to show
+// those are dropped.
+//
+//   gcc -O2 -I../TempSensor/main -I../components/gas_channels -o scd41_model
+//       scd41_model.c ../TempSensor/main/scd41.c ../TempSensor/main/acq_sched.c
+//       ../TempSensor/main/adaptive_sampling.c -lm
+//   ./scd41_model [--minutes 60] [--corrupt 0]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "scd41.h"
+#include "acq_sched.h"
+
+#define TICK_MS         10      // FreeRTOS tick on the node
+#define I2C_BIT_US      10      // 100 kHz
+#define DRIFT_PPM       3000    // sensor oscillator against the node's, walks the poll phase
+
+static const uint32_t poll_periods[] = { 250, 500, 1000, 2000, 5000 };
+
+typedef struct {
+    uint32_t now_ms;
+    bool periodic;
+    uint32_t interval_ms;
+    uint32_t next_measure_ms;
+    uint32_t busy_until_ms;     // stop_periodic settling
+    uint16_t command;           // last command, answered by the next read
+    uint32_t command_ms;
+    bool ready;
+    uint32_t ready_ms;
+    uint16_t words[3];          // latest measurement
+    uint16_t altitude_m;
+    uint16_t pressure_hpa;
+    int corrupt_every;
+
+    // Accounting
+    uint32_t produced;
+    uint32_t overwritten;
+    uint32_t read;
+    uint32_t corrupted;
+    uint32_t nacks;
+    uint64_t bus_us;
+    double latency_sum_ms;
+    uint32_t latency_max_ms;
+} scd41_model_t;
+
+static scd41_model_t model;
+
+static double co2_script(uint32_t t_ms) {
+    double t_s = t_ms / 1000.0;
+    if (t_s < 600) {
+        return 450;
+    }
+    return 450 + 1050 * exp(-(t_s - 600) / 400.0);
+}
+
+static void model_advance(void) {
+    while (model.periodic && (int32_t)(model.now_ms - model.next_measure_ms) >= 0) {
+        if (model.ready) {
+            model.overwritten++;
+        }
+        model.words[0] = (uint16_t)lround(co2_script(model.next_measure_ms));
+        model.words[1] = (uint16_t)lround((22.0 + 45.0) * 65535.0 / 175.0);
+        model.words[2] = (uint16_t)lround(50.0 * 65535.0 / 100.0);
+        model.ready = true;
+        model.ready_ms = model.next_measure_ms;
+        model.produced++;
+        model.next_measure_ms += model.interval_ms;
+    }
+}
+
+static void model_account(size_t len) {
+    // Start, address byte, data bytes with their ACKs, stop
+    model.bus_us += (uint64_t)((len + 1) * 9 + 2) * I2C_BIT_US;
+}
+
+static esp_err_t model_nack(void) {
+    model.nacks++;
+    return ESP_FAIL;
+}
+
+esp_err_t scd41_bus_write(const uint8_t *data, size_t len) {
+    model_advance();
+    model_account(len);
+    if ((int32_t)(model.now_ms - model.busy_until_ms) < 0 || (len != 2 && len != 5)) {
+        return model_nack();
+    }
+    uint16_t command = (uint16_t)(data[0] << 8 | data[1]);
+    uint16_t arg = 0;
+    if (len == 5) {
+        if (scd41_crc(&data[2]) != data[4]) {
+            return model_nack();
+        }
+        arg = (uint16_t)(data[2] << 8 | data[3]);
+    }
+    bool measuring_ok = command == SCD41_CMD_READ_MEASUREMENT || command == SCD41_CMD_GET_DATA_READY ||
+                        command == SCD41_CMD_SET_AMBIENT_PRESSURE || command == SCD41_CMD_STOP_PERIODIC;
+    if (model.periodic && !measuring_ok) {
+        return model_nack();
+    }
+    if (command == SCD41_CMD_READ_MEASUREMENT && !model.ready) {
+        return model_nack();
+    }
+
+    switch (command) {
+    case SCD41_CMD_START_PERIODIC:
+    case SCD41_CMD_START_LOW_POWER:
+        model.periodic = true;
+        model.interval_ms = command == SCD41_CMD_START_PERIODIC ? 5000 : 30000;
+        model.interval_ms += model.interval_ms * DRIFT_PPM / 1000000;
+        model.next_measure_ms = model.now_ms + model.interval_ms;
+        break;
+    case SCD41_CMD_STOP_PERIODIC:
+        model.periodic = false;
+        model.busy_until_ms = model.now_ms + SCD41_STOP_MS;
+        break;
+    case SCD41_CMD_SET_ALTITUDE:
+        model.altitude_m = arg;
+        break;
+    case SCD41_CMD_SET_AMBIENT_PRESSURE:
+        model.pressure_hpa = arg;
+        break;
+    case SCD41_CMD_GET_DATA_READY:
+    case SCD41_CMD_READ_MEASUREMENT:
+    case SCD41_CMD_GET_SERIAL:
+        break;
+    default:
+        return model_nack();
+    }
+    model.command = command;
+    model.command_ms = model.now_ms;
+    return ESP_OK;
+}
+
+esp_err_t scd41_bus_read(uint8_t *data, size_t len) {
+    model_advance();
+    model_account(len);
+    if (model.now_ms - model.command_ms < SCD41_COMMAND_MS) {
+        return model_nack();
+    }
+    uint16_t words[3];
+    int count;
+    bool corrupt = false;
+    switch (model.command) {
+    case SCD41_CMD_GET_DATA_READY:
+        words[0] = model.ready ? 0x8006 : 0x8000;
+        count = 1;
+        break;
+    case SCD41_CMD_READ_MEASUREMENT:
+        memcpy(words, model.words, sizeof(words));
+        count = 3;
+        model.ready = false;
+        model.read++;
+        uint32_t latency = model.now_ms - model.ready_ms;
+        model.latency_sum_ms += latency;
+        if (latency > model.latency_max_ms) {
+            model.latency_max_ms = latency;
+        }
+        corrupt = model.corrupt_every > 0 && model.read % model.corrupt_every == 0;
+        model.corrupted += corrupt;
+        break;
+    case SCD41_CMD_GET_SERIAL:
+        words[0] = 0x1234;
+        words[1] = 0x5678;
+        words[2] = 0x9abc;
+        count = 3;
+        break;
+    default:
+        return model_nack();
+    }
+    model.command = 0;
+    if (len != (size_t)count * 3) {
+        return model_nack();
+    }
+    for (int i = 0; i < count; i++) {
+        data[i * 3] = words[i] >> 8;
+        data[i * 3 + 1] = words[i] & 0xff;
+        data[i * 3 + 2] = scd41_crc(&data[i * 3]);
+    }
+    if (corrupt) {
+        data[2] ^= 0x01;
+    }
+    return ESP_OK;
+}
+
+void scd41_bus_delay(uint32_t ms) {
+    model.now_ms += ms;
+}
+
+// The node's adapters, as in hello_world_main.c
+static uint32_t mismatches;
+
+static int32_t scd41_start(void *ctx) {
+    switch (scd41_step()) {
+    case SCD41_STEP_AGAIN:
+        return ACQ_STEP(SCD41_COMMAND_MS);
+    case SCD41_STEP_FETCH:
+        return SCD41_COMMAND_MS;
+    case SCD41_STEP_NO_DATA:
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static bool scd41_collect(void *ctx, gas_sample_t *sample) {
+    scd41_measurement_t measurement;
+    if (scd41_fetch(&measurement) != ESP_OK) {
+        return false;
+    }
+    mismatches += measurement.co2_ppm != model.words[0] || fabsf(measurement.temperature_c - 22.0f) > 0.01f ||
+                  fabsf(measurement.humidity - 50.0f) > 0.01f;
+    sample->co2 = measurement.co2_ppm;
+    return true;
+}
+
+static int run(bool low_power, uint32_t poll_ms, uint32_t minutes, int corrupt_every, bool print_header) {
+    memset(&model, 0, sizeof(model));
+    model.corrupt_every = corrupt_every;
+    mismatches = 0;
+
+    scd41_config_t config = { .low_power = low_power, .pressure_hpa = 950 };
+    uint64_t serial = 0;
+    if (scd41_init(&config, &serial) != ESP_OK || serial != 0x123456789abcULL || model.pressure_hpa != 950) {
+        printf("init failed\n");
+        return 1;
+    }
+    scd41_stats_t init_stats;
+    scd41_get_stats(&init_stats);
+
+    acq_job_t job = { .name = "scd41", .period_ms = poll_ms, .start = scd41_start, .collect = scd41_collect };
+    acq_sched_t sched;
+    gas_sample_t sample = { 0 };
+    acq_init(&sched);
+    acq_add(&sched, &job, model.now_ms);
+
+    uint32_t end_ms = model.now_ms + minutes * 60000;
+    uint32_t published = 0;
+    while ((int32_t)(model.now_ms - end_ms) < 0) {
+        int32_t wait_ms = acq_time_until_due(&sched, model.now_ms);
+        if (wait_ms > 0) {
+            // Round up to whole ticks, as vTaskDelay does
+            model.now_ms += (wait_ms + TICK_MS - 1) / TICK_MS * TICK_MS;
+            continue;
+        }
+        published += acq_run(&sched, model.now_ms, &sample) != NULL;
+    }
+
+    scd41_stats_t stats;
+    scd41_get_stats(&stats);
+    uint32_t transactions = stats.transactions - init_stats.transactions;
+    // A measurement still waiting at the end is not a loss
+    uint32_t lost = model.produced - model.read - model.ready;
+    if (print_header) {
+        printf("%-9s %7s %8s %6s %6s %6s %9s %9s %8s %9s %4s %5s %5s\n", "mode", "poll ms", "measured", "read",
+               "lost", "pub", "mean ms", "worst ms", "txn/meas", "bus us/m", "crc", "nack", "bad");
+    }
+    printf("%-9s %7u %8u %6u %6u %6u %9.0f %9u %8.1f %9.0f %4u %5u %5u\n", low_power ? "low-power" : "periodic",
+           poll_ms, model.produced, model.read, lost, published,
+           model.read ? model.latency_sum_ms / model.read : 0.0, model.latency_max_ms,
+           model.read ? (double)transactions / model.read : 0.0, (double)model.bus_us / minutes,
+           stats.crc_failures, model.nacks, mismatches);
+
+    // Every read reached the node unless its CRC was corrupted, values intact,
+    // and never later than a poll period plus the two command steps
+    int errors = mismatches != 0 || published != model.read - model.corrupted ||
+                 stats.crc_failures != model.corrupted || model.nacks != 0 ||
+                 model.latency_max_ms > poll_ms + 2 * TICK_MS;
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    uint32_t minutes = 60;
+    int corrupt_every = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--minutes") == 0 && i + 1 < argc) {
+            minutes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--corrupt") == 0 && i + 1 < argc) {
+            corrupt_every = atoi(argv[++i]);
+        }
+    }
+    if (minutes < 1) {
+        fprintf(stderr, "minutes must be at least 1\n");
+        return 1;
+    }
+
+    int errors = 0;
+    bool header = true;
+    for (int mode = 0; mode < 2; mode++) {
+        for (int p = 0; p < sizeof(poll_periods) / sizeof(poll_periods[0]); p++) {
+            errors += run(mode == 1, poll_periods[p], minutes, corrupt_every, header);
+            header = false;
+        }
+    }
+    printf("\n%s\n", errors == 0 ? "all checks passed" : "CHECKS FAILED");
+    return errors != 0;
+}
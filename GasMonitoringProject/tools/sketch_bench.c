@@ -0,0 +1,214 @@
+// Accuracy, size and speed of the quantile sketch (components/gas_sketch).
+//
+// For the gas channels of sensor_data.csv and a day of synthetic 1 s
+// samples (log-normal, heavy-tailed Pareto, and a spread wider than the
+// kept buckets) prints the largest relative error of the sketch's P50 to
+// P99.9 against the exact quantiles of the sorted samples, how many of them
+// the sketch vouches for, the serialized size and the host time per add,
+// per quantile and per merge. Then checks that a sketch rebuilt from eight
+// serialized parts answers like the one built from all the samples.
+//
+// With --merge, reads sketches as served by GET /sketch from the given
+// files, merges them and prints their percentiles, e.g. one file per node.
+//
+//   gcc -O2 -I../components/gas_sketch -I../components/gas_channels
+//       -I../components/fastfmt -o sketch_bench sketch_bench.c
+//       ../components/gas_sketch/gas_sketch.c ../components/gas_channels/gas_channels.c
+//       ../components/fastfmt/fastfmt.c -lm
+//   ./sketch_bench [--file ../TempSensor/partition/sensor_data.csv]
+//   ./sketch_bench --merge node1.bin node2.bin ...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gas_sketch.h"
+#include "gas_channels.h"
+
+#define DAY_SAMPLES 86400
+#define MAX_ROWS    8192
+#define PARTS       8
+#define REPEAT      20      // passes when timing
+
+static const float quantiles[] = { 0.5f, 0.9f, 0.95f, 0.99f, 0.999f };
+#define QUANTILE_COUNT (sizeof(quantiles) / sizeof(quantiles[0]))
+
+static const gas_channel_t gas_inputs[] = { GAS_CH_AMMONIA, GAS_CH_H2S, GAS_CH_CO2, GAS_CH_METHANE };
+#define GAS_INPUT_COUNT (sizeof(gas_inputs) / sizeof(gas_inputs[0]))
+
+static gas_sample_t rows[MAX_ROWS];
+static float values[DAY_SAMPLES];
+static float sorted[DAY_SAMPLES];
+
+static int load_rows(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[256];
+    int count = 0;
+    fgets(line, sizeof(line), file); // header
+    while (count < MAX_ROWS && fgets(line, sizeof(line), file) != NULL) {
+        if (gas_csv_parse(line, &rows[count], NULL) > 0) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double uniform(void) {
+    return (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+}
+
+static double gaussian(void) {
+    return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+static int compare_floats(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, int count) {
+    static gas_sketch_t sketch, merged, part;
+    static uint8_t buf[GAS_SKETCH_SERIALIZED_MAX];
+
+    gas_sketch_init(&sketch);
+    double start = now_ns();
+    for (int r = 0; r < REPEAT; r++) {
+        gas_sketch_init(&sketch);
+        for (int i = 0; i < count; i++) {
+            gas_sketch_add(&sketch, values[i]);
+        }
+    }
+    double add_ns = (now_ns() - start) / ((double)REPEAT * count);
+
+    volatile float sink = 0;
+    start = now_ns();
+    for (int r = 0; r < REPEAT * 100; r++) {
+        sink += gas_sketch_quantile(&sketch, 0.99f);
+    }
+    double quantile_ns = (now_ns() - start) / (REPEAT * 100);
+
+    start = now_ns();
+    for (int r = 0; r < REPEAT * 100; r++) {
+        gas_sketch_init(&merged);
+        gas_sketch_merge(&merged, &sketch);
+    }
+    double merge_ns = (now_ns() - start) / (REPEAT * 100);
+
+    memcpy(sorted, values, count * sizeof(float));
+    qsort(sorted, count, sizeof(float), compare_floats);
+    double max_error = 0;
+    int reliable = 0;
+    for (int q = 0; q < QUANTILE_COUNT; q++) {
+        if (!gas_sketch_reliable(&sketch, quantiles[q])) {
+            continue;
+        }
+        float exact = sorted[(int)(quantiles[q] * (count - 1))];
+        float estimate = gas_sketch_quantile(&sketch, quantiles[q]);
+        max_error = fmax(max_error, fabs(estimate - exact) / fabs(exact));
+        reliable++;
+    }
+
+    // Sketches of consecutive slices, through the wire format
+    gas_sketch_init(&merged);
+    for (int p = 0; p < PARTS; p++) {
+        gas_sketch_init(&part);
+        for (int i = p * count / PARTS; i < (p + 1) * count / PARTS; i++) {
+            gas_sketch_add(&part, values[i]);
+        }
+        size_t len = gas_sketch_serialize(&part, buf, sizeof(buf));
+        if (!gas_sketch_deserialize(&part, buf, len)) {
+            printf("%s: part %d does not deserialize\n", name, p);
+            exit(1);
+        }
+        gas_sketch_merge(&merged, &part);
+    }
+    bool same = merged.count == sketch.count;
+    for (int q = 0; q < QUANTILE_COUNT; q++) {
+        bool both = gas_sketch_reliable(&sketch, quantiles[q]) && gas_sketch_reliable(&merged, quantiles[q]);
+        same &= !both || gas_sketch_quantile(&merged, quantiles[q]) == gas_sketch_quantile(&sketch, quantiles[q]);
+    }
+
+    size_t len = gas_sketch_serialize(&sketch, buf, sizeof(buf));
+    printf("%-10s %7d %8.2f%% %5d/%zu %8zu %8.1f %8.1f %8.1f %6s\n", name, count, 100 * max_error, reliable,
+           QUANTILE_COUNT, len, add_ns, quantile_ns, merge_ns, same ? "yes" : "NO");
+}
+
+static int merge_files(int argc, char **argv) {
+    static gas_sketch_t merged, sketch;
+    static uint8_t buf[GAS_SKETCH_SERIALIZED_MAX];
+    gas_sketch_init(&merged);
+    for (int i = 0; i < argc; i++) {
+        FILE *file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        size_t len = fread(buf, 1, sizeof(buf), file);
+        fclose(file);
+        if (!gas_sketch_deserialize(&sketch, buf, len)) {
+            fprintf(stderr, "%s: not a sketch\n", argv[i]);
+            return 1;
+        }
+        gas_sketch_merge(&merged, &sketch);
+    }
+    printf("%u samples from %d sketches, min %g, max %g\n", (unsigned)merged.count, argc, merged.min, merged.max);
+    for (int q = 0; q < QUANTILE_COUNT; q++) {
+        if (gas_sketch_reliable(&merged, quantiles[q])) {
+            printf("p%-5g %g\n", 100 * quantiles[q], gas_sketch_quantile(&merged, quantiles[q]));
+        } else {
+            printf("p%-5g below the kept range\n", 100 * quantiles[q]);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "../TempSensor/partition/sensor_data.csv";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--merge") == 0) {
+            return merge_files(argc - i - 1, argv + i + 1);
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        }
+    }
+
+    printf("sketch: %zu bytes in RAM, %d buckets, %.2f%% relative accuracy, serialized at most %d bytes\n\n",
+           sizeof(gas_sketch_t), GAS_SKETCH_BUCKETS, 100 * GAS_SKETCH_ACCURACY, GAS_SKETCH_SERIALIZED_MAX);
+    printf("%-10s %7s %9s %7s %8s %8s %8s %8s %6s\n", "dataset", "samples", "max err", "vouched", "bytes",
+           "ns/add", "ns/quant", "ns/merge", "merge");
+
+    int count = load_rows(path);
+    for (int c = 0; c < GAS_INPUT_COUNT && count > 0; c++) {
+        for (int i = 0; i < count; i++) {
+            values[i] = rows[i].values[gas_inputs[c]];
+        }
+        report(gas_channel_names[gas_inputs[c]], count);
+    }
+
+    srand(1);
+    for (int i = 0; i < DAY_SAMPLES; i++) {
+        values[i] = (float)(5 * exp(0.8 * gaussian()));          // ppm around 5, a day at 1 s
+    }
+    report("lognormal", DAY_SAMPLES);
+    for (int i = 0; i < DAY_SAMPLES; i++) {
+        values[i] = (float)(2 / pow(uniform(), 1 / 1.5));      // Pareto, alpha 1.5
+    }
+    report("pareto", DAY_SAMPLES);
+    for (int i = 0; i < DAY_SAMPLES; i++) {
+        values[i] = (float)exp2(24 * uniform() - 8);            // 2^-8 to 2^16, past the kept octaves
+    }
+    report("wide", DAY_SAMPLES);
+    return 0;
+}
@@ -0,0 +1,96 @@
+# Pass/fail runner for the heap soak test (CONFIG_GAS_HEAP_SOAK_TEST).
+#
+# Watches the console of a node or gateway built with the soak test on,
+# live from a serial port or from a log saved by an earlier run, and exits
+# 0 once the heap guard logs that the test passed, 1 if it fails, the board
+# panics or reboots, or the console goes quiet for longer than --idle.
+#
+#   python soak_monitor.py --port /dev/ttyUSB0 --save soak.log
+#   python soak_monitor.py --file soak.log
+
+import argparse
+import re
+import sys
+import time
+
+PASSED_RE = re.compile(r'Heap soak test passed after (\d+) h')
+PROGRESS_RE = re.compile(r'Heap soak (\d+) min, free (\d+) bytes, min free (\d+) bytes')
+FAILED = [
+    'Heap soak test failed',
+    'Free heap drifted',
+    'Guru Meditation',
+    'abort() was called',
+    'rst:0x',           # ROM boot banner: the board restarted mid-run
+]
+
+def check_line(line):
+    """Returns True (passed), False (failed) or None (keep watching)."""
+    progress = PROGRESS_RE.search(line)
+    if progress:
+        minutes, free_heap, min_free = (int(value) for value in progress.groups())
+        print(f'{minutes:>6} min  free {free_heap:>7}  min free {min_free:>7}')
+        return None
+    if PASSED_RE.search(line):
+        print(f'PASS: {line}')
+        return True
+    for marker in FAILED:
+        if marker in line:
+            print(f'FAIL: {line}')
+            return False
+    return None
+
+def watch_serial(port, baud, save, idle_s):
+    import serial  # pyserial, only needed for live capture
+    log = open(save, 'w') if save else None
+    last = time.monotonic()
+    try:
+        with serial.Serial(port, baud, timeout=1) as uart:
+            while True:
+                raw = uart.readline()
+                if not raw:
+                    if time.monotonic() - last > idle_s:
+                        print(f'FAIL: no console output for {idle_s} s')
+                        return False
+                    continue
+                last = time.monotonic()
+                line = raw.decode(errors='replace').strip()
+                if log:
+                    log.write(line + '\n')
+                    log.flush()
+                result = check_line(line)
+                if result is not None:
+                    return result
+    except KeyboardInterrupt:
+        print('FAIL: stopped before the soak test finished')
+        return False
+    finally:
+        if log:
+            log.close()
+
+def watch_file(path):
+    with open(path) as log:
+        for line in log:
+            result = check_line(line.strip())
+            if result is not None:
+                return result
+    print('FAIL: log ends before the soak test finished')
+    return False
+
+def main():
+    parser = argparse.ArgumentParser(description='Pass/fail runner for the heap soak test')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--port', help='console UART, e.g. /dev/ttyUSB0')
+    source.add_argument('--file', help='log saved with --save')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--save', help='save the console output')
+    parser.add_argument('--idle', type=int, default=300, help='fail after this many silent seconds')
+    args = parser.parse_args()
+
+    if args.port:
+        passed = watch_serial(args.port, args.baud, args.save, args.idle)
+    else:
+        passed = watch_file(args.file)
+    sys.exit(0 if passed else 1)
+
+if __name__ == '__main__':
+    main()
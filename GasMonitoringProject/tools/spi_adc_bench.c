@@ -0,0 +1,109 @@
+// Scan rate and bus utilization of the SPI ADC driver (components/spi_adc)
+// against the simulated converter.
+//
+// First checks that a scan returns every input's code in frame order. Then,
+// for each SPI clock and frames-per-scan setting, prints the bus time per
+// frame, the highest frame rate the bus allows, the bus share at the chosen
+// sampling rate and the wake-ups per second of the waiting task. The bus
+// model counts the 24 data clocks and the chip-select gap of each
+// conversion; --gap-us adds a fixed software gap per queued transaction for
+// a rough idea of the interrupt cost on the node.
+//
+//   gcc -O2 -I../components/spi_adc -I../components/adc_frontend -o spi_adc_bench
+//       spi_adc_bench.c ../components/spi_adc/spi_adc.c ../components/adc_frontend/adc_sim.c
+//   ./spi_adc_bench [--rate 5000] [--channels 4] [--gap-us 0]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "spi_adc.h"
+
+#define VREF 3.3f
+#define BENCH_SCANS 20000
+
+static const int clocks[] = { 500000, 1000000, 2000000 };
+static const int bursts[] = { 1, 4, 16 };
+
+static adc_sim_t sim;
+static uint16_t frames[SPI_ADC_MAX_TRANSACTIONS];
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Noise-free inputs at distinct codes must come back exactly, in order
+static int check_order(int channels) {
+    adc_sim_init(&sim, VREF, 0.0f, 1);
+    for (int ch = 0; ch < channels; ch++) {
+        adc_sim_set_input(&sim, ch, (100 + 500 * ch) * VREF / (1 << ADC_SIM_BITS));
+    }
+    spi_adc_config_t config = { .clock_hz = 1000000, .channels = channels, .sim = &sim };
+    int errors = 0;
+    if (spi_adc_init(&config) != ESP_OK) {
+        return 1;
+    }
+    for (int count = 1; count * channels <= SPI_ADC_MAX_TRANSACTIONS; count++) {
+        memset(frames, 0xff, sizeof(frames));
+        if (spi_adc_scan(frames, count) != ESP_OK) {
+            errors++;
+            continue;
+        }
+        for (int i = 0; i < count * channels; i++) {
+            errors += frames[i] != 100 + 500 * (i % channels);
+        }
+    }
+    errors += spi_adc_scan(frames, SPI_ADC_MAX_TRANSACTIONS / channels + 1) != ESP_ERR_INVALID_ARG;
+    printf("order check: %s\n\n", errors == 0 ? "ok" : "FAILED");
+    return errors;
+}
+
+int main(int argc, char **argv) {
+    int rate = 5000;
+    int channels = 4;
+    double gap_us = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--channels") == 0 && i + 1 < argc) {
+            channels = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--gap-us") == 0 && i + 1 < argc) {
+            gap_us = atof(argv[++i]);
+        }
+    }
+    if (channels < 1 || channels > SPI_ADC_MAX_CHANNELS) {
+        fprintf(stderr, "channels must be 1..%d\n", SPI_ADC_MAX_CHANNELS);
+        return 1;
+    }
+    int errors = check_order(channels);
+
+    printf("%d channels, %d frames/s, %.1f us software gap per transaction\n", channels, rate, gap_us);
+    printf("one read per channel would wake the reader %d times/s\n", rate * channels);
+    printf("%9s %7s %12s %12s %8s %10s %12s\n", "clock Hz", "frames", "bus us/frm", "max frm/s", "bus %",
+           "wakeups/s", "host ns/cnv");
+    adc_sim_init(&sim, VREF, 1.0f, 1);
+    for (int c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++) {
+        for (int b = 0; b < sizeof(bursts) / sizeof(bursts[0]); b++) {
+            int count = bursts[b];
+            if (count * channels > SPI_ADC_MAX_TRANSACTIONS) {
+                continue;
+            }
+            spi_adc_config_t config = { .clock_hz = clocks[c], .channels = channels, .sim = &sim };
+            spi_adc_init(&config);
+            double start = now_ns();
+            for (int s = 0; s < BENCH_SCANS; s++) {
+                spi_adc_scan(frames, count);
+            }
+            double host_ns = (now_ns() - start) / ((double)BENCH_SCANS * count * channels);
+
+            spi_adc_stats_t stats;
+            spi_adc_get_stats(&stats);
+            double frame_us = (double)stats.bus_us / ((double)stats.scans * count) + gap_us * channels;
+            printf("%9d %7d %12.1f %12.0f %8.1f %10.1f %12.1f\n", clocks[c], count, frame_us, 1e6 / frame_us,
+                   100.0 * rate * frame_us / 1e6, (double)rate / count, host_ns);
+        }
+    }
+    return errors != 0;
+}
@@ -0,0 +1,414 @@
+// Host check and bench of the tokenized log (components/tlog).
+//
+// Formats: every message in tlog_formats.h is written with TLOG() over a set
+// of argument values, drained as "#TL" hex records and turned back into text
+// two ways, by tlog_format() (what CONFIG_GAS_TLOG_HOST_DECODE=n prints on
+// the device) and by tools/tlog_decode.py. Both have to match snprintf() with
+// the same format and arguments byte for byte.
+//
+// Overflow: the ring is filled past its size without draining. The first
+// CONFIG_GAS_TLOG_RING_SLOTS records must come out in order and the rest be
+// counted as dropped, tlog_queued() must read the ring size before the drain
+// and 0 after it, then the ring must take records again. Four producer
+// threads then write against a draining thread, paced and in bursts: every
+// record must either be drained, in order per producer, or counted as dropped.
+//
+// Bench: time per call of TLOG() against formatting the same line with
+// snprintf() and printing it ESP_LOGI-style ("I (ms) TAG: text\n" through
+// stdio, as esp_log_write() does), and the drain's time per record, for a
+// two-float and a six-float message. Output goes to /dev/null.
+//
+//   gcc -O2 -pthread -I../components/tlog -o tlog_check tlog_check.c
+//       ../components/tlog/tlog.c
+//   ./tlog_check [--decoder tlog_decode.py]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include "tlog.h"
+
+#define RING_SLOTS      64      // CONFIG_GAS_TLOG_RING_SLOTS of the host build
+#define MAX_CASES       64
+#define PRODUCERS       4
+#define PER_PRODUCER    50000
+#define BENCH_ROUNDS    200000
+
+static const char *const format_of[TLOG_FORMAT_COUNT] = {
+#define FORMAT_ENTRY(id, level, tag, format) [id] = format,
+    TLOG_FORMATS(FORMAT_ENTRY)
+#undef FORMAT_ENTRY
+};
+
+static const char *const tag_of[TLOG_FORMAT_COUNT] = {
+#define TAG_ENTRY(id, level, tag, format) [id] = tag,
+    TLOG_FORMATS(TAG_ENTRY)
+#undef TAG_ENTRY
+};
+
+static const char level_of[TLOG_FORMAT_COUNT] = {
+#define LEVEL_ENTRY(id, level, tag, format) [id] = #level[0],
+    TLOG_FORMATS(LEVEL_ENTRY)
+#undef LEVEL_ENTRY
+};
+
+typedef struct {
+    tlog_id_t id;
+    char text[192];
+} expected_t;
+
+static expected_t expected[MAX_CASES];
+static int case_count;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Sends what tlog_drain() prints to `path` until capture_end()
+static int saved_stdout = -1;
+
+static void capture_begin(const char *path) {
+    fflush(stdout);
+    saved_stdout = dup(STDOUT_FILENO);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+}
+
+static void capture_end(void) {
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+}
+
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+
+// One TLOG() and the line snprintf() makes of the same call
+#define CASE(message, ...) do { \
+        TLOG(message, __VA_ARGS__); \
+        expected[case_count].id = message; \
+        snprintf(expected[case_count].text, sizeof(expected[case_count].text), format_of[message], __VA_ARGS__); \
+        case_count++; \
+    } while (0)
+
+#define CASE0(message) do { \
+        TLOG(message); \
+        expected[case_count].id = message; \
+        snprintf(expected[case_count].text, sizeof(expected[case_count].text), "%s", format_of[message]); \
+        case_count++; \
+    } while (0)
+
+// Fewer than RING_SLOTS records, so none are dropped
+static void write_cases(void) {
+    static const float values[] = { 0.0f, 71.25f, -12.345f, 1234567.9f, 0.005f, 1e-7f };
+    for (int v = 0; v < 6; v++) {
+        float a = values[v], b = values[(v + 1) % 6], c = values[(v + 2) % 6];
+        CASE(TLOG_SI7021_SAMPLE, a, b);
+        CASE(TLOG_NODE_FRAME_SENT, a, b, c, a + b, b * c, -a);
+    }
+    CASE0(TLOG_ADC_CSV_ROW);
+    CASE0(TLOG_ADC_CSV_END);
+    CASE(TLOG_ADC_AMMONIA, 12.5f);
+    CASE(TLOG_ADC_METHANE, 150.754f);
+    CASE(TLOG_ADC_H2S, -0.425f);
+    CASE(TLOG_ADC_CO2, 812.25f);
+    CASE(TLOG_GW_FRAME_RECEIVED, 97);
+    CASE(TLOG_GW_FRAME_RECEIVED, -1);
+    CASE(TLOG_GW_PARSED, 21.37f, 45.1f, 12.5f, 0.42f, 812.25f, 150.75f);
+    CASE(TLOG_SCD41_SAMPLE, 40000u, 23.5f, 51.25f);
+    CASE(TLOG_SCD41_SAMPLE, 4294967295u, -10.0f, 0.0f);
+    CASE(TLOG_ANOMALY, 3, 812.25f, 0x5u);
+    CASE(TLOG_ANOMALY, -1, -3.5f, 0xffffffffu);
+    CASE(TLOG_LINK_RETX, 1u, 4000000000u);
+}
+
+// "#TL <ts> <id> <arg>..." back to its words
+static int parse_record(const char *line, tlog_id_t *id, uint32_t *args) {
+    unsigned timestamp, format;
+    int used;
+    if (sscanf(line, "#TL %x %x%n", &timestamp, &format, &used) != 2) {
+        return -1;
+    }
+    *id = (tlog_id_t)format;
+    int argc = 0;
+    const char *p = line + used;
+    unsigned word;
+    int n;
+    while (argc < TLOG_MAX_ARGS && sscanf(p, " %x%n", &word, &n) == 1) {
+        args[argc++] = word;
+        p += n;
+    }
+    return argc;
+}
+
+static int check_formats(const char *decoder) {
+    const char *path = "/tmp/tlog_check_formats.log";
+    case_count = 0;
+    write_cases();
+    capture_begin(path);
+    int drained = tlog_drain();
+    capture_end();
+
+    // tlog_format() against snprintf()
+    FILE *records = fopen(path, "r");
+    char line[256];
+    int index = 0, device_mismatches = 0;
+    while (fgets(line, sizeof(line), records) != NULL && index < case_count) {
+        tlog_id_t id;
+        uint32_t args[TLOG_MAX_ARGS];
+        char text[192];
+        int argc = parse_record(line, &id, args);
+        tlog_format(id, args, argc < 0 ? 0 : argc, text, sizeof(text));
+        if (argc < 0 || id != expected[index].id || strcmp(text, expected[index].text) != 0) {
+            printf("  tlog_format  got \"%s\"\n               want \"%s\"\n", text, expected[index].text);
+            device_mismatches++;
+        }
+        index++;
+    }
+    fclose(records);
+
+    // tools/tlog_decode.py against snprintf()
+    char command[512];
+    snprintf(command, sizeof(command), "python3 %s --file %s", decoder, path);
+    FILE *decoded = popen(command, "r");
+    int decoded_lines = 0, host_mismatches = 0;
+    while (decoded != NULL && fgets(line, sizeof(line), decoded) != NULL && decoded_lines < case_count) {
+        line[strcspn(line, "\n")] = '\0';
+        // "L (ms) TAG: text"
+        const expected_t *want = &expected[decoded_lines];
+        char tag[48];
+        snprintf(tag, sizeof(tag), ") %s: ", tag_of[want->id]);
+        const char *text = strstr(line, tag);
+        if (line[0] != level_of[want->id] || strncmp(line + 1, " (", 2) != 0 || text == NULL ||
+            strcmp(text + strlen(tag), want->text) != 0) {
+            printf("  tlog_decode  got \"%s\"\n               want \"%s\"\n", line, want->text);
+            host_mismatches++;
+        }
+        decoded_lines++;
+    }
+    int status = decoded != NULL ? pclose(decoded) : -1;
+    remove(path);
+    if (status != 0 || decoded_lines != case_count) {
+        printf("  tlog_decode.py did not run (status %d, %d lines)\n", status, decoded_lines);
+        host_mismatches += case_count - decoded_lines + (decoded_lines == case_count);
+    }
+
+    printf("%-28s %8d %8d %10d\n", "tlog_format (on device)", case_count, drained, device_mismatches);
+    printf("%-28s %8d %8d %10d\n", "tlog_decode.py (host)", case_count, decoded_lines, host_mismatches);
+    return device_mismatches + host_mismatches + (drained != case_count);
+}
+
+// Fills the ring past its size, then checks what comes out
+static int check_overflow(void) {
+    const char *path = "/tmp/tlog_check_overflow.log";
+    const int extra = 37;
+    unsigned dropped_before = tlog_dropped_count();
+    for (uint32_t i = 0; i < RING_SLOTS + extra; i++) {
+        TLOG(TLOG_LINK_RETX, i, ~i);
+    }
+    unsigned dropped = tlog_dropped_count() - dropped_before;
+    unsigned queued_full = tlog_queued();
+
+    capture_begin(path);
+    int drained = tlog_drain();
+    unsigned queued_empty = tlog_queued();
+    TLOG(TLOG_LINK_RETX, 1000u, 1001u);
+    int after = tlog_drain();
+    capture_end();
+
+    // The first RING_SLOTS records in order, then the one written after the drain
+    FILE *records = fopen(path, "r");
+    char line[256];
+    int in_order = 0;
+    uint32_t index = 0;
+    while (fgets(line, sizeof(line), records) != NULL) {
+        tlog_id_t id;
+        uint32_t args[TLOG_MAX_ARGS];
+        uint32_t want_a = index < RING_SLOTS ? index : 1000u;
+        uint32_t want_b = index < RING_SLOTS ? ~index : 1001u;
+        if (parse_record(line, &id, args) == 2 && id == TLOG_LINK_RETX && args[0] == want_a && args[1] == want_b) {
+            in_order++;
+        }
+        index++;
+    }
+    fclose(records);
+    remove(path);
+
+    bool ok = drained == RING_SLOTS && dropped == (unsigned)extra && after == 1 && in_order == RING_SLOTS + 1 &&
+              queued_full == RING_SLOTS && queued_empty == 0;
+    printf("%-28s %8d %8d %10u %s\n", "single writer", RING_SLOTS + extra + 1, drained + after, dropped,
+           ok ? "ok" : "FAIL");
+    return !ok;
+}
+
+static volatile bool producers_done;
+static bool producers_paced;
+
+static void *producer(void *arg) {
+    uint32_t p = (uint32_t)(uintptr_t)arg;
+    for (uint32_t i = 0; i < PER_PRODUCER; i++) {
+        TLOG(TLOG_LINK_RETX, p, i);
+        if (producers_paced && i % 8 == 7) {
+            usleep(10);     // sample tasks write a few lines, then block
+        }
+    }
+    return NULL;
+}
+
+static void *drainer(void *arg) {
+    int *total = arg;
+    while (!producers_done) {
+        *total += tlog_drain();
+        sched_yield();
+    }
+    *total += tlog_drain();
+    return NULL;
+}
+
+// Paced producers mostly fit in the ring, unpaced ones mostly overflow it
+static int check_concurrent(bool paced) {
+    const char *path = "/tmp/tlog_check_concurrent.log";
+    unsigned dropped_before = tlog_dropped_count();
+    int drained = 0;
+    pthread_t threads[PRODUCERS], drain_thread;
+
+    capture_begin(path);
+    producers_done = false;
+    producers_paced = paced;
+    pthread_create(&drain_thread, NULL, drainer, &drained);
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_create(&threads[p], NULL, producer, (void *)(uintptr_t)p);
+    }
+    for (int p = 0; p < PRODUCERS; p++) {
+        pthread_join(threads[p], NULL);
+    }
+    producers_done = true;
+    pthread_join(drain_thread, NULL);
+    capture_end();
+    unsigned dropped = tlog_dropped_count() - dropped_before;
+
+    FILE *records = fopen(path, "r");
+    char line[256];
+    int64_t last[PRODUCERS];
+    int lines = 0, out_of_order = 0;
+    for (int p = 0; p < PRODUCERS; p++) {
+        last[p] = -1;
+    }
+    while (fgets(line, sizeof(line), records) != NULL) {
+        tlog_id_t id;
+        uint32_t args[TLOG_MAX_ARGS];
+        if (parse_record(line, &id, args) != 2 || id != TLOG_LINK_RETX || args[0] >= PRODUCERS ||
+            (int64_t)args[1] <= last[args[0]]) {
+            out_of_order++;
+            continue;
+        }
+        last[args[0]] = args[1];
+        lines++;
+    }
+    fclose(records);
+    remove(path);
+
+    int written = PRODUCERS * PER_PRODUCER;
+    bool ok = out_of_order == 0 && lines == drained && (unsigned)drained + dropped == (unsigned)written;
+    printf("%-28s %8d %8d %10u %s\n", paced ? "4 paced writers, 1 drain" : "4 burst writers, 1 drain", written, drained, dropped, ok ? "ok" : "FAIL");
+    return !ok;
+}
+
+static volatile float sink_a = 71.25f, sink_b = 40.5f;
+
+// What ESP_LOGI() does with the line: format it and print it with the prefix
+static void esp_log_style(const char *tag, const char *text) {
+    printf("I (%u) %s: %s\n", (unsigned)(now_ns() / 1e6), tag, text);
+}
+
+static void bench(void) {
+    static const char *const names[2] = { "SI7021 (2 floats)", "frame sent (6 floats)" };
+    double results[2][4];
+    char text[192];
+    float a = sink_a, b = sink_b;
+
+    capture_begin("/dev/null");
+    for (int message = 0; message < 2; message++) {
+        double tlog_ns = 0, drain_ns = 0, t0;
+        for (int r = 0; r < BENCH_ROUNDS; r += RING_SLOTS / 2) {
+            t0 = now_ns();
+            for (int i = 0; i < RING_SLOTS / 2; i++) {
+                if (message == 0) {
+                    TLOG(TLOG_SI7021_SAMPLE, a, b);
+                } else {
+                    TLOG(TLOG_NODE_FRAME_SENT, a, b, a, b, a, b);
+                }
+            }
+            tlog_ns += now_ns() - t0;
+            t0 = now_ns();
+            tlog_drain();
+            drain_ns += now_ns() - t0;
+        }
+
+        t0 = now_ns();
+        for (int r = 0; r < BENCH_ROUNDS; r++) {
+            if (message == 0) {
+                snprintf(text, sizeof(text), format_of[TLOG_SI7021_SAMPLE], a, b);
+            } else {
+                snprintf(text, sizeof(text), format_of[TLOG_NODE_FRAME_SENT], a, b, a, b, a, b);
+            }
+        }
+        double snprintf_ns = now_ns() - t0;
+
+        t0 = now_ns();
+        for (int r = 0; r < BENCH_ROUNDS; r++) {
+            if (message == 0) {
+                snprintf(text, sizeof(text), format_of[TLOG_SI7021_SAMPLE], a, b);
+                esp_log_style(tag_of[TLOG_SI7021_SAMPLE], text);
+            } else {
+                snprintf(text, sizeof(text), format_of[TLOG_NODE_FRAME_SENT], a, b, a, b, a, b);
+                esp_log_style(tag_of[TLOG_NODE_FRAME_SENT], text);
+            }
+        }
+        double esp_log_ns = now_ns() - t0;
+
+        results[message][0] = tlog_ns / BENCH_ROUNDS;
+        results[message][1] = drain_ns / BENCH_ROUNDS;
+        results[message][2] = snprintf_ns / BENCH_ROUNDS;
+        results[message][3] = esp_log_ns / BENCH_ROUNDS;
+    }
+    capture_end();
+
+    printf("\n%-24s %9s %9s %9s %9s\n", "ns per line","TLOG", "drain", "snprintf", "ESP_LOGI");
+    for (int message = 0; message < 2; message++) {
+        printf("%-24s %9.1f %9.1f %9.1f %9.1f\n", names[message], results[message][0], results[message][1],
+               results[message][2], results[message][3]);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *decoder = "tlog_decode.py";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--decoder") == 0 && i + 1 < argc) {
+            decoder = argv[++i];
+        }
+    }
+
+    int failures = 0;
+    printf("%-28s %8s %8s %10s\n", "formats", "cases", "decoded", "mismatches");
+    failures += check_formats(decoder);
+
+    printf("\n%-28s %8s %8s %10s\n", "ring overflow", "written", "drained", "dropped");
+    failures += check_overflow();
+    failures += check_concurrent(true);
+    failures += check_concurrent(false);
+
+    bench();
+
+    printf("\n%s\n", failures == 0 ? "all checks passed" : "CHECKS FAILED");
+    return failures != 0;
+}
@@ -0,0 +1,114 @@
+# Decoder for tokenized TLOG() records (components/tlog).
+#
+# With CONFIG_GAS_TLOG_HOST_DECODE the firmware prints hot-path log messages
+# as hex records instead of text:
+#
+#   #TL <timestamp ms> <format id> <arg word>...
+#
+# This tool reads the console output, either live from a serial port or from a
+# saved file (e.g. idf.py monitor output), and turns every record back into a
+# normal ESP-IDF log line using the format table in tlog_formats.h. All other
+# lines are passed through unchanged.
+#
+#   python tlog_decode.py --port /dev/ttyUSB0
+#   python tlog_decode.py --file monitor.log > decoded.log
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+DEFAULT_FORMATS = os.path.join(os.path.dirname(__file__), '..', 'components', 'tlog', 'tlog_formats.h')
+
+ENTRY_RE = re.compile(r'X\(\s*(\w+)\s*,\s*(\w)\s*,\s*"((?:[^"\\]|\\.)*)"\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)')
+SPEC_RE = re.compile(r'%([-+ #0-9.]*)(?:hh|h|ll|l|z|j|t)?([diouxXcfFeEgG%])')
+
+FLOAT_CONVERSIONS = 'fFeEgG'
+SIGNED_CONVERSIONS = 'dic'
+
+def load_formats(path):
+    with open(path, encoding='utf-8') as header:
+        text = header.read()
+    formats = []
+    for name, level, tag, fmt in ENTRY_RE.findall(text):
+        fmt = fmt.encode().decode('unicode_escape').encode('latin-1').decode('utf-8')
+        formats.append((name, level, tag, fmt))
+    return formats
+
+def convert(spec, conversion, word):
+    if conversion in FLOAT_CONVERSIONS:
+        value = struct.unpack('<f', struct.pack('<I', word))[0]
+    elif conversion in SIGNED_CONVERSIONS:
+        value = word - (1 << 32) if word & 0x80000000 else word
+    else:
+        value = word
+    if conversion == 'u':
+        conversion = 'd'
+    return ('%' + spec + conversion) % value
+
+def format_message(fmt, words):
+    words = list(words)
+
+    def substitute(match):
+        spec, conversion = match.groups()
+        if conversion == '%':
+            return '%'
+        return convert(spec, conversion, words.pop(0) if words else 0)
+
+    return SPEC_RE.sub(substitute, fmt)
+
+def decode_line(line, formats):
+    if line.startswith('#TLV '):
+        count = int(line.split()[1])
+        if count != len(formats):
+            return f'tlog_decode: firmware has {count} formats, table has {len(formats)}; rebuild from the same tree'
+        return None
+    if not line.startswith('#TL '):
+        return line
+    fields = line.split()[1:]
+    try:
+        timestamp = int(fields[0], 16)
+        format_id = int(fields[1], 16)
+        words = [int(field, 16) for field in fields[2:]]
+    except (IndexError, ValueError):
+        return line
+    if format_id >= len(formats):
+        return f'? ({timestamp}) tlog: unknown format {format_id}'
+    _, level, tag, fmt = formats[format_id]
+    return f'{level} ({timestamp}) {tag}: {format_message(fmt, words)}'
+
+def lines_from_serial(port, baud):
+    import serial  # pyserial, only needed for live capture
+    with serial.Serial(port, baud, timeout=1) as uart:
+        while True:
+            raw = uart.readline()
+            if raw:
+                yield raw.decode(errors='replace')
+
+def lines_from_file(path):
+    with open(path, encoding='utf-8', errors='replace') as log:
+        yield from log
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode tokenized TLOG() records back to text')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--port', help='console UART, e.g. /dev/ttyUSB0')
+    source.add_argument('--file', help='saved console output')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--formats', default=DEFAULT_FORMATS, help='path to tlog_formats.h')
+    args = parser.parse_args()
+
+    formats = load_formats(args.formats)
+    lines = lines_from_serial(args.port, args.baud) if args.port else lines_from_file(args.file)
+    try:
+        for line in lines:
+            decoded = decode_line(line.rstrip('\r\n'), formats)
+            if decoded is not None:
+                print(decoded)
+                sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,139 @@
+# Latency report for frames traced with CONFIG_GAS_TRACE_ENABLE.
+#
+# Reads the gateway UART output, either live from a serial port or from a log
+# saved by an earlier run, and prints per-hop latency percentiles. It can also
+# export a Chrome trace (open in chrome://tracing or ui.perfetto.dev).
+#
+#   python trace_report.py --port /dev/ttyUSB0 --save run.log
+#   python trace_report.py --file run.log --chrome trace.json
+#
+# Gateway lines look like
+#   Temp:..,CH4:..,T:<seq>:<acquire>:<publish>:<send>:<recv>:<uart>
+# with all stamps in microseconds on the gateway clock. The host clock is not
+# synchronised, so the host offset is estimated as the smallest observed
+# (ingest - uart) gap; the last hop therefore shows delay above that minimum.
+
+import argparse
+import json
+import re
+import time
+
+TRACE_RE = re.compile(r',T:(\d+):(-?\d+):(-?\d+):(-?\d+):(-?\d+):(-?\d+)')
+
+# hop name, start stamp index, end stamp index (index 5 is host ingest)
+HOPS = [
+    ('acquire->publish', 0, 1),
+    ('publish->send', 1, 2),
+    ('send->gateway recv', 2, 3),
+    ('gateway recv->uart', 3, 4),
+    ('uart->host ingest', 4, 5),
+]
+
+def parse_line(host_us, line):
+    match = TRACE_RE.search(line)
+    if match is None:
+        return None
+    seq = int(match.group(1))
+    stamps = [int(value) for value in match.groups()[1:]]
+    return seq, stamps + [host_us]
+
+def read_serial(port, baud, save, count):
+    import serial  # pyserial, only needed for live capture
+    records = []
+    log = open(save, 'w') if save else None
+    # Ctrl-C ends the capture; what was captured so far is still reported
+    try:
+        with serial.Serial(port, baud, timeout=1) as uart:
+            while count is None or len(records) < count:
+                raw = uart.readline()
+                if not raw:
+                    continue
+                host_us = time.time_ns() // 1000
+                line = raw.decode(errors='replace').strip()
+                if log:
+                    log.write(f'{host_us}|{line}\n')
+                    log.flush()
+                record = parse_line(host_us, line)
+                if record:
+                    records.append(record)
+                    print(f'seq {record[0]} captured')
+    except KeyboardInterrupt:
+        print(f'Capture stopped, {len(records)} traced samples')
+    finally:
+        if log:
+            log.close()
+    return records
+
+def read_file(path):
+    records = []
+    with open(path) as log:
+        for entry in log:
+            host_us, _, line = entry.rstrip('\n').partition('|')
+            record = parse_line(int(host_us), line)
+            if record:
+                records.append(record)
+    return records
+
+def align_host_clock(records):
+    offset = min(stamps[5] - stamps[4] for _, stamps in records)
+    for _, stamps in records:
+        stamps[5] -= offset
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, int(round(fraction * (len(ordered) - 1))))
+    return ordered[index]
+
+def print_report(records):
+    print(f'{len(records)} traced samples')
+    print(f'{"hop":<22}{"p50 ms":>10}{"p90 ms":>10}{"p99 ms":>10}{"max ms":>10}')
+    hops = HOPS + [('end to end', 0, 5)]
+    for name, start, end in hops:
+        values = [(stamps[end] - stamps[start]) / 1000.0 for _, stamps in records]
+        print(f'{name:<22}{percentile(values, 0.5):>10.2f}{percentile(values, 0.9):>10.2f}'
+              f'{percentile(values, 0.99):>10.2f}{max(values):>10.2f}')
+
+def write_chrome_trace(records, path):
+    events = []
+    for seq, stamps in records:
+        for tid, (name, start, end) in enumerate(HOPS):
+            events.append({
+                'name': name,
+                'cat': 'sample',
+                'ph': 'X',
+                'pid': 1,
+                'tid': tid,
+                'ts': stamps[start],
+                'dur': max(0, stamps[end] - stamps[start]),
+                'args': {'seq': seq},
+            })
+    with open(path, 'w') as out:
+        json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, out)
+    print(f'Chrome trace written to {path}')
+
+def main():
+    parser = argparse.ArgumentParser(description='Per-hop latency report for traced sensor frames')
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--port', help='gateway UART, e.g. /dev/ttyUSB0')
+    source.add_argument('--file', help='log saved with --save')
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--count', type=int, help='stop after this many traced samples')
+    parser.add_argument('--save', help='save the raw capture for later replay')
+    parser.add_argument('--chrome', help='write a Chrome trace JSON file')
+    args = parser.parse_args()
+
+    if args.port:
+        records = read_serial(args.port, args.baud, args.save, args.count)
+    else:
+        records = read_file(args.file)
+
+    if not records:
+        print('No traced frames found')
+        return
+    align_host_clock(records)
+    print_report(records)
+    if args.chrome:
+        write_chrome_trace(records, args.chrome)
+
+if __name__ == '__main__':
+    main()
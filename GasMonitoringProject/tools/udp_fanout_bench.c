@@ -0,0 +1,303 @@
+// Cost per sample of sending the node's frames to several stations over TCP
+// (one send per client, as tcp_server_task does) against one UDP datagram
+// to a multicast group (CONFIG_GAS_UDP_PUBLISH), on the host.
+//
+// For 1 and 4 subscribers on loopback, numbers frames into a gas_link ring
+// and sends each one either to every accepted TCP connection, formatted per
+// client, or once to the group the subscribers joined. Prints the sender's
+// CPU time per sample, the IP bytes per sample and the airtime an 802.11
+// AP would spend on them: TCP as unicast data frames at 54 Mb/s, each
+// acknowledged by the station and by a TCP ACK of its own, UDP at the basic
+// rate (1 Mb/s DSSS with 802.11b stations, 6 Mb/s OFDM without) with no
+// link-level ACK. Loopback delivers every multicast copy in the sender's
+// context, which a radio does not; the UDP CPU figure at 4 subscribers is
+// an upper bound. The UDP subscribers also drop a share of the datagrams
+// on purpose (--drop) and check that their gas_link_tracker_t counts
+// exactly those as lost.
+//
+//   gcc -O2 -pthread -I../components/gas_link -I../components/gas_channels
+//       -I../components/fastfmt -o udp_fanout_bench udp_fanout_bench.c
+//       ../components/gas_link/gas_link.c ../components/gas_channels/gas_channels.c
+//       ../components/fastfmt/fastfmt.c -lm
+//   ./udp_fanout_bench [--samples 20000] [--drop 0.01]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "gas_link.h"
+
+#define MAX_SUBSCRIBERS 4
+#define RING_FRAMES     128
+#define PACE_NS         50000       // between samples, so no receive buffer overflows
+#define GROUP           "239.255.0.33"
+#define UDP_PORT        3334
+#define BOOT            0x1234
+
+// 802.11 framing around an IP packet: MAC header, LLC/SNAP and FCS
+#define WIFI_OVERHEAD   36
+#define TCP_IP_HEADERS  40
+#define UDP_IP_HEADERS  28
+
+typedef struct {
+    int sock;
+    bool udp;
+    double drop;
+    unsigned seed;
+    uint64_t dropped;
+    gas_link_tracker_t tracker;
+} subscriber_t;
+
+static int sample_count = 20000;
+static double drop_rate = 0.01;
+
+static double thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void pace(void) {
+    struct timespec ts = { 0, PACE_NS };
+    nanosleep(&ts, NULL);
+}
+
+// OFDM: 20 us preamble, 4 us symbols of 24 data bits per Mb/s
+static double ofdm_us(int bytes, int rate_mbps) {
+    int bits = 16 + 6 + 8 * bytes;
+    int per_symbol = 4 * rate_mbps;
+    return 20 + 4.0 * ((bits + per_symbol - 1) / per_symbol);
+}
+
+// Unicast data frame at 54 Mb/s with DIFS, mean backoff, SIFS and the ACK
+static double unicast_us(int ip_bytes) {
+    return 28 + 7.5 * 9 + ofdm_us(ip_bytes + WIFI_OVERHEAD, 54) + 16 + ofdm_us(14, 24);
+}
+
+// Group-addressed frame at the basic rate, never acknowledged
+static double multicast_us(int ip_bytes, int rate_mbps) {
+    if (rate_mbps == 1) {
+        return 50 + 15.5 * 20 + 192 + 8.0 * (ip_bytes + WIFI_OVERHEAD);
+    }
+    return 28 + 7.5 * 9 + ofdm_us(ip_bytes + WIFI_OVERHEAD, rate_mbps);
+}
+
+static void *subscribe(void *arg) {
+    subscriber_t *sub = arg;
+    gas_link_lines_t *lines = calloc(1, sizeof(gas_link_lines_t));
+    char datagram[GAS_LINK_LINE_MAX];
+    while (1) {
+        char *line = NULL;
+        int len;
+        if (sub->udp) {
+            len = recv(sub->sock, datagram, sizeof(datagram) - 1, 0);
+            if (len <= 0 || strcmp(datagram, "END") == 0) {
+                break;
+            }
+            datagram[len] = '\0';
+            if (rand_r(&sub->seed) < sub->drop * RAND_MAX) {
+                sub->dropped++; // lost on the air
+                continue;
+            }
+            line = datagram;
+        } else {
+            size_t avail;
+            char *space = gas_link_lines_space(lines, &avail);
+            len = recv(sub->sock, space, avail, 0);
+            if (len <= 0) {
+                break;
+            }
+            gas_link_lines_commit(lines, len);
+        }
+        do {
+            if (!sub->udp) {
+                line = gas_link_lines_next(lines);
+                if (line == NULL) {
+                    break;
+                }
+            }
+            uint16_t boot;
+            uint32_t seq;
+            int64_t capture_ms;
+            if (gas_link_parse_suffix(line, &boot, &seq, &capture_ms)) {
+                gas_link_track(&sub->tracker, boot, seq);
+                // As the gateway's handle_datagram(): no retransmission
+                if (sub->udp && gas_link_missing(&sub->tracker) > 0) {
+                    gas_link_gone(&sub->tracker, 1, UINT32_MAX);
+                }
+            }
+        } while (!sub->udp);
+    }
+    free(lines);
+    return NULL;
+}
+
+static void run(int subscribers, bool udp) {
+    static gas_link_record_t records[RING_FRAMES];
+    gas_link_ring_t ring;
+    gas_link_ring_init(&ring, records, RING_FRAMES);
+    subscriber_t subs[MAX_SUBSCRIBERS];
+    pthread_t threads[MAX_SUBSCRIBERS];
+    int out[MAX_SUBSCRIBERS];
+    int udp_sock = -1;
+    struct sockaddr_in group = { .sin_family = AF_INET, .sin_port = htons(UDP_PORT) };
+    inet_pton(AF_INET, GROUP, &group.sin_addr);
+
+    int listen_sock = -1;
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t addr_len = sizeof(addr);
+    if (!udp) {
+        listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+        bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr));
+        listen(listen_sock, MAX_SUBSCRIBERS);
+        getsockname(listen_sock, (struct sockaddr *)&addr, &addr_len);
+    }
+    for (int i = 0; i < subscribers; i++) {
+        subscriber_t *sub = &subs[i];
+        memset(sub, 0, sizeof(*sub));
+        sub->udp = udp;
+        sub->seed = 7 + i;
+        gas_link_tracker_init(&sub->tracker);
+        if (udp) {
+            sub->drop = drop_rate;
+            sub->sock = socket(AF_INET, SOCK_DGRAM, 0);
+            int one = 1;
+            setsockopt(sub->sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            struct sockaddr_in any = { .sin_family = AF_INET, .sin_port = htons(UDP_PORT),
+                                       .sin_addr.s_addr = htonl(INADDR_ANY) };
+            struct ip_mreq mreq = { .imr_interface.s_addr = htonl(INADDR_LOOPBACK) };
+            mreq.imr_multiaddr = group.sin_addr;
+            if (bind(sub->sock, (struct sockaddr *)&any, sizeof(any)) != 0 ||
+                setsockopt(sub->sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0) {
+                perror("udp subscriber");
+                exit(1);
+            }
+        } else {
+            sub->sock = socket(AF_INET, SOCK_STREAM, 0);
+            if (connect(sub->sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+                perror("connect");
+                exit(1);
+            }
+            out[i] = accept(listen_sock, NULL, NULL);
+            int one = 1;
+            setsockopt(out[i], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        pthread_create(&threads[i], NULL, subscribe, sub);
+    }
+    if (udp) {
+        udp_sock = socket(AF_INET, SOCK_DGRAM, 0);
+        struct in_addr lo = { htonl(INADDR_LOOPBACK) };
+        unsigned char ttl = 1;
+        setsockopt(udp_sock, IPPROTO_IP, IP_MULTICAST_IF, &lo, sizeof(lo));
+        setsockopt(udp_sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+
+    double cpu_ns = 0;
+    uint64_t payload = 0;
+    uint64_t packets = 0;
+    for (int n = 0; n < sample_count; n++) {
+        gas_sample_t sample = { .temperature = 70 + (n % 50) / 10.0f, .humidity = 40 + (n % 30),
+                                .ammonia = 10 + (n % 17) / 4.0f, .h2s = 0.2f + (n % 9) / 20.0f,
+                                .co2 = 700 + (n % 200), .methane = 150 + (n % 40) };
+        gas_link_ring_push(&ring, &sample, 0, n * 5000LL);
+        const gas_link_record_t *record = gas_link_ring_get(&ring, ring.next_seq - 1);
+        char frame[128 + GAS_LINK_SUFFIX_LEN + 1];
+
+        double start = thread_cpu_ns();
+        if (udp) {
+            int len = gas_link_format(record, GAS_CH_ALL, BOOT, frame, sizeof(frame) - 1);
+            frame[len++] = '\n';
+            if (sendto(udp_sock, frame, len, 0, (struct sockaddr *)&group, sizeof(group)) != len) {
+                perror("sendto");
+                exit(1);
+            }
+            payload += len;
+            packets++;
+        } else {
+            for (int i = 0; i < subscribers; i++) {
+                int len = gas_link_format(record, GAS_CH_ALL, BOOT, frame, sizeof(frame) - 1);
+                frame[len++] = '\n';
+                if (send(out[i], frame, len, 0) != len) {
+                    perror("send");
+                    exit(1);
+                }
+                payload += len;
+                packets++;
+            }
+        }
+        cpu_ns += thread_cpu_ns() - start;
+        pace();
+    }
+
+    // End of run: closing the TCP side, a marker the UDP subscribers stop on
+    for (int i = 0; i < subscribers; i++) {
+        if (udp) {
+            for (int k = 0; k < 3; k++) {
+                sendto(udp_sock, "END", 4, 0, (struct sockaddr *)&group, sizeof(group));
+            }
+        } else {
+            shutdown(out[i], SHUT_WR);
+        }
+    }
+    bool consistent = true;
+    for (int i = 0; i < subscribers; i++) {
+        pthread_join(threads[i], NULL);
+        const gas_link_tracker_t *t = &subs[i].tracker;
+        uint32_t lost = t->lost + gas_link_missing(t);
+        consistent &= t->received + lost == (uint32_t)sample_count - 1 + (t->received > 0) &&
+                      lost <= subs[i].dropped && subs[i].dropped - lost <= 1;
+        close(subs[i].sock);
+        if (!udp) {
+            close(out[i]);
+        }
+    }
+    if (udp) {
+        close(udp_sock);
+    } else {
+        close(listen_sock);
+    }
+
+    int frame_bytes = (int)(payload / packets);
+    int headers = udp ? UDP_IP_HEADERS : TCP_IP_HEADERS;
+    double ip_bytes = (double)packets / sample_count * (frame_bytes + headers);
+    double air_us;
+    char air[48];
+    if (udp) {
+        air_us = multicast_us(frame_bytes + headers, 1);
+        snprintf(air, sizeof(air), "%7.0f (%4.0f at 6 Mb/s)", air_us, multicast_us(frame_bytes + headers, 6));
+    } else {
+        // Data frame, then the station's TCP ACK as a data frame of its own
+        air_us = subscribers * (unicast_us(frame_bytes + headers) + unicast_us(TCP_IP_HEADERS));
+        snprintf(air, sizeof(air), "%7.0f", air_us);
+    }
+    uint64_t dropped = 0;
+    for (int i = 0; i < subscribers; i++) {
+        dropped += subs[i].dropped;
+    }
+    printf("%-4s %11d %12.2f %10.0f %-24s %8llu %6s\n", udp ? "UDP" : "TCP", subscribers, cpu_ns / sample_count / 1000,
+           ip_bytes, air, (unsigned long long)dropped, consistent ? "yes" : "NO");
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            sample_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--drop") == 0 && i + 1 < argc) {
+            drop_rate = atof(argv[++i]);
+        }
+    }
+    printf("%d samples, UDP subscribers drop %.1f%% on purpose\n\n", sample_count, 100 * drop_rate);
+    printf("%-4s %11s %12s %10s %-24s %8s %6s\n", "path", "subscribers", "cpu us/samp", "IP bytes",
+           "airtime us/sample", "dropped", "counted");
+    for (int subscribers = 1; subscribers <= MAX_SUBSCRIBERS; subscribers *= 4) {
+        run(subscribers, false);
+        run(subscribers, true);
+    }
+    return 0;
+}
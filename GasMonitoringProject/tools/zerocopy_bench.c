@@ -0,0 +1,271 @@
+// Copies per sample and CPU per byte on the frame path, before and after
+// the shared frame buffers (components/gas_fbuf), on the host.
+//
+// Node: a new frame goes to 1 or 4 clients over socketpairs, the kernel's
+// copy standing in for the one lwIP's send() makes into its pbufs.
+//   before  every client encodes the frame into a stack buffer and sends it
+//   after   the first client encodes it into a pool buffer, the others send
+//           the same bytes with a reference held
+// Gateway: frames arrive over a socketpair into the line buffer and go to a
+// 2 KB ring standing in for the UART driver's TX ring.
+//   before  each line is copied with snprintf("%s\n") and then into the ring
+//   after   the line goes into the ring from the line buffer, its newline
+//           written in place of the NUL
+//
+// Copies count every pass over the frame's bytes: an encode, the send, the
+// recv, a copy between buffers, the write into the ring. CPU is per byte of
+// frame delivered, once with the send()s and recv()s and once for the work
+// around them only.
+//
+//   gcc -O2 -I../components/gas_fbuf -I../components/gas_link
+//       -I../components/gas_channels -I../components/fastfmt
+//       -o zerocopy_bench zerocopy_bench.c ../components/gas_fbuf/gas_fbuf.c
+//       ../components/gas_link/gas_link.c ../components/gas_channels/gas_channels.c
+//       ../components/fastfmt/fastfmt.c -lm
+//   ./zerocopy_bench [samples]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "gas_fbuf.h"
+
+#define MAX_CLIENTS 4
+#define UART_RING   2048
+
+typedef struct {
+    gas_link_ring_t ring;
+    gas_link_record_t records[128];
+    gas_fbuf_pool_t pool;
+    gas_fbuf_t fbufs[MAX_CLIENTS + 1];
+    int socks[MAX_CLIENTS][2];
+    uint64_t copies;
+    uint64_t bytes;                 // frame bytes delivered
+} node_t;
+
+typedef struct {
+    int socks[2];
+    gas_link_lines_t lines;
+    char ring[UART_RING];
+    size_t head;
+    uint64_t copies;
+    uint64_t bytes;
+} gateway_t;
+
+static uint32_t samples = 200000;
+static bool syscalls = true;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void pair(int socks[2]) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks) != 0) {
+        perror("socketpair");
+        exit(1);
+    }
+}
+
+static void drain(int sock) {
+    char sink[4096];
+    while (recv(sock, sink, sizeof(sink), MSG_DONTWAIT) > 0) {
+    }
+}
+
+static void node_send(node_t *node, int client, const char *data, int len) {
+    if (syscalls) {
+        if (send(node->socks[client][0], data, len, 0) != len) {
+            perror("send");
+            exit(1);
+        }
+    }
+    node->copies++;
+    node->bytes += len;
+}
+
+static uint32_t node_push(node_t *node, uint32_t i) {
+    gas_sample_t sample = { .temperature = 21.37f + (i % 50) * 0.01f, .humidity = 45.1f, .ammonia = 12.5f,
+                            .h2s = 0.42f, .co2 = 812.25f, .methane = 150.75f };
+    return gas_link_ring_push(&node->ring, &sample, 0, 1700000000000LL + i * 5000LL);
+}
+
+// Prints copies per sample and ns per byte, or only ns per byte without the send()s
+static void run_node(int clients, bool shared) {
+    static node_t node;
+    memset(&node, 0, sizeof(node));
+    gas_link_ring_init(&node.ring, node.records, 128);
+    gas_fbuf_pool_init(&node.pool, node.fbufs, MAX_CLIENTS + 1);
+    for (int c = 0; c < clients; c++) {
+        pair(node.socks[c]);
+    }
+
+    double elapsed = 0;
+    for (uint32_t i = 0; i < samples; i++) {
+        const gas_link_record_t *record = gas_link_ring_get(&node.ring, node_push(&node, i));
+        double t0 = now_us();
+        for (int c = 0; c < clients; c++) {
+            if (shared) {
+                uint32_t encodes = node.pool.encodes;
+                gas_fbuf_t *fbuf = gas_fbuf_get(&node.pool, record, GAS_CH_ALL, 0x1234);
+                node.copies += node.pool.encodes != encodes;
+                node_send(&node, c, fbuf->data, fbuf->len);
+                gas_fbuf_release(fbuf);
+            } else {
+                char frame[128 + GAS_LINK_SUFFIX_LEN + 16 + 1];
+                int len = gas_link_format(record, GAS_CH_ALL, 0x1234, frame, sizeof(frame) - 1);
+                frame[len++] = '\n';
+                node.copies++;
+                node_send(&node, c, frame, len);
+            }
+        }
+        elapsed += now_us() - t0;
+        for (int c = 0; c < clients && syscalls; c++) {
+            drain(node.socks[c][1]);
+        }
+    }
+    for (int c = 0; c < clients; c++) {
+        close(node.socks[c][0]);
+        close(node.socks[c][1]);
+    }
+    if (syscalls) {
+        printf(" %8.2f %9.1f", (double)node.copies / samples, elapsed * 1000 / node.bytes);
+    } else {
+        printf(" %9.1f", elapsed * 1000 / node.bytes);
+    }
+}
+
+static void uart_write(gateway_t *gw, const char *data, size_t len) {
+    size_t first = len < UART_RING - gw->head ? len : UART_RING - gw->head;
+    memcpy(gw->ring + gw->head, data, first);
+    memcpy(gw->ring, data + first, len - first);
+    gw->head = (gw->head + len) % UART_RING;
+    gw->copies++;
+    gw->bytes += len;
+}
+
+static void run_gateway(bool in_place) {
+    static gateway_t gw;
+    memset(&gw, 0, sizeof(gw));
+    pair(gw.socks);
+
+    // The node's frames, sent ahead in chunks of 32
+    gas_link_ring_t ring;
+    static gas_link_record_t records[128];
+    gas_link_ring_init(&ring, records, 128);
+    char frames[32][256];
+    int frame_lens[32];
+    for (int i = 0; i < 32; i++) {
+        gas_sample_t sample = { .temperature = 21.37f + i * 0.01f, .humidity = 45.1f, .ammonia = 12.5f,
+                                .h2s = 0.42f, .co2 = 812.25f, .methane = 150.75f };
+        gas_link_ring_push(&ring, &sample, 0, 1700000000000LL + i * 5000LL);
+        frame_lens[i] = gas_link_format(gas_link_ring_get(&ring, i + 1), GAS_CH_ALL, 0x1234, frames[i], 255);
+        frames[i][frame_lens[i]++] = '\n';
+    }
+
+    double elapsed = 0;
+    uint32_t received = 0;
+    while (received < samples) {
+        for (int i = 0; i < 32; i++) {
+            send(gw.socks[0], frames[i], frame_lens[i], 0);
+        }
+        double t0 = now_us();
+        uint32_t lines = 0;
+        while (lines < 32) {
+            size_t avail;
+            char *space = gas_link_lines_space(&gw.lines, &avail);
+            int len = recv(gw.socks[1], space, avail, 0);
+            if (len <= 0) {
+                perror("recv");
+                exit(1);
+            }
+            gas_link_lines_commit(&gw.lines, len);
+            for (char *line; (line = gas_link_lines_next(&gw.lines)) != NULL; lines++) {
+                gw.copies++;    // recv
+                if (in_place) {
+                    size_t line_len = strlen(line);
+                    line[line_len] = '\n';
+                    uart_write(&gw, line, line_len + 1);
+                    line[line_len] = '\0';
+                } else {
+                    char uart_line[GAS_LINK_LINE_MAX + 1];
+                    snprintf(uart_line, sizeof(uart_line), "%s\n", line);
+                    gw.copies++;
+                    uart_write(&gw, uart_line, strlen(uart_line));
+                }
+            }
+        }
+        elapsed += now_us() - t0;
+        received += lines;
+    }
+    close(gw.socks[0]);
+    close(gw.socks[1]);
+    printf(" %8.2f %9.1f", (double)gw.copies / received, elapsed * 1000 / gw.bytes);
+}
+
+// Gateway work without the recv(): lines already in the buffer
+static void run_gateway_work(bool in_place) {
+    static gateway_t gw;
+    memset(&gw, 0, sizeof(gw));
+    char frame[256];
+    gas_link_ring_t ring;
+    static gas_link_record_t records[4];
+    gas_link_ring_init(&ring, records, 4);
+    gas_sample_t sample = { .temperature = 21.37f, .humidity = 45.1f, .ammonia = 12.5f, .h2s = 0.42f,
+                            .co2 = 812.25f, .methane = 150.75f };
+    gas_link_ring_push(&ring, &sample, 0, 1700000000000LL);
+    int len = gas_link_format(gas_link_ring_get(&ring, 1), GAS_CH_ALL, 0x1234, frame, sizeof(frame) - 1);
+    frame[len] = '\0';
+
+    double t0 = now_us();
+    for (uint32_t i = 0; i < samples; i++) {
+        if (in_place) {
+            size_t line_len = strlen(frame);
+            frame[line_len] = '\n';
+            uart_write(&gw, frame, line_len + 1);
+            frame[line_len] = '\0';
+        } else {
+            char uart_line[GAS_LINK_LINE_MAX + 1];
+            snprintf(uart_line, sizeof(uart_line), "%s\n", frame);
+            uart_write(&gw, uart_line, strlen(uart_line));
+        }
+    }
+    double elapsed = now_us() - t0;
+    printf(" %9.1f", elapsed * 1000 / gw.bytes);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1) {
+        samples = (uint32_t)atoi(argv[1]);
+    }
+    printf("%u samples\n\n", (unsigned)samples);
+
+    printf("node           %18s %18s %20s\n", "--- before ---", "--- after ---", "--- work only ---");
+    printf("%-14s %8s %9s %8s %9s %9s %9s\n", "clients", "copies", "ns/byte", "copies", "ns/byte",
+           "before", "after");
+    int counts[] = { 1, 4 };
+    for (int k = 0; k < 2; k++) {
+        printf("%-14d", counts[k]);
+        syscalls = true;
+        run_node(counts[k], false);
+        run_node(counts[k], true);
+        syscalls = false;
+        run_node(counts[k], false);
+        run_node(counts[k], true);
+        printf("\n");
+    }
+    printf("\n");
+
+    printf("gateway        %18s %18s %20s\n", "--- before ---", "--- after ---", "--- work only ---");
+    printf("%-14s %8s %9s %8s %9s %9s %9s\n", "", "copies", "ns/byte", "copies", "ns/byte", "before", "after");
+    printf("%-14s", "per frame");
+    run_gateway(false);
+    run_gateway(true);
+    run_gateway_work(false);
+    run_gateway_work(true);
+    printf("\n");
+    return 0;
+}